@@ -0,0 +1,573 @@
+#include <scenes.hpp>
+#include <bvh.hpp>
+#include <bvh_tree.hpp>
+#include <bvh_binary.hpp>
+#include <linear_bvh.hpp>
+#include <wide_bvh.hpp>
+#include <quantized_bvh.hpp>
+#include <packet.hpp>
+#include <query.hpp>
+#include <traversal.hpp>
+#include <obj_loader.hpp>
+#include <thread_pool.hpp>
+#include <log.hpp>
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <functional>
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifndef BVH_VERSION
+#define BVH_VERSION "unknown"
+#endif
+
+using namespace bvh;
+using namespace bvh::bench;
+
+// Benchmark driver. Every measurement is printed on stdout as one JSON object per line (JSON Lines), so
+// runs of different versions can be collected and compared by scripts; progress goes to stderr.
+
+struct BenchOptions {
+    int size = 100000;          // Triangles per generated scene
+    int rays = 200000;          // Rays per query benchmark
+    int repeat = 3;             // Runs per measurement, the median is reported
+    int threads = 0;            // Threads of the parallel builders, 0 uses the hardware concurrency
+    unsigned int seed = 1;
+    std::vector<std::string> scenes = {"uniform", "clustered", "thin"};
+    std::string obj;            // OBJ file for the load benchmark, a generated one when empty
+    std::string work_dir = "."; // Where the generated files are written
+};
+
+// One line of output, with its fields in insertion order
+class Record {
+public:
+    explicit Record(const std::string& type) { add("record", type); }
+
+    Record& add(const std::string& key, const std::string& value) {
+        field(key) << '"' << value << '"';
+        return *this;
+    }
+    Record& add(const std::string& key, const char* value) { return add(key, std::string(value)); }
+    Record& add(const std::string& key, double value) {
+        field(key) << value;
+        return *this;
+    }
+    Record& add(const std::string& key, long value) {
+        field(key) << value;
+        return *this;
+    }
+    Record& add(const std::string& key, int value) { return add(key, static_cast<long>(value)); }
+
+    void print() const {
+        printf("{%s}\n", out.str().c_str());
+        fflush(stdout);
+    }
+
+private:
+    std::ostringstream out;
+    bool first = true;
+
+    std::ostringstream& field(const std::string& key) {
+        if (!first) {
+            out << ',';
+        }
+        first = false;
+        out.precision(9);
+        out << '"' << key << "\":";
+        return out;
+    }
+};
+
+static long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss; // kilobytes on Linux
+}
+
+// Median time in seconds of repeat runs of f
+static double time_median(int repeat, const std::function<void()>& f) {
+    std::vector<double> times;
+    for (int i = 0; i < repeat; i++) {
+        auto start = std::chrono::steady_clock::now();
+        f();
+        auto end = std::chrono::steady_clock::now();
+        times.push_back(std::chrono::duration<double>(end - start).count());
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size() / 2];
+}
+
+// Hardware cache misses of the calling thread, -1 where perf events are not available (containers,
+// perf_event_paranoid)
+class CacheMissCounter {
+public:
+    CacheMissCounter() {
+        struct perf_event_attr attr;
+        std::memset(&attr, 0, sizeof(attr));
+        attr.type = PERF_TYPE_HARDWARE;
+        attr.size = sizeof(attr);
+        attr.config = PERF_COUNT_HW_CACHE_MISSES;
+        attr.disabled = 1;
+        attr.exclude_kernel = 1;
+        attr.exclude_hv = 1;
+        fd = static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0));
+    }
+    ~CacheMissCounter() {
+        if (fd >= 0) {
+            close(fd);
+        }
+    }
+
+    void start() {
+        if (fd >= 0) {
+            ioctl(fd, PERF_EVENT_IOC_RESET, 0);
+            ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
+        }
+    }
+
+    long stop() {
+        long long count = -1;
+        if (fd < 0) {
+            return -1;
+        }
+        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+            return -1;
+        }
+        return static_cast<long>(count);
+    }
+
+private:
+    int fd;
+};
+
+struct TreeStats {
+    long nodes = 0;
+    long leaves = 0;
+    long triangles = 0;
+    int max_depth = 0;
+};
+
+static void tree_stats(const BvhNode* node, int depth, TreeStats& stats) {
+    stats.nodes++;
+    stats.max_depth = std::max(stats.max_depth, depth);
+    if (node->left == nullptr) {
+        stats.leaves++;
+        stats.triangles += static_cast<const BvhLeaf*>(node)->num_triangles;
+        return;
+    }
+    tree_stats(node->left, depth + 1, stats);
+    tree_stats(node->right, depth + 1, stats);
+}
+
+static void print_tree_record(const std::string& scene, const std::string& builder, const BvhTree& tree) {
+    TreeStats stats;
+    tree_stats(tree.root(), 0, stats);
+    Record("tree")
+        .add("scene", scene)
+        .add("builder", builder)
+        .add("nodes", stats.nodes)
+        .add("leaves", stats.leaves)
+        .add("max_depth", stats.max_depth)
+        .add("avg_leaf_size", static_cast<double>(stats.triangles) / stats.leaves)
+        .add("sah_cost", static_cast<double>(sah_cost(tree.root())))
+        .add("memory_bytes", static_cast<long>(tree.memory_size()))
+        .print();
+}
+
+static void bench_builds(const BenchOptions& options, const std::string& scene, std::vector<Triangle>& tris, ThreadPool& pool) {
+    int n = static_cast<int>(tris.size());
+    LbvhOptions plain;
+    plain.agglomerate = false;
+    std::vector<std::pair<std::string, std::function<BvhTree()>>> builders = {
+        {"median", [&]() { return BvhTree::median(tris.data(), 0, n); }},
+        {"sah", [&]() { return BvhTree::sah(tris.data(), 0, n); }},
+        {"parallel", [&]() { return BvhTree::parallel(tris.data(), 0, n, pool); }},
+        {"lbvh", [&]() { return BvhTree::lbvh(tris.data(), 0, n, pool); }},
+        {"lbvh_plain", [&]() { return BvhTree::lbvh(tris.data(), 0, n, pool, plain); }},
+        {"sbvh", [&]() { return BvhTree::sbvh(tris.data(), 0, n); }},
+    };
+
+    for (auto& builder : builders) {
+        fprintf(stderr, "build %s %s\n", scene.c_str(), builder.first.c_str());
+        BvhTree tree;
+        // Assigning frees the previous tree, outside of the next measurement
+        double seconds = time_median(options.repeat, [&]() { tree = builder.second(); });
+        Record("build")
+            .add("scene", scene)
+            .add("builder", builder.first)
+            .add("triangles", n)
+            .add("threads", pool.num_threads())
+            .add("seconds", seconds)
+            .add("builds_per_sec", 1.0 / seconds)
+            .add("mtris_per_sec", n / seconds * 1e-6)
+            .add("peak_rss_kb", peak_rss_kb())
+            .print();
+        print_tree_record(scene, builder.first, tree);
+    }
+}
+
+// Primary rays of a pinhole camera looking at the scene (coherent) and rays between random points (incoherent)
+static std::vector<Ray> make_rays(const BoundingBox& box, int num_rays, bool coherent, unsigned int seed) {
+    std::vector<Ray> rays;
+    rays.reserve(num_rays);
+    vec3<float> extent = box.max - box.min;
+    if (coherent) {
+        int side = std::max(1, static_cast<int>(std::sqrt(static_cast<double>(num_rays))));
+        vec3<float> eye = box.centroid() - vec3<float>(0.0f, 0.0f, extent.z * 1.5f);
+        for (int i = 0; i < num_rays; i++) {
+            float u = static_cast<float>(i % side) / side;
+            float v = static_cast<float>(i / side % side) / side;
+            vec3<float> target(box.min.x + u * extent.x, box.min.y + v * extent.y, box.max.z);
+            rays.push_back(Ray(eye, target - eye));
+        }
+        return rays;
+    }
+
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+    for (int i = 0; i < num_rays; i++) {
+        vec3<float> a(box.min.x + dis(gen) * extent.x, box.min.y + dis(gen) * extent.y, box.min.z + dis(gen) * extent.z);
+        vec3<float> b(box.min.x + dis(gen) * extent.x, box.min.y + dis(gen) * extent.y, box.min.z + dis(gen) * extent.z);
+        rays.push_back(Ray(a, b - a));
+    }
+    return rays;
+}
+
+static void bench_queries(const BenchOptions& options, const std::string& scene, const std::vector<Triangle>& tris) {
+    BvhTree tree = BvhTree::sah(const_cast<Triangle*>(tris.data()), 0, tris.size());
+    LinearBvh linear = LinearBvh::flatten(tree.root());
+    Bvh4 bvh4 = Bvh4::collapse(tree.root());
+    Bvh8 bvh8 = Bvh8::collapse(tree.root());
+    QuantizedBvh quantized = QuantizedBvh::compress(linear.view());
+    const Triangle* t = tris.data();
+
+    // Memory of each traversal layout of the same tree, the node arena of the tree has no fixed node size
+    struct Layout {
+        const char* name;
+        size_t nodes;
+        size_t node_bytes;
+        size_t memory;
+    };
+    Layout layouts[] = {
+        {"linear", linear.nodes.size(), sizeof(LinearBvhNode), linear.memory_size()},
+        {"quantized", quantized.nodes.size(), sizeof(QuantizedBvhNode), quantized.memory_size()},
+        {"bvh4", bvh4.nodes.size(), sizeof(WideBvhNode<4>), bvh4.memory_size()},
+        {"bvh8", bvh8.nodes.size(), sizeof(WideBvhNode<8>), bvh8.memory_size()},
+    };
+    for (const Layout& layout : layouts) {
+        Record("layout")
+            .add("scene", scene)
+            .add("layout", layout.name)
+            .add("nodes", static_cast<long>(layout.nodes))
+            .add("bytes_per_node", static_cast<long>(layout.node_bytes))
+            .add("memory_bytes", static_cast<long>(layout.memory))
+            .add("tree_memory_bytes", static_cast<long>(tree.memory_size()))
+            .print();
+    }
+
+    for (int coherent = 1; coherent >= 0; coherent--) {
+        std::vector<Ray> rays = make_rays(tree.root()->bounding_box, options.rays, coherent, options.seed);
+        int num_rays = static_cast<int>(rays.size());
+        std::vector<Hit> hits(num_rays);
+        std::vector<char> occluded_results(num_rays);
+
+        std::vector<std::pair<std::string, std::function<void()>>> queries = {
+            {"tree_closest", [&]() { for (int i = 0; i < num_rays; i++) hits[i] = intersect(tree.root(), t, rays[i]); }},
+            {"tree_any", [&]() { for (int i = 0; i < num_rays; i++) occluded_results[i] = occluded(tree.root(), t, rays[i]); }},
+            {"linear_closest", [&]() { for (int i = 0; i < num_rays; i++) hits[i] = intersect(linear, t, rays[i]); }},
+            {"linear_any", [&]() { for (int i = 0; i < num_rays; i++) occluded_results[i] = occluded(linear, t, rays[i]); }},
+            {"quantized_closest", [&]() { for (int i = 0; i < num_rays; i++) hits[i] = intersect(quantized, t, rays[i]); }},
+            {"quantized_any", [&]() { for (int i = 0; i < num_rays; i++) occluded_results[i] = occluded(quantized, t, rays[i]); }},
+            {"bvh4_closest", [&]() { for (int i = 0; i < num_rays; i++) hits[i] = intersect(bvh4, t, rays[i]); }},
+            {"bvh8_closest", [&]() { for (int i = 0; i < num_rays; i++) hits[i] = intersect(bvh8, t, rays[i]); }},
+            {"stream_closest", [&]() { intersect_stream(linear.view(), t, rays.data(), num_rays, hits.data()); }},
+        };
+
+        for (auto& query : queries) {
+            fprintf(stderr, "query %s %s %s\n", scene.c_str(), coherent ? "primary" : "random", query.first.c_str());
+            double seconds = time_median(options.repeat, query.second);
+            Record("query")
+                .add("scene", scene)
+                .add("rays", coherent ? "primary" : "random")
+                .add("path", query.first)
+                .add("num_rays", num_rays)
+                .add("seconds", seconds)
+                .add("mrays_per_sec", num_rays / seconds * 1e-6)
+                .print();
+        }
+    }
+}
+
+// Box queries of about 2% of the scene extent and closest point queries from their corners, serial and
+// batched on the pool
+static void bench_overlaps(const BenchOptions& options, const std::string& scene, const std::vector<Triangle>& tris, ThreadPool& pool) {
+    BvhTree tree = BvhTree::sah(const_cast<Triangle*>(tris.data()), 0, tris.size());
+    const BoundingBox& bounds = tree.root()->bounding_box;
+    vec3<float> extent = bounds.max - bounds.min;
+    int num_queries = std::max(1, options.rays / 16);
+    std::mt19937 gen(options.seed);
+    std::uniform_real_distribution<float> dis(0.0f, 1.0f);
+    std::vector<BoundingBox> boxes(num_queries);
+    for (BoundingBox& box : boxes) {
+        vec3<float> corner(bounds.min.x + dis(gen) * extent.x, bounds.min.y + dis(gen) * extent.y, bounds.min.z + dis(gen) * extent.z);
+        box = BoundingBox(corner, corner + extent * 0.02f);
+    }
+
+    const int capacity = 256;
+    std::vector<int> indices(static_cast<size_t>(num_queries) * capacity);
+    std::vector<int> counts(num_queries);
+    std::vector<vec3<float>> points(num_queries);
+    std::vector<ClosestPoint> closest(num_queries);
+    for (int i = 0; i < num_queries; i++) {
+        points[i] = boxes[i].min;
+    }
+    auto count_found = [&]() {
+        for (int i = 0; i < num_queries; i++) {
+            counts[i] = closest[i].found();
+        }
+    };
+    const Triangle* t = tris.data();
+    std::vector<std::pair<std::string, std::function<void()>>> queries = {
+        {"box", [&]() { for (int i = 0; i < num_queries; i++) counts[i] = query_box(tree.root(), t, boxes[i], &indices[i * capacity], capacity); }},
+        {"box_batch", [&]() { query_boxes(tree.root(), t, boxes.data(), num_queries, indices.data(), capacity, counts.data(), pool); }},
+        {"closest", [&]() { for (int i = 0; i < num_queries; i++) closest[i] = closest_point(tree.root(), t, points[i]); count_found(); }},
+        {"closest_batch", [&]() { closest_points(tree.root(), t, points.data(), num_queries, closest.data(), pool); count_found(); }},
+    };
+
+    for (auto& query : queries) {
+        fprintf(stderr, "overlap %s %s\n", scene.c_str(), query.first.c_str());
+        double seconds = time_median(options.repeat, query.second);
+        long matches = 0;
+        for (int count : counts) {
+            matches += count;
+        }
+        Record("overlap")
+            .add("scene", scene)
+            .add("path", query.first)
+            .add("num_queries", num_queries)
+            .add("threads", query.first == "box" || query.first == "closest" ? 1 : pool.num_threads())
+            .add("matches", matches)
+            .add("seconds", seconds)
+            .add("mqueries_per_sec", num_queries / seconds * 1e-6)
+            .print();
+    }
+}
+
+// Adds up the page changes from node to every leaf below it, the pages a traversal reaching that leaf loads
+static void page_changes(const LinearBvh& bvh, uint32_t index, int changes, long& total, long& leaves) {
+    const uint32_t page_nodes = BVH_LAYOUT_PAGE_SIZE / sizeof(LinearBvhNode);
+    const LinearBvhNode& node = bvh.nodes[index];
+    if (node.is_leaf()) {
+        total += changes;
+        leaves++;
+        return;
+    }
+    for (uint32_t child = node.offset; child <= node.offset + 1; child++) {
+        page_changes(bvh, child, changes + (child / page_nodes != index / page_nodes), total, leaves);
+    }
+}
+
+// The same SAH tree flattened in every node layout, traced with random rays
+static void bench_orders(const BenchOptions& options, const std::string& scene, const std::vector<Triangle>& tris) {
+    BvhTree tree = BvhTree::sah(const_cast<Triangle*>(tris.data()), 0, tris.size());
+    std::vector<Ray> rays = make_rays(tree.root()->bounding_box, options.rays, false, options.seed);
+    int num_rays = static_cast<int>(rays.size());
+    std::vector<Hit> hits(num_rays);
+    const Triangle* t = tris.data();
+
+    std::pair<const char*, NodeLayout> layouts[] = {
+        {"depth_first", NodeLayout::DepthFirst},
+        {"breadth_first", NodeLayout::BreadthFirst},
+        {"van_emde_boas", NodeLayout::VanEmdeBoas},
+        {"page_clustered", NodeLayout::PageClustered},
+    };
+    CacheMissCounter misses;
+    for (auto& layout : layouts) {
+        fprintf(stderr, "order %s %s\n", scene.c_str(), layout.first);
+        LinearBvh linear = LinearBvh::flatten(tree.root(), layout.second);
+        long total = 0, leaves = 0;
+        page_changes(linear, 0, 0, total, leaves);
+
+        long cache_misses = -1;
+        double seconds = time_median(options.repeat, [&]() {
+            misses.start();
+            for (int i = 0; i < num_rays; i++) hits[i] = intersect(linear, t, rays[i]);
+            cache_misses = misses.stop();
+        });
+        Record("order")
+            .add("scene", scene)
+            .add("layout", layout.first)
+            .add("nodes", static_cast<long>(linear.nodes.size()))
+            .add("page_changes_per_leaf", static_cast<double>(total) / leaves)
+            .add("num_rays", num_rays)
+            .add("seconds", seconds)
+            .add("mrays_per_sec", num_rays / seconds * 1e-6)
+            .add("cache_misses_per_ray", cache_misses < 0 ? -1.0 : static_cast<double>(cache_misses) / num_rays)
+            .print();
+    }
+}
+
+static void bench_loads(const BenchOptions& options) {
+    std::string obj = options.obj;
+    if (obj.empty()) {
+        obj = options.work_dir + "/bench_scene.obj";
+        fprintf(stderr, "writing %s\n", obj.c_str());
+        if (!write_obj_scene(obj, options.size * 10, options.seed)) {
+            fprintf(stderr, "Error: could not write %s\n", obj.c_str());
+            return;
+        }
+    }
+
+    int num_tris = 0;
+    fprintf(stderr, "load obj %s\n", obj.c_str());
+    double seconds = time_median(options.repeat, [&]() {
+        Triangle* tris = nullptr;
+        num_tris = parse_obj_file(obj.c_str(), &tris, options.threads);
+        delete[] tris;
+    });
+    Record("load").add("format", "obj").add("file", obj).add("triangles", num_tris).add("seconds", seconds)
+        .add("mtris_per_sec", num_tris / seconds * 1e-6).add("peak_rss_kb", peak_rss_kb()).print();
+
+    Mesh mesh;
+    seconds = time_median(options.repeat, [&]() { parse_obj_file(obj.c_str(), mesh, options.threads); });
+    Record("load").add("format", "obj_indexed").add("file", obj).add("triangles", mesh.num_triangles()).add("seconds", seconds)
+        .add("mtris_per_sec", mesh.num_triangles() / seconds * 1e-6).add("peak_rss_kb", peak_rss_kb()).print();
+
+    // Binary BVH: mapped and converted back into a tree
+    std::string bvh_file = options.work_dir + "/bench_scene.bvh";
+    BvhTree tree = BvhTree::sah(mesh);
+    if (mesh.num_triangles() == 0 || !save_bvh_binary(bvh_file.c_str(), LinearBvh::flatten(tree.root()), mesh.num_triangles())) {
+        fprintf(stderr, "Error: could not write %s\n", bvh_file.c_str());
+        return;
+    }
+    fprintf(stderr, "load bvh %s\n", bvh_file.c_str());
+    bool mapped_ok = true;
+    seconds = time_median(options.repeat, [&]() {
+        MappedBvh* mapped = MappedBvh::open(bvh_file.c_str());
+        if (mapped == nullptr) {
+            mapped_ok = false;
+            return;
+        }
+        BvhTree loaded = BvhTree::from_linear(mapped->view());
+        delete mapped;
+    });
+    if (mapped_ok) {
+        Record("load").add("format", "bvh_binary").add("file", bvh_file).add("triangles", mesh.num_triangles()).add("seconds", seconds)
+            .add("mtris_per_sec", mesh.num_triangles() / seconds * 1e-6).add("peak_rss_kb", peak_rss_kb()).print();
+    } else {
+        fprintf(stderr, "Error: could not load %s\n", bvh_file.c_str());
+    }
+
+    if (options.obj.empty()) {
+        remove(obj.c_str());
+    }
+    remove(bvh_file.c_str());
+}
+
+static void print_usage(const char* name) {
+    fprintf(stderr,
+            "Usage: %s [options]\n"
+            "  --size N       triangles per generated scene (default 100000)\n"
+            "  --rays N       rays per query benchmark (default 200000)\n"
+            "  --repeat N     runs per measurement, the median is reported (default 3)\n"
+            "  --threads N    threads of the parallel builders and loaders, 0 = all cores (default 0)\n"
+            "  --seed N       seed of the scene generators (default 1)\n"
+            "  --scene NAME   uniform, clustered or thin, may be repeated (default all three)\n"
+            "  --obj FILE     OBJ file for the load benchmark (default a generated height field)\n"
+            "  --dir DIR      directory for generated files (default .)\n"
+            "  --only KIND    build, query, order, overlap or load, may be repeated (default all)\n"
+            "  --trace FILE   write the build trace events of every build to FILE\n",
+            name);
+}
+
+int main(int argc, char** argv) {
+    BenchOptions options;
+    std::vector<std::string> scenes;
+    std::vector<std::string> kinds;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--size" && has_value) {
+            options.size = std::atoi(argv[++i]);
+        } else if (arg == "--rays" && has_value) {
+            options.rays = std::atoi(argv[++i]);
+        } else if (arg == "--repeat" && has_value) {
+            options.repeat = std::max(1, std::atoi(argv[++i]));
+        } else if (arg == "--threads" && has_value) {
+            options.threads = std::atoi(argv[++i]);
+        } else if (arg == "--seed" && has_value) {
+            options.seed = static_cast<unsigned int>(std::strtoul(argv[++i], nullptr, 10));
+        } else if (arg == "--scene" && has_value) {
+            scenes.push_back(argv[++i]);
+        } else if (arg == "--obj" && has_value) {
+            options.obj = argv[++i];
+        } else if (arg == "--dir" && has_value) {
+            options.work_dir = argv[++i];
+        } else if (arg == "--only" && has_value) {
+            kinds.push_back(argv[++i]);
+        } else if (arg == "--trace" && has_value) {
+            if (!trace::open(argv[++i])) {
+                return 1;
+            }
+        } else {
+            print_usage(argv[0]);
+            return 1;
+        }
+    }
+    if (!scenes.empty()) {
+        options.scenes = scenes;
+    }
+    auto selected = [&kinds](const char* kind) {
+        return kinds.empty() || std::find(kinds.begin(), kinds.end(), kind) != kinds.end();
+    };
+
+    ThreadPool pool(options.threads);
+    Record("run")
+        .add("version", BVH_VERSION)
+        .add("size", options.size)
+        .add("rays", options.rays)
+        .add("repeat", options.repeat)
+        .add("threads", pool.num_threads())
+        .add("seed", static_cast<long>(options.seed))
+        .print();
+
+    for (const std::string& scene : options.scenes) {
+        std::vector<Triangle> tris = make_scene(scene, options.size, options.seed);
+        if (tris.empty()) {
+            fprintf(stderr, "Error: unknown scene %s\n", scene.c_str());
+            return 1;
+        }
+        if (selected("build")) {
+            bench_builds(options, scene, tris, pool);
+        }
+        if (selected("query")) {
+            bench_queries(options, scene, tris);
+        }
+        if (selected("order")) {
+            bench_orders(options, scene, tris);
+        }
+        if (selected("overlap")) {
+            bench_overlaps(options, scene, tris, pool);
+        }
+    }
+    if (selected("load")) {
+        bench_loads(options);
+    }
+
+    Record("summary").add("peak_rss_kb", peak_rss_kb()).print();
+    trace::close();
+    return 0;
+}
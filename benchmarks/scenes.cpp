@@ -0,0 +1,136 @@
+#include <scenes.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <random>
+
+namespace bvh::bench {
+
+static Triangle make_triangle(const vec3<float>& a, const vec3<float>& b, const vec3<float>& c) {
+    Triangle tri = {};
+    tri.vertices[0] = a;
+    tri.vertices[1] = b;
+    tri.vertices[2] = c;
+    return tri;
+}
+
+std::vector<Triangle> uniform_scene(int num_tris, unsigned int seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> pos_dis(0.0f, 100.0f);
+    std::uniform_real_distribution<float> offset_dis(-0.5f, 0.5f);
+
+    std::vector<Triangle> triangles(num_tris);
+    for (Triangle& tri : triangles) {
+        vec3<float> p(pos_dis(gen), pos_dis(gen), pos_dis(gen));
+        vec3<float> v[3];
+        for (int j = 0; j < 3; j++) {
+            v[j] = vec3<float>(p.x + offset_dis(gen), p.y + offset_dis(gen), p.z + offset_dis(gen));
+        }
+        tri = make_triangle(v[0], v[1], v[2]);
+    }
+    return triangles;
+}
+
+std::vector<Triangle> clustered_scene(int num_tris, unsigned int seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> pos_dis(0.0f, 100.0f);
+    std::uniform_real_distribution<float> log_radius_dis(-2.0f, 1.5f);
+    std::normal_distribution<float> normal_dis(0.0f, 1.0f);
+    std::uniform_real_distribution<float> unit_dis(-1.0f, 1.0f);
+
+    // About 64 triangles per cluster, cluster radii from 0.01 to 30
+    int num_clusters = std::max(1, num_tris / 64);
+    std::vector<vec3<float>> centers(num_clusters);
+    std::vector<float> radii(num_clusters);
+    for (int c = 0; c < num_clusters; c++) {
+        centers[c] = vec3<float>(pos_dis(gen), pos_dis(gen), pos_dis(gen));
+        radii[c] = std::pow(10.0f, log_radius_dis(gen));
+    }
+
+    std::uniform_int_distribution<int> cluster_dis(0, num_clusters - 1);
+    std::vector<Triangle> triangles(num_tris);
+    for (Triangle& tri : triangles) {
+        int c = cluster_dis(gen);
+        float r = radii[c];
+        vec3<float> p(centers[c].x + r * normal_dis(gen), centers[c].y + r * normal_dis(gen), centers[c].z + r * normal_dis(gen));
+        float size = 0.05f * r;
+        vec3<float> v[3];
+        for (int j = 0; j < 3; j++) {
+            v[j] = vec3<float>(p.x + size * unit_dis(gen), p.y + size * unit_dis(gen), p.z + size * unit_dis(gen));
+        }
+        tri = make_triangle(v[0], v[1], v[2]);
+    }
+    return triangles;
+}
+
+std::vector<Triangle> thin_scene(int num_tris, unsigned int seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> pos_dis(0.0f, 100.0f);
+    std::uniform_real_distribution<float> length_dis(5.0f, 30.0f);
+    std::normal_distribution<float> normal_dis(0.0f, 1.0f);
+    std::uniform_real_distribution<float> width_dis(-0.02f, 0.02f);
+
+    std::vector<Triangle> triangles(num_tris);
+    for (Triangle& tri : triangles) {
+        vec3<float> p(pos_dis(gen), pos_dis(gen), pos_dis(gen));
+        vec3<float> d(normal_dis(gen), normal_dis(gen), normal_dis(gen));
+        float norm = std::sqrt(vec3<float>::dot(d, d));
+        d = d * (length_dis(gen) / std::max(norm, 1e-6f));
+        vec3<float> w(width_dis(gen), width_dis(gen), width_dis(gen));
+        tri = make_triangle(p, p + d, p + d * 0.5f + w);
+    }
+    return triangles;
+}
+
+std::vector<Triangle> make_scene(const std::string& name, int num_tris, unsigned int seed) {
+    if (name == "uniform") {
+        return uniform_scene(num_tris, seed);
+    }
+    if (name == "clustered") {
+        return clustered_scene(num_tris, seed);
+    }
+    if (name == "thin") {
+        return thin_scene(num_tris, seed);
+    }
+    return std::vector<Triangle>();
+}
+
+bool write_obj_scene(const std::string& path, int num_tris, unsigned int seed) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        return false;
+    }
+
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> phase_dis(0.0f, 6.2831853f);
+    float phase_x = phase_dis(gen);
+    float phase_y = phase_dis(gen);
+
+    // n x n quads, two triangles each
+    int n = std::max(1, static_cast<int>(std::sqrt(num_tris / 2.0)));
+    for (int j = 0; j <= n; j++) {
+        for (int i = 0; i <= n; i++) {
+            float x = 100.0f * i / n;
+            float y = 100.0f * j / n;
+            float z = 5.0f * std::sin(0.2f * x + phase_x) * std::cos(0.15f * y + phase_y);
+            fprintf(file, "v %f %f %f\n", x, y, z);
+            fprintf(file, "vt %f %f\n", static_cast<float>(i) / n, static_cast<float>(j) / n);
+            fprintf(file, "vn 0 0 1\n");
+        }
+    }
+    for (int j = 0; j < n; j++) {
+        for (int i = 0; i < n; i++) {
+            int a = j * (n + 1) + i + 1; // OBJ indices start at 1
+            int b = a + 1;
+            int c = a + n + 1;
+            int d = c + 1;
+            fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, b, b, b, d, d, d);
+            fprintf(file, "f %d/%d/%d %d/%d/%d %d/%d/%d\n", a, a, a, d, d, d, c, c, c);
+        }
+    }
+
+    return fclose(file) == 0;
+}
+
+}
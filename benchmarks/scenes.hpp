@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <triangle.hpp>
+
+namespace bvh::bench {
+
+  // Scene generators for the benchmarks. They are seeded: the same size and seed always give the same
+  // triangles, on every machine, so results can be compared across versions.
+
+  // Small triangles spread uniformly in a 100 x 100 x 100 box
+  std::vector<Triangle> uniform_scene(int num_tris, unsigned int seed);
+
+  // Dense clusters of very different sizes separated by empty space, like objects in a large level
+  std::vector<Triangle> clustered_scene(int num_tris, unsigned int seed);
+
+  // Long thin triangles with random orientations, their boxes are large and overlap a lot
+  std::vector<Triangle> thin_scene(int num_tris, unsigned int seed);
+
+  // One of the scenes above by name ("uniform", "clustered" or "thin"), empty for an unknown name
+  std::vector<Triangle> make_scene(const std::string& name, int num_tris, unsigned int seed);
+
+  /**
+   * @brief Writes a large OBJ file: a displaced height field with shared vertices, texture coordinates and
+   * normals, about num_tris triangles
+   * @return false if the file could not be written
+   */
+  bool write_obj_scene(const std::string& path, int num_tris, unsigned int seed);
+
+}
@@ -0,0 +1,116 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <utility>
+#include <vector>
+#include <vec3.hpp>
+#include <bvh_node.hpp>
+#include <thread_pool.hpp>
+
+// Size of the blocks a NodeArena takes from the heap, about a thousand nodes each
+#define BVH_ARENA_BLOCK_SIZE (64 * 1024)
+
+namespace bvh {
+
+  /**
+   * @brief Bump allocator holding the nodes of one tree.
+   *
+   * Objects are placed one after the other in large blocks and are never destroyed one by one: the
+   * destructor frees the blocks without visiting the objects, so it costs one free per block instead
+   * of one delete per node. Only objects that own nothing outside the arena may be created in it
+   * (BvhNode and BvhLeaf, whose children and leaf indices live in the same arena), and they must never be deleted.
+   *
+   * An arena is not thread safe. Parallel builds give each thread running their tasks its own sub-arena,
+   * see thread_arena(); the sub-arenas are freed together with their parent.
+   */
+  class NodeArena {
+  public:
+    explicit NodeArena(size_t block_size = BVH_ARENA_BLOCK_SIZE);
+    ~NodeArena();
+
+    NodeArena(const NodeArena&) = delete;
+    NodeArena& operator=(const NodeArena&) = delete;
+
+    // Returns size bytes aligned on alignment (a power of two), valid until the arena is destroyed
+    void* allocate(size_t size, size_t alignment);
+
+    // Constructs a T in the arena, its destructor will never run
+    template <typename T, typename... Args>
+    T* create(Args&&... args) {
+      return new (allocate(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    /**
+     * @brief Creates the sub-arenas of the workers of a pool and makes the calling thread the owner of this
+     * arena. Must be called by the thread starting a build, before its parallel part: thread_arena() then
+     * never locks for the owner and the workers.
+     * @param pool The pool running the build
+     */
+    void reserve_threads(const ThreadPool& pool);
+
+    /**
+     * @brief Arena of the calling thread for a build running on pool: the sub-arena of a worker, this arena for
+     * the owner, and a sub-arena created on first use (under a lock) for any other thread running tasks of
+     * the pool, e.g. a thread waiting on another build or the worker of an outer pool
+     */
+    NodeArena& thread_arena(const ThreadPool& pool);
+
+    // Sub-arena of the worker of index worker (ThreadPool::worker_index()), 0 is this arena
+    NodeArena& thread_arena(int worker) { return worker == 0 ? *this : *thread_arenas[worker - 1]; }
+
+    // Bytes handed out by this arena and its sub-arenas
+    size_t bytes_used() const;
+
+    // Blocks taken from the heap by this arena and its sub-arenas
+    size_t num_blocks() const;
+
+  private:
+    std::vector<char*> blocks;
+    char* cursor = nullptr;  // Next free byte of the last block
+    char* limit = nullptr;   // End of the last block
+    size_t block_size;
+    size_t used = 0;
+    std::vector<std::unique_ptr<NodeArena>> thread_arenas;  // thread_arenas[i] belongs to worker i + 1
+    std::thread::id owner;  // Thread allocating from this arena directly, the one that created it or reserved its threads
+    std::mutex outside_mutex;
+    std::vector<std::pair<std::thread::id, std::unique_ptr<NodeArena>>> outside_arenas;  // Threads outside the pool
+  };
+
+  // Node allocation policies of the builders, they all create nodes through node() and leaf().
+
+  // Every node is a separate heap allocation, the tree is freed by deleting its root
+  struct HeapNodeAllocator {
+    BvhNode* node(const vec3<float>& min, const vec3<float>& max) const { return new BvhNode(min, max); }
+    BvhLeaf* leaf(const vec3<float>& min, const vec3<float>& max, int count, const int* indices) const {
+      return new BvhLeaf(min, max, count, indices);
+    }
+    // Frees a subtree that will not be part of the result
+    void discard(BvhNode* node) const { delete node; }
+    // Allocator for the calling thread of a parallel build running on pool
+    HeapNodeAllocator local(const ThreadPool&) const { return *this; }
+  };
+
+  // Nodes are created in a NodeArena, the tree is freed with the arena
+  struct ArenaNodeAllocator {
+    NodeArena* arena;
+
+    BvhNode* node(const vec3<float>& min, const vec3<float>& max) const { return arena->create<BvhNode>(min, max); }
+    // The indices are copied into the arena too, right after the leaf
+    BvhLeaf* leaf(const vec3<float>& min, const vec3<float>& max, int count, const int* indices) const {
+      BvhLeaf* leaf = arena->create<BvhLeaf>(min, max, count, nullptr, false);
+      leaf->indices = static_cast<int*>(arena->allocate(count * sizeof(int), alignof(int)));
+      std::copy(indices, indices + count, leaf->indices);
+      return leaf;
+    }
+    // Arena nodes cannot be freed alone, the memory goes with the arena
+    void discard(BvhNode*) const {}
+    // Sub-arena of the calling thread for a build running on pool, see NodeArena::thread_arena()
+    ArenaNodeAllocator local(const ThreadPool& pool) const { return {&arena->thread_arena(pool)}; }
+  };
+
+}
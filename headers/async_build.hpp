@@ -0,0 +1,111 @@
+#pragma once
+
+#include <future>
+#include <memory>
+#include <string>
+#include <ray.hpp>
+#include <triangle.hpp>
+#include <object.hpp>
+#include <bvh_node.hpp>
+#include <build_monitor.hpp>
+#include <thread_pool.hpp>
+
+namespace bvh {
+
+  /**
+   * @brief Slot holding the current version of an object, traced by some threads while others build the next
+   * version. Readers take a snapshot with acquire() and trace it without any lock; publish() swaps the new
+   * version in atomically. A replaced version is freed when its last snapshot is released, so readers still
+   * tracing it are never cut short and never see a half-built tree.
+   *
+   * acquire() and publish() go through the atomic shared_ptr functions, a reference count update and a short
+   * critical section, not a lock held during traversal.
+   */
+  class SharedObject {
+  public:
+    SharedObject() = default;
+    explicit SharedObject(std::shared_ptr<const Object> object) : current(std::move(object)) {}
+
+    SharedObject(const SharedObject&) = delete;
+    SharedObject& operator=(const SharedObject&) = delete;
+
+    // The current version, nullptr before the first publish()
+    std::shared_ptr<const Object> acquire() const { return std::atomic_load(&current); }
+
+    // Replaces the current version, returns the previous one
+    std::shared_ptr<const Object> publish(std::shared_ptr<const Object> object) {
+      return std::atomic_exchange(&current, std::move(object));
+    }
+
+    /**
+     * @brief Publishes a copy of the current version refitted to moved triangles, the way to refit while
+     * queries run: refit() writes the boxes in place and must not run under readers. The copy of the tree and
+     * the refit are made on the calling thread, readers keep tracing the current version meanwhile.
+     *
+     * Writers must be serialized: the copy is made from the version current when the call starts, so a
+     * publish() or publish_refit() running at the same time is overwritten and its update lost.
+     * @param tris The moved triangles, as many as the current version has, allocated with new[]; the new
+     *        version takes them, they are freed if the slot is empty
+     * @return The previous version, nullptr if the slot is empty (nothing is published then)
+     */
+    std::shared_ptr<const Object> publish_refit(Triangle* tris);
+
+    // Same as Object::intersect and Object::occluded on a snapshot of the current version
+    Hit intersect(const Ray& ray) const;
+    bool occluded(const Ray& ray) const;
+
+  private:
+    std::shared_ptr<const Object> current;
+  };
+
+  /**
+   * @brief Handle of an object whose BVH is built on a ThreadPool, so that the calling thread never blocks on
+   * the build. The pool and the target slot, if any, must outlive the build.
+   */
+  class AsyncBuild {
+  public:
+    /**
+     * @brief Starts building the SAH BVH of triangles in the background
+     * @param pool The pool running the build
+     * @param tris The triangles, allocated with new[]; the built object takes them, they are freed if the build
+     *        fails or is cancelled
+     * @param num_tris The number of triangles
+     * @param target If not nullptr, the object is published to this slot as soon as it is built
+     * @param settings The build settings, their monitor is replaced by the one of the handle
+     */
+    static AsyncBuild start(ThreadPool& pool, Triangle* tris, int num_tris, SharedObject* target = nullptr,
+                            const BuildSettings& settings = BuildSettings());
+
+    // Same as above with the triangles of an OBJ file, loaded in the background too (see Object::build_bvh)
+    static AsyncBuild load(ThreadPool& pool, const std::string& obj_filename, SharedObject* target = nullptr,
+                           const BuildSettings& settings = BuildSettings());
+
+    // Fraction of the build done, in [0, 1], 1 once the object is built
+    float progress() const { return monitor->progress(); }
+
+    // Asks the build to stop; get() then throws BuildCancelled unless the build had already finished
+    void cancel() { monitor->cancel(); }
+
+    // Whether get() would return without waiting
+    bool ready() const;
+
+    // Waits for the end of the build, running queued tasks of the pool meanwhile, so that pools without worker
+    // threads complete too
+    void wait();
+
+    /**
+     * @brief Waits for the object and returns it. Can be called only once.
+     * @throws BuildCancelled if the build was cancelled, or the exception that stopped the build
+     */
+    std::shared_ptr<Object> get();
+
+  private:
+    AsyncBuild(ThreadPool& pool, std::shared_ptr<BuildMonitor> monitor, std::future<std::shared_ptr<Object>> result)
+        : pool(&pool), monitor(std::move(monitor)), result(std::move(result)) {}
+
+    ThreadPool* pool;
+    std::shared_ptr<BuildMonitor> monitor;
+    std::future<std::shared_ptr<Object>> result;
+  };
+
+}
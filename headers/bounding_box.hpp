@@ -1,5 +1,6 @@
 #pragma once
 
+#include <limits>
 #include <vec3.hpp>
 
 namespace bvh {
@@ -14,6 +15,37 @@ namespace bvh {
 
     bool operator==(const BoundingBox& other) const;
 
+    // Inverted box that any call to expand() will overwrite
+    static BoundingBox empty() {
+      const float inf = std::numeric_limits<float>::max();
+      return BoundingBox(vec3<float>(inf, inf, inf), vec3<float>(-inf, -inf, -inf));
+    }
+
+    // Grow the box so that it contains the point p
+    void expand(const vec3<float>& p) {
+      min = vec3<float>::min(min, p);
+      max = vec3<float>::max(max, p);
+    }
+
+    // Grow the box so that it contains the box other
+    void expand(const BoundingBox& other) {
+      min = vec3<float>::min(min, other.min);
+      max = vec3<float>::max(max, other.max);
+    }
+
+    vec3<float> centroid() const {
+      return (min + max) * 0.5f;
+    }
+
+    // Surface area of the box, 0 for empty (inverted) boxes
+    float surface_area() const {
+      vec3<float> d = max - min;
+      if (d.x < 0.0f || d.y < 0.0f || d.z < 0.0f) {
+        return 0.0f;
+      }
+      return 2.0f * (d.x * d.y + d.y * d.z + d.z * d.x);
+    }
+
   };
 
 
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <stdexcept>
+
+namespace bvh {
+
+  // Thrown out of a build whose BuildMonitor was cancelled
+  class BuildCancelled : public std::runtime_error {
+  public:
+    BuildCancelled() : std::runtime_error("BVH build cancelled") {}
+  };
+
+  /**
+   * @brief Progress and cancellation of one build, shared between the threads building it (through
+   * BuildSettings::monitor) and the threads watching it. The builders report the triangles of every leaf
+   * they create, and throw BuildCancelled at the next leaf once cancel() was called. Builds into a BvhTree
+   * free their nodes with the arena when they stop; builds with new/delete nodes leak the finished subtrees.
+   */
+  class BuildMonitor {
+  public:
+    // num_tris is the number of triangles of the build, the 100% of progress()
+    explicit BuildMonitor(int num_tris = 0) : num_tris(num_tris) {}
+
+    BuildMonitor(const BuildMonitor&) = delete;
+    BuildMonitor& operator=(const BuildMonitor&) = delete;
+
+    // Asks the build to stop, from any thread
+    void cancel() { cancelled.store(true, std::memory_order_relaxed); }
+    bool cancel_requested() const { return cancelled.load(std::memory_order_relaxed); }
+
+    // Fraction of the triangles placed in leaves so far, in [0, 1]. Spatial splits reference some triangles
+    // from several leaves, the fraction is clamped at 1.
+    float progress() const {
+      if (finished.load(std::memory_order_acquire)) {
+        return 1.0f;
+      }
+      long done = placed.load(std::memory_order_relaxed);
+      int total = num_tris.load(std::memory_order_relaxed);
+      return total <= 0 ? 0.0f : (done >= total ? 1.0f : static_cast<float>(done) / total);
+    }
+
+    // Called by the builders for each leaf of count triangles
+    void leaf_done(int count) {
+      placed.fetch_add(count, std::memory_order_relaxed);
+      if (cancel_requested()) {
+        throw BuildCancelled();
+      }
+    }
+
+    // Sets the number of triangles, for builds that only learn it once started (e.g. after parsing a file)
+    void set_total(int total) { num_tris.store(total, std::memory_order_relaxed); }
+
+    // Marks the whole build as done, progress() is 1 from then on
+    void finish() { finished.store(true, std::memory_order_release); }
+
+  private:
+    std::atomic<long> placed{0};
+    std::atomic<bool> cancelled{false};
+    std::atomic<bool> finished{false};
+    std::atomic<int> num_tris;
+  };
+
+}
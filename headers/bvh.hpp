@@ -1,20 +1,153 @@
 #pragma once
 
 #include <triangle.hpp>
+#include <mesh.hpp>
 #include <object.hpp>
 #include <bvh_node.hpp>
+#include <bvh_tree.hpp>
+#include <thread_pool.hpp>
 
 namespace bvh {
+  // The builders below return trees of individually allocated nodes, freed by deleting the root.
+  // They all take a BuildSettings, whose defaults give leaves of up to BVH_LEAF_SIZE triangles.
+  // The BvhTree factories of the same names build identical trees in one arena (see bvh_tree.hpp).
+
+  /**
+   * @brief Precomputes the BVH for a list of triangles delimited by the indices [start, end[
+   * @param tris The list of triangles
+   * @param start The start index of the list
+   * @param end The end index of the list (excluded)
+   * @param settings Leaf sizes, costs and maximum depth, see BuildSettings
+   */
+  BvhNode *precompute_bvh(Triangle* tris, int start, int end, const BuildSettings& settings = BuildSettings());
+
+  /**
+   * @brief Same as precompute_bvh, built on a work-stealing thread pool. The tree is identical
+   *        to the one of the serial build.
+   * @param tris The list of triangles
+   * @param start The start index of the list
+   * @param end The end index of the list (excluded)
+   * @param num_threads The number of threads, 0 uses the hardware concurrency
+   * @param settings Leaf sizes, costs and maximum depth, see BuildSettings
+   */
+  BvhNode *precompute_bvh_parallel(Triangle* tris, int start, int end, int num_threads = 0, const BuildSettings& settings = BuildSettings());
+
+  /**
+   * @brief Same as precompute_bvh_parallel, running on an existing pool
+   */
+  BvhNode *precompute_bvh_parallel(Triangle* tris, int start, int end, ThreadPool& pool, const BuildSettings& settings = BuildSettings());
+
+  /**
+   * @brief Same as precompute_bvh_parallel over every triangle of an indexed mesh.
+   *        Leaf indices are triangle indices of the mesh.
+   */
+  BvhNode *precompute_bvh_parallel(const Mesh& mesh, int num_threads = 0, const BuildSettings& settings = BuildSettings());
+  BvhNode *precompute_bvh_parallel(const Mesh& mesh, ThreadPool& pool, const BuildSettings& settings = BuildSettings());
+
   /**
    * @brief Precomputes the BVH for a list of triangles delimited by the indices [start, end[
+   *        using the binned surface area heuristic (SAH). All three axes are tried at every node.
    * @param tris The list of triangles
    * @param start The start index of the list
    * @param end The end index of the list (excluded)
+   * @param num_bins The number of bins per axis, clamped to [2, BVH_SAH_MAX_BINS]
+   * @param settings Leaf sizes, costs and maximum depth, see BuildSettings
+   */
+  BvhNode *precompute_bvh_sah(Triangle* tris, int start, int end, int num_bins = 16, const BuildSettings& settings = BuildSettings());
+
+  /**
+   * @brief Same as precompute_bvh_sah over every triangle of an indexed mesh.
+   *        Leaf indices are triangle indices of the mesh.
    */
-  BvhNode *precompute_bvh(Triangle* tris, int start, int end);
+  BvhNode *precompute_bvh_sah(const Mesh& mesh, int num_bins = 16, const BuildSettings& settings = BuildSettings());
 
   /**
-   * @brief Builds the BVH for a list of objects given the start index
+   * @brief Builds a linear BVH (LBVH) from Morton codes, for meshes too large or too dynamic for the other
+   *        builders. The triangle centroids are quantized in their bounding box and ordered along a Morton
+   *        curve with a parallel radix sort; every node then splits its range where the highest differing
+   *        bit of the codes changes. With options.agglomerate, the subtrees of BVH_LBVH_CLUSTER_SIZE
+   *        triangles or less are rebuilt by greedily merging the pair of clusters with the smallest
+   *        bounding box, which recovers most of the SAH quality lost by the Morton split.
+   *        The tree does not depend on the number of threads.
+   * @param tris The list of triangles
+   * @param start The start index of the list
+   * @param end The end index of the list (excluded)
+   * @param num_threads The number of threads, 0 uses the hardware concurrency
+   * @param options The code length and whether to cluster the bottom of the tree
+   * @param settings Leaf sizes, costs and maximum depth, see BuildSettings
+   */
+  BvhNode *precompute_bvh_lbvh(Triangle* tris, int start, int end, int num_threads = 0, const LbvhOptions& options = LbvhOptions(), const BuildSettings& settings = BuildSettings());
+  BvhNode *precompute_bvh_lbvh(Triangle* tris, int start, int end, ThreadPool& pool, const LbvhOptions& options = LbvhOptions(), const BuildSettings& settings = BuildSettings());
+
+  /**
+   * @brief Same as precompute_bvh_lbvh over every triangle of an indexed mesh.
+   *        Leaf indices are triangle indices of the mesh.
+   */
+  BvhNode *precompute_bvh_lbvh(const Mesh& mesh, int num_threads = 0, const LbvhOptions& options = LbvhOptions(), const BuildSettings& settings = BuildSettings());
+  BvhNode *precompute_bvh_lbvh(const Mesh& mesh, ThreadPool& pool, const LbvhOptions& options = LbvhOptions(), const BuildSettings& settings = BuildSettings());
+
+  /**
+   * @brief Builds a spatial split BVH (SBVH): at every node, besides the binned SAH split of the triangles
+   *        (as precompute_bvh_sah), planes cutting through them are evaluated. A triangle crossing the chosen
+   *        plane is clipped and referenced from both children, unless moving it whole to one side is cheaper.
+   *        This pays off on long or large triangles (floors, walls) whose boxes make the children overlap;
+   *        leaves then only bound the parts of their triangles inside them and a triangle can be in several
+   *        leaves. Spatial splits are only tried where the children of the best object split overlap, and
+   *        stop once options.duplication_budget * (end - start) references were added, in build order.
+   * @param tris The list of triangles
+   * @param start The start index of the list
+   * @param end The end index of the list (excluded)
+   * @param options The bin count, the duplication budget and the overlap threshold
+   * @param settings Leaf sizes, costs and maximum depth, see BuildSettings
+   */
+  BvhNode *precompute_bvh_sbvh(Triangle* tris, int start, int end, const SbvhOptions& options = SbvhOptions(), const BuildSettings& settings = BuildSettings());
+
+  /**
+   * @brief Same as precompute_bvh_sbvh over every triangle of an indexed mesh.
+   *        Leaf indices are triangle indices of the mesh.
+   */
+  BvhNode *precompute_bvh_sbvh(const Mesh& mesh, const SbvhOptions& options = SbvhOptions(), const BuildSettings& settings = BuildSettings());
+
+  /**
+   * @brief Computes the SAH cost of a BVH, normalized by the surface area of the root.
+   *        Lower is better; use it to compare builders on the same mesh.
+   * @param root The root node of the BVH
+   * @param traversal_cost The cost of visiting an internal node
+   * @param intersection_cost The cost of intersecting one triangle
+   */
+  float sah_cost(const BvhNode* root, float traversal_cost = 1.0f, float intersection_cost = 1.0f);
+
+  /**
+   * @brief Recomputes every bounding box of a BVH bottom-up after the triangle vertices moved,
+   *        in one pass over the nodes. The tree topology and the leaf contents are kept. Leaves of a
+   *        spatial split BVH get the boxes of their whole triangles: still correct, no longer clipped.
+   * @param root The root node of the BVH
+   * @param tris The triangles indexed by the leaves of the BVH, with their new positions
+   */
+  void refit_bvh(BvhNode* root, const Triangle* tris);
+  void refit_bvh(BvhNode* root, const Mesh& mesh);
+
+  /**
+   * @brief Same as refit_bvh, the subtrees near the root are refitted as parallel tasks
+   * @param num_threads The number of threads, 0 uses the hardware concurrency
+   */
+  void refit_bvh_parallel(BvhNode* root, const Triangle* tris, int num_threads = 0);
+  void refit_bvh_parallel(BvhNode* root, const Triangle* tris, ThreadPool& pool);
+  void refit_bvh_parallel(BvhNode* root, const Mesh& mesh, int num_threads = 0);
+  void refit_bvh_parallel(BvhNode* root, const Mesh& mesh, ThreadPool& pool);
+
+  /**
+   * @brief Measures how much refitting has degraded a BVH: its SAH cost divided by the cost it had
+   *        right after being built (see sah_cost). 1 means no degradation; once the ratio goes past
+   *        BVH_REFIT_REBUILD_RATIO, rebuilding usually pays for itself in faster traversals.
+   * @param root The root node of the refitted BVH
+   * @param build_cost sah_cost(root) right after the build
+   */
+  float refit_degradation(const BvhNode* root, float build_cost);
+
+  /**
+   * @brief Builds the BVH for a list of objects given the start index by re-parenting the objects' own
+   *        BVH roots. The object transforms are ignored; use Tlas for placed or instanced objects.
    * @param objs The list of objects
    * @param num_objs The number of objects
    * @param start The start index of the list of objects
@@ -22,4 +155,24 @@ namespace bvh {
   BvhNode *build_bvh_from_objects(Object *objs, int num_objs, int start);
   BoundingBox computeCombinedBoundingBox(const std::vector<BvhNode*>& bvhNodes);
 
+  /**
+   * @brief Chooses the longest axis of a box (0 = x, 1 = y, 2 = z)
+   */
+  int chooseSplitAxis(const BoundingBox& box);
+
+  // Orders triangle indices by the centroid coordinate along the split axis. Ties are broken by index so that
+  // the order is unique and every partition (serial or parallel) gives the same result.
+  struct CentroidLess {
+    const float* keys;  // keys[i - base] is the centroid coordinate of triangle i along the split axis
+    int base;
+
+    CentroidLess(const float* keys, int base) : keys(keys), base(base) {}
+
+    bool operator()(int a, int b) const {
+      float ka = keys[a - base];
+      float kb = keys[b - base];
+      return ka < kb || (ka == kb && a < b);
+    }
+  };
+
 }
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <linear_bvh.hpp>
+
+#define BVH_BINARY_MAGIC "BVHB"
+#define BVH_BINARY_VERSION 1
+
+namespace bvh {
+
+  // Header of a binary .bvh file, followed by the node array and the primitive index array.
+  // See docs/bvh_file_format.txt.
+  struct BvhBinaryHeader {
+    char magic[4];            // "BVHB"
+    uint32_t version;         // BVH_BINARY_VERSION
+    uint32_t endian_tag;      // 0x01020304 written in the byte order of the machine that saved the file
+    uint32_t header_size;     // sizeof(BvhBinaryHeader), the node array starts right after it
+    uint32_t node_size;       // sizeof(LinearBvhNode)
+    uint32_t num_nodes;
+    uint32_t num_primitives;
+    uint32_t num_triangles;   // Triangles the BVH was built over, every primitive index is below it
+    uint64_t checksum;        // FNV-1a 64 over the node and primitive index arrays
+    uint64_t file_size;       // Total size of the file in bytes
+    uint8_t pad[16];
+  };
+
+  static_assert(sizeof(BvhBinaryHeader) == 64, "BvhBinaryHeader must stay 64 bytes");
+
+  /**
+   * @brief Saves a flattened BVH in the binary format
+   * @param bvh_filename The name of the file to write
+   * @param bvh The flattened BVH
+   * @param num_triangles The number of triangles the BVH was built over, its primitive indices are below it
+   * @return true on success
+   */
+  bool save_bvh_binary(const char* bvh_filename, const LinearBvh& bvh, uint32_t num_triangles);
+
+  /**
+   * @brief Read-only memory mapping of a binary .bvh file.
+   * The nodes and indices are used in place, loading allocates nothing per node.
+   */
+  class MappedBvh {
+  public:
+    /**
+     * @brief Maps a binary .bvh file
+     * @param bvh_filename The name of the file to map
+     * @param verify Check the checksum and that every offset stays in bounds, touches the whole file
+     * @return The mapping (owned by the caller), nullptr if the file is missing or invalid
+     */
+    static MappedBvh* open(const char* bvh_filename, bool verify = true);
+
+    ~MappedBvh();
+
+    MappedBvh(const MappedBvh&) = delete;
+    MappedBvh& operator=(const MappedBvh&) = delete;
+
+    const BvhBinaryHeader& header() const { return *static_cast<const BvhBinaryHeader*>(data); }
+    LinearBvhView view() const { return bvh_view; }
+
+    // Triangles the BVH was built over, the object using it must have as many. Every primitive index is below
+    // it once verified.
+    uint32_t num_triangles() const { return header().num_triangles; }
+
+  private:
+    MappedBvh(void* data, size_t size);
+
+    void* data;
+    size_t size;
+    LinearBvhView bvh_view;
+  };
+
+  /**
+   * @brief Checks whether a file starts with the binary .bvh magic
+   */
+  bool is_bvh_binary(const char* bvh_filename);
+
+  /**
+   * @brief FNV-1a 64 hash, used as the checksum of the binary format
+   * @param data The bytes to hash
+   * @param size The number of bytes
+   * @param hash The hash to continue from, to hash several buffers in a row
+   */
+  uint64_t fnv1a64(const void* data, size_t size, uint64_t hash = 14695981039346656037ULL);
+
+}
@@ -3,11 +3,62 @@
 #include <vec3.hpp>
 #include <triangle.hpp>
 #include <bounding_box.hpp>
+#include <build_monitor.hpp>
 
-#define BVH_LEAF_SIZE 8
+#define BVH_LEAF_SIZE 8 // Default maximum number of triangles per leaf, see BuildSettings
+#define BVH_MAX_LEAF_SIZE 65535 // Largest leaf a flattened BVH can hold (LinearBvhNode::count)
+#define BVH_MAX_DEPTH 64 // Default maximum depth of the builders, the size of the traversal stacks
+#define BVH_SAH_MAX_BINS 32
+#define BVH_REFIT_REBUILD_RATIO 1.5f // Refit degradation (see refit_degradation) above which a rebuild is recommended
+#define BVH_LBVH_CLUSTER_SIZE 16 // Ranges of Morton ordered triangles this small are clustered agglomeratively, see LbvhOptions
 
 namespace bvh {
 
+  /**
+   * @brief Parameters shared by every builder, the defaults give the trees of the previous fixed constants.
+   * Each builder uses the ones that apply to it: the median builders only split by count, the SAH based
+   * builders (SAH, SBVH and the clustered LBVH bottom levels) also weigh the costs.
+   */
+  struct BuildSettings {
+    int max_leaf_size = BVH_LEAF_SIZE;    // Nodes with more triangles are split, clamped to [1, BVH_MAX_LEAF_SIZE]
+    int min_leaf_size = 1;                // Nodes with this many triangles or fewer always become leaves
+    float traversal_cost = 1.0f;          // SAH cost of visiting an internal node
+    float intersection_cost = 1.0f;       // SAH cost of intersecting one triangle
+    int max_depth = BVH_MAX_DEPTH;        // Nodes at this depth become leaves whatever their size, unless larger than BVH_MAX_LEAF_SIZE
+    BuildMonitor* monitor = nullptr;      // Progress and cancellation of the build, not owned; nullptr for none
+
+    // Same settings with every value in its valid range
+    BuildSettings clamped() const {
+      BuildSettings s = *this;
+      s.max_leaf_size = s.max_leaf_size < 1 ? 1 : (s.max_leaf_size > BVH_MAX_LEAF_SIZE ? BVH_MAX_LEAF_SIZE : s.max_leaf_size);
+      s.min_leaf_size = s.min_leaf_size < 1 ? 1 : (s.min_leaf_size > s.max_leaf_size ? s.max_leaf_size : s.min_leaf_size);
+      s.traversal_cost = s.traversal_cost < 0.0f ? 0.0f : s.traversal_cost;
+      s.intersection_cost = s.intersection_cost <= 0.0f ? 1.0f : s.intersection_cost;
+      s.max_depth = s.max_depth < 1 ? 1 : s.max_depth;
+      return s;
+    }
+
+    // Whether a node of count triangles at depth must become a leaf without looking for a split
+    bool forces_leaf(int count, int depth) const {
+      return count <= min_leaf_size || (depth >= max_depth && count <= BVH_MAX_LEAF_SIZE);
+    }
+  };
+
+  // Options of the Morton code (LBVH) builder, see precompute_bvh_lbvh()
+  struct LbvhOptions {
+    int morton_bits = 30;     // 30 (10 bits per axis, 32-bit keys) or 63 (21 bits per axis, 64-bit keys)
+    bool agglomerate = true;  // Rebuild subtrees of BVH_LBVH_CLUSTER_SIZE triangles or less by agglomerative clustering
+  };
+
+  // Options of the spatial split (SBVH) builder, see precompute_bvh_sbvh()
+  struct SbvhOptions {
+    int num_bins = 16;                // Bins per axis of the object and of the spatial split searches, clamped to [2, BVH_SAH_MAX_BINS]
+    float duplication_budget = 0.3f;  // References added by spatial splits, as a fraction of the triangle count; 0 disables them
+    float min_overlap = 1e-5f;        // Spatial splits are only tried where the object split children overlap by more than this fraction of the root area
+  };
+
+  // Traversals and queries only read the nodes, they can run on the same tree from any number of threads;
+  // refits write the boxes in place and need the tree to themselves (see docs/thread_safety.txt)
   class BvhNode {
     public:
       BvhNode *left, *right;
@@ -19,16 +70,26 @@ namespace bvh {
       virtual void print(int depth=0);
   };
 
+  // A triangle is normally in exactly one leaf. Spatial splits (precompute_bvh_sbvh) reference it from every leaf
+  // overlapping it, the leaf box then only bounds the parts of the triangles inside it.
   class BvhLeaf : public BvhNode // BvhLeaf inherits from BvhNode (special type of BvhNode)
   {
   public:
     int num_triangles;
-    int indices[BVH_LEAF_SIZE];
+    int* indices;  // num_triangles triangle indices, any number of them
 
       BvhLeaf();
-      BvhLeaf(vec3<float> min, vec3<float> max, int num_triangles, int* indices);
+      // Copies the indices into an array owned by the leaf
+      BvhLeaf(vec3<float> min, vec3<float> max, int num_triangles, const int* indices);
+      // Uses the indices in place, they are freed with the leaf only if owns_indices (arena leaves point into their arena)
+      BvhLeaf(vec3<float> min, vec3<float> max, int num_triangles, int* indices, bool owns_indices);
+      BvhLeaf(const BvhLeaf&) = delete;
+      BvhLeaf& operator=(const BvhLeaf&) = delete;
       ~BvhLeaf();
       void print(int depth) override;
+
+  private:
+    bool owns_indices;
   };
 
 }
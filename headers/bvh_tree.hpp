@@ -0,0 +1,77 @@
+#pragma once
+
+#include <memory>
+#include <utility>
+#include <triangle.hpp>
+#include <mesh.hpp>
+#include <bvh_node.hpp>
+#include <arena.hpp>
+#include <thread_pool.hpp>
+
+namespace bvh {
+
+  struct LinearBvhView;
+  class Object;
+
+  /**
+   * @brief Owning handle of a BvhNode tree whose nodes all live in one NodeArena.
+   *
+   * The tree is freed with the handle in one go (see NodeArena), its nodes must not be deleted. The
+   * handle can be moved but not copied. The root is an ordinary BvhNode*, so every function working
+   * on raw trees (traversal, refit, flatten...) takes root().
+   */
+  class BvhTree {
+  public:
+    BvhTree() = default;
+
+    // Takes the nodes of arena, root must have been created in it (or in one of its sub-arenas)
+    BvhTree(std::unique_ptr<NodeArena> arena, BvhNode* root) : arena(std::move(arena)), root_node(root) {}
+
+    BvhTree(BvhTree&& other) noexcept : arena(std::move(other.arena)), root_node(other.root_node) {
+      other.root_node = nullptr;
+    }
+
+    BvhTree& operator=(BvhTree&& other) noexcept {
+      arena = std::move(other.arena);
+      root_node = other.root_node;
+      other.root_node = nullptr;
+      return *this;
+    }
+
+    BvhNode* root() const { return root_node; }
+    bool empty() const { return root_node == nullptr; }
+
+    // Bytes taken by the nodes of the tree
+    size_t memory_size() const { return arena ? arena->bytes_used() : 0; }
+
+    // Same trees as precompute_bvh, precompute_bvh_sah, precompute_bvh_parallel, precompute_bvh_lbvh and
+    // precompute_bvh_sbvh, see bvh.hpp
+    static BvhTree median(Triangle* tris, int start, int end, const BuildSettings& settings = BuildSettings());
+    static BvhTree sah(Triangle* tris, int start, int end, int num_bins = 16, const BuildSettings& settings = BuildSettings());
+    static BvhTree sah(const Mesh& mesh, int num_bins = 16, const BuildSettings& settings = BuildSettings());
+    static BvhTree parallel(Triangle* tris, int start, int end, int num_threads = 0, const BuildSettings& settings = BuildSettings());
+    static BvhTree parallel(Triangle* tris, int start, int end, ThreadPool& pool, const BuildSettings& settings = BuildSettings());
+    static BvhTree parallel(const Mesh& mesh, int num_threads = 0, const BuildSettings& settings = BuildSettings());
+    static BvhTree parallel(const Mesh& mesh, ThreadPool& pool, const BuildSettings& settings = BuildSettings());
+    static BvhTree lbvh(Triangle* tris, int start, int end, int num_threads = 0, const LbvhOptions& options = LbvhOptions(), const BuildSettings& settings = BuildSettings());
+    static BvhTree lbvh(Triangle* tris, int start, int end, ThreadPool& pool, const LbvhOptions& options = LbvhOptions(), const BuildSettings& settings = BuildSettings());
+    static BvhTree lbvh(const Mesh& mesh, int num_threads = 0, const LbvhOptions& options = LbvhOptions(), const BuildSettings& settings = BuildSettings());
+    static BvhTree lbvh(const Mesh& mesh, ThreadPool& pool, const LbvhOptions& options = LbvhOptions(), const BuildSettings& settings = BuildSettings());
+    static BvhTree sbvh(Triangle* tris, int start, int end, const SbvhOptions& options = SbvhOptions(), const BuildSettings& settings = BuildSettings());
+    static BvhTree sbvh(const Mesh& mesh, const SbvhOptions& options = SbvhOptions(), const BuildSettings& settings = BuildSettings());
+
+    /**
+     * @brief Same tree as build_bvh_from_objects. Only the nodes joining the objects belong to the
+     * handle, the BVHs of the objects are reused as they are and must outlive it.
+     */
+    static BvhTree from_objects(Object* objs, int num_objs, int start);
+
+    // Converts a flattened BVH back into a tree, see to_tree() in linear_bvh.hpp
+    static BvhTree from_linear(const LinearBvhView& bvh);
+
+  private:
+    std::unique_ptr<NodeArena> arena;
+    BvhNode* root_node = nullptr;
+  };
+
+}
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <vector>
+#include <ray.hpp>
+#include <object.hpp>
+#include <bounding_box.hpp>
+
+namespace bvh {
+
+  // Node of a DynamicBvh. Leaves hold one object, internal nodes always have two children.
+  struct DynamicBvhNode {
+    BoundingBox box;
+    int parent;           // -1 for the root; next entry of the free list for unused nodes
+    int left, right;      // Children of an internal node, -1 for leaves
+    int height;           // 0 for leaves, 1 + the height of the highest child for internal nodes
+    const Object* object; // Object of a leaf, nullptr for internal nodes
+
+    bool is_leaf() const { return left == -1; }
+  };
+
+  /**
+   * @brief Object-level BVH updated in place as objects come and go, instead of calling
+   * build_bvh_from_objects over the whole array again. Like build_bvh_from_objects, the leaves use the
+   * box of each object's BVH root and the object transforms are ignored.
+   *
+   * Objects are inserted next to the sibling that adds the least surface area to the tree (branch and
+   * bound search), and the nodes on the way back to the root are rotated when swapping a child with a
+   * grandchild shrinks them. Each operation costs O(log n) on a balanced tree. Nodes live in one array
+   * with a free list: once it has grown to the largest number of objects (see reserve()), insertions,
+   * removals and updates never allocate.
+   *
+   * Objects are identified by proxies, the index of their leaf, which stay valid until they are removed.
+   */
+  class DynamicBvh {
+  public:
+    /**
+     * @brief Inserts an object with the box of its BVH root
+     * @return The proxy of the object, -1 if the object has no BVH (it is left out, like in
+     *         build_bvh_from_objects)
+     */
+    int insert(const Object* object);
+
+    /**
+     * @brief Inserts an object with an explicit box, e.g. a world space box or one enlarged to absorb small
+     * motions without updates
+     * @return The proxy of the object
+     */
+    int insert(const Object* object, const BoundingBox& box);
+
+    // Removes an object, its proxy can be reused by later insertions
+    void remove(int proxy);
+
+    // Moves an object to the box of its BVH root, after its triangles moved and its BVH was refitted
+    void update(int proxy);
+
+    // Moves an object to an explicit box, its leaf is reinserted unless the box did not change
+    void update(int proxy, const BoundingBox& box);
+
+    // Makes room for num_objects objects, so that inserting up to that many never allocates
+    void reserve(int num_objects);
+
+    const Object* object(int proxy) const { return nodes[proxy].object; }
+    const BoundingBox& bounds(int proxy) const { return nodes[proxy].box; }
+
+    // Index of the root node in node_array(), -1 when the tree is empty
+    int root() const { return root_node; }
+    const std::vector<DynamicBvhNode>& node_array() const { return nodes; }
+
+    int size() const { return num_objects; }
+    bool empty() const { return root_node == -1; }
+
+    // Number of internal nodes on the longest path from the root to a leaf, 0 for a single object
+    int height() const { return root_node == -1 ? 0 : nodes[root_node].height; }
+
+    // Sum of the surface areas of the internal nodes over the area of the root, the quality the
+    // insertions and rotations minimize
+    float sah_cost() const;
+
+    // Checks the links, heights and boxes of every node, for tests
+    bool validate() const;
+
+    /**
+     * @brief Finds the closest hit of a ray among the objects, the ray being in the space of the boxes
+     * @return The closest hit, hit.instance is the proxy of the object hit, hit.triangle is -1 if nothing
+     *         was hit
+     */
+    Hit intersect(const Ray& ray) const;
+
+    // Whether a ray hits any of the objects
+    bool occluded(const Ray& ray) const;
+
+  private:
+    struct SearchEntry {
+      int node;
+      float inherited_cost;  // Growth of the ancestors of node if the new leaf goes below it
+    };
+
+    std::vector<DynamicBvhNode> nodes;
+    std::vector<SearchEntry> search_heap;  // Kept between insertions, so that the sibling search does not allocate
+    int root_node = -1;
+    int free_list = -1;
+    int num_objects = 0;
+
+    int allocate_node();
+    void free_node(int index);
+    int find_best_sibling(const BoundingBox& box);
+    void insert_leaf(int leaf);
+    void remove_leaf(int leaf);
+    void refit_upwards(int index);
+    void rotate(int index);
+  };
+
+}
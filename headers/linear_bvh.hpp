@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vec3.hpp>
+#include <ray.hpp>
+#include <triangle.hpp>
+#include <mesh.hpp>
+#include <bvh_node.hpp>
+
+#define BVH_LAYOUT_PAGE_SIZE 4096 // Bytes of the node clusters of NodeLayout::PageClustered
+
+namespace bvh {
+
+  // Node of a flattened BVH: 32 bytes, no pointers and no virtuals.
+  // The two children of an internal node are stored next to each other, left then right, always after their
+  // parent. Where the pairs go depends on the NodeLayout the BVH was flattened with.
+  struct LinearBvhNode {
+    vec3<float> min;     // Bounding box minimum
+    uint32_t offset;     // Leaf: first entry in primitive_indices, internal node: index of the left child (the right one is offset + 1)
+    vec3<float> max;     // Bounding box maximum
+    uint16_t count;      // Number of triangles of a leaf, 0 for internal nodes
+    uint8_t axis;        // Split axis of an internal node, used to visit the nearer child first
+    uint8_t pad;
+
+    bool is_leaf() const { return count > 0; }
+  };
+
+  static_assert(sizeof(LinearBvhNode) == 32, "LinearBvhNode must stay 32 bytes");
+
+  // Order of the nodes of a flattened BVH. Every order keeps the children of a node together and after it,
+  // they differ in which nodes share cache lines and pages.
+  enum class NodeLayout {
+    DepthFirst,    // Pairs of children in depth-first order, the pair of a left child follows its parent's closely
+    BreadthFirst,  // Level by level, the order of the text format
+    VanEmdeBoas,   // Recursively the top half of the levels, then each subtree below it: cache-oblivious, the
+                   // nodes of a subtree of any height are close together
+    PageClustered  // Subtrees of about BVH_LAYOUT_PAGE_SIZE bytes, each filled breadth first, stored one after the other
+  };
+
+  // Non-owning view of a flattened BVH, over a LinearBvh or over nodes used in place (e.g. a mapped file)
+  struct LinearBvhView {
+    const LinearBvhNode* nodes = nullptr;
+    uint32_t num_nodes = 0;
+    const int* primitive_indices = nullptr;
+    uint32_t num_primitives = 0;
+
+    bool empty() const { return num_nodes == 0; }
+  };
+
+  class LinearBvh {
+  public:
+    std::vector<LinearBvhNode> nodes;    // Nodes in the order of the NodeLayout flattened with, nodes[0] is the root
+    std::vector<int> primitive_indices;  // Triangle indices, each leaf owns a contiguous range (a triangle may be in several, see precompute_bvh_sbvh)
+
+    /**
+     * @brief Flattens a BvhNode tree into the linear layout. Empty leaves are left out and leaves of more than
+     * BVH_MAX_LEAF_SIZE triangles are split, so the result can differ from the tree when it has such leaves.
+     * @param root The root node of the BVH, may be nullptr
+     * @param layout The order of the nodes, see NodeLayout. Leaves own their primitive indices in node order.
+     * @param page_size The bytes of a cluster of NodeLayout::PageClustered, ignored by the other layouts
+     */
+    static LinearBvh flatten(const BvhNode* root, NodeLayout layout = NodeLayout::DepthFirst,
+                             size_t page_size = BVH_LAYOUT_PAGE_SIZE);
+
+    /**
+     * @brief Converts the linear layout back into a heap allocated BvhNode tree
+     * @return The root node (owned by the caller), nullptr if the BVH is empty.
+     *         BvhTree::from_linear() builds it in an arena instead.
+     */
+    BvhNode* to_tree() const;
+
+    /**
+     * @brief Recomputes every node box after the triangle vertices moved. Children are stored after their
+     * parent in every layout, so a single pass over the nodes in reverse order visits every child before its parent.
+     * @param tris The triangles indexed by the primitive indices, with their new positions
+     */
+    void refit(const Triangle* tris);
+    void refit(const Mesh& mesh);
+
+    bool empty() const { return nodes.empty(); }
+
+    // Bytes used by the nodes and the primitive indices
+    size_t memory_size() const {
+      return nodes.size() * sizeof(LinearBvhNode) + primitive_indices.size() * sizeof(int);
+    }
+
+    LinearBvhView view() const {
+      return {nodes.data(), static_cast<uint32_t>(nodes.size()),
+              primitive_indices.data(), static_cast<uint32_t>(primitive_indices.size())};
+    }
+  };
+
+  /**
+   * @brief Finds the closest triangle hit by a ray in a flattened BVH
+   * @param bvh The flattened BVH
+   * @param tris The triangles indexed by the primitive indices of the BVH
+   * @param ray The ray, in the same space as the triangles
+   * @return The closest hit, hit.triangle is -1 if nothing was hit
+   */
+  Hit intersect(const LinearBvh& bvh, const Triangle* tris, const Ray& ray);
+
+  /**
+   * @brief Checks whether a ray hits any triangle of a flattened BVH
+   * @param bvh The flattened BVH
+   * @param tris The triangles indexed by the primitive indices of the BVH
+   * @param ray The ray, in the same space as the triangles
+   */
+  bool occluded(const LinearBvh& bvh, const Triangle* tris, const Ray& ray);
+
+  /**
+   * @brief Converts a flattened BVH back into a heap allocated BvhNode tree, see LinearBvh::to_tree()
+   */
+  BvhNode* to_tree(const LinearBvhView& bvh);
+
+  class NodeArena;
+
+  /**
+   * @brief Tree whose leaves all fit in a LinearBvhNode or a WideBvhNode child: empty leaves are left out and
+   * leaves of more than BVH_MAX_LEAF_SIZE triangles are split, each part with the box of the original leaf
+   * @param root The root node of the tree, not nullptr
+   * @param arena Holds the nodes of the copy when one is needed
+   * @return root itself when every leaf fits, otherwise a copy in arena, nullptr when no leaf has a triangle
+   */
+  const BvhNode* flattenable_tree(const BvhNode* root, NodeArena& arena);
+
+  // Same as above on a view, e.g. of a memory mapped BVH
+  Hit intersect(const LinearBvhView& bvh, const Triangle* tris, const Ray& ray);
+  bool occluded(const LinearBvhView& bvh, const Triangle* tris, const Ray& ray);
+
+  // Same as above over an indexed mesh, for BVHs built from it
+  Hit intersect(const LinearBvh& bvh, const Mesh& mesh, const Ray& ray);
+  bool occluded(const LinearBvh& bvh, const Mesh& mesh, const Ray& ray);
+  Hit intersect(const LinearBvhView& bvh, const Mesh& mesh, const Ray& ray);
+  bool occluded(const LinearBvhView& bvh, const Mesh& mesh, const Ray& ray);
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <linear_bvh.hpp>
+#include <traversal.hpp>
+
+#include <algorithm>
+
+namespace bvh {
+
+  /**
+   * @brief Scalar traversal loop of a flattened BVH, shared by the single ray and the packet traversals.
+   * With ANY_HIT the loop returns at the first hit found.
+   * @param bvh The flattened BVH
+   * @param current The node to start from, its box is tested first
+   * @param tris Accessor to the triangle vertices (TriangleArrayAccessor or MeshAccessor)
+   * @param ray The ray
+   * @param hit The closest hit so far, hit.t bounds the search and is updated with every closer hit
+   * @return true if a hit closer than hit.t was found
+   */
+  template <bool ANY_HIT, typename Accessor>
+  bool traverse_linear(const LinearBvhView& bvh, uint32_t current, const Accessor& tris, const Ray& ray, Hit& hit) {
+    const LinearBvhNode* nodes = bvh.nodes;
+    const int* primitive_indices = bvh.primitive_indices;
+    const bool dir_is_neg[3] = {ray.inv_direction.x < 0.0f, ray.inv_direction.y < 0.0f, ray.inv_direction.z < 0.0f};
+
+    uint32_t stack[BVH_TRAVERSAL_STACK_SIZE];
+    int stack_size = 0;
+    bool found = false;
+
+    while (true) {
+      const LinearBvhNode& node = nodes[current];
+      float tnear;
+      if (intersect_box(node.min, node.max, ray, hit.t, tnear)) {
+        if (node.is_leaf()) {
+          for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+            int tri = primitive_indices[i];
+            float t, u, v;
+            if (intersect_triangle(ray, tris.vertex(tri, 0), tris.vertex(tri, 1), tris.vertex(tri, 2), hit.t, t, u, v)) {
+              hit.triangle = primitive_indices[i];
+              hit.t = t;
+              hit.u = u;
+              hit.v = v;
+              found = true;
+              if (ANY_HIT) {
+                return true;
+              }
+            }
+          }
+        } else {
+          // Visit the child on the side the ray comes from first
+          uint32_t near_child = node.offset;
+          uint32_t far_child = node.offset + 1;
+          if (dir_is_neg[node.axis]) {
+            std::swap(near_child, far_child);
+          }
+          if (stack_size == BVH_TRAVERSAL_STACK_SIZE) {
+            // Tree deeper than the stack: finish the far subtree recursively
+            if (traverse_linear<ANY_HIT>(bvh, far_child, tris, ray, hit)) {
+              found = true;
+              if (ANY_HIT) {
+                return true;
+              }
+            }
+          } else {
+            stack[stack_size++] = far_child;
+          }
+          current = near_child;
+          continue;
+        }
+      }
+
+      if (stack_size == 0) {
+        return found;
+      }
+      current = stack[--stack_size];
+    }
+  }
+
+}
@@ -0,0 +1,157 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <sstream>
+#include <string>
+
+// Log levels, from the most to the least verbose
+#define BVH_LOG_LEVEL_TRACE 0
+#define BVH_LOG_LEVEL_DEBUG 1
+#define BVH_LOG_LEVEL_INFO 2
+#define BVH_LOG_LEVEL_WARN 3
+#define BVH_LOG_LEVEL_ERROR 4
+#define BVH_LOG_LEVEL_OFF 5
+
+// Messages below this level are removed by the compiler, their arguments are never evaluated
+#ifndef BVH_LOG_COMPILE_LEVEL
+#define BVH_LOG_COMPILE_LEVEL BVH_LOG_LEVEL_INFO
+#endif
+
+// Set to 0 to remove the build trace events (see bvh::trace) from the builders
+#ifndef BVH_BUILD_TRACE
+#define BVH_BUILD_TRACE 1
+#endif
+
+/**
+ * @brief Logs a message built with operator<<, e.g. BVH_LOG(DEBUG, "Split at " << mid).
+ *
+ * A message is written when its level is at least BVH_LOG_COMPILE_LEVEL and bvh::log::level().
+ * Below the compile level the statement is dead code; below the runtime level it costs one
+ * relaxed atomic load and the message is not formatted.
+ */
+#define BVH_LOG(level, message)                                                                  \
+  do {                                                                                           \
+    if (BVH_LOG_LEVEL_##level >= BVH_LOG_COMPILE_LEVEL &&                                        \
+        ::bvh::log::enabled(static_cast<::bvh::log::Level>(BVH_LOG_LEVEL_##level))) {            \
+      std::ostringstream bvh_log_stream;                                                         \
+      bvh_log_stream << message;                                                                 \
+      ::bvh::log::write(static_cast<::bvh::log::Level>(BVH_LOG_LEVEL_##level), bvh_log_stream.str()); \
+    }                                                                                            \
+  } while (0)
+
+namespace bvh {
+
+  namespace log {
+
+    enum class Level {
+      Trace = BVH_LOG_LEVEL_TRACE,
+      Debug = BVH_LOG_LEVEL_DEBUG,
+      Info = BVH_LOG_LEVEL_INFO,
+      Warn = BVH_LOG_LEVEL_WARN,
+      Error = BVH_LOG_LEVEL_ERROR,
+      Off = BVH_LOG_LEVEL_OFF
+    };
+
+    namespace detail {
+      extern std::atomic<int> runtime_level;
+    }
+
+    // Runtime level, Info by default. Can be changed at any time from any thread.
+    void set_level(Level level);
+    Level level();
+
+    inline bool enabled(Level level) {
+      return static_cast<int>(level) >= detail::runtime_level.load(std::memory_order_relaxed);
+    }
+
+    // Stream the messages go to, std::cerr by default. The stream must outlive its use.
+    void set_output(std::ostream& output);
+
+    // Writes one line "<Level>: message", lines from different threads are never interleaved
+    void write(Level level, const std::string& message);
+
+  }
+
+  /**
+   * @brief Structured build trace: split decisions and phase timings of the builders, written as
+   * JSON Lines to a file (see docs/build_trace.txt).
+   *
+   * Tracing is off until open() is called. When off, every event costs one relaxed atomic load;
+   * with BVH_BUILD_TRACE set to 0 the events are removed at compile time.
+   */
+  namespace trace {
+
+    namespace detail {
+      extern std::atomic<bool> active;
+    }
+
+    // Starts writing events to path (truncated), returns false if it cannot be opened
+    bool open(const std::string& path);
+
+    // Stops tracing and closes the file
+    void close();
+
+    inline bool enabled() {
+      return BVH_BUILD_TRACE && detail::active.load(std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Split decision of a node.
+     * @param builder Name of the builder ("median", "sah", "parallel"...)
+     * @param depth Depth of the node, the root is 0
+     * @param count Number of triangles of the node
+     * @param left Number of triangles going to the left child
+     * @param axis Split axis, -1 when the node was split without one
+     * @param cost Estimated cost of the split, negative when the builder has none
+     */
+    void split(const char* builder, int depth, int count, int left, int axis, float cost);
+
+    // Leaf created at depth with count triangles
+    void leaf(const char* builder, int depth, int count);
+
+    // Duration of one phase of a build
+    void phase(const char* builder, const char* name, double ms);
+
+    // Whole build of num_tris triangles
+    void build(const char* builder, int num_tris, double ms);
+
+    /**
+     * @brief Times the phases of one build. Each call to phase() reports the time since the
+     * previous one (or since construction), done() reports the whole build.
+     * Does nothing if tracing was off when it was constructed.
+     */
+    class BuildTimer {
+    public:
+      explicit BuildTimer(const char* builder) : builder(builder), active(enabled()) {
+        if (active) {
+          start = last = std::chrono::steady_clock::now();
+        }
+      }
+
+      void phase(const char* name) {
+        if (active) {
+          auto now = std::chrono::steady_clock::now();
+          trace::phase(builder, name, std::chrono::duration<double, std::milli>(now - last).count());
+          last = now;
+        }
+      }
+
+      void done(int num_tris) {
+        if (active) {
+          auto now = std::chrono::steady_clock::now();
+          trace::build(builder, num_tris, std::chrono::duration<double, std::milli>(now - start).count());
+        }
+      }
+
+    private:
+      const char* builder;
+      bool active;
+      std::chrono::steady_clock::time_point start;
+      std::chrono::steady_clock::time_point last;
+    };
+
+  }
+
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include <vec2.hpp>
+#include <vec3.hpp>
+#include <triangle.hpp>
+
+namespace bvh {
+
+  /**
+   * @brief Indexed triangle mesh: shared vertices in SoA streams and 3 indices per triangle.
+   * A vertex is a unique (position, texture coordinate, normal) combination, so a vertex shared by
+   * several triangles is stored once, unlike in the Triangle array.
+   */
+  class Mesh {
+  public:
+    std::vector<float> px, py, pz;    // Positions
+    std::vector<float> nx, ny, nz;    // Normals
+    std::vector<float> u, v;          // Texture coordinates
+    std::vector<uint32_t> indices;    // Vertex indices, 3 per triangle
+    std::vector<uint8_t> smooth;      // Smooth shading flag, 1 per triangle
+
+    int num_triangles() const { return static_cast<int>(smooth.size()); }
+    size_t num_vertices() const { return px.size(); }
+
+    vec3<float> position(uint32_t vertex) const {
+      return vec3<float>(px[vertex], py[vertex], pz[vertex]);
+    }
+
+    // Position of corner k (0, 1 or 2) of a triangle
+    vec3<float> vertex(int tri, int k) const {
+      return position(indices[3 * tri + k]);
+    }
+
+    // Appends a vertex and returns its index
+    uint32_t add_vertex(const vec3<float>& position, const vec2<float>& uv, const vec3<float>& normal);
+
+    // Expands a triangle into the non-indexed representation
+    Triangle triangle(int tri) const;
+
+    // Heap memory used by the streams, in bytes
+    size_t memory_size() const;
+
+    // Releases the capacity left over by add_vertex()
+    void shrink_to_fit();
+
+    /**
+     * @brief Builds an indexed mesh from a triangle array, merging bit-identical vertices
+     * @param tris The triangles
+     * @param num_tris The number of triangles
+     */
+    static Mesh from_triangles(const Triangle* tris, int num_tris);
+  };
+
+  // Uniform access to the vertices of a triangle array or of a mesh, used by the builders and traversals
+  struct TriangleArrayAccessor {
+    const Triangle* tris;
+    const vec3<float>& vertex(int tri, int k) const { return tris[tri].vertices[k]; }
+  };
+
+  struct MeshAccessor {
+    const Mesh* mesh;
+    vec3<float> vertex(int tri, int k) const { return mesh->vertex(tri, k); }
+  };
+
+}
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <triangle.hpp>
+#include <mesh.hpp>
+
+namespace bvh {
+
+  /**
+   * @brief Parses a Wavefront OBJ file into a triangle array.
+   *
+   * The file is memory mapped and split into chunks at line boundaries that are parsed in parallel,
+   * then merged. Supported statements: v, vt, vn, f and s (smoothing on/off). Faces may use the
+   * v, v/vt, v//vn and v/vt/vn forms, negative (relative) indices, and any number of vertices
+   * (polygons are triangulated as fans). Missing texture coordinates and normals are set to 0.
+   *
+   * @param obj_filename The name of the OBJ file
+   * @param triangles Set to the new triangle array (owned by the caller, delete[])
+   * @param num_threads The number of threads, 0 uses the hardware concurrency
+   * @return The number of triangles, -1 on error
+   */
+  int parse_obj_file(const char *obj_filename, Triangle **triangles, int num_threads = 0);
+
+  /**
+   * @brief Parses a Wavefront OBJ file into an indexed mesh, see above for the supported statements.
+   * Corners sharing the same position, texture coordinate and normal indices share one mesh vertex.
+   *
+   * @param obj_filename The name of the OBJ file
+   * @param mesh Set to the parsed mesh, emptied on error
+   * @param num_threads The number of threads, 0 uses the hardware concurrency
+   * @return The number of triangles, -1 on error
+   */
+  int parse_obj_file(const char *obj_filename, Mesh &mesh, int num_threads = 0);
+
+}
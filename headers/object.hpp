@@ -2,11 +2,18 @@
 
 #include <vec3.hpp>
 #include <triangle.hpp>
+#include <mesh.hpp>
 #include <bvh_node.hpp>
+#include <bvh_tree.hpp>
+#include <linear_bvh.hpp>
+#include <ray.hpp>
 
 namespace bvh
 {
 
+  // Queries (intersect, occluded) are const and reentrant, any number of threads can run them on the same
+  // object. refit() and the other writes must not run under them; publish refitted or rebuilt versions
+  // through a SharedObject instead (see docs/thread_safety.txt).
   class Object
   {
   public:
@@ -17,23 +24,51 @@ namespace bvh
     Triangle *triangles; // Triangles stored to represent the surface of the object
     int num_triangles;   // Number of triangles in the object
 
+    Mesh *mesh; // Indexed mesh used instead of the triangles when set, owned by the object
+
     BvhNode *bvh; // Pointer to the root node of the object's BVH
+    BvhTree bvh_tree; // Owns the nodes of bvh when the object was given a BvhTree (always for load()), empty otherwise
+    float bvh_build_cost; // SAH cost of the BVH when it was given to the object, the reference for refit_degradation()
 
     static void build_bvh(char *obj_filename, char *bvh_filename);
 
-    static void save_bvh(char *bvh_filename, BvhNode *bvh);
+    // Saves the BVH in the text format, with the nodes in the order of layout
+    static void save_bvh(char *bvh_filename, BvhNode *bvh, NodeLayout layout = NodeLayout::BreadthFirst);
+
+    // Saves the BVH in the binary format, which load() and MappedBvh read back without parsing. num_triangles
+    // is the number of triangles the BVH was built over, load() only accepts the file for an object with as many.
+    static void save_bvh_binary(char *bvh_filename, BvhNode *bvh, int num_triangles);
 
     static Object *load(char *obj_filename, char *bvh_filename);
 
+    // Same as load() but keeps the triangles as an indexed mesh, with shared vertices stored once
+    static Object *load_indexed(char *obj_filename, char *bvh_filename);
+
     // Method to get the BVH
     BvhNode* getBvh() const {
         return bvh;
     }
+
+    // Closest hit of a ray given in object space, hit.triangle is -1 on a miss
+    Hit intersect(const Ray& ray) const;
+
+    // Whether a ray given in object space hits any triangle of the object
+    bool occluded(const Ray& ray) const;
+
+    // Recomputes the BVH boxes after the vertices of the triangles (or of the mesh) moved
+    void refit(bool parallel = false);
+
+    // Whether refitting has degraded the BVH past max_degradation, see refit_degradation()
+    bool needs_rebuild(float max_degradation = BVH_REFIT_REBUILD_RATIO) const;
     
     ~Object();
     
   public:
     Object(vec3<float> position, vec3<float> rotation, vec3<float> scale, Triangle *triangles, int num_triangles, BvhNode *bvh);
+    Object(vec3<float> position, vec3<float> rotation, vec3<float> scale, Mesh *mesh, BvhNode *bvh);
+    // Same as above, the object takes the tree and frees it with itself
+    Object(vec3<float> position, vec3<float> rotation, vec3<float> scale, Triangle *triangles, int num_triangles, BvhTree &&tree);
+    Object(vec3<float> position, vec3<float> rotation, vec3<float> scale, Mesh *mesh, BvhTree &&tree);
   };
 
   // private:
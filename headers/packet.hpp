@@ -0,0 +1,59 @@
+#pragma once
+
+#include <ray.hpp>
+#include <triangle.hpp>
+#include <mesh.hpp>
+#include <linear_bvh.hpp>
+
+// Number of rays traced together by the packet traversal (one AVX2 lane per ray)
+#define BVH_PACKET_SIZE 8
+
+// A packet with this many active rays or fewer finishes the current subtree one ray at a time
+#define BVH_PACKET_SCALAR_THRESHOLD 2
+
+namespace bvh {
+
+  /**
+   * @brief Finds the closest hits of a packet of rays traced together through a flattened BVH.
+   *
+   * Every node box and leaf triangle is tested against all the rays of the packet at once with AVX2,
+   * rays that miss a node are masked out of its subtree. When no more than BVH_PACKET_SCALAR_THRESHOLD
+   * rays remain active in a subtree, the packet falls back to single ray traversal for it. The results
+   * are the same as calling intersect() on every ray. Without AVX2 the rays are traced one by one.
+   *
+   * @param bvh The flattened BVH, e.g. LinearBvh::view()
+   * @param tris The triangles indexed by the primitive indices of the BVH
+   * @param rays The rays, should be coherent (close origins and directions) to benefit from packets
+   * @param count The number of rays, 1 to BVH_PACKET_SIZE
+   * @param hits Set to the closest hit of each ray, hit.triangle is -1 if nothing was hit
+   */
+  void intersect_packet(const LinearBvhView& bvh, const Triangle* tris, const Ray* rays, int count, Hit* hits);
+
+  /**
+   * @brief Checks which rays of a packet hit any triangle, see intersect_packet()
+   * @param results Set to whether each ray is occluded
+   */
+  void occluded_packet(const LinearBvhView& bvh, const Triangle* tris, const Ray* rays, int count, bool* results);
+
+  /**
+   * @brief Finds the closest hits of any number of rays. The rays are reordered internally by direction
+   * octant and position so that consecutive rays form coherent packets, then traced with intersect_packet().
+   * @param rays The rays, in any order
+   * @param num_rays The number of rays
+   * @param hits Set to the closest hit of each ray, in the order of the rays
+   */
+  void intersect_stream(const LinearBvhView& bvh, const Triangle* tris, const Ray* rays, int num_rays, Hit* hits);
+
+  /**
+   * @brief Checks which of any number of rays hit any triangle, see intersect_stream()
+   * @param results Set to whether each ray is occluded, in the order of the rays
+   */
+  void occluded_stream(const LinearBvhView& bvh, const Triangle* tris, const Ray* rays, int num_rays, bool* results);
+
+  // Same as above over an indexed mesh, for BVHs built from it
+  void intersect_packet(const LinearBvhView& bvh, const Mesh& mesh, const Ray* rays, int count, Hit* hits);
+  void occluded_packet(const LinearBvhView& bvh, const Mesh& mesh, const Ray* rays, int count, bool* results);
+  void intersect_stream(const LinearBvhView& bvh, const Mesh& mesh, const Ray* rays, int num_rays, Hit* hits);
+  void occluded_stream(const LinearBvhView& bvh, const Mesh& mesh, const Ray* rays, int num_rays, bool* results);
+
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <vec3.hpp>
+#include <ray.hpp>
+#include <triangle.hpp>
+#include <mesh.hpp>
+#include <bounding_box.hpp>
+#include <bvh_node.hpp>
+#include <linear_bvh.hpp>
+
+namespace bvh {
+
+  // Node of a quantized BVH: 16 bytes, half of a LinearBvhNode, in the same order (the children of an
+  // internal node are offset and offset + 1). The box is stored as 8-bit coordinates on the grid of the
+  // parent box, rounded outward so that it always contains the exact box.
+  struct QuantizedBvhNode {
+    uint32_t offset;     // Leaf: first entry in primitive_indices, internal node: index of the left child
+    uint8_t qmin[3];     // Bounding box minimum on the grid of the parent
+    uint8_t qmax[3];     // Bounding box maximum on the grid of the parent
+    uint16_t count;      // Number of triangles of a leaf, 0 for internal nodes
+    uint8_t axis;        // Split axis of an internal node, used to visit the nearer child first
+    uint8_t pad[3];
+
+    bool is_leaf() const { return count > 0; }
+  };
+
+  static_assert(sizeof(QuantizedBvhNode) == 16, "QuantizedBvhNode must stay 16 bytes");
+
+  // Grid of 8-bit coordinates over a box, coordinate q is at origin + q * step. The step is a 254th of the
+  // extent rather than a 255th, which keeps coordinate 255 above the box maximum despite float rounding.
+  struct QuantizationGrid {
+    vec3<float> origin;
+    vec3<float> step;
+
+    static QuantizationGrid of(const BoundingBox& box) {
+      // Inverted (empty) boxes get a zero step, their children are never visited
+      vec3<float> extent = vec3<float>::max(box.max - box.min, vec3<float>(0.0f, 0.0f, 0.0f));
+      return {box.min, extent * (1.0f / 254.0f)};
+    }
+
+    // The box of a node whose parent has this grid
+    BoundingBox decode(const QuantizedBvhNode& node) const {
+      return BoundingBox(vec3<float>(origin.x + node.qmin[0] * step.x, origin.y + node.qmin[1] * step.y, origin.z + node.qmin[2] * step.z),
+                         vec3<float>(origin.x + node.qmax[0] * step.x, origin.y + node.qmax[1] * step.y, origin.z + node.qmax[2] * step.z));
+    }
+  };
+
+  class QuantizedBvh {
+  public:
+    std::vector<QuantizedBvhNode> nodes;  // Same order as the LinearBvh it was compressed from, nodes[0] is the root
+    std::vector<int> primitive_indices;   // Triangle indices, each leaf owns a contiguous range
+    BoundingBox bounds;                   // Exact box of the root, the grid of the root node
+
+    /**
+     * @brief Compresses a flattened BVH. Node i of the result is node i of bvh with its box quantized, the
+     * decoded boxes are slightly larger than the exact ones, so traversal visits a few more nodes but
+     * never misses a hit.
+     * @param bvh The flattened BVH
+     */
+    static QuantizedBvh compress(const LinearBvhView& bvh);
+
+    // Same as above from a BvhNode tree, flattened first
+    static QuantizedBvh compress(const BvhNode* root);
+
+    bool empty() const { return nodes.empty(); }
+
+    // Bytes used by the nodes and the primitive indices
+    size_t memory_size() const {
+      return nodes.size() * sizeof(QuantizedBvhNode) + primitive_indices.size() * sizeof(int);
+    }
+  };
+
+  /**
+   * @brief Finds the closest triangle hit by a ray in a quantized BVH
+   * @param bvh The quantized BVH
+   * @param tris The triangles indexed by the primitive indices of the BVH
+   * @param ray The ray, in the same space as the triangles
+   * @return The closest hit, hit.triangle is -1 if nothing was hit
+   */
+  Hit intersect(const QuantizedBvh& bvh, const Triangle* tris, const Ray& ray);
+
+  /**
+   * @brief Checks whether a ray hits any triangle of a quantized BVH
+   * @param bvh The quantized BVH
+   * @param tris The triangles indexed by the primitive indices of the BVH
+   * @param ray The ray, in the same space as the triangles
+   */
+  bool occluded(const QuantizedBvh& bvh, const Triangle* tris, const Ray& ray);
+
+  // Same as above over an indexed mesh, for BVHs built from it
+  Hit intersect(const QuantizedBvh& bvh, const Mesh& mesh, const Ray& ray);
+  bool occluded(const QuantizedBvh& bvh, const Mesh& mesh, const Ray& ray);
+
+}
@@ -0,0 +1,165 @@
+#pragma once
+
+#include <limits>
+#include <vec3.hpp>
+#include <triangle.hpp>
+#include <mesh.hpp>
+#include <bounding_box.hpp>
+#include <bvh_node.hpp>
+#include <thread_pool.hpp>
+
+namespace bvh {
+
+  // Solid sphere
+  struct Sphere {
+    vec3<float> center;
+    float radius;
+  };
+
+  // Plane dot(normal, p) + offset = 0, the side the normal points to is the inside
+  struct Plane {
+    vec3<float> normal;
+    float offset;
+
+    float distance(const vec3<float>& p) const { return vec3<float>::dot(normal, p) + offset; }
+  };
+
+  // Convex volume inside six planes, e.g. the view volume of a camera
+  struct Frustum {
+    Plane planes[6];  // Left, right, bottom, top, near, far
+
+    /**
+     * @brief View volume of a perspective camera
+     * @param eye The position of the camera
+     * @param forward The viewing direction
+     * @param up The up direction, must not be parallel to forward
+     * @param vertical_fov The vertical field of view, in radians
+     * @param aspect The width of the image divided by its height
+     * @param near, far The distances of the clipping planes along forward
+     */
+    static Frustum perspective(const vec3<float>& eye, const vec3<float>& forward, const vec3<float>& up,
+                               float vertical_fov, float aspect, float near, float far);
+  };
+
+  // Two overlapping triangles found by query_pairs(), a from the first BVH and b from the second
+  struct PrimitivePair {
+    int a;
+    int b;
+  };
+
+  // Result of closest_point()
+  struct ClosestPoint {
+    int triangle = -1;  // Index of the closest triangle, -1 if none was found within the search radius
+    vec3<float> point;  // Closest point on that triangle
+    float distance = std::numeric_limits<float>::max();  // Unsigned distance from the query point
+    float u = 0.0f, v = 0.0f;  // Barycentric coordinates of point, v0 + u * (v1 - v0) + v * (v2 - v0) as in Hit
+
+    bool found() const { return triangle != -1; }
+  };
+
+  // The overlap queries below walk a BVH and append the indices of the triangles whose bounding box overlaps (or
+  // touches) a volume. Nodes entirely inside the volume are appended without testing their triangles, so
+  // culling large visible regions costs one test per node.
+  //
+  // Results go to a buffer of the caller and nothing is allocated. Every query returns the number of
+  // matches; only the first capacity are written, a larger return value means the buffer was too small.
+  // Matches come in tree order, a triangle referenced by several leaves (spatial splits, see
+  // precompute_bvh_sbvh) can be reported more than once.
+
+  /**
+   * @brief Finds the triangles overlapping a box
+   * @param root The root node of the BVH, may be nullptr
+   * @param tris The triangles indexed by the leaves of the BVH
+   * @param box The query box, in the space of the triangles
+   * @param indices Receives up to capacity triangle indices
+   * @param capacity The size of indices
+   * @return The number of triangles found, may be larger than capacity
+   */
+  int query_box(const BvhNode* root, const Triangle* tris, const BoundingBox& box, int* indices, int capacity);
+
+  // Same as query_box for the triangles overlapping a sphere
+  int query_sphere(const BvhNode* root, const Triangle* tris, const Sphere& sphere, int* indices, int capacity);
+
+  // Same as query_box for the triangles inside or crossing a frustum. Like most culling tests it is
+  // conservative: a box near an edge of the frustum can be reported without being inside.
+  int query_frustum(const BvhNode* root, const Triangle* tris, const Frustum& frustum, int* indices, int capacity);
+
+  // Same as above over an indexed mesh, for trees built from it
+  int query_box(const BvhNode* root, const Mesh& mesh, const BoundingBox& box, int* indices, int capacity);
+  int query_sphere(const BvhNode* root, const Mesh& mesh, const Sphere& sphere, int* indices, int capacity);
+  int query_frustum(const BvhNode* root, const Mesh& mesh, const Frustum& frustum, int* indices, int capacity);
+
+  /**
+   * @brief Runs many box queries, split across the threads of a pool. Query i writes its triangles to
+   *        indices[i * capacity, (i + 1) * capacity[ and their number to counts[i], as query_box would.
+   * @param root The root node of the BVH, may be nullptr
+   * @param tris The triangles indexed by the leaves of the BVH
+   * @param boxes The query boxes
+   * @param num_queries The number of boxes
+   * @param indices Receives the results, num_queries * capacity entries
+   * @param capacity The number of results kept per query
+   * @param counts Receives the number of triangles found by each query, may be larger than capacity
+   * @param pool The pool running the queries
+   */
+  void query_boxes(const BvhNode* root, const Triangle* tris, const BoundingBox* boxes, int num_queries,
+                   int* indices, int capacity, int* counts, ThreadPool& pool);
+
+  // Same as query_boxes for spheres and frustums
+  void query_spheres(const BvhNode* root, const Triangle* tris, const Sphere* spheres, int num_queries,
+                     int* indices, int capacity, int* counts, ThreadPool& pool);
+  void query_frustums(const BvhNode* root, const Triangle* tris, const Frustum* frustums, int num_queries,
+                      int* indices, int capacity, int* counts, ThreadPool& pool);
+
+  // Same as above over an indexed mesh
+  void query_boxes(const BvhNode* root, const Mesh& mesh, const BoundingBox* boxes, int num_queries,
+                   int* indices, int capacity, int* counts, ThreadPool& pool);
+  void query_spheres(const BvhNode* root, const Mesh& mesh, const Sphere* spheres, int num_queries,
+                     int* indices, int capacity, int* counts, ThreadPool& pool);
+  void query_frustums(const BvhNode* root, const Mesh& mesh, const Frustum* frustums, int num_queries,
+                      int* indices, int capacity, int* counts, ThreadPool& pool);
+
+  /**
+   * @brief Finds the point of the triangles closest to a query point, e.g. for distance fields or snapping.
+   *        Nodes are visited best first, ordered by the distance to their box, and the search radius
+   *        shrinks to the closest triangle found so far; the walk stops once the nearest unvisited box
+   *        is farther than that.
+   * @param root The root node of the BVH, may be nullptr
+   * @param tris The triangles indexed by the leaves of the BVH
+   * @param p The query point, in the space of the triangles
+   * @param max_distance Triangles farther than this are ignored, smaller radii make the query cheaper
+   * @return The closest point, result.triangle is -1 if no triangle is within max_distance
+   */
+  ClosestPoint closest_point(const BvhNode* root, const Triangle* tris, const vec3<float>& p,
+                             float max_distance = std::numeric_limits<float>::max());
+  ClosestPoint closest_point(const BvhNode* root, const Mesh& mesh, const vec3<float>& p,
+                             float max_distance = std::numeric_limits<float>::max());
+
+  /**
+   * @brief Runs closest_point() for many points, split across the threads of a pool
+   * @param points The query points
+   * @param num_points The number of points
+   * @param results Set to the closest point of each query point, in the same order
+   */
+  void closest_points(const BvhNode* root, const Triangle* tris, const vec3<float>* points, int num_points,
+                      ClosestPoint* results, ThreadPool& pool, float max_distance = std::numeric_limits<float>::max());
+  void closest_points(const BvhNode* root, const Mesh& mesh, const vec3<float>* points, int num_points,
+                      ClosestPoint* results, ThreadPool& pool, float max_distance = std::numeric_limits<float>::max());
+
+  /**
+   * @brief Collision broadphase between two BVHs: finds the pairs of triangles, one from each, whose
+   *        bounding boxes overlap. Both trees are descended together, so only overlapping subtrees are
+   *        visited. Both BVHs must be in the same space (transform one set of triangles and refit first).
+   *        Given the same tree twice, finds the pairs of distinct triangles of that tree, each pair once
+   *        with a < b.
+   * @param root_a, tris_a The first BVH and its triangles
+   * @param root_b, tris_b The second BVH and its triangles
+   * @param pairs Receives up to capacity pairs
+   * @param capacity The size of pairs
+   * @return The number of pairs found, may be larger than capacity
+   */
+  int query_pairs(const BvhNode* root_a, const Triangle* tris_a, const BvhNode* root_b, const Triangle* tris_b,
+                  PrimitivePair* pairs, int capacity);
+  int query_pairs(const BvhNode* root_a, const Mesh& mesh_a, const BvhNode* root_b, const Mesh& mesh_b,
+                  PrimitivePair* pairs, int capacity);
+
+}
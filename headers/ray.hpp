@@ -0,0 +1,93 @@
+#pragma once
+
+#include <limits>
+#include <vec3.hpp>
+#include <bounding_box.hpp>
+
+namespace bvh {
+
+  class Ray {
+  public:
+    vec3<float> origin;         // Starting point of the ray
+    vec3<float> direction;      // Direction of the ray, does not need to be normalized
+    vec3<float> inv_direction;  // 1 / direction, precomputed for the slab test
+    float tmin, tmax;           // Valid interval along the ray
+
+    Ray(vec3<float> origin, vec3<float> direction,
+        float tmin = 0.0f, float tmax = std::numeric_limits<float>::max())
+        : origin(origin), direction(direction),
+          inv_direction(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z),
+          tmin(tmin), tmax(tmax) {}
+  };
+
+  class Hit {
+  public:
+    int triangle = -1;  // Index of the closest triangle hit, -1 if nothing was hit
+    float t = std::numeric_limits<float>::max();  // Distance along the ray (in units of direction), this default on every miss
+    float u = 0.0f, v = 0.0f;  // Barycentric coordinates of the hit point
+    int instance = -1;  // Index of the instance hit in a two-level structure (see Tlas), proxy of the object for DynamicBvh, -1 otherwise
+
+    bool hit() const { return triangle != -1; }
+  };
+
+  /**
+   * @brief Slab test between a ray and a box
+   * @param min, max The corners of the box to test
+   * @param ray The ray, its inv_direction must be up to date
+   * @param tmax The current upper bound of the ray interval (closest hit so far)
+   * @param tnear Set to the entry distance of the ray into the box
+   * @return true if the ray enters the box within [ray.tmin, tmax]
+   */
+  inline bool intersect_box(const vec3<float>& min, const vec3<float>& max, const Ray& ray, float tmax, float& tnear) {
+    float tx1 = (min.x - ray.origin.x) * ray.inv_direction.x;
+    float tx2 = (max.x - ray.origin.x) * ray.inv_direction.x;
+    float ty1 = (min.y - ray.origin.y) * ray.inv_direction.y;
+    float ty2 = (max.y - ray.origin.y) * ray.inv_direction.y;
+    float tz1 = (min.z - ray.origin.z) * ray.inv_direction.z;
+    float tz2 = (max.z - ray.origin.z) * ray.inv_direction.z;
+
+    tnear = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::max(std::min(tz1, tz2), ray.tmin));
+    float tfar = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::min(std::max(tz1, tz2), tmax));
+    return tnear <= tfar;
+  }
+
+  inline bool intersect_box(const BoundingBox& box, const Ray& ray, float tmax, float& tnear) {
+    return intersect_box(box.min, box.max, ray, tmax, tnear);
+  }
+
+  /**
+   * @brief Moller-Trumbore ray/triangle intersection
+   * @param ray The ray
+   * @param v0, v1, v2 The vertices of the triangle
+   * @param tmax The current upper bound of the ray interval (closest hit so far)
+   * @param t, u, v Set to the distance and barycentric coordinates of the hit point
+   * @return true if the triangle is hit strictly inside ]ray.tmin, tmax[
+   */
+  inline bool intersect_triangle(const Ray& ray, const vec3<float>& v0, const vec3<float>& v1, const vec3<float>& v2,
+                                 float tmax, float& t, float& u, float& v) {
+    vec3<float> e1 = v1 - v0;
+    vec3<float> e2 = v2 - v0;
+    vec3<float> p = vec3<float>::cross(ray.direction, e2);
+    float det = vec3<float>::dot(e1, p);
+    if (det == 0.0f) {
+      return false; // ray parallel to the triangle plane
+    }
+
+    float inv_det = 1.0f / det;
+    vec3<float> s = ray.origin - v0;
+    u = vec3<float>::dot(s, p) * inv_det;
+    if (u < 0.0f || u > 1.0f) {
+      return false;
+    }
+
+    vec3<float> q = vec3<float>::cross(s, e1);
+    v = vec3<float>::dot(ray.direction, q) * inv_det;
+    if (v < 0.0f || u + v > 1.0f) {
+      return false;
+    }
+
+    t = vec3<float>::dot(e2, q) * inv_det;
+    return t > ray.tmin && t < tmax;
+  }
+
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+namespace bvh {
+
+#ifdef __AVX2__
+
+  // Lane-wise std::min(a, b) and std::max(a, b), including which operand is returned for NaN,
+  // so that the SIMD and the single ray traversals take the same decisions
+  inline __m256 lane_min(__m256 a, __m256 b) { return _mm256_min_ps(b, a); }
+  inline __m256 lane_max(__m256 a, __m256 b) { return _mm256_max_ps(b, a); }
+  inline __m128 lane_min(__m128 a, __m128 b) { return _mm_min_ps(b, a); }
+  inline __m128 lane_max(__m128 a, __m128 b) { return _mm_max_ps(b, a); }
+
+#endif
+
+}
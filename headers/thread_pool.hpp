@@ -0,0 +1,99 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace bvh {
+
+  /**
+   * @brief Work-stealing thread pool.
+   *
+   * Every worker owns a deque: it pushes and pops its own tasks at the back (depth first),
+   * and idle workers steal from the front of the others (largest, oldest tasks first).
+   * Tasks submitted from outside the pool go to a shared queue.
+   * The thread that waits on a TaskGroup runs tasks too, so nested waits never deadlock.
+   */
+  class ThreadPool {
+  public:
+    /**
+     * @param num_threads Number of threads taking part in the work, including the thread that
+     *        waits on the tasks. 0 uses std::thread::hardware_concurrency().
+     */
+    explicit ThreadPool(int num_threads = 0);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Number of threads taking part in the work, including the waiting thread
+    int num_threads() const { return static_cast<int>(workers.size()) + 1; }
+
+    // Queues a task. Tasks must not throw, wrap them in a TaskGroup to forward exceptions.
+    void submit(std::function<void()> task);
+
+    // Runs one queued task on the calling thread, returns false if none was available
+    bool run_one();
+
+    // Index of the calling worker in its own pool, in [1, num_threads[, 0 for any thread outside a pool. Names
+    // the thread in logs; use worker_index() to pick per-thread data of a given pool.
+    static int current_worker();
+
+    // Index of the calling thread among the workers of this pool, in [1, num_threads[, -1 for any other thread
+    // (threads waiting on its tasks, workers of other pools)
+    int worker_index() const;
+
+  private:
+    struct WorkQueue {
+      std::mutex mutex;
+      std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::thread> workers;
+    std::vector<std::unique_ptr<WorkQueue>> queues;  // queues[0] is the shared queue
+    std::atomic<int> num_queued{0};
+    std::atomic<bool> stopping{false};
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+
+    bool pop_task(int worker, std::function<void()>& task);
+    void worker_loop(int worker);
+  };
+
+  /**
+   * @brief Set of tasks that can be waited on together.
+   * The first exception thrown by a task is rethrown by wait().
+   */
+  class TaskGroup {
+  public:
+    explicit TaskGroup(ThreadPool& pool) : pool(pool) {}
+    ~TaskGroup();
+
+    void run(std::function<void()> task);
+
+    // Runs queued tasks on the calling thread until every task of the group has finished
+    void wait();
+
+  private:
+    ThreadPool& pool;
+    std::atomic<int> pending{0};
+    std::mutex error_mutex;
+    std::exception_ptr error;
+  };
+
+  /**
+   * @brief Runs body(begin, end) over [0, count[ split into chunks of at least grain_size items
+   * @param pool The pool running the chunks
+   * @param count The number of items
+   * @param grain_size The minimum number of items per chunk
+   * @param body The function called on each chunk
+   */
+  void parallel_for(ThreadPool& pool, size_t count, size_t grain_size, const std::function<void(size_t, size_t)>& body);
+
+}
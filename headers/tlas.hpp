@@ -0,0 +1,78 @@
+#pragma once
+
+#include <vector>
+#include <ray.hpp>
+#include <object.hpp>
+#include <transform.hpp>
+#include <linear_bvh.hpp>
+
+// Maximum number of instances in a leaf of the top-level BVH
+#define BVH_TLAS_LEAF_SIZE 2
+
+namespace bvh {
+
+  // Placement of a shared object in the world
+  struct Instance {
+    const Object* object;  // The geometry and its bottom-level BVH, in object space, not owned
+    Transform to_world;    // Object to world transform
+    Transform to_object;   // Inverse of to_world
+    BoundingBox bounds;    // World space box of the object's BVH root
+  };
+
+  /**
+   * @brief Two-level acceleration structure: a top-level BVH over instances, each referencing the
+   * bottom-level BVH of an Object. Several instances can share one object. Rays are transformed
+   * into object space at the instances, so bottom-level BVHs are never rebuilt when instances move.
+   */
+  class Tlas {
+  public:
+    std::vector<Instance> instances;
+    LinearBvh top;  // Top-level BVH, its primitive indices are instance indices
+
+    /**
+     * @brief Adds an instance placed with the object's position, rotation and scale
+     * @return The index of the instance
+     */
+    int add_instance(const Object* object);
+
+    /**
+     * @brief Adds an instance of an object with an explicit object to world transform
+     * @return The index of the instance
+     */
+    int add_instance(const Object* object, const Transform& to_world);
+
+    /**
+     * @brief Moves an instance. Call build() or refit() once all the instances have moved.
+     */
+    void set_transform(int instance, const Transform& to_world);
+
+    /**
+     * @brief Recomputes the world box of an instance from the current root box of its object's BVH,
+     * e.g. after Object::refit(). refit() does it for every instance.
+     */
+    void update_bounds(int instance);
+
+    /**
+     * @brief Rebuilds the top-level BVH from the instance boxes, median split along the longest axis.
+     * Costs O(n log n) in the number of instances and never touches the triangles.
+     */
+    void build();
+
+    /**
+     * @brief Updates the boxes of the top-level BVH after instances moved or their objects were refitted,
+     * keeping its tree. Costs O(n) in the number of instances; prefer build() once the instances have moved
+     * far from their neighbours.
+     */
+    void refit();
+
+    /**
+     * @brief Finds the closest hit of a world space ray among all the instances
+     * @return The closest hit, hit.instance and hit.triangle are -1 if nothing was hit
+     */
+    Hit intersect(const Ray& ray) const;
+
+    // Whether a world space ray hits any instance
+    bool occluded(const Ray& ray) const;
+  };
+
+}
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <cmath>
+#include <vec3.hpp>
+#include <bounding_box.hpp>
+
+namespace bvh {
+
+  /**
+   * @brief Affine transform stored as a 3x4 row-major matrix: a linear part m[i][0..2] and a translation m[i][3]
+   */
+  class Transform {
+  public:
+    float m[3][4];
+
+    // Identity transform
+    Transform() : m{{1.0f, 0.0f, 0.0f, 0.0f}, {0.0f, 1.0f, 0.0f, 0.0f}, {0.0f, 0.0f, 1.0f, 0.0f}} {}
+
+    /**
+     * @brief Object to world transform of an object: scale first, then rotate, then translate
+     * @param position The translation
+     * @param rotation Euler angles in radians, applied around x, then y, then z
+     * @param scale The scale along each axis
+     */
+    static Transform from_object(const vec3<float>& position, const vec3<float>& rotation, const vec3<float>& scale) {
+      float cx = std::cos(rotation.x), sx = std::sin(rotation.x);
+      float cy = std::cos(rotation.y), sy = std::sin(rotation.y);
+      float cz = std::cos(rotation.z), sz = std::sin(rotation.z);
+
+      // R = Rz * Ry * Rx
+      float r[3][3] = {
+        {cz * cy, cz * sy * sx - sz * cx, cz * sy * cx + sz * sx},
+        {sz * cy, sz * sy * sx + cz * cx, sz * sy * cx - cz * sx},
+        {-sy, cy * sx, cy * cx}
+      };
+
+      Transform t;
+      for (int i = 0; i < 3; i++) {
+        t.m[i][0] = r[i][0] * scale.x;
+        t.m[i][1] = r[i][1] * scale.y;
+        t.m[i][2] = r[i][2] * scale.z;
+        t.m[i][3] = position[i];
+      }
+      return t;
+    }
+
+    vec3<float> point(const vec3<float>& p) const {
+      return vec3<float>(m[0][0] * p.x + m[0][1] * p.y + m[0][2] * p.z + m[0][3],
+                         m[1][0] * p.x + m[1][1] * p.y + m[1][2] * p.z + m[1][3],
+                         m[2][0] * p.x + m[2][1] * p.y + m[2][2] * p.z + m[2][3]);
+    }
+
+    // Applies the linear part only, for directions
+    vec3<float> vector(const vec3<float>& v) const {
+      return vec3<float>(m[0][0] * v.x + m[0][1] * v.y + m[0][2] * v.z,
+                         m[1][0] * v.x + m[1][1] * v.y + m[1][2] * v.z,
+                         m[2][0] * v.x + m[2][1] * v.y + m[2][2] * v.z);
+    }
+
+    // Box containing the transformed box, computed from the matrix terms instead of the 8 corners (Arvo)
+    BoundingBox box(const BoundingBox& b) const {
+      float lo[3], hi[3];
+      for (int i = 0; i < 3; i++) {
+        lo[i] = hi[i] = m[i][3];
+        for (int j = 0; j < 3; j++) {
+          float a = m[i][j] * b.min[j];
+          float c = m[i][j] * b.max[j];
+          lo[i] += std::min(a, c);
+          hi[i] += std::max(a, c);
+        }
+      }
+      return BoundingBox(vec3<float>(lo[0], lo[1], lo[2]), vec3<float>(hi[0], hi[1], hi[2]));
+    }
+
+    // Inverse transform, the linear part must be invertible (no zero scale)
+    Transform inverse() const {
+      float det = m[0][0] * (m[1][1] * m[2][2] - m[1][2] * m[2][1]) -
+                  m[0][1] * (m[1][0] * m[2][2] - m[1][2] * m[2][0]) +
+                  m[0][2] * (m[1][0] * m[2][1] - m[1][1] * m[2][0]);
+      float inv_det = 1.0f / det;
+
+      Transform t;
+      t.m[0][0] = (m[1][1] * m[2][2] - m[1][2] * m[2][1]) * inv_det;
+      t.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+      t.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+      t.m[1][0] = (m[1][2] * m[2][0] - m[1][0] * m[2][2]) * inv_det;
+      t.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+      t.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+      t.m[2][0] = (m[1][0] * m[2][1] - m[1][1] * m[2][0]) * inv_det;
+      t.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+      t.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+
+      vec3<float> translation = t.vector(vec3<float>(m[0][3], m[1][3], m[2][3]));
+      t.m[0][3] = -translation.x;
+      t.m[1][3] = -translation.y;
+      t.m[2][3] = -translation.z;
+      return t;
+    }
+  };
+
+}
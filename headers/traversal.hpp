@@ -0,0 +1,35 @@
+#pragma once
+
+#include <ray.hpp>
+#include <triangle.hpp>
+#include <mesh.hpp>
+#include <bvh_node.hpp>
+
+// Size of the fixed traversal stack, deeper trees fall back to recursion. The stack is an array in the frame
+// of each query, so concurrent queries never share it and never allocate (see docs/thread_safety.txt).
+#define BVH_TRAVERSAL_STACK_SIZE 64
+
+namespace bvh {
+
+  /**
+   * @brief Finds the closest triangle hit by a ray. Children are visited nearest first.
+   * @param root The root node of the BVH
+   * @param tris The triangles indexed by the leaves of the BVH
+   * @param ray The ray, in the same space as the triangles
+   * @return The closest hit, hit.triangle is -1 if nothing was hit
+   */
+  Hit intersect(const BvhNode* root, const Triangle* tris, const Ray& ray);
+
+  /**
+   * @brief Checks whether a ray hits any triangle. Stops at the first hit found.
+   * @param root The root node of the BVH
+   * @param tris The triangles indexed by the leaves of the BVH
+   * @param ray The ray, in the same space as the triangles
+   */
+  bool occluded(const BvhNode* root, const Triangle* tris, const Ray& ray);
+
+  // Same as above over an indexed mesh, for trees built from it
+  Hit intersect(const BvhNode* root, const Mesh& mesh, const Ray& ray);
+  bool occluded(const BvhNode* root, const Mesh& mesh, const Ray& ray);
+
+}
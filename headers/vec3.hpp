@@ -17,6 +17,11 @@ namespace bvh {
         return vec3<T>(this->x + other.x, this->y + other.y, this->z + other.z);
     }
 
+    // Define the multiplication operator by a scalar
+    vec3<T> operator*(T scalar) const {
+        return vec3<T>(this->x * scalar, this->y * scalar, this->z * scalar);
+    }
+
     // Define the division operator by a scalar
     vec3<T> operator/(T scalar) const {
         return vec3<T>(this->x / scalar, this->y / scalar, this->z / scalar);
@@ -27,6 +32,11 @@ namespace bvh {
         return vec3<T>(this->x - other.x, this->y - other.y, this->z - other.z);
     }
 
+    // Access a component by axis index (0 = x, 1 = y, 2 = z)
+    T operator[](int axis) const {
+        return axis == 0 ? x : (axis == 1 ? y : z);
+    }
+
     bool operator==(const vec3<T>& other) const {
             return (x == other.x) && (y == other.y) && (z == other.z);
     }
@@ -40,6 +50,20 @@ namespace bvh {
         return os;
     }
 
+    // Static method to get the dot product of two vec3
+    static T dot(const vec3<T>& a, const vec3<T>& b) {
+        return a.x * b.x + a.y * b.y + a.z * b.z;
+    }
+
+    // Static method to get the cross product of two vec3
+    static vec3<T> cross(const vec3<T>& a, const vec3<T>& b) {
+        return vec3<T>(
+            a.y * b.z - a.z * b.y,
+            a.z * b.x - a.x * b.z,
+            a.x * b.y - a.y * b.x
+        );
+    }
+
     // Static method to get the minimum of two vec3
     static vec3<T> min(const vec3<T>& a, const vec3<T>& b) {
         return vec3<T>(
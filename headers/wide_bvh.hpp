@@ -0,0 +1,84 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+#include <ray.hpp>
+#include <triangle.hpp>
+#include <mesh.hpp>
+#include <bvh_node.hpp>
+
+namespace bvh {
+
+  /**
+   * @brief Node of an N-wide BVH (N = 4 or 8). The bounds of the children are stored in SoA form so that
+   * a ray is tested against all of them in one SIMD pass.
+   * Children are stored in slots [0, num_children). A child with count 0 is an internal node (child is its
+   * node index), otherwise it is a leaf (child is its first entry in primitive_indices).
+   */
+  template <int N>
+  struct alignas(N * sizeof(float)) WideBvhNode {
+    float min_x[N], min_y[N], min_z[N];
+    float max_x[N], max_y[N], max_z[N];
+    uint32_t child[N];
+    uint16_t count[N];
+    uint8_t num_children;
+  };
+
+  /**
+   * @brief N-wide BVH collapsed from a binary BvhNode tree, see WideBvh::collapse()
+   */
+  template <int N>
+  class WideBvh {
+  public:
+    std::vector<WideBvhNode<N>> nodes;     // Root first
+    std::vector<int> primitive_indices;    // Triangle indices of the leaves, each leaf is a contiguous range
+
+    /**
+     * @brief Collapses a binary tree into an N-wide tree. Each wide node starts with the two children of a
+     * binary node and repeatedly opens the internal child with the largest surface area, replacing it with
+     * its own children, until N children are reached. With all the children of a node tested together,
+     * opening a child saves its traversal step, which the SAH weights by its surface area, so the largest
+     * child is the one whose collapse lowers the SAH cost the most.
+     * Empty leaves are left out and leaves of more than BVH_MAX_LEAF_SIZE triangles are split, see flattenable_tree().
+     * @param root The root node of the binary tree, nullptr gives an empty BVH
+     */
+    static WideBvh collapse(const BvhNode* root);
+
+    bool empty() const { return nodes.empty(); }
+
+    // Bytes used by the nodes and the primitive indices
+    size_t memory_size() const {
+      return nodes.size() * sizeof(WideBvhNode<N>) + primitive_indices.size() * sizeof(int);
+    }
+  };
+
+  typedef WideBvh<4> Bvh4;
+  typedef WideBvh<8> Bvh8;
+
+  /**
+   * @brief Finds the closest triangle hit by a ray in a wide BVH. All the children boxes of a node are
+   * tested at once (SSE for BVH4, AVX2 for BVH8) and the children hit are visited by increasing distance.
+   * @param bvh The wide BVH
+   * @param tris The triangles indexed by the primitive indices of the BVH
+   * @param ray The ray, in the same space as the triangles
+   * @return The closest hit, hit.triangle is -1 if nothing was hit
+   */
+  template <int N>
+  Hit intersect(const WideBvh<N>& bvh, const Triangle* tris, const Ray& ray);
+
+  /**
+   * @brief Checks whether a ray hits any triangle of a wide BVH
+   * @param bvh The wide BVH
+   * @param tris The triangles indexed by the primitive indices of the BVH
+   * @param ray The ray, in the same space as the triangles
+   */
+  template <int N>
+  bool occluded(const WideBvh<N>& bvh, const Triangle* tris, const Ray& ray);
+
+  // Same as above over an indexed mesh, for BVHs built from it
+  template <int N>
+  Hit intersect(const WideBvh<N>& bvh, const Mesh& mesh, const Ray& ray);
+  template <int N>
+  bool occluded(const WideBvh<N>& bvh, const Mesh& mesh, const Ray& ray);
+
+}
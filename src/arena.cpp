@@ -0,0 +1,83 @@
+#include <arena.hpp>
+
+#include <algorithm>
+#include <cstdint>
+
+namespace bvh {
+
+NodeArena::NodeArena(size_t block_size) : block_size(block_size), owner(std::this_thread::get_id()) {}
+
+NodeArena::~NodeArena() {
+    for (char* block : blocks) {
+        ::operator delete(block);
+    }
+}
+
+void* NodeArena::allocate(size_t size, size_t alignment) {
+    uintptr_t address = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+    if (cursor == nullptr || address + size > reinterpret_cast<uintptr_t>(limit)) {
+        // Requests larger than a block get a block of their own
+        size_t bytes = std::max(block_size, size + alignment);
+        char* block = static_cast<char*>(::operator new(bytes));
+        blocks.push_back(block);
+        cursor = block;
+        limit = block + bytes;
+        address = (reinterpret_cast<uintptr_t>(cursor) + alignment - 1) & ~static_cast<uintptr_t>(alignment - 1);
+    }
+
+    cursor = reinterpret_cast<char*>(address + size);
+    used += size;
+    return reinterpret_cast<void*>(address);
+}
+
+void NodeArena::reserve_threads(const ThreadPool& pool) {
+    owner = std::this_thread::get_id();
+    while (static_cast<int>(thread_arenas.size()) < pool.num_threads() - 1) {
+        thread_arenas.push_back(std::make_unique<NodeArena>(block_size));
+    }
+}
+
+NodeArena& NodeArena::thread_arena(const ThreadPool& pool) {
+    int worker = pool.worker_index();
+    if (worker > 0 && worker <= static_cast<int>(thread_arenas.size())) {
+        return *thread_arenas[worker - 1];
+    }
+    std::thread::id id = std::this_thread::get_id();
+    if (id == owner) {
+        return *this;
+    }
+
+    // Another thread ran a task of the pool while waiting on its own work, it must not share an arena
+    std::lock_guard<std::mutex> lock(outside_mutex);
+    for (auto& entry : outside_arenas) {
+        if (entry.first == id) {
+            return *entry.second;
+        }
+    }
+    outside_arenas.emplace_back(id, std::make_unique<NodeArena>(block_size));
+    return *outside_arenas.back().second;
+}
+
+size_t NodeArena::bytes_used() const {
+    size_t total = used;
+    for (const auto& arena : thread_arenas) {
+        total += arena->bytes_used();
+    }
+    for (const auto& entry : outside_arenas) {
+        total += entry.second->bytes_used();
+    }
+    return total;
+}
+
+size_t NodeArena::num_blocks() const {
+    size_t total = blocks.size();
+    for (const auto& arena : thread_arenas) {
+        total += arena->num_blocks();
+    }
+    for (const auto& entry : outside_arenas) {
+        total += entry.second->num_blocks();
+    }
+    return total;
+}
+
+}
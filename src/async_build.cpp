@@ -0,0 +1,123 @@
+#include <async_build.hpp>
+#include <bvh_tree.hpp>
+#include <linear_bvh.hpp>
+#include <obj_loader.hpp>
+#include <log.hpp>
+
+#include <chrono>
+#include <functional>
+#include <stdexcept>
+
+namespace bvh {
+
+Hit SharedObject::intersect(const Ray& ray) const {
+    std::shared_ptr<const Object> object = acquire();
+    if (object == nullptr) {
+        return Hit();
+    }
+    return object->intersect(ray);
+}
+
+bool SharedObject::occluded(const Ray& ray) const {
+    std::shared_ptr<const Object> object = acquire();
+    return object != nullptr && object->occluded(ray);
+}
+
+std::shared_ptr<const Object> SharedObject::publish_refit(Triangle* tris) {
+    std::shared_ptr<const Object> current = acquire();
+    if (current == nullptr) {
+        BVH_LOG(ERROR, "publish_refit() on an empty slot, nothing to refit");
+        delete[] tris;
+        return nullptr;
+    }
+    BvhTree tree = BvhTree::from_linear(LinearBvh::flatten(current->getBvh()).view());
+    std::shared_ptr<Object> next = std::make_shared<Object>(current->position, current->rotation, current->scale, tris,
+                                                            current->num_triangles, std::move(tree));
+    // Degradation is measured against the tree as it was built, not against the copy
+    next->bvh_build_cost = current->bvh_build_cost;
+    next->refit();
+    return publish(next);
+}
+
+// Builds the object around the triangles and publishes it, the triangles are freed if anything throws
+static std::shared_ptr<Object> build_object(Triangle* tris, int num_tris, SharedObject* target, const BuildSettings& settings) {
+    std::unique_ptr<Triangle[]> owned(tris);
+    if (settings.monitor->cancel_requested()) {
+        throw BuildCancelled();
+    }
+    BvhTree tree = BvhTree::sah(tris, 0, num_tris, 16, settings);
+    std::shared_ptr<Object> object = std::make_shared<Object>(vec3<float>(0.0f, 0.0f, 0.0f), vec3<float>(0.0f, 0.0f, 0.0f),
+                                                              vec3<float>(1.0f, 1.0f, 1.0f), owned.release(), num_tris, std::move(tree));
+    settings.monitor->finish();
+    if (target != nullptr) {
+        target->publish(object);
+    }
+    return object;
+}
+
+using ObjectFuture = std::future<std::shared_ptr<Object>>;
+
+// Runs job on the pool, its result or exception goes to the future of the handle
+static ObjectFuture run_async(ThreadPool& pool, std::function<std::shared_ptr<Object>()> job) {
+    std::shared_ptr<std::promise<std::shared_ptr<Object>>> promise = std::make_shared<std::promise<std::shared_ptr<Object>>>();
+    ObjectFuture result = promise->get_future();
+    pool.submit([promise, job = std::move(job)]() {
+        try {
+            promise->set_value(job());
+        } catch (const BuildCancelled&) {
+            BVH_LOG(DEBUG, "Background build cancelled");
+            promise->set_exception(std::current_exception());
+        } catch (...) {
+            promise->set_exception(std::current_exception());
+        }
+    });
+    return result;
+}
+
+AsyncBuild AsyncBuild::start(ThreadPool& pool, Triangle* tris, int num_tris, SharedObject* target, const BuildSettings& settings) {
+    std::shared_ptr<BuildMonitor> monitor = std::make_shared<BuildMonitor>(num_tris);
+    BuildSettings build_settings = settings;
+    build_settings.monitor = monitor.get();
+    // The job holds the monitor too, the handle can be dropped while the build runs
+    ObjectFuture result = run_async(pool, [tris, num_tris, target, build_settings, monitor]() {
+        return build_object(tris, num_tris, target, build_settings);
+    });
+    return AsyncBuild(pool, std::move(monitor), std::move(result));
+}
+
+AsyncBuild AsyncBuild::load(ThreadPool& pool, const std::string& obj_filename, SharedObject* target, const BuildSettings& settings) {
+    // The number of triangles is only known once the file is parsed, progress() stays at 0 until then
+    std::shared_ptr<BuildMonitor> monitor = std::make_shared<BuildMonitor>(0);
+    ObjectFuture result = run_async(pool, [obj_filename, target, settings, monitor]() {
+        Triangle* tris = nullptr;
+        int num_tris = parse_obj_file(obj_filename.c_str(), &tris, 1);
+        if (num_tris <= 0) {
+            delete[] tris;
+            throw std::runtime_error("Could not load triangles from " + obj_filename);
+        }
+        monitor->set_total(num_tris);
+        BuildSettings build_settings = settings;
+        build_settings.monitor = monitor.get();
+        return build_object(tris, num_tris, target, build_settings);
+    });
+    return AsyncBuild(pool, std::move(monitor), std::move(result));
+}
+
+bool AsyncBuild::ready() const {
+    return result.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+}
+
+void AsyncBuild::wait() {
+    while (!ready()) {
+        if (!pool->run_one()) {
+            result.wait_for(std::chrono::milliseconds(1));
+        }
+    }
+}
+
+std::shared_ptr<Object> AsyncBuild::get() {
+    wait();
+    return result.get();
+}
+
+}
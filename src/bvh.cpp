@@ -1,8 +1,9 @@
 #include <limits>
 #include <vector>
 #include <bvh.hpp>
+#include <bvh_tree.hpp>
 #include <algorithm>
-#include <iostream>
+#include <log.hpp>
 #include "object.hpp"
 
 namespace bvh{
@@ -39,181 +40,156 @@ namespace bvh{
         }
     }
     
-static BvhNode* precompute_helper(Triangle* tris, std::vector<int> index_list, int start, int end){
-    int num_tris = end - start;
-
-    // Handle empty or invalid input
-    if (start < 0 || end > start+num_tris || start >= end || index_list.data() == nullptr) {
-      return nullptr; // Return null for invalid ranges
-    }
-
-    // Initialize bounding box values
-    float min_x = std::numeric_limits<float>::max();
-    float min_y = std::numeric_limits<float>::max();
-    float min_z = std::numeric_limits<float>::max();
-    float max_x = std::numeric_limits<float>::lowest();
-    float max_y = std::numeric_limits<float>::lowest();
-    float max_z = std::numeric_limits<float>::lowest();
-    std::vector<int> indices(index_list.begin() + start, index_list.begin() + end);
-
-    // Calculate the bounding box
-    for (int i = 0; i < num_tris; i++) {
-        for (int j = 0; j < 3; j++) {
-            const vec3<float>& vertex = tris[indices[i]].vertices[j];
-            min_x = std::min(min_x, vertex.x);
-            min_y = std::min(min_y, vertex.y);
-            min_z = std::min(min_z, vertex.z);
-            max_x = std::max(max_x, vertex.x);
-            max_y = std::max(max_y, vertex.y);
-            max_z = std::max(max_z, vertex.z);
+// Builds the subtree over indices[0, count[, which holds the triangles of ranks [0, count[ of this range in
+// the median order. The range is split in place with std::nth_element: both halves get the same triangles a
+// full sort would give them, and only leaves are sorted, so the tree is the one a full sort builds.
+// Boxes are merged from the children, the vertices of a triangle are only read again at its leaf.
+template <typename Allocator>
+static BvhNode* precompute_helper(Triangle* tris, int* indices, int count, int depth, const CentroidLess& less,
+                                  const BuildSettings& settings, const Allocator& alloc){
+    if (count <= settings.max_leaf_size || settings.forces_leaf(count, depth)) {
+        std::sort(indices, indices + count, less);
+        BoundingBox box = BoundingBox::empty();
+        for (int i = 0; i < count; i++) {
+            for (int j = 0; j < 3; j++) {
+                box.expand(tris[indices[i]].vertices[j]);
+            }
         }
-    }
-
-    // Construct the bounding box for the current node
-    vec3<float> min(min_x, min_y, min_z);
-    vec3<float> max(max_x, max_y, max_z);
-
-    if (num_tris <= BVH_LEAF_SIZE) {
-        return new BvhLeaf(min, max, num_tris, indices.data());
+        if (trace::enabled()) {
+            trace::leaf("median", depth, count);
+        }
+        if (settings.monitor != nullptr) {
+            settings.monitor->leaf_done(count);
+        }
+        return alloc.leaf(box.min, box.max, count, indices);
     }
 
     // Split the triangles in half
-    int mid = start + num_tris / 2;
+    int mid = count / 2;
+    std::nth_element(indices, indices + mid, indices + count, less);
+    if (trace::enabled()) {
+        trace::split("median", depth, count, mid, -1, -1.0f);
+    }
 
     // Recursively build the left and right child nodes
-    BvhNode* leftChild = precompute_helper(tris,index_list, start, mid);
-    BvhNode* rightChild = precompute_helper(tris,index_list, mid, end); // Use end here
+    BvhNode* leftChild = precompute_helper(tris, indices, mid, depth + 1, less, settings, alloc);
+    BvhNode* rightChild = precompute_helper(tris, indices + mid, count - mid, depth + 1, less, settings, alloc);
 
     // Create and return an internal node with the bounding box and child nodes
-    BvhNode* node = new BvhNode(min, max);
+    BoundingBox box = leftChild->bounding_box;
+    box.expand(rightChild->bounding_box);
+    BvhNode* node = alloc.node(box.min, box.max);
     node->left = leftChild;
     node->right = rightChild;
 
     return node;
 }
 
-// TODO: optimize - sort using triangle bounds instead of centroids
-BvhNode* precompute_bvh(Triangle* tris, int start, int end) {
+template <typename Allocator>
+static BvhNode* build_median(Triangle* tris, int start, int end, const BuildSettings& settings, const Allocator& alloc) {
     int num_tris = end - start;
 
     // Handle empty or invalid input
-    if (start < 0 || end > start+num_tris || start >= end || tris == nullptr) {
+    if (start < 0 || start >= end || tris == nullptr) {
       return nullptr; // Return null for invalid ranges
     }
-
-    // Initialize bounding box values
-    float min_x = std::numeric_limits<float>::max();
-    float min_y = std::numeric_limits<float>::max();
-    float min_z = std::numeric_limits<float>::max();
-    float max_x = std::numeric_limits<float>::lowest();
-    float max_y = std::numeric_limits<float>::lowest();
-    float max_z = std::numeric_limits<float>::lowest();
+    trace::BuildTimer timer("median");
 
     // Calculate the bounding box
+    BoundingBox box = BoundingBox::empty();
     for (int i = start; i < end; i++) {
         for (int j = 0; j < 3; j++) {
-            const vec3<float>& vertex = tris[i].vertices[j];
-            min_x = std::min(min_x, vertex.x);
-            min_y = std::min(min_y, vertex.y);
-            min_z = std::min(min_z, vertex.z);
-            max_x = std::max(max_x, vertex.x);
-            max_y = std::max(max_y, vertex.y);
-            max_z = std::max(max_z, vertex.z);
+            box.expand(tris[i].vertices[j]);
         }
     }
 
-    // Construct the bounding box for the current node
-    vec3<float> min(min_x, min_y, min_z);
-    vec3<float> max(max_x, max_y, max_z);
-
-    // Compute the centroids of the triangles to decide on partitioning
-    std::vector<vec3<float>> centroids(end - start);
-    for (int i = start; i < end; i++) {
-        centroids[i - start] = (tris[i].vertices[0] + tris[i].vertices[1] + tris[i].vertices[2]) / 3.0f;
-        std::cout << "Centroid: " << centroids[i - start] << "for triangle" << i << std::endl;
-    }
-
-    // Initialize indices
-    std::vector<int> indices(centroids.size());
-    for (int i = 0; i < indices.size(); i++) {
-        indices[i] = i;  // Fill with 0, 1, 2, ..., N-1
+    // Handle the leaf case, the triangles stay in input order
+    std::vector<int> indices(num_tris);
+    for (int i = 0; i < num_tris; i++) {
+        indices[i] = start + i;  // Fill with start, start + 1, ..., end - 1
     }
-
-    int splitAxis = chooseSplitAxis(BoundingBox(min, max));
-
-    // Sort indices based on the longest axis
-    std::sort(indices.begin(), indices.end(), [&centroids, splitAxis](int a, int b) {
-    if (splitAxis == 0) {
-        return centroids[a].x < centroids[b].x;
-    } else if (splitAxis == 1) {
-        return centroids[a].y < centroids[b].y;
-    } else {
-        return centroids[a].z < centroids[b].z;
+    if (num_tris <= settings.max_leaf_size || settings.forces_leaf(num_tris, 0)) {
+        if (trace::enabled()) {
+            trace::leaf("median", 0, num_tris);
+        }
+        timer.done(num_tris);
+        return alloc.leaf(box.min, box.max, num_tris, indices.data());
     }
-});
 
-    // After sorting, update the triangles based on the sorted indices
-    std::vector<bvh::Triangle> sortedTris(end - start);
-    for (int i = 0; i < indices.size(); i++) {
-        std::cout << "Index: " << indices[i] << std::endl;
-        sortedTris[i] = tris[start + indices[i]];
+    // Only the centroid coordinate along the longest axis is needed to partition
+    int splitAxis = chooseSplitAxis(box);
+    std::vector<float> keys(num_tris);
+    for (int i = start; i < end; i++) {
+        keys[i - start] = (tris[i].vertices[0][splitAxis] + tris[i].vertices[1][splitAxis] +
+                           tris[i].vertices[2][splitAxis]) / 3.0f;
     }
+    timer.phase("centroids");
 
-    // Handle the leaf case MAYBE MOVE THIS AFTER SORTING
-    if (num_tris <= BVH_LEAF_SIZE) {
-        std::vector<int> indices(num_tris);
-        for (int i = 0; i < num_tris; i++) {
-            indices[i] = start + i;  // Store triangle indices
-        }
-        return new BvhLeaf(min, max, num_tris, indices.data());
+    // Split the triangles in half (ranks in the median order)
+    CentroidLess less(keys.data(), start);
+    int mid = num_tris / 2;
+    std::nth_element(indices.begin(), indices.begin() + mid, indices.end(), less);
+    if (trace::enabled()) {
+        trace::split("median", 0, num_tris, mid, splitAxis, -1.0f);
     }
 
-    // Split the triangles in half
-    int mid = start + num_tris / 2;
-
     // Recursively build the left and right child nodes
-    BvhNode* leftChild = precompute_helper(tris, indices, start, mid);
-    BvhNode* rightChild = precompute_helper(tris, indices, mid, end); // Use end here
+    BvhNode* leftChild = precompute_helper(tris, indices.data(), mid, 1, less, settings, alloc);
+    BvhNode* rightChild = precompute_helper(tris, indices.data() + mid, num_tris - mid, 1, less, settings, alloc);
 
     // Create and return an internal node with the bounding box and child nodes
-    BvhNode* node = new BvhNode(min, max);
+    BvhNode* node = alloc.node(box.min, box.max);
     node->left = leftChild;
     node->right = rightChild;
+    timer.phase("hierarchy");
+    timer.done(num_tris);
 
     return node;
 }
 
-BvhNode* build_bvh_recursion(std::vector<BvhNode*>& bvhNodes, int start, int end) {
+BvhNode* precompute_bvh(Triangle* tris, int start, int end, const BuildSettings& settings) {
+    return build_median(tris, start, end, settings.clamped(), HeapNodeAllocator());
+}
+
+BvhTree BvhTree::median(Triangle* tris, int start, int end, const BuildSettings& settings) {
+    std::unique_ptr<NodeArena> arena = std::make_unique<NodeArena>();
+    BvhNode* root = build_median(tris, start, end, settings.clamped(), ArenaNodeAllocator{arena.get()});
+    return root ? BvhTree(std::move(arena), root) : BvhTree();
+}
+
+template <typename Allocator>
+static BvhNode* build_bvh_recursion(std::vector<BvhNode*>& bvhNodes, int start, int end, const Allocator& alloc) {
     size_t bvhSize = end - start;
 
     // Base case: only one BVH node
     if (bvhSize == 1) {
-        std::cout << "Assigning node: " << bvhNodes[start] << std::endl;
+        BVH_LOG(TRACE, "Assigning node: " << bvhNodes[start]);
         return bvhNodes[start];
     }
     // Case with exactly two BVH nodes
     else if (bvhSize == 2) {
-        BvhNode* parentBvh = new BvhNode();
+        BvhNode* parentBvh = alloc.node(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0));
         parentBvh->bounding_box = computeCombinedBoundingBox({bvhNodes[start], bvhNodes[start + 1]});
         parentBvh->left = bvhNodes[start];
         parentBvh->right = bvhNodes[start + 1];
-        std::cout << "Assigning left: " << bvhNodes[start] << ", right: " << bvhNodes[start + 1] << std::endl;
+        BVH_LOG(TRACE, "Assigning left: " << bvhNodes[start] << ", right: " << bvhNodes[start + 1]);
         return parentBvh;
     }
 
     // More than two nodes: recursively split
     size_t midIndex = start + bvhSize / 2;
-    BvhNode* parentBvh = new BvhNode();
-    parentBvh->left = build_bvh_recursion(bvhNodes, start, midIndex);
-    parentBvh->right = build_bvh_recursion(bvhNodes, midIndex, end);
+    BvhNode* parentBvh = alloc.node(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0));
+    parentBvh->left = build_bvh_recursion(bvhNodes, start, midIndex, alloc);
+    parentBvh->right = build_bvh_recursion(bvhNodes, midIndex, end, alloc);
 
     // Combine bounding boxes of the left and right child nodes
     parentBvh->bounding_box = computeCombinedBoundingBox({parentBvh->left, parentBvh->right});
-    std::cout << "Returning parent: " << parentBvh << std::endl;
+    BVH_LOG(TRACE, "Returning parent: " << parentBvh);
     return parentBvh;
 }
 
-BvhNode* build_bvh_from_objects(Object* objs, int num_objs, int start) {
+template <typename Allocator>
+static BvhNode* build_from_objects(Object* objs, int num_objs, int start, const Allocator& alloc) {
     std::vector<BvhNode*> bvhNodes;
 
     // Collect BVH nodes from objects
@@ -230,10 +206,20 @@ BvhNode* build_bvh_from_objects(Object* objs, int num_objs, int start) {
 
     // Start recursive BVH building
     if (!bvhNodes.empty()) {
-        return build_bvh_recursion(bvhNodes, 0, bvhNodes.size());
+        return build_bvh_recursion(bvhNodes, 0, bvhNodes.size(), alloc);
     } else {
         return nullptr;
     }
 }
 
+BvhNode* build_bvh_from_objects(Object* objs, int num_objs, int start) {
+    return build_from_objects(objs, num_objs, start, HeapNodeAllocator());
+}
+
+BvhTree BvhTree::from_objects(Object* objs, int num_objs, int start) {
+    std::unique_ptr<NodeArena> arena = std::make_unique<NodeArena>();
+    BvhNode* root = build_from_objects(objs, num_objs, start, ArenaNodeAllocator{arena.get()});
+    return BvhTree(std::move(arena), root);
+}
+
 }
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include <bvh_binary.hpp>
+#include <log.hpp>
+
+#include <cstdio>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bvh {
+
+static const uint32_t BVH_BINARY_ENDIAN_TAG = 0x01020304;
+
+uint64_t fnv1a64(const void* data, size_t size, uint64_t hash) {
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (size_t i = 0; i < size; i++) {
+        hash ^= bytes[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+bool save_bvh_binary(const char* bvh_filename, const LinearBvh& bvh, uint32_t num_triangles) {
+    FILE* file = fopen(bvh_filename, "wb");
+    if (!file) {
+        BVH_LOG(ERROR, "Could not open file " << bvh_filename << " for writing.");
+        return false;
+    }
+
+    size_t nodes_size = bvh.nodes.size() * sizeof(LinearBvhNode);
+    size_t indices_size = bvh.primitive_indices.size() * sizeof(int);
+
+    BvhBinaryHeader header;
+    std::memset(&header, 0, sizeof(header));
+    std::memcpy(header.magic, BVH_BINARY_MAGIC, 4);
+    header.version = BVH_BINARY_VERSION;
+    header.endian_tag = BVH_BINARY_ENDIAN_TAG;
+    header.header_size = sizeof(BvhBinaryHeader);
+    header.node_size = sizeof(LinearBvhNode);
+    header.num_nodes = bvh.nodes.size();
+    header.num_primitives = bvh.primitive_indices.size();
+    header.num_triangles = num_triangles;
+    header.checksum = fnv1a64(bvh.primitive_indices.data(), indices_size, fnv1a64(bvh.nodes.data(), nodes_size));
+    header.file_size = sizeof(BvhBinaryHeader) + nodes_size + indices_size;
+
+    bool ok = fwrite(&header, sizeof(header), 1, file) == 1;
+    ok = ok && (nodes_size == 0 || fwrite(bvh.nodes.data(), nodes_size, 1, file) == 1);
+    ok = ok && (indices_size == 0 || fwrite(bvh.primitive_indices.data(), indices_size, 1, file) == 1);
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok) {
+        BVH_LOG(ERROR, "Could not write file " << bvh_filename);
+    }
+    return ok;
+}
+
+bool is_bvh_binary(const char* bvh_filename) {
+    FILE* file = fopen(bvh_filename, "rb");
+    if (!file) {
+        return false;
+    }
+    char magic[4];
+    bool binary = fread(magic, 1, 4, file) == 4 && std::memcmp(magic, BVH_BINARY_MAGIC, 4) == 0;
+    fclose(file);
+    return binary;
+}
+
+// Checks that every child and primitive range of the node array stays in bounds, that children come after
+// their parent (which also rules out cycles) and that every primitive index is one of the num_triangles triangles
+static bool verify_structure(const LinearBvhView& bvh, uint32_t num_triangles) {
+    for (uint32_t i = 0; i < bvh.num_nodes; i++) {
+        const LinearBvhNode& node = bvh.nodes[i];
+        if (node.is_leaf()) {
+            if (node.offset > bvh.num_primitives || node.count > bvh.num_primitives - node.offset) {
+                return false;
+            }
+        } else if (node.offset <= i || node.offset >= bvh.num_nodes - 1 || node.axis > 2) {
+            return false;
+        }
+    }
+    for (uint32_t i = 0; i < bvh.num_primitives; i++) {
+        if (bvh.primitive_indices[i] < 0 || static_cast<uint32_t>(bvh.primitive_indices[i]) >= num_triangles) {
+            return false;
+        }
+    }
+    return true;
+}
+
+MappedBvh::MappedBvh(void* data, size_t size) : data(data), size(size) {
+    const BvhBinaryHeader& h = header();
+    const char* bytes = static_cast<const char*>(data);
+    bvh_view.nodes = reinterpret_cast<const LinearBvhNode*>(bytes + h.header_size);
+    bvh_view.num_nodes = h.num_nodes;
+    bvh_view.primitive_indices = reinterpret_cast<const int*>(bytes + h.header_size + h.num_nodes * sizeof(LinearBvhNode));
+    bvh_view.num_primitives = h.num_primitives;
+}
+
+MappedBvh::~MappedBvh() {
+    munmap(data, size);
+}
+
+MappedBvh* MappedBvh::open(const char* bvh_filename, bool verify) {
+    int fd = ::open(bvh_filename, O_RDONLY);
+    if (fd < 0) {
+        BVH_LOG(ERROR, "Could not open file " << bvh_filename);
+        return nullptr;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(BvhBinaryHeader)) {
+        BVH_LOG(ERROR, bvh_filename << " is too small to be a binary BVH file");
+        close(fd);
+        return nullptr;
+    }
+
+    size_t size = st.st_size;
+    void* data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd); // the mapping keeps the file alive
+    if (data == MAP_FAILED) {
+        BVH_LOG(ERROR, "Could not map file " << bvh_filename);
+        return nullptr;
+    }
+
+    const BvhBinaryHeader* header = static_cast<const BvhBinaryHeader*>(data);
+    const char* error = nullptr;
+    if (std::memcmp(header->magic, BVH_BINARY_MAGIC, 4) != 0) {
+        error = "bad magic";
+    } else if (header->version != BVH_BINARY_VERSION) {
+        error = "unsupported version";
+    } else if (header->endian_tag != BVH_BINARY_ENDIAN_TAG) {
+        error = "saved with a different byte order";
+    } else if (header->header_size != sizeof(BvhBinaryHeader) || header->node_size != sizeof(LinearBvhNode)) {
+        error = "unsupported layout";
+    } else if (header->file_size != size ||
+               size != sizeof(BvhBinaryHeader) + (uint64_t)header->num_nodes * sizeof(LinearBvhNode) +
+                       (uint64_t)header->num_primitives * sizeof(int)) {
+        error = "truncated file";
+    } else if (header->num_primitives > 0 && header->num_triangles == 0) {
+        error = "no triangle count";
+    }
+
+    if (error == nullptr && verify) {
+        const char* payload = static_cast<const char*>(data) + sizeof(BvhBinaryHeader);
+        if (fnv1a64(payload, size - sizeof(BvhBinaryHeader)) != header->checksum) {
+            error = "checksum mismatch";
+        }
+    }
+
+    if (error != nullptr) {
+        BVH_LOG(ERROR, bvh_filename << " is not a valid binary BVH file (" << error << ")");
+        munmap(data, size);
+        return nullptr;
+    }
+
+    MappedBvh* mapped = new MappedBvh(data, size);
+    if (verify && !verify_structure(mapped->view(), header->num_triangles)) {
+        BVH_LOG(ERROR, bvh_filename << " is not a valid binary BVH file (offset or index out of bounds)");
+        delete mapped;
+        return nullptr;
+    }
+    return mapped;
+}
+
+}
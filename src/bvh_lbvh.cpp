@@ -0,0 +1,493 @@
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+#include <mutex>
+#include <bvh.hpp>
+#include <bvh_tree.hpp>
+#include <log.hpp>
+
+namespace bvh {
+
+// Ranges at least this large are built as separate tasks, smaller ones recurse on the same thread
+static const int LBVH_SUBTREE_THRESHOLD = 4096;
+// Minimum number of triangles per task when computing the codes
+static const size_t LBVH_CODE_GRAIN = 1 << 14;
+// Minimum number of keys per chunk of the radix sort
+static const size_t LBVH_SORT_GRAIN = 1 << 15;
+// The radix sort handles this many bits per pass
+static const int LBVH_RADIX_BITS = 8;
+static const int LBVH_RADIX_SIZE = 1 << LBVH_RADIX_BITS;
+
+// Spreads the lower 10 bits of x so that there are two zero bits between each
+static uint32_t spread_bits_10(uint32_t x) {
+    x &= 0x3ff;
+    x = (x | (x << 16)) & 0x030000ff;
+    x = (x | (x << 8)) & 0x0300f00f;
+    x = (x | (x << 4)) & 0x030c30c3;
+    x = (x | (x << 2)) & 0x09249249;
+    return x;
+}
+
+// Spreads the lower 21 bits of x so that there are two zero bits between each
+static uint64_t spread_bits_21(uint64_t x) {
+    x &= 0x1fffff;
+    x = (x | (x << 32)) & 0x001f00000000ffffull;
+    x = (x | (x << 16)) & 0x001f0000ff0000ffull;
+    x = (x | (x << 8)) & 0x100f00f00f00f00full;
+    x = (x | (x << 4)) & 0x10c30c30c30c30c3ull;
+    x = (x | (x << 2)) & 0x1249249249249249ull;
+    return x;
+}
+
+// Morton code of a point quantized on 2^bits cells per axis, 30-bit codes in 32-bit keys and 63-bit codes in 64-bit keys
+template <typename Key>
+struct MortonEncoder;
+
+template <>
+struct MortonEncoder<uint32_t> {
+    static const int bits = 10;
+    static uint32_t encode(uint32_t x, uint32_t y, uint32_t z) {
+        return (spread_bits_10(x) << 2) | (spread_bits_10(y) << 1) | spread_bits_10(z);
+    }
+};
+
+template <>
+struct MortonEncoder<uint64_t> {
+    static const int bits = 21;
+    static uint64_t encode(uint32_t x, uint32_t y, uint32_t z) {
+        return (spread_bits_21(x) << 2) | (spread_bits_21(y) << 1) | spread_bits_21(z);
+    }
+};
+
+static uint32_t quantize(float value, float min, float scale, uint32_t max) {
+    float q = (value - min) * scale;
+    if (!(q > 0.0f)) {
+        return 0;
+    }
+    return std::min(static_cast<uint32_t>(q), max);
+}
+
+// Per-triangle data shared by the whole build, indexed by absolute triangle index - base
+template <typename Key>
+struct LbvhContext {
+    std::vector<BoundingBox> bounds;
+    std::vector<Key> keys;    // Sorted Morton codes
+    std::vector<int> indices; // Triangle indices in the order of keys
+    int base;
+    bool agglomerate;
+    BuildSettings settings;
+};
+
+// Stable LSD radix sort of (key, value) pairs. Every pass counts the digits of each chunk in parallel,
+// turns the counts into per-chunk offsets and scatters the chunks in parallel. Being stable, the order
+// does not depend on the number of chunks.
+template <typename Key>
+static void parallel_radix_sort(ThreadPool& pool, std::vector<Key>& keys, std::vector<int>& values, int key_bits) {
+    size_t count = keys.size();
+    size_t num_chunks = std::max<size_t>(1, std::min<size_t>(pool.num_threads() * 2, count / LBVH_SORT_GRAIN));
+    std::vector<size_t> bounds(num_chunks + 1);
+    for (size_t i = 0; i <= num_chunks; i++) {
+        bounds[i] = count * i / num_chunks;
+    }
+
+    std::vector<Key> key_buffer(count);
+    std::vector<int> value_buffer(count);
+    std::vector<size_t> offsets(num_chunks * LBVH_RADIX_SIZE);
+
+    for (int shift = 0; shift < key_bits; shift += LBVH_RADIX_BITS) {
+        TaskGroup group(pool);
+        for (size_t c = 0; c < num_chunks; c++) {
+            group.run([&, c]() {
+                size_t* histogram = &offsets[c * LBVH_RADIX_SIZE];
+                std::fill(histogram, histogram + LBVH_RADIX_SIZE, 0);
+                for (size_t i = bounds[c]; i < bounds[c + 1]; i++) {
+                    histogram[(keys[i] >> shift) & (LBVH_RADIX_SIZE - 1)]++;
+                }
+            });
+        }
+        group.wait();
+
+        // Every chunk writes its keys of a digit after those of the same digit in the previous chunks
+        size_t sum = 0;
+        for (int digit = 0; digit < LBVH_RADIX_SIZE; digit++) {
+            for (size_t c = 0; c < num_chunks; c++) {
+                size_t n = offsets[c * LBVH_RADIX_SIZE + digit];
+                offsets[c * LBVH_RADIX_SIZE + digit] = sum;
+                sum += n;
+            }
+        }
+
+        for (size_t c = 0; c < num_chunks; c++) {
+            group.run([&, c]() {
+                size_t* offset = &offsets[c * LBVH_RADIX_SIZE];
+                for (size_t i = bounds[c]; i < bounds[c + 1]; i++) {
+                    size_t to = offset[(keys[i] >> shift) & (LBVH_RADIX_SIZE - 1)]++;
+                    key_buffer[to] = keys[i];
+                    value_buffer[to] = values[i];
+                }
+            });
+        }
+        group.wait();
+
+        keys.swap(key_buffer);
+        values.swap(value_buffer);
+    }
+}
+
+static inline int highest_bit(uint64_t x) {
+    return 63 - __builtin_clzll(x);
+}
+
+// First position of [begin, end[ whose key has the highest bit differing between the first and last keys set,
+// the middle when every key is the same
+template <typename Key>
+static int find_split(const std::vector<Key>& keys, int begin, int end) {
+    Key first = keys[begin];
+    Key last = keys[end - 1];
+    if (first == last) {
+        return begin + (end - begin) / 2;
+    }
+
+    int bit = highest_bit(static_cast<uint64_t>(first ^ last));
+    Key threshold = (last >> bit) << bit;
+    return static_cast<int>(std::lower_bound(keys.begin() + begin, keys.begin() + end, threshold) - keys.begin());
+}
+
+// Clusters of the agglomerative clustering of one range, in SoA form. Clusters [0, count[ are the triangles,
+// every merge appends one cluster.
+struct LbvhClusters {
+    float min_x[2 * BVH_LBVH_CLUSTER_SIZE], min_y[2 * BVH_LBVH_CLUSTER_SIZE], min_z[2 * BVH_LBVH_CLUSTER_SIZE];
+    float max_x[2 * BVH_LBVH_CLUSTER_SIZE], max_y[2 * BVH_LBVH_CLUSTER_SIZE], max_z[2 * BVH_LBVH_CLUSTER_SIZE];
+    int left[2 * BVH_LBVH_CLUSTER_SIZE], right[2 * BVH_LBVH_CLUSTER_SIZE];  // Merged clusters, -1 for a triangle
+    int count[2 * BVH_LBVH_CLUSTER_SIZE];    // Number of triangles
+    float cost[2 * BVH_LBVH_CLUSTER_SIZE];   // SAH cost of the subtree, in half surface areas
+    bool leaf[2 * BVH_LBVH_CLUSTER_SIZE];    // Emitted as a single leaf
+
+    // Half the surface area of the union of two clusters, the factor 2 does not change any comparison
+    float merged_area(int a, int b) const {
+        float dx = std::max(max_x[a], max_x[b]) - std::min(min_x[a], min_x[b]);
+        float dy = std::max(max_y[a], max_y[b]) - std::min(min_y[a], min_y[b]);
+        float dz = std::max(max_z[a], max_z[b]) - std::min(min_z[a], min_z[b]);
+        return dx * dy + dy * dz + dz * dx;
+    }
+};
+
+// Closest active cluster to i, the one giving the smallest merged box
+static int nearest_cluster(const LbvhClusters& clusters, const int* active, int num_active, int i, float& area) {
+    int best = -1;
+    area = std::numeric_limits<float>::max();
+    for (int k = 0; k < num_active; k++) {
+        int j = active[k];
+        if (j == i) {
+            continue;
+        }
+        float a = clusters.merged_area(i, j);
+        if (a < area) {
+            area = a;
+            best = j;
+        }
+    }
+    return best;
+}
+
+static void collect_cluster_indices(const LbvhClusters& clusters, const int* indices, int c, int* out, int& n) {
+    if (clusters.left[c] == -1) {
+        out[n++] = indices[c];
+        return;
+    }
+    collect_cluster_indices(clusters, indices, clusters.left[c], out, n);
+    collect_cluster_indices(clusters, indices, clusters.right[c], out, n);
+}
+
+template <typename Allocator>
+static BvhNode* emit_cluster(const LbvhClusters& clusters, const int* indices, int c, const Allocator& alloc) {
+    vec3<float> min(clusters.min_x[c], clusters.min_y[c], clusters.min_z[c]);
+    vec3<float> max(clusters.max_x[c], clusters.max_y[c], clusters.max_z[c]);
+    if (clusters.leaf[c]) {
+        int leaf_indices[BVH_LBVH_CLUSTER_SIZE];
+        int n = 0;
+        collect_cluster_indices(clusters, indices, c, leaf_indices, n);
+        return alloc.leaf(min, max, n, leaf_indices);
+    }
+
+    BvhNode* node = alloc.node(min, max);
+    node->left = emit_cluster(clusters, indices, clusters.left[c], alloc);
+    node->right = emit_cluster(clusters, indices, clusters.right[c], alloc);
+    return node;
+}
+
+// Builds the subtree of a small range bottom-up, always merging the two clusters whose union has the smallest
+// surface area. Each cluster caches its nearest neighbour, so only the clusters that pointed to a merged one
+// search again. A cluster becomes a leaf when that is allowed and not more expensive than its children.
+template <typename Key, typename Allocator>
+static BvhNode* agglomerate_range(ThreadPool& pool, const LbvhContext<Key>& ctx, int begin, int end, const Allocator& alloc) {
+    int num_tris = end - begin;
+    const int* indices = &ctx.indices[begin];
+    LbvhClusters clusters;
+    int active[BVH_LBVH_CLUSTER_SIZE] = {};
+    int nearest[2 * BVH_LBVH_CLUSTER_SIZE];
+    float nearest_area[2 * BVH_LBVH_CLUSTER_SIZE];
+
+    for (int i = 0; i < num_tris; i++) {
+        const BoundingBox& box = ctx.bounds[indices[i] - ctx.base];
+        clusters.min_x[i] = box.min.x;
+        clusters.min_y[i] = box.min.y;
+        clusters.min_z[i] = box.min.z;
+        clusters.max_x[i] = box.max.x;
+        clusters.max_y[i] = box.max.y;
+        clusters.max_z[i] = box.max.z;
+        clusters.left[i] = -1;
+        clusters.right[i] = -1;
+        clusters.count[i] = 1;
+        clusters.cost[i] = ctx.settings.intersection_cost * clusters.merged_area(i, i);
+        clusters.leaf[i] = true;
+        active[i] = i;
+        nearest_area[i] = std::numeric_limits<float>::max();
+    }
+
+    // Every pair is measured once for the initial neighbours
+    for (int i = 0; i < num_tris; i++) {
+        for (int j = i + 1; j < num_tris; j++) {
+            float area = clusters.merged_area(i, j);
+            if (area < nearest_area[i]) {
+                nearest_area[i] = area;
+                nearest[i] = j;
+            }
+            if (area < nearest_area[j]) {
+                nearest_area[j] = area;
+                nearest[j] = i;
+            }
+        }
+    }
+
+    int num_active = num_tris;
+    int num_clusters = num_tris;
+    while (num_active > 1) {
+        int best = 0;
+        for (int k = 1; k < num_active; k++) {
+            if (nearest_area[active[k]] < nearest_area[active[best]]) {
+                best = k;
+            }
+        }
+        int a = active[best];
+        int b = nearest[a];
+
+        int c = num_clusters++;
+        clusters.min_x[c] = std::min(clusters.min_x[a], clusters.min_x[b]);
+        clusters.min_y[c] = std::min(clusters.min_y[a], clusters.min_y[b]);
+        clusters.min_z[c] = std::min(clusters.min_z[a], clusters.min_z[b]);
+        clusters.max_x[c] = std::max(clusters.max_x[a], clusters.max_x[b]);
+        clusters.max_y[c] = std::max(clusters.max_y[a], clusters.max_y[b]);
+        clusters.max_z[c] = std::max(clusters.max_z[a], clusters.max_z[b]);
+        clusters.left[c] = a;
+        clusters.right[c] = b;
+        clusters.count[c] = clusters.count[a] + clusters.count[b];
+        float area = nearest_area[a];
+        float split_cost = ctx.settings.traversal_cost * area + clusters.cost[a] + clusters.cost[b];
+        float leaf_cost = ctx.settings.intersection_cost * area * clusters.count[c];
+        clusters.leaf[c] = clusters.count[c] <= ctx.settings.min_leaf_size ||
+                           (clusters.count[c] <= ctx.settings.max_leaf_size && leaf_cost <= split_cost);
+        clusters.cost[c] = clusters.leaf[c] ? leaf_cost : split_cost;
+
+        // Replace a with the merged cluster and remove b
+        for (int k = 0; k < num_active; k++) {
+            if (active[k] == a) {
+                active[k] = c;
+            } else if (active[k] == b) {
+                active[k] = active[--num_active];
+                k--;
+            }
+        }
+
+        nearest[c] = nearest_cluster(clusters, active, num_active, c, nearest_area[c]);
+        for (int k = 0; k < num_active; k++) {
+            int i = active[k];
+            if (i == c) {
+                continue;
+            }
+            if (nearest[i] == a || nearest[i] == b) {
+                nearest[i] = nearest_cluster(clusters, active, num_active, i, nearest_area[i]);
+            } else {
+                float merged_with_c = clusters.merged_area(i, c);
+                if (merged_with_c < nearest_area[i]) {
+                    nearest[i] = c;
+                    nearest_area[i] = merged_with_c;
+                }
+            }
+        }
+    }
+
+    return emit_cluster(clusters, indices, active[0], alloc.local(pool));
+}
+
+template <typename Key, typename Allocator>
+static BvhNode* lbvh_helper(ThreadPool& pool, const LbvhContext<Key>& ctx, int begin, int end, int depth, const Allocator& alloc) {
+    int count = end - begin;
+    bool forced_leaf = ctx.settings.forces_leaf(count, depth);
+    // A cluster tree can be count - 1 levels deep, ranges too close to the maximum depth keep the Morton split
+    if (!forced_leaf && ctx.agglomerate && count <= BVH_LBVH_CLUSTER_SIZE && depth + count - 1 <= ctx.settings.max_depth) {
+        if (ctx.settings.monitor != nullptr) {
+            ctx.settings.monitor->leaf_done(count);
+        }
+        return agglomerate_range(pool, ctx, begin, end, alloc);
+    }
+
+    if (forced_leaf || count <= ctx.settings.max_leaf_size) {
+        BoundingBox box = BoundingBox::empty();
+        for (int i = begin; i < end; i++) {
+            box.expand(ctx.bounds[ctx.indices[i] - ctx.base]);
+        }
+        if (trace::enabled()) {
+            trace::leaf(ctx.agglomerate ? "lbvh" : "lbvh_plain", depth, count);
+        }
+        if (ctx.settings.monitor != nullptr) {
+            ctx.settings.monitor->leaf_done(count);
+        }
+        return alloc.local(pool).leaf(box.min, box.max, count, &ctx.indices[begin]);
+    }
+
+    int split = find_split(ctx.keys, begin, end);
+    if (trace::enabled()) {
+        trace::split(ctx.agglomerate ? "lbvh" : "lbvh_plain", depth, count, split - begin, -1, -1.0f);
+    }
+    BvhNode* left;
+    BvhNode* right;
+    if (count >= LBVH_SUBTREE_THRESHOLD) {
+        TaskGroup group(pool);
+        group.run([&]() { left = lbvh_helper(pool, ctx, begin, split, depth + 1, alloc); });
+        right = lbvh_helper(pool, ctx, split, end, depth + 1, alloc);
+        group.wait();
+    } else {
+        left = lbvh_helper(pool, ctx, begin, split, depth + 1, alloc);
+        right = lbvh_helper(pool, ctx, split, end, depth + 1, alloc);
+    }
+
+    BoundingBox box = left->bounding_box;
+    box.expand(right->bounding_box);
+    BvhNode* node = alloc.local(pool).node(box.min, box.max);
+    node->left = left;
+    node->right = right;
+    return node;
+}
+
+template <typename Key, typename Accessor, typename Allocator>
+static BvhNode* build_lbvh(const Accessor& tris, int start, int end, ThreadPool& pool, bool agglomerate,
+                           const BuildSettings& settings, const Allocator& alloc) {
+    int num_tris = end - start;
+    trace::BuildTimer timer(agglomerate ? "lbvh" : "lbvh_plain");
+    LbvhContext<Key> ctx;
+    ctx.base = start;
+    ctx.agglomerate = agglomerate;
+    ctx.settings = settings.clamped();
+    ctx.bounds.resize(num_tris);
+    ctx.keys.resize(num_tris);
+    ctx.indices.resize(num_tris);
+
+    // Triangle bounds and the bounds of their centroids, in which the codes are quantized
+    BoundingBox centroid_bounds = BoundingBox::empty();
+    std::mutex bounds_mutex;
+    parallel_for(pool, num_tris, LBVH_CODE_GRAIN, [&](size_t begin, size_t end) {
+        BoundingBox local = BoundingBox::empty();
+        for (size_t i = begin; i < end; i++) {
+            BoundingBox box = BoundingBox::empty();
+            box.expand(tris.vertex(start + i, 0));
+            box.expand(tris.vertex(start + i, 1));
+            box.expand(tris.vertex(start + i, 2));
+            ctx.bounds[i] = box;
+            local.expand(box.centroid());
+        }
+        std::lock_guard<std::mutex> lock(bounds_mutex);
+        centroid_bounds.expand(local);
+    });
+    timer.phase("bounds");
+
+    const uint32_t max_cell = (1u << MortonEncoder<Key>::bits) - 1;
+    vec3<float> extent = centroid_bounds.max - centroid_bounds.min;
+    vec3<float> scale(extent.x > 0.0f ? max_cell / extent.x : 0.0f,
+                      extent.y > 0.0f ? max_cell / extent.y : 0.0f,
+                      extent.z > 0.0f ? max_cell / extent.z : 0.0f);
+    parallel_for(pool, num_tris, LBVH_CODE_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            vec3<float> c = ctx.bounds[i].centroid();
+            ctx.keys[i] = MortonEncoder<Key>::encode(quantize(c.x, centroid_bounds.min.x, scale.x, max_cell),
+                                                     quantize(c.y, centroid_bounds.min.y, scale.y, max_cell),
+                                                     quantize(c.z, centroid_bounds.min.z, scale.z, max_cell));
+            ctx.indices[i] = start + i;
+        }
+    });
+    timer.phase("codes");
+
+    parallel_radix_sort(pool, ctx.keys, ctx.indices, 3 * MortonEncoder<Key>::bits);
+    timer.phase("sort");
+
+    BvhNode* root = lbvh_helper(pool, ctx, 0, num_tris, 0, alloc);
+    timer.phase("hierarchy");
+    timer.done(num_tris);
+    return root;
+}
+
+template <typename Accessor, typename Allocator>
+static BvhNode* build_lbvh(const Accessor& tris, int start, int end, ThreadPool& pool, const LbvhOptions& options,
+                           const BuildSettings& settings, const Allocator& alloc) {
+    if (options.morton_bits > 30) {
+        return build_lbvh<uint64_t>(tris, start, end, pool, options.agglomerate, settings, alloc);
+    }
+    return build_lbvh<uint32_t>(tris, start, end, pool, options.agglomerate, settings, alloc);
+}
+
+BvhNode* precompute_bvh_lbvh(Triangle* tris, int start, int end, ThreadPool& pool, const LbvhOptions& options, const BuildSettings& settings) {
+    // Handle empty or invalid input
+    if (start < 0 || start >= end || tris == nullptr) {
+        return nullptr;
+    }
+    return build_lbvh(TriangleArrayAccessor{tris}, start, end, pool, options, settings, HeapNodeAllocator());
+}
+
+BvhNode* precompute_bvh_lbvh(Triangle* tris, int start, int end, int num_threads, const LbvhOptions& options, const BuildSettings& settings) {
+    ThreadPool pool(num_threads);
+    return precompute_bvh_lbvh(tris, start, end, pool, options, settings);
+}
+
+BvhNode* precompute_bvh_lbvh(const Mesh& mesh, ThreadPool& pool, const LbvhOptions& options, const BuildSettings& settings) {
+    if (mesh.num_triangles() == 0) {
+        return nullptr;
+    }
+    return build_lbvh(MeshAccessor{&mesh}, 0, mesh.num_triangles(), pool, options, settings, HeapNodeAllocator());
+}
+
+BvhNode* precompute_bvh_lbvh(const Mesh& mesh, int num_threads, const LbvhOptions& options, const BuildSettings& settings) {
+    ThreadPool pool(num_threads);
+    return precompute_bvh_lbvh(mesh, pool, options, settings);
+}
+
+BvhTree BvhTree::lbvh(Triangle* tris, int start, int end, ThreadPool& pool, const LbvhOptions& options, const BuildSettings& settings) {
+    if (start < 0 || start >= end || tris == nullptr) {
+        return BvhTree();
+    }
+    std::unique_ptr<NodeArena> arena = std::make_unique<NodeArena>();
+    arena->reserve_threads(pool);
+    BvhNode* root = build_lbvh(TriangleArrayAccessor{tris}, start, end, pool, options, settings, ArenaNodeAllocator{arena.get()});
+    return BvhTree(std::move(arena), root);
+}
+
+BvhTree BvhTree::lbvh(Triangle* tris, int start, int end, int num_threads, const LbvhOptions& options, const BuildSettings& settings) {
+    ThreadPool pool(num_threads);
+    return lbvh(tris, start, end, pool, options, settings);
+}
+
+BvhTree BvhTree::lbvh(const Mesh& mesh, ThreadPool& pool, const LbvhOptions& options, const BuildSettings& settings) {
+    if (mesh.num_triangles() == 0) {
+        return BvhTree();
+    }
+    std::unique_ptr<NodeArena> arena = std::make_unique<NodeArena>();
+    arena->reserve_threads(pool);
+    BvhNode* root = build_lbvh(MeshAccessor{&mesh}, 0, mesh.num_triangles(), pool, options, settings, ArenaNodeAllocator{arena.get()});
+    return BvhTree(std::move(arena), root);
+}
+
+BvhTree BvhTree::lbvh(const Mesh& mesh, int num_threads, const LbvhOptions& options, const BuildSettings& settings) {
+    ThreadPool pool(num_threads);
+    return lbvh(mesh, pool, options, settings);
+}
+
+}
@@ -59,17 +59,31 @@ void BvhNode::print(int depth) {
 
 BvhLeaf::BvhLeaf() : BvhNode() {
   this->num_triangles = 0;
+  this->indices = nullptr;
+  this->owns_indices = false;
 }
 
-BvhLeaf::BvhLeaf(vec3<float> min, vec3<float> max, int num_triangles, int* indices) : BvhNode(min, max) {
+BvhLeaf::BvhLeaf(vec3<float> min, vec3<float> max, int num_triangles, const int* indices) : BvhNode(min, max) {
   this->num_triangles = num_triangles;
+  this->indices = new int[num_triangles];
+  this->owns_indices = true;
   for (int i = 0; i < num_triangles; i++)
   {
     this->indices[i] = indices[i];
   }
 }
 
-BvhLeaf::~BvhLeaf() {}
+BvhLeaf::BvhLeaf(vec3<float> min, vec3<float> max, int num_triangles, int* indices, bool owns_indices) : BvhNode(min, max) {
+  this->num_triangles = num_triangles;
+  this->indices = indices;
+  this->owns_indices = owns_indices;
+}
+
+BvhLeaf::~BvhLeaf() {
+  if (this->owns_indices) {
+    delete[] this->indices;
+  }
+}
 
 void BvhLeaf::print(int depth=0) {
   printf("%*sBvhLeaf\n", depth * 2, "");
@@ -0,0 +1,284 @@
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <limits>
+#include <mutex>
+#include <bvh.hpp>
+#include <bvh_tree.hpp>
+#include <log.hpp>
+
+namespace bvh {
+
+// Ranges at least this large are built as separate tasks, smaller ones recurse on the same thread
+static const int PARALLEL_SUBTREE_THRESHOLD = 4096;
+// Ranges at least this large have their bounds reduced in parallel
+static const int PARALLEL_BOUNDS_THRESHOLD = 1 << 16;
+// Minimum number of triangles whose centroid keys are computed by one task
+static const size_t PARALLEL_CENTROID_GRAIN = 1 << 14;
+// Number of key bins of the parallel partition
+static const int PARTITION_BINS = 1024;
+// Indices of a range per entry of its slot table: a range of count indices has at most
+// count / (PARALLEL_BOUNDS_THRESHOLD / 4) chunks of PARTITION_BINS slots
+static const int PARTITION_SLOT_RATIO = (PARALLEL_BOUNDS_THRESHOLD / 4) / PARTITION_BINS;
+
+// Scratch memory of parallel_partition, allocated once for the whole index array. The range [offset,
+// offset + count[ of the index array scatters into the same range of indices and keeps its slot table from
+// slots[offset / PARTITION_SLOT_RATIO], so ranges that do not overlap never share scratch memory.
+struct PartitionScratch {
+    std::vector<int> indices;
+    std::vector<int> slots;
+};
+
+template <typename Accessor>
+static BoundingBox triangle_range_bounds(const Accessor& tris, const int* indices, int count) {
+    BoundingBox box = BoundingBox::empty();
+    for (int i = 0; i < count; i++) {
+        box.expand(tris.vertex(indices[i], 0));
+        box.expand(tris.vertex(indices[i], 1));
+        box.expand(tris.vertex(indices[i], 2));
+    }
+    return box;
+}
+
+// min/max are exact, so the reduction order does not change the result
+template <typename Accessor>
+static BoundingBox parallel_range_bounds(ThreadPool& pool, const Accessor& tris, const int* indices, int count) {
+    if (count < PARALLEL_BOUNDS_THRESHOLD) {
+        return triangle_range_bounds(tris, indices, count);
+    }
+
+    BoundingBox box = BoundingBox::empty();
+    std::mutex box_mutex;
+    parallel_for(pool, count, PARALLEL_BOUNDS_THRESHOLD / 4, [&](size_t begin, size_t end) {
+        BoundingBox local = triangle_range_bounds(tris, indices + begin, end - begin);
+        std::lock_guard<std::mutex> lock(box_mutex);
+        box.expand(local);
+    });
+    return box;
+}
+
+// Puts the mid first indices of [indices, indices + count[ in the order of less before the others, like
+// std::nth_element, with the work spread over the pool. The keys are counted into bins by chunks of indices,
+// each chunk scatters its indices to its own slots of the bins, and only the bin holding the mid-th index is
+// partitioned further. less is a strict total order, so both halves hold the same indices as with nth_element.
+// offset is the position of indices in the whole index array, which picks the scratch memory of the range.
+static void parallel_partition(ThreadPool& pool, int* indices, int offset, int count, int mid, const CentroidLess& less,
+                               PartitionScratch& scratch) {
+    if (count < PARALLEL_BOUNDS_THRESHOLD) {
+        std::nth_element(indices, indices + mid, indices + count, less);
+        return;
+    }
+
+    int num_chunks = std::min(pool.num_threads() * 4, count / (PARALLEL_BOUNDS_THRESHOLD / 4));
+    int chunk_size = (count + num_chunks - 1) / num_chunks;
+    auto for_each_chunk = [&](const std::function<void(int, int, int)>& body) {
+        parallel_for(pool, num_chunks, 1, [&](size_t first, size_t last) {
+            for (size_t chunk = first; chunk < last; chunk++) {
+                int begin = std::min(count, static_cast<int>(chunk) * chunk_size);
+                body(static_cast<int>(chunk), begin, std::min(count, begin + chunk_size));
+            }
+        });
+    };
+    auto key = [&](int index) { return less.keys[index - less.base]; };
+
+    // Key range of the indices
+    std::vector<float> chunk_lo(num_chunks, std::numeric_limits<float>::infinity());
+    std::vector<float> chunk_hi(num_chunks, -std::numeric_limits<float>::infinity());
+    for_each_chunk([&](int chunk, int begin, int end) {
+        for (int i = begin; i < end; i++) {
+            chunk_lo[chunk] = std::min(chunk_lo[chunk], key(indices[i]));
+            chunk_hi[chunk] = std::max(chunk_hi[chunk], key(indices[i]));
+        }
+    });
+    float lo = *std::min_element(chunk_lo.begin(), chunk_lo.end());
+    float hi = *std::max_element(chunk_hi.begin(), chunk_hi.end());
+    if (!(lo < hi)) {
+        // Every key is equal, only the indices order the range
+        std::nth_element(indices, indices + mid, indices + count, less);
+        return;
+    }
+
+    // Bins are monotonic in the key, so every index of a bin comes before every index of the next bins
+    float scale = PARTITION_BINS / (hi - lo);
+    auto bin = [&](int index) {
+        float t = (key(index) - lo) * scale;
+        return !(t > 0.0f) ? 0 : t >= PARTITION_BINS ? PARTITION_BINS - 1 : static_cast<int>(t);
+    };
+    int* slots = scratch.slots.data() + offset / PARTITION_SLOT_RATIO;
+    std::fill(slots, slots + static_cast<size_t>(num_chunks) * PARTITION_BINS, 0);
+    for_each_chunk([&](int chunk, int begin, int end) {
+        int* counts = &slots[static_cast<size_t>(chunk) * PARTITION_BINS];
+        for (int i = begin; i < end; i++) {
+            counts[bin(indices[i])]++;
+        }
+    });
+
+    // Each chunk writes its indices of a bin after those of the previous chunks
+    int bin_start[PARTITION_BINS + 1];
+    int position = 0;
+    for (int b = 0; b < PARTITION_BINS; b++) {
+        bin_start[b] = position;
+        for (int chunk = 0; chunk < num_chunks; chunk++) {
+            int chunk_count = slots[static_cast<size_t>(chunk) * PARTITION_BINS + b];
+            slots[static_cast<size_t>(chunk) * PARTITION_BINS + b] = position;
+            position += chunk_count;
+        }
+    }
+    bin_start[PARTITION_BINS] = count;
+
+    int* scattered = scratch.indices.data() + offset;
+    for_each_chunk([&](int chunk, int begin, int end) {
+        int* next = &slots[static_cast<size_t>(chunk) * PARTITION_BINS];
+        for (int i = begin; i < end; i++) {
+            scattered[next[bin(indices[i])]++] = indices[i];
+        }
+    });
+    for_each_chunk([&](int, int begin, int end) {
+        std::copy(scattered + begin, scattered + end, indices + begin);
+    });
+
+    // The smallest and largest keys fall in the first and last bins, so the bin holding mid is smaller than the range
+    int mid_bin = static_cast<int>(std::upper_bound(bin_start, bin_start + PARTITION_BINS + 1, mid) - bin_start) - 1;
+    int first = bin_start[mid_bin];
+    parallel_partition(pool, indices + first, offset + first, bin_start[mid_bin + 1] - first, mid - first, less, scratch);
+}
+
+// Same partitioning as precompute_helper in bvh.cpp: the range is split in place with std::nth_element and
+// boxes are merged from the children, so the tree is identical to the serial one. Both halves of a large
+// range are built by separate tasks, and large ranges are partitioned with parallel_partition, so all threads
+// are at work from the root down.
+// Nodes come from alloc.local(pool), the allocator of whichever thread runs the task
+template <typename Accessor, typename Allocator>
+static BvhNode* parallel_helper(ThreadPool& pool, const Accessor& tris, int* indices, int offset, int count, int depth,
+                                const CentroidLess& less, PartitionScratch& scratch, const BuildSettings& settings,
+                                const Allocator& alloc) {
+    if (count <= settings.max_leaf_size || settings.forces_leaf(count, depth)) {
+        std::sort(indices, indices + count, less);
+        BoundingBox box = triangle_range_bounds(tris, indices, count);
+        if (trace::enabled()) {
+            trace::leaf("parallel", depth, count);
+        }
+        if (settings.monitor != nullptr) {
+            settings.monitor->leaf_done(count);
+        }
+        return alloc.local(pool).leaf(box.min, box.max, count, indices);
+    }
+
+    // Split the triangles in half, exactly as the serial build does
+    int mid = count / 2;
+    parallel_partition(pool, indices, offset, count, mid, less, scratch);
+    if (trace::enabled()) {
+        trace::split("parallel", depth, count, mid, -1, -1.0f);
+    }
+    BvhNode* node = alloc.local(pool).node(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0));
+    if (count >= PARALLEL_SUBTREE_THRESHOLD) {
+        TaskGroup group(pool);
+        group.run([&]() { node->left = parallel_helper(pool, tris, indices, offset, mid, depth + 1, less, scratch, settings, alloc); });
+        node->right = parallel_helper(pool, tris, indices + mid, offset + mid, count - mid, depth + 1, less, scratch, settings, alloc);
+        group.wait();
+    } else {
+        node->left = parallel_helper(pool, tris, indices, offset, mid, depth + 1, less, scratch, settings, alloc);
+        node->right = parallel_helper(pool, tris, indices + mid, offset + mid, count - mid, depth + 1, less, scratch, settings, alloc);
+    }
+    node->bounding_box = node->left->bounding_box;
+    node->bounding_box.expand(node->right->bounding_box);
+    return node;
+}
+
+template <typename Accessor, typename Allocator>
+static BvhNode* build_parallel(const Accessor& tris, int start, int end, ThreadPool& pool, const BuildSettings& settings, const Allocator& alloc) {
+    int num_tris = end - start;
+    trace::BuildTimer timer("parallel");
+    std::vector<int> indices(num_tris);
+    parallel_for(pool, num_tris, PARALLEL_CENTROID_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            indices[i] = start + i;
+        }
+    });
+    BoundingBox box = parallel_range_bounds(pool, tris, indices.data(), num_tris);
+
+    // The serial build keeps the leaf in input order when everything fits in it
+    if (num_tris <= settings.max_leaf_size || settings.forces_leaf(num_tris, 0)) {
+        timer.done(num_tris);
+        return alloc.leaf(box.min, box.max, num_tris, indices.data());
+    }
+
+    // Only the centroid coordinate along the longest axis is needed to partition
+    int split_axis = chooseSplitAxis(box);
+    std::vector<float> keys(num_tris);
+    parallel_for(pool, num_tris, PARALLEL_CENTROID_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            keys[i] = (tris.vertex(start + i, 0)[split_axis] + tris.vertex(start + i, 1)[split_axis] +
+                       tris.vertex(start + i, 2)[split_axis]) / 3.0f;
+        }
+    });
+    timer.phase("centroids");
+
+    // One scratch buffer for every parallel partition of the build, smaller ranges are partitioned in place
+    PartitionScratch scratch;
+    if (num_tris >= PARALLEL_BOUNDS_THRESHOLD) {
+        scratch.indices.resize(num_tris);
+        scratch.slots.resize(num_tris / PARTITION_SLOT_RATIO);
+    }
+    BvhNode* root = parallel_helper(pool, tris, indices.data(), 0, num_tris, 0, CentroidLess(keys.data(), start), scratch, settings, alloc);
+    timer.phase("hierarchy");
+    timer.done(num_tris);
+    return root;
+}
+
+BvhNode* precompute_bvh_parallel(Triangle* tris, int start, int end, ThreadPool& pool, const BuildSettings& settings) {
+    // Handle empty or invalid input
+    if (start < 0 || start >= end || tris == nullptr) {
+        return nullptr;
+    }
+    return build_parallel(TriangleArrayAccessor{tris}, start, end, pool, settings.clamped(), HeapNodeAllocator());
+}
+
+BvhNode* precompute_bvh_parallel(Triangle* tris, int start, int end, int num_threads, const BuildSettings& settings) {
+    ThreadPool pool(num_threads);
+    return precompute_bvh_parallel(tris, start, end, pool, settings);
+}
+
+BvhNode* precompute_bvh_parallel(const Mesh& mesh, ThreadPool& pool, const BuildSettings& settings) {
+    if (mesh.num_triangles() == 0) {
+        return nullptr;
+    }
+    return build_parallel(MeshAccessor{&mesh}, 0, mesh.num_triangles(), pool, settings.clamped(), HeapNodeAllocator());
+}
+
+BvhNode* precompute_bvh_parallel(const Mesh& mesh, int num_threads, const BuildSettings& settings) {
+    ThreadPool pool(num_threads);
+    return precompute_bvh_parallel(mesh, pool, settings);
+}
+
+BvhTree BvhTree::parallel(Triangle* tris, int start, int end, ThreadPool& pool, const BuildSettings& settings) {
+    if (start < 0 || start >= end || tris == nullptr) {
+        return BvhTree();
+    }
+    std::unique_ptr<NodeArena> arena = std::make_unique<NodeArena>();
+    arena->reserve_threads(pool);
+    BvhNode* root = build_parallel(TriangleArrayAccessor{tris}, start, end, pool, settings.clamped(), ArenaNodeAllocator{arena.get()});
+    return BvhTree(std::move(arena), root);
+}
+
+BvhTree BvhTree::parallel(Triangle* tris, int start, int end, int num_threads, const BuildSettings& settings) {
+    ThreadPool pool(num_threads);
+    return parallel(tris, start, end, pool, settings);
+}
+
+BvhTree BvhTree::parallel(const Mesh& mesh, ThreadPool& pool, const BuildSettings& settings) {
+    if (mesh.num_triangles() == 0) {
+        return BvhTree();
+    }
+    std::unique_ptr<NodeArena> arena = std::make_unique<NodeArena>();
+    arena->reserve_threads(pool);
+    BvhNode* root = build_parallel(MeshAccessor{&mesh}, 0, mesh.num_triangles(), pool, settings.clamped(), ArenaNodeAllocator{arena.get()});
+    return BvhTree(std::move(arena), root);
+}
+
+BvhTree BvhTree::parallel(const Mesh& mesh, int num_threads, const BuildSettings& settings) {
+    ThreadPool pool(num_threads);
+    return parallel(mesh, pool, settings);
+}
+
+}
@@ -0,0 +1,90 @@
+#include <bvh.hpp>
+
+namespace bvh {
+
+// Subtrees at most this deep below the root are refitted as separate tasks
+static const int PARALLEL_REFIT_DEPTH = 8;
+
+template <typename Accessor>
+static BoundingBox leaf_bounds(const BvhLeaf* leaf, const Accessor& tris) {
+    BoundingBox box = BoundingBox::empty();
+    for (int i = 0; i < leaf->num_triangles; i++) {
+        box.expand(tris.vertex(leaf->indices[i], 0));
+        box.expand(tris.vertex(leaf->indices[i], 1));
+        box.expand(tris.vertex(leaf->indices[i], 2));
+    }
+    return box;
+}
+
+// Children before parents, every node is visited once
+template <typename Accessor>
+static void refit_helper(BvhNode* node, const Accessor& tris) {
+    // Nodes without children are always leaves
+    if (node->left == nullptr) {
+        node->bounding_box = leaf_bounds(static_cast<const BvhLeaf*>(node), tris);
+        return;
+    }
+
+    refit_helper(node->left, tris);
+    refit_helper(node->right, tris);
+    node->bounding_box = node->left->bounding_box;
+    node->bounding_box.expand(node->right->bounding_box);
+}
+
+template <typename Accessor>
+static void parallel_refit_helper(ThreadPool& pool, BvhNode* node, const Accessor& tris, int depth) {
+    if (node->left == nullptr || depth >= PARALLEL_REFIT_DEPTH) {
+        refit_helper(node, tris);
+        return;
+    }
+
+    TaskGroup group(pool);
+    group.run([&]() { parallel_refit_helper(pool, node->left, tris, depth + 1); });
+    parallel_refit_helper(pool, node->right, tris, depth + 1);
+    group.wait();
+    node->bounding_box = node->left->bounding_box;
+    node->bounding_box.expand(node->right->bounding_box);
+}
+
+void refit_bvh(BvhNode* root, const Triangle* tris) {
+    if (root != nullptr && tris != nullptr) {
+        refit_helper(root, TriangleArrayAccessor{tris});
+    }
+}
+
+void refit_bvh(BvhNode* root, const Mesh& mesh) {
+    if (root != nullptr) {
+        refit_helper(root, MeshAccessor{&mesh});
+    }
+}
+
+void refit_bvh_parallel(BvhNode* root, const Triangle* tris, ThreadPool& pool) {
+    if (root != nullptr && tris != nullptr) {
+        parallel_refit_helper(pool, root, TriangleArrayAccessor{tris}, 0);
+    }
+}
+
+void refit_bvh_parallel(BvhNode* root, const Triangle* tris, int num_threads) {
+    ThreadPool pool(num_threads);
+    refit_bvh_parallel(root, tris, pool);
+}
+
+void refit_bvh_parallel(BvhNode* root, const Mesh& mesh, ThreadPool& pool) {
+    if (root != nullptr) {
+        parallel_refit_helper(pool, root, MeshAccessor{&mesh}, 0);
+    }
+}
+
+void refit_bvh_parallel(BvhNode* root, const Mesh& mesh, int num_threads) {
+    ThreadPool pool(num_threads);
+    refit_bvh_parallel(root, mesh, pool);
+}
+
+float refit_degradation(const BvhNode* root, float build_cost) {
+    if (build_cost <= 0.0f) {
+        return 1.0f;
+    }
+    return sah_cost(root) / build_cost;
+}
+
+}
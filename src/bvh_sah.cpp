@@ -0,0 +1,235 @@
+#include <vector>
+#include <algorithm>
+#include <bvh.hpp>
+#include <bvh_tree.hpp>
+#include <log.hpp>
+
+namespace bvh {
+
+// Per-triangle data shared by the whole build, indexed by absolute triangle index - base
+struct SahContext {
+    std::vector<BoundingBox> bounds;
+    std::vector<vec3<float>> centroids;
+    int base;
+    int num_bins;
+    BuildSettings settings;  // Costs of the heuristic, leaf sizes and depth
+};
+
+struct SahBin {
+    BoundingBox bounds = BoundingBox::empty();
+    int count = 0;
+};
+
+// Best split found for a node: axis == -1 means no valid plane exists
+struct SahSplit {
+    int axis = -1;
+    int bin = 0;        // triangles with bin index < bin go to the left child
+    float cost = std::numeric_limits<float>::max();
+};
+
+static inline int sah_bin_index(float c, float cmin, float scale, int num_bins) {
+    int b = static_cast<int>((c - cmin) * scale);
+    return std::min(std::max(b, 0), num_bins - 1);
+}
+
+// Evaluates the SAH on num_bins - 1 candidate planes along each axis and returns the cheapest one.
+// The cost is expressed in units of the node's own surface area.
+static SahSplit find_sah_split(const SahContext& ctx, const int* indices, int count,
+                               const BoundingBox& bounds, const BoundingBox& centroid_bounds) {
+    SahSplit best;
+    float node_area = bounds.surface_area();
+    if (node_area <= 0.0f) {
+        node_area = 1.0f; // degenerate (flat) node: compare raw counts instead
+    }
+
+    for (int axis = 0; axis < 3; axis++) {
+        float cmin = centroid_bounds.min[axis];
+        float extent = centroid_bounds.max[axis] - cmin;
+        if (extent <= 0.0f) {
+            continue; // all centroids on the same plane, nothing to split
+        }
+
+        SahBin bins[BVH_SAH_MAX_BINS];
+        float scale = ctx.num_bins / extent;
+        for (int i = 0; i < count; i++) {
+            int prim = indices[i] - ctx.base;
+            int b = sah_bin_index(ctx.centroids[prim][axis], cmin, scale, ctx.num_bins);
+            bins[b].count++;
+            bins[b].bounds.expand(ctx.bounds[prim]);
+        }
+
+        // Sweep from the right to get the area and count of every right side
+        float right_area[BVH_SAH_MAX_BINS];
+        int right_count[BVH_SAH_MAX_BINS];
+        BoundingBox acc = BoundingBox::empty();
+        int n = 0;
+        for (int b = ctx.num_bins - 1; b > 0; b--) {
+            acc.expand(bins[b].bounds);
+            n += bins[b].count;
+            right_area[b] = acc.surface_area();
+            right_count[b] = n;
+        }
+
+        // Sweep from the left and evaluate every plane between bins b - 1 and b
+        acc = BoundingBox::empty();
+        n = 0;
+        for (int b = 1; b < ctx.num_bins; b++) {
+            acc.expand(bins[b - 1].bounds);
+            n += bins[b - 1].count;
+            if (n == 0 || right_count[b] == 0) {
+                continue;
+            }
+            float cost = ctx.settings.traversal_cost +
+                         ctx.settings.intersection_cost * (n * acc.surface_area() + right_count[b] * right_area[b]) / node_area;
+            if (cost < best.cost) {
+                best.axis = axis;
+                best.bin = b;
+                best.cost = cost;
+            }
+        }
+    }
+
+    return best;
+}
+
+template <typename Allocator>
+static BvhNode* sah_helper(const SahContext& ctx, int* indices, int count, int depth, const Allocator& alloc) {
+    BoundingBox bounds = BoundingBox::empty();
+    BoundingBox centroid_bounds = BoundingBox::empty();
+    for (int i = 0; i < count; i++) {
+        int prim = indices[i] - ctx.base;
+        bounds.expand(ctx.bounds[prim]);
+        centroid_bounds.expand(ctx.centroids[prim]);
+    }
+
+    SahSplit split;
+    if (!ctx.settings.forces_leaf(count, depth)) {
+        split = find_sah_split(ctx, indices, count, bounds, centroid_bounds);
+    }
+
+    // Make a leaf when it is allowed and cheaper than the best split
+    float leaf_cost = ctx.settings.intersection_cost * count;
+    if (ctx.settings.forces_leaf(count, depth) ||
+        (count <= ctx.settings.max_leaf_size && (split.axis == -1 || leaf_cost <= split.cost))) {
+        if (trace::enabled()) {
+            trace::leaf("sah", depth, count);
+        }
+        if (ctx.settings.monitor != nullptr) {
+            ctx.settings.monitor->leaf_done(count);
+        }
+        return alloc.leaf(bounds.min, bounds.max, count, indices);
+    }
+
+    int mid = count / 2; // fallback when every centroid coincides
+    if (split.axis != -1) {
+        float cmin = centroid_bounds.min[split.axis];
+        float scale = ctx.num_bins / (centroid_bounds.max[split.axis] - cmin);
+        int* middle = std::partition(indices, indices + count, [&](int index) {
+            float c = ctx.centroids[index - ctx.base][split.axis];
+            return sah_bin_index(c, cmin, scale, ctx.num_bins) < split.bin;
+        });
+        mid = static_cast<int>(middle - indices);
+    }
+    if (trace::enabled()) {
+        trace::split("sah", depth, count, mid, split.axis, split.axis == -1 ? -1.0f : split.cost);
+    }
+
+    BvhNode* node = alloc.node(bounds.min, bounds.max);
+    node->left = sah_helper(ctx, indices, mid, depth + 1, alloc);
+    node->right = sah_helper(ctx, indices + mid, count - mid, depth + 1, alloc);
+    return node;
+}
+
+// Precomputes the bounds and centroid of every triangle once, then builds the tree
+template <typename Accessor, typename Allocator>
+static BvhNode* build_sah(const Accessor& tris, int start, int end, int num_bins, const BuildSettings& settings, const Allocator& alloc) {
+    int num_tris = end - start;
+    trace::BuildTimer timer("sah");
+    SahContext ctx;
+    ctx.base = start;
+    ctx.num_bins = std::min(std::max(num_bins, 2), BVH_SAH_MAX_BINS);
+    ctx.settings = settings.clamped();
+    ctx.bounds.resize(num_tris);
+    ctx.centroids.resize(num_tris);
+
+    std::vector<int> indices(num_tris);
+    for (int i = 0; i < num_tris; i++) {
+        BoundingBox box = BoundingBox::empty();
+        box.expand(tris.vertex(start + i, 0));
+        box.expand(tris.vertex(start + i, 1));
+        box.expand(tris.vertex(start + i, 2));
+        ctx.bounds[i] = box;
+        ctx.centroids[i] = box.centroid();
+        indices[i] = start + i;
+    }
+
+    timer.phase("bounds");
+
+    BvhNode* root = sah_helper(ctx, indices.data(), num_tris, 0, alloc);
+    timer.phase("hierarchy");
+    timer.done(num_tris);
+    return root;
+}
+
+BvhNode* precompute_bvh_sah(Triangle* tris, int start, int end, int num_bins, const BuildSettings& settings) {
+    // Handle empty or invalid input
+    if (start < 0 || start >= end || tris == nullptr) {
+        return nullptr;
+    }
+    return build_sah(TriangleArrayAccessor{tris}, start, end, num_bins, settings, HeapNodeAllocator());
+}
+
+BvhNode* precompute_bvh_sah(const Mesh& mesh, int num_bins, const BuildSettings& settings) {
+    if (mesh.num_triangles() == 0) {
+        return nullptr;
+    }
+    return build_sah(MeshAccessor{&mesh}, 0, mesh.num_triangles(), num_bins, settings, HeapNodeAllocator());
+}
+
+BvhTree BvhTree::sah(Triangle* tris, int start, int end, int num_bins, const BuildSettings& settings) {
+    if (start < 0 || start >= end || tris == nullptr) {
+        return BvhTree();
+    }
+    std::unique_ptr<NodeArena> arena = std::make_unique<NodeArena>();
+    BvhNode* root = build_sah(TriangleArrayAccessor{tris}, start, end, num_bins, settings, ArenaNodeAllocator{arena.get()});
+    return BvhTree(std::move(arena), root);
+}
+
+BvhTree BvhTree::sah(const Mesh& mesh, int num_bins, const BuildSettings& settings) {
+    if (mesh.num_triangles() == 0) {
+        return BvhTree();
+    }
+    std::unique_ptr<NodeArena> arena = std::make_unique<NodeArena>();
+    BvhNode* root = build_sah(MeshAccessor{&mesh}, 0, mesh.num_triangles(), num_bins, settings, ArenaNodeAllocator{arena.get()});
+    return BvhTree(std::move(arena), root);
+}
+
+static float sah_cost_helper(const BvhNode* node, float traversal_cost, float intersection_cost) {
+    if (node == nullptr) {
+        return 0.0f;
+    }
+
+    const BvhLeaf* leaf = dynamic_cast<const BvhLeaf*>(node);
+    if (leaf != nullptr) {
+        return node->bounding_box.surface_area() * intersection_cost * leaf->num_triangles;
+    }
+
+    return node->bounding_box.surface_area() * traversal_cost +
+           sah_cost_helper(node->left, traversal_cost, intersection_cost) +
+           sah_cost_helper(node->right, traversal_cost, intersection_cost);
+}
+
+float sah_cost(const BvhNode* root, float traversal_cost, float intersection_cost) {
+    if (root == nullptr) {
+        return 0.0f;
+    }
+
+    float root_area = root->bounding_box.surface_area();
+    if (root_area <= 0.0f) {
+        return 0.0f;
+    }
+
+    return sah_cost_helper(root, traversal_cost, intersection_cost) / root_area;
+}
+
+}
@@ -0,0 +1,444 @@
+#include <vector>
+#include <algorithm>
+#include <bvh.hpp>
+#include <bvh_tree.hpp>
+#include <log.hpp>
+
+namespace bvh {
+
+// A triangle, or the part of it left inside bounds by the spatial splits above
+struct SbvhRef {
+    BoundingBox bounds;
+    int tri;
+};
+
+template <typename Accessor>
+struct SbvhContext {
+    Accessor tris;
+    int num_bins;
+    float min_overlap;  // Overlap area above which spatial splits are tried
+    int remaining;      // References spatial splits may still add
+    BuildSettings settings;
+};
+
+// Best split found for a node: axis == -1 means no valid split exists
+struct SbvhSplit {
+    int axis = -1;
+    bool spatial = false;
+    int bin = 0;            // object split: references with centroid bin < bin go left
+    float position = 0.0f;  // spatial split: references are clipped at this plane
+    float cost = std::numeric_limits<float>::max();
+    BoundingBox left_bounds;
+    BoundingBox right_bounds;
+    int left_count = 0;
+    int right_count = 0;
+};
+
+struct SbvhObjectBin {
+    BoundingBox bounds = BoundingBox::empty();
+    int count = 0;
+};
+
+struct SbvhSpatialBin {
+    BoundingBox bounds = BoundingBox::empty();
+    int entries = 0;  // references starting in this bin
+    int exits = 0;    // references ending in this bin
+};
+
+static inline void set_axis(vec3<float>& v, int axis, float value) {
+    if (axis == 0) {
+        v.x = value;
+    } else if (axis == 1) {
+        v.y = value;
+    } else {
+        v.z = value;
+    }
+}
+
+static inline BoundingBox box_intersection(const BoundingBox& a, const BoundingBox& b) {
+    return BoundingBox(vec3<float>::max(a.min, b.min), vec3<float>::min(a.max, b.max));
+}
+
+static inline BoundingBox box_union(const BoundingBox& a, const BoundingBox& b) {
+    BoundingBox box = a;
+    box.expand(b);
+    return box;
+}
+
+static inline bool box_is_empty(const BoundingBox& box) {
+    return box.min.x > box.max.x || box.min.y > box.max.y || box.min.z > box.max.z;
+}
+
+static inline int sbvh_bin_index(float c, float cmin, float scale, int num_bins) {
+    int b = static_cast<int>((c - cmin) * scale);
+    return std::min(std::max(b, 0), num_bins - 1);
+}
+
+// Clips a reference at a plane: the triangle edges are cut where they cross it, each side keeps the vertices and
+// crossing points on it, bounded by the part of the triangle the reference already stood for
+template <typename Accessor>
+static void split_reference(const Accessor& tris, const SbvhRef& ref, int axis, float position, SbvhRef& left, SbvhRef& right) {
+    left.tri = ref.tri;
+    right.tri = ref.tri;
+    left.bounds = BoundingBox::empty();
+    right.bounds = BoundingBox::empty();
+
+    for (int k = 0; k < 3; k++) {
+        vec3<float> v0 = tris.vertex(ref.tri, k);
+        vec3<float> v1 = tris.vertex(ref.tri, (k + 1) % 3);
+        float p0 = v0[axis];
+        float p1 = v1[axis];
+        if (p0 <= position) {
+            left.bounds.expand(v0);
+        }
+        if (p0 >= position) {
+            right.bounds.expand(v0);
+        }
+        if ((p0 < position && position < p1) || (p1 < position && position < p0)) {
+            vec3<float> crossing = v0 + (v1 - v0) * ((position - p0) / (p1 - p0));
+            set_axis(crossing, axis, position);
+            left.bounds.expand(crossing);
+            right.bounds.expand(crossing);
+        }
+    }
+
+    set_axis(left.bounds.max, axis, std::min(left.bounds.max[axis], position));
+    set_axis(right.bounds.min, axis, std::max(right.bounds.min[axis], position));
+    left.bounds = box_intersection(left.bounds, ref.bounds);
+    right.bounds = box_intersection(right.bounds, ref.bounds);
+}
+
+// Binned SAH over the reference centroids, as in the binned SAH builder, also keeping the child boxes
+static SbvhSplit find_object_split(const std::vector<SbvhRef>& refs, int num_bins, const BuildSettings& settings, float node_area,
+                                   const BoundingBox& centroid_bounds) {
+    SbvhSplit best;
+    int count = static_cast<int>(refs.size());
+
+    for (int axis = 0; axis < 3; axis++) {
+        float cmin = centroid_bounds.min[axis];
+        float extent = centroid_bounds.max[axis] - cmin;
+        if (extent <= 0.0f) {
+            continue;
+        }
+
+        SbvhObjectBin bins[BVH_SAH_MAX_BINS];
+        float scale = num_bins / extent;
+        for (const SbvhRef& ref : refs) {
+            int b = sbvh_bin_index(ref.bounds.centroid()[axis], cmin, scale, num_bins);
+            bins[b].count++;
+            bins[b].bounds.expand(ref.bounds);
+        }
+
+        BoundingBox right_bounds[BVH_SAH_MAX_BINS];
+        int right_count[BVH_SAH_MAX_BINS];
+        BoundingBox acc = BoundingBox::empty();
+        int n = 0;
+        for (int b = num_bins - 1; b > 0; b--) {
+            acc.expand(bins[b].bounds);
+            n += bins[b].count;
+            right_bounds[b] = acc;
+            right_count[b] = n;
+        }
+
+        acc = BoundingBox::empty();
+        n = 0;
+        for (int b = 1; b < num_bins; b++) {
+            acc.expand(bins[b - 1].bounds);
+            n += bins[b - 1].count;
+            if (n == 0 || right_count[b] == 0) {
+                continue;
+            }
+            float cost = settings.traversal_cost +
+                         settings.intersection_cost * (n * acc.surface_area() + right_count[b] * right_bounds[b].surface_area()) / node_area;
+            if (cost < best.cost) {
+                best.axis = axis;
+                best.spatial = false;
+                best.bin = b;
+                best.cost = cost;
+                best.left_bounds = acc;
+                best.right_bounds = right_bounds[b];
+                best.left_count = n;
+                best.right_count = count - n;
+            }
+        }
+    }
+
+    return best;
+}
+
+// Bins the clipped references between equally spaced planes of the node box. A reference spanning several bins
+// adds its clipped part to each, the planes between bins are the candidates.
+template <typename Accessor>
+static SbvhSplit find_spatial_split(const SbvhContext<Accessor>& ctx, const std::vector<SbvhRef>& refs, const BoundingBox& bounds, float node_area) {
+    SbvhSplit best;
+    int count = static_cast<int>(refs.size());
+
+    for (int axis = 0; axis < 3; axis++) {
+        float bmin = bounds.min[axis];
+        float extent = bounds.max[axis] - bmin;
+        if (extent <= 0.0f) {
+            continue;
+        }
+
+        SbvhSpatialBin bins[BVH_SAH_MAX_BINS];
+        float width = extent / ctx.num_bins;
+        float scale = ctx.num_bins / extent;
+        for (const SbvhRef& ref : refs) {
+            int first = sbvh_bin_index(ref.bounds.min[axis], bmin, scale, ctx.num_bins);
+            int last = sbvh_bin_index(ref.bounds.max[axis], bmin, scale, ctx.num_bins);
+            SbvhRef current = ref;
+            for (int b = first; b < last; b++) {
+                SbvhRef left, right;
+                split_reference(ctx.tris, current, axis, bmin + (b + 1) * width, left, right);
+                bins[b].bounds.expand(left.bounds);
+                current = right;
+            }
+            bins[last].bounds.expand(current.bounds);
+            bins[first].entries++;
+            bins[last].exits++;
+        }
+
+        BoundingBox right_bounds[BVH_SAH_MAX_BINS];
+        int right_count[BVH_SAH_MAX_BINS];
+        BoundingBox acc = BoundingBox::empty();
+        int n = 0;
+        for (int b = ctx.num_bins - 1; b > 0; b--) {
+            acc.expand(bins[b].bounds);
+            n += bins[b].exits;
+            right_bounds[b] = acc;
+            right_count[b] = n;
+        }
+
+        acc = BoundingBox::empty();
+        n = 0;
+        for (int b = 1; b < ctx.num_bins; b++) {
+            acc.expand(bins[b - 1].bounds);
+            n += bins[b - 1].entries;
+            // Both children must shrink, or a node full of references spanning it would split forever
+            if (n == 0 || right_count[b] == 0 || n == count || right_count[b] == count) {
+                continue;
+            }
+            if (n + right_count[b] - count > ctx.remaining) {
+                continue;
+            }
+            float cost = ctx.settings.traversal_cost +
+                         ctx.settings.intersection_cost * (n * acc.surface_area() + right_count[b] * right_bounds[b].surface_area()) / node_area;
+            if (cost < best.cost) {
+                best.axis = axis;
+                best.spatial = true;
+                best.position = bmin + b * width;
+                best.cost = cost;
+                best.left_bounds = acc;
+                best.right_bounds = right_bounds[b];
+                best.left_count = n;
+                best.right_count = right_count[b];
+            }
+        }
+    }
+
+    return best;
+}
+
+// Distributes the references of a spatial split. A reference crossing the plane goes whole to one side when that is
+// cheaper than duplicating it ("unsplitting"), or when the duplication budget is spent.
+template <typename Accessor>
+static void partition_spatial(SbvhContext<Accessor>& ctx, const std::vector<SbvhRef>& refs, SbvhSplit split,
+                              std::vector<SbvhRef>& left, std::vector<SbvhRef>& right) {
+    int axis = split.axis;
+    BoundingBox left_bounds = BoundingBox::empty();
+    BoundingBox right_bounds = BoundingBox::empty();
+    std::vector<const SbvhRef*> crossing;
+    for (const SbvhRef& ref : refs) {
+        if (ref.bounds.max[axis] <= split.position) {
+            left.push_back(ref);
+            left_bounds.expand(ref.bounds);
+        } else if (ref.bounds.min[axis] >= split.position) {
+            right.push_back(ref);
+            right_bounds.expand(ref.bounds);
+        } else {
+            crossing.push_back(&ref);
+        }
+    }
+
+    float left_area = split.left_bounds.surface_area();
+    float right_area = split.right_bounds.surface_area();
+    int left_count = split.left_count;
+    int right_count = split.right_count;
+    for (const SbvhRef* ref : crossing) {
+        float split_cost = left_area * left_count + right_area * right_count;
+        float left_cost = box_union(split.left_bounds, ref->bounds).surface_area() * left_count + right_area * (right_count - 1);
+        float right_cost = left_area * (left_count - 1) + box_union(split.right_bounds, ref->bounds).surface_area() * right_count;
+        bool duplicate = ctx.remaining > 0 && split_cost < left_cost && split_cost < right_cost;
+
+        SbvhRef left_part, right_part;
+        if (duplicate) {
+            split_reference(ctx.tris, *ref, axis, split.position, left_part, right_part);
+            // A part can vanish when the triangle only touches the plane inside the reference box
+            duplicate = !box_is_empty(left_part.bounds) && !box_is_empty(right_part.bounds);
+        }
+
+        if (duplicate) {
+            left.push_back(left_part);
+            right.push_back(right_part);
+            left_bounds.expand(left_part.bounds);
+            right_bounds.expand(right_part.bounds);
+            ctx.remaining--;
+        } else if (left_cost <= right_cost) {
+            left.push_back(*ref);
+            left_bounds.expand(ref->bounds);
+            right_count--;
+        } else {
+            right.push_back(*ref);
+            right_bounds.expand(ref->bounds);
+            left_count--;
+        }
+    }
+}
+
+template <typename Accessor, typename Allocator>
+static BvhNode* sbvh_helper(SbvhContext<Accessor>& ctx, std::vector<SbvhRef>& refs, int depth, const Allocator& alloc) {
+    int count = static_cast<int>(refs.size());
+    BoundingBox bounds = BoundingBox::empty();
+    BoundingBox centroid_bounds = BoundingBox::empty();
+    for (const SbvhRef& ref : refs) {
+        bounds.expand(ref.bounds);
+        centroid_bounds.expand(ref.bounds.centroid());
+    }
+
+    float node_area = bounds.surface_area();
+    if (node_area <= 0.0f) {
+        node_area = 1.0f; // degenerate (flat) node: compare raw counts instead
+    }
+
+    bool forced_leaf = ctx.settings.forces_leaf(count, depth);
+    SbvhSplit object_split;
+    if (!forced_leaf) {
+        object_split = find_object_split(refs, ctx.num_bins, ctx.settings, node_area, centroid_bounds);
+    }
+    SbvhSplit split = object_split;
+    if (!forced_leaf && ctx.remaining > 0) {
+        bool overlapping = object_split.axis == -1 ||
+                           box_intersection(object_split.left_bounds, object_split.right_bounds).surface_area() > ctx.min_overlap;
+        if (overlapping) {
+            SbvhSplit spatial = find_spatial_split(ctx, refs, bounds, node_area);
+            if (spatial.cost < split.cost) {
+                split = spatial;
+            }
+        }
+    }
+
+    // Make a leaf when it is allowed and cheaper than the best split
+    float leaf_cost = ctx.settings.intersection_cost * count;
+    if (forced_leaf || (count <= ctx.settings.max_leaf_size && (split.axis == -1 || leaf_cost <= split.cost))) {
+        if (trace::enabled()) {
+            trace::leaf("sbvh", depth, count);
+        }
+        if (ctx.settings.monitor != nullptr) {
+            ctx.settings.monitor->leaf_done(count);
+        }
+        std::vector<int> indices(count);
+        for (int i = 0; i < count; i++) {
+            indices[i] = refs[i].tri;
+        }
+        return alloc.leaf(bounds.min, bounds.max, count, indices.data());
+    }
+
+    std::vector<SbvhRef> left;
+    std::vector<SbvhRef> right;
+    if (split.spatial) {
+        partition_spatial(ctx, refs, split, left, right);
+    }
+    if (!split.spatial || left.empty() || right.empty()) {
+        left.clear();
+        right.clear();
+        split = object_split;
+        if (split.axis != -1) {
+            float cmin = centroid_bounds.min[split.axis];
+            float scale = ctx.num_bins / (centroid_bounds.max[split.axis] - cmin);
+            for (const SbvhRef& ref : refs) {
+                bool is_left = sbvh_bin_index(ref.bounds.centroid()[split.axis], cmin, scale, ctx.num_bins) < split.bin;
+                (is_left ? left : right).push_back(ref);
+            }
+        } else {
+            // Every centroid coincides, or the spatial split fell apart: halve the list
+            left.assign(refs.begin(), refs.begin() + count / 2);
+            right.assign(refs.begin() + count / 2, refs.end());
+        }
+    }
+    if (trace::enabled()) {
+        trace::split("sbvh", depth, count, static_cast<int>(left.size()), split.axis, split.axis == -1 ? -1.0f : split.cost);
+    }
+
+    // The children hold their own copies, free this level before going down
+    std::vector<SbvhRef>().swap(refs);
+
+    BvhNode* node = alloc.node(bounds.min, bounds.max);
+    node->left = sbvh_helper(ctx, left, depth + 1, alloc);
+    node->right = sbvh_helper(ctx, right, depth + 1, alloc);
+    return node;
+}
+
+template <typename Accessor, typename Allocator>
+static BvhNode* build_sbvh(const Accessor& tris, int start, int end, const SbvhOptions& options, const BuildSettings& settings,
+                           const Allocator& alloc) {
+    int num_tris = end - start;
+    trace::BuildTimer timer("sbvh");
+
+    std::vector<SbvhRef> refs(num_tris);
+    BoundingBox root_bounds = BoundingBox::empty();
+    for (int i = 0; i < num_tris; i++) {
+        BoundingBox box = BoundingBox::empty();
+        box.expand(tris.vertex(start + i, 0));
+        box.expand(tris.vertex(start + i, 1));
+        box.expand(tris.vertex(start + i, 2));
+        refs[i].bounds = box;
+        refs[i].tri = start + i;
+        root_bounds.expand(box);
+    }
+    timer.phase("references");
+
+    SbvhContext<Accessor> ctx{tris, std::min(std::max(options.num_bins, 2), BVH_SAH_MAX_BINS),
+                              options.min_overlap * root_bounds.surface_area(),
+                              static_cast<int>(std::max(options.duplication_budget, 0.0f) * num_tris), settings.clamped()};
+    BvhNode* root = sbvh_helper(ctx, refs, 0, alloc);
+    timer.phase("hierarchy");
+    timer.done(num_tris);
+    BVH_LOG(DEBUG, "SBVH over " << num_tris << " triangles added "
+                   << static_cast<int>(std::max(options.duplication_budget, 0.0f) * num_tris) - ctx.remaining << " references");
+    return root;
+}
+
+BvhNode* precompute_bvh_sbvh(Triangle* tris, int start, int end, const SbvhOptions& options, const BuildSettings& settings) {
+    // Handle empty or invalid input
+    if (start < 0 || start >= end || tris == nullptr) {
+        return nullptr;
+    }
+    return build_sbvh(TriangleArrayAccessor{tris}, start, end, options, settings, HeapNodeAllocator());
+}
+
+BvhNode* precompute_bvh_sbvh(const Mesh& mesh, const SbvhOptions& options, const BuildSettings& settings) {
+    if (mesh.num_triangles() == 0) {
+        return nullptr;
+    }
+    return build_sbvh(MeshAccessor{&mesh}, 0, mesh.num_triangles(), options, settings, HeapNodeAllocator());
+}
+
+BvhTree BvhTree::sbvh(Triangle* tris, int start, int end, const SbvhOptions& options, const BuildSettings& settings) {
+    if (start < 0 || start >= end || tris == nullptr) {
+        return BvhTree();
+    }
+    std::unique_ptr<NodeArena> arena = std::make_unique<NodeArena>();
+    BvhNode* root = build_sbvh(TriangleArrayAccessor{tris}, start, end, options, settings, ArenaNodeAllocator{arena.get()});
+    return BvhTree(std::move(arena), root);
+}
+
+BvhTree BvhTree::sbvh(const Mesh& mesh, const SbvhOptions& options, const BuildSettings& settings) {
+    if (mesh.num_triangles() == 0) {
+        return BvhTree();
+    }
+    std::unique_ptr<NodeArena> arena = std::make_unique<NodeArena>();
+    BvhNode* root = build_sbvh(MeshAccessor{&mesh}, 0, mesh.num_triangles(), options, settings, ArenaNodeAllocator{arena.get()});
+    return BvhTree(std::move(arena), root);
+}
+
+}
@@ -0,0 +1,385 @@
+#include <dynamic_bvh.hpp>
+#include <traversal.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace bvh {
+
+static BoundingBox union_of(const BoundingBox& a, const BoundingBox& b) {
+    return BoundingBox(vec3<float>::min(a.min, b.min), vec3<float>::max(a.max, b.max));
+}
+
+int DynamicBvh::insert(const Object* object) {
+    const BvhNode* root = object->getBvh();
+    if (root == nullptr) {
+        return -1;
+    }
+    return insert(object, root->bounding_box);
+}
+
+int DynamicBvh::insert(const Object* object, const BoundingBox& box) {
+    int leaf = allocate_node();
+    DynamicBvhNode& node = nodes[leaf];
+    node.box = box;
+    node.left = node.right = -1;
+    node.height = 0;
+    node.object = object;
+    insert_leaf(leaf);
+    num_objects++;
+    return leaf;
+}
+
+void DynamicBvh::remove(int proxy) {
+    remove_leaf(proxy);
+    free_node(proxy);
+    num_objects--;
+}
+
+void DynamicBvh::update(int proxy) {
+    update(proxy, nodes[proxy].object->getBvh()->bounding_box);
+}
+
+void DynamicBvh::update(int proxy, const BoundingBox& box) {
+    if (nodes[proxy].box == box) {
+        return;
+    }
+    // The leaf keeps its index, and the parent freed by the removal is the one the insertion takes back
+    remove_leaf(proxy);
+    nodes[proxy].box = box;
+    insert_leaf(proxy);
+}
+
+void DynamicBvh::reserve(int num_objects) {
+    // n leaves need n - 1 internal nodes, the search heap never holds more entries than there are nodes
+    size_t num_nodes = num_objects > 0 ? 2 * static_cast<size_t>(num_objects) - 1 : 0;
+    nodes.reserve(num_nodes);
+    search_heap.reserve(num_nodes);
+}
+
+int DynamicBvh::allocate_node() {
+    if (free_list == -1) {
+        nodes.push_back(DynamicBvhNode());
+        return static_cast<int>(nodes.size()) - 1;
+    }
+    int index = free_list;
+    free_list = nodes[index].parent;
+    return index;
+}
+
+void DynamicBvh::free_node(int index) {
+    DynamicBvhNode& node = nodes[index];
+    node.parent = free_list;
+    node.left = node.right = -1;
+    node.height = -1;
+    node.object = nullptr;
+    free_list = index;
+}
+
+// Branch and bound search for the node whose replacement by a new parent of itself and the new leaf adds the
+// least surface area: the new parent costs the area of the union, and each ancestor grows by its union with
+// the leaf. Below a node, the cost is at least the growth of its ancestors plus the area of the leaf, so the
+// subtrees whose bound is above the best cost found are skipped. The cheapest bounds are expanded first.
+int DynamicBvh::find_best_sibling(const BoundingBox& box) {
+    const float area = box.surface_area();
+    auto greater = [](const SearchEntry& a, const SearchEntry& b) { return a.inherited_cost > b.inherited_cost; };
+
+    int best = root_node;
+    float best_cost = std::numeric_limits<float>::max();
+    search_heap.clear();
+    search_heap.push_back(SearchEntry{root_node, 0.0f});
+    while (!search_heap.empty()) {
+        std::pop_heap(search_heap.begin(), search_heap.end(), greater);
+        SearchEntry entry = search_heap.back();
+        search_heap.pop_back();
+        if (entry.inherited_cost + area >= best_cost) {
+            break;  // every remaining entry has a larger bound
+        }
+
+        const DynamicBvhNode& node = nodes[entry.node];
+        float direct_cost = union_of(node.box, box).surface_area();
+        float cost = direct_cost + entry.inherited_cost;
+        if (cost < best_cost) {
+            best = entry.node;
+            best_cost = cost;
+        }
+
+        if (!node.is_leaf()) {
+            float inherited_cost = entry.inherited_cost + direct_cost - node.box.surface_area();
+            if (inherited_cost + area < best_cost) {
+                search_heap.push_back(SearchEntry{node.left, inherited_cost});
+                std::push_heap(search_heap.begin(), search_heap.end(), greater);
+                search_heap.push_back(SearchEntry{node.right, inherited_cost});
+                std::push_heap(search_heap.begin(), search_heap.end(), greater);
+            }
+        }
+    }
+    return best;
+}
+
+void DynamicBvh::insert_leaf(int leaf) {
+    if (root_node == -1) {
+        root_node = leaf;
+        nodes[leaf].parent = -1;
+        return;
+    }
+
+    int sibling = find_best_sibling(nodes[leaf].box);
+    int old_parent = nodes[sibling].parent;
+    int parent = allocate_node();  // may move the nodes, no references are held across it
+
+    DynamicBvhNode& node = nodes[parent];
+    node.parent = old_parent;
+    node.left = sibling;
+    node.right = leaf;
+    node.object = nullptr;
+    node.box = union_of(nodes[sibling].box, nodes[leaf].box);
+    node.height = 1 + std::max(nodes[sibling].height, nodes[leaf].height);
+
+    if (old_parent == -1) {
+        root_node = parent;
+    } else if (nodes[old_parent].left == sibling) {
+        nodes[old_parent].left = parent;
+    } else {
+        nodes[old_parent].right = parent;
+    }
+    nodes[sibling].parent = parent;
+    nodes[leaf].parent = parent;
+
+    refit_upwards(parent);
+}
+
+void DynamicBvh::remove_leaf(int leaf) {
+    if (leaf == root_node) {
+        root_node = -1;
+        return;
+    }
+
+    // The parent of the leaf goes away, the sibling takes its place
+    int parent = nodes[leaf].parent;
+    int grandparent = nodes[parent].parent;
+    int sibling = (nodes[parent].left == leaf) ? nodes[parent].right : nodes[parent].left;
+    nodes[sibling].parent = grandparent;
+    if (grandparent == -1) {
+        root_node = sibling;
+    } else {
+        if (nodes[grandparent].left == parent) {
+            nodes[grandparent].left = sibling;
+        } else {
+            nodes[grandparent].right = sibling;
+        }
+        refit_upwards(grandparent);
+    }
+    free_node(parent);
+    nodes[leaf].parent = -1;
+}
+
+// Recomputes the boxes and heights from index up to the root, rotating each node on the way
+void DynamicBvh::refit_upwards(int index) {
+    while (index != -1) {
+        DynamicBvhNode& node = nodes[index];
+        const DynamicBvhNode& left = nodes[node.left];
+        const DynamicBvhNode& right = nodes[node.right];
+        node.box = union_of(left.box, right.box);
+        node.height = 1 + std::max(left.height, right.height);
+        rotate(index);
+        index = node.parent;
+    }
+}
+
+// Swaps a child of the node with a grandchild under its other child when that shrinks the other child the
+// most. The box of the node itself does not change, only the box and height of the child that now holds the
+// moved subtree, and the height of the node.
+void DynamicBvh::rotate(int index) {
+    DynamicBvhNode& node = nodes[index];
+    int children[2] = {node.left, node.right};
+
+    float best_gain = 0.0f;
+    int best_child = -1;      // 0 or 1, the child that moves down
+    int best_grandchild = -1; // 0 or 1, the grandchild under the other child that moves up
+    for (int c = 0; c < 2; c++) {
+        const DynamicBvhNode& moving = nodes[children[c]];
+        const DynamicBvhNode& other = nodes[children[1 - c]];
+        if (other.is_leaf()) {
+            continue;
+        }
+        float area = other.box.surface_area();
+        int grandchildren[2] = {other.left, other.right};
+        for (int g = 0; g < 2; g++) {
+            // The grandchild g moves up, the other child then bounds the moving child and the remaining grandchild
+            float gain = area - union_of(moving.box, nodes[grandchildren[1 - g]].box).surface_area();
+            if (gain > best_gain) {
+                best_gain = gain;
+                best_child = c;
+                best_grandchild = g;
+            }
+        }
+    }
+    if (best_child == -1) {
+        return;
+    }
+
+    int moving = children[best_child];
+    int other = children[1 - best_child];
+    DynamicBvhNode& lower = nodes[other];
+    int& slot = (best_grandchild == 0) ? lower.left : lower.right;
+    int raised = slot;
+
+    slot = moving;
+    nodes[moving].parent = other;
+    (best_child == 0 ? node.left : node.right) = raised;
+    nodes[raised].parent = index;
+
+    lower.box = union_of(nodes[lower.left].box, nodes[lower.right].box);
+    lower.height = 1 + std::max(nodes[lower.left].height, nodes[lower.right].height);
+    node.height = 1 + std::max(nodes[node.left].height, nodes[node.right].height);
+}
+
+float DynamicBvh::sah_cost() const {
+    if (root_node == -1) {
+        return 0.0f;
+    }
+    float root_area = nodes[root_node].box.surface_area();
+    if (root_area <= 0.0f) {
+        return 0.0f;
+    }
+    float total = 0.0f;
+    std::vector<int> stack = {root_node};
+    while (!stack.empty()) {
+        const DynamicBvhNode& node = nodes[stack.back()];
+        stack.pop_back();
+        if (!node.is_leaf()) {
+            total += node.box.surface_area();
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+    return total / root_area;
+}
+
+bool DynamicBvh::validate() const {
+    int num_free = 0;
+    for (int i = free_list; i != -1; i = nodes[i].parent) {
+        if (i < 0 || i >= static_cast<int>(nodes.size()) || nodes[i].height != -1 || ++num_free > static_cast<int>(nodes.size())) {
+            return false;
+        }
+    }
+
+    int num_reached = 0, num_leaves = 0;
+    if (root_node != -1) {
+        if (nodes[root_node].parent != -1) {
+            return false;
+        }
+        std::vector<int> stack = {root_node};
+        while (!stack.empty()) {
+            int index = stack.back();
+            stack.pop_back();
+            const DynamicBvhNode& node = nodes[index];
+            if (++num_reached > static_cast<int>(nodes.size())) {
+                return false;  // cycle
+            }
+            if (node.is_leaf()) {
+                if (node.right != -1 || node.height != 0 || node.object == nullptr) {
+                    return false;
+                }
+                num_leaves++;
+                continue;
+            }
+            const DynamicBvhNode& left = nodes[node.left];
+            const DynamicBvhNode& right = nodes[node.right];
+            if (node.object != nullptr || left.parent != index || right.parent != index ||
+                node.height != 1 + std::max(left.height, right.height) || !(node.box == union_of(left.box, right.box))) {
+                return false;
+            }
+            stack.push_back(node.left);
+            stack.push_back(node.right);
+        }
+    }
+    return num_leaves == num_objects && num_reached + num_free == static_cast<int>(nodes.size());
+}
+
+// Closest-first traversal over the object boxes, the objects of the leaves are traced with their own BVHs.
+// With ANY_HIT the loop returns at the first hit found.
+template <bool ANY_HIT>
+static bool traverse(const DynamicBvhNode* nodes, int current, const Ray& ray, Hit& hit) {
+    int stack[BVH_TRAVERSAL_STACK_SIZE];
+    int stack_size = 0;
+    bool found = false;
+
+    while (true) {
+        const DynamicBvhNode& node = nodes[current];
+        if (node.is_leaf()) {
+            Ray local = ray;
+            local.tmax = hit.t;
+            if (ANY_HIT) {
+                if (node.object->occluded(local)) {
+                    return true;
+                }
+            } else {
+                Hit object_hit = node.object->intersect(local);
+                if (object_hit.hit() && object_hit.t < hit.t) {
+                    hit = object_hit;
+                    hit.instance = current;
+                    found = true;
+                }
+            }
+        } else {
+            float tnear_left, tnear_right;
+            bool hit_left = intersect_box(nodes[node.left].box, ray, hit.t, tnear_left);
+            bool hit_right = intersect_box(nodes[node.right].box, ray, hit.t, tnear_right);
+            if (hit_left && hit_right) {
+                int near_child = node.left;
+                int far_child = node.right;
+                if (tnear_right < tnear_left) {
+                    std::swap(near_child, far_child);
+                }
+                if (stack_size == BVH_TRAVERSAL_STACK_SIZE) {
+                    // Tree deeper than the stack: finish the far subtree recursively
+                    if (traverse<ANY_HIT>(nodes, far_child, ray, hit)) {
+                        found = true;
+                        if (ANY_HIT) {
+                            return true;
+                        }
+                    }
+                } else {
+                    stack[stack_size++] = far_child;
+                }
+                current = near_child;
+                continue;
+            }
+            if (hit_left || hit_right) {
+                current = hit_left ? node.left : node.right;
+                continue;
+            }
+        }
+
+        // Entries pushed before a closer hit was found may no longer be in range, they fail the box test
+        // of their children or return no closer hit
+        if (stack_size == 0) {
+            return found;
+        }
+        current = stack[--stack_size];
+    }
+}
+
+Hit DynamicBvh::intersect(const Ray& ray) const {
+    Hit hit;
+    hit.t = ray.tmax;
+    float tnear;
+    if (root_node != -1 && intersect_box(nodes[root_node].box, ray, hit.t, tnear)) {
+        traverse<false>(nodes.data(), root_node, ray, hit);
+    }
+    if (!hit.hit()) {
+        hit.t = std::numeric_limits<float>::max();
+    }
+    return hit;
+}
+
+bool DynamicBvh::occluded(const Ray& ray) const {
+    float tnear;
+    Hit hit;
+    hit.t = ray.tmax;
+    return root_node != -1 && intersect_box(nodes[root_node].box, ray, hit.t, tnear) && traverse<true>(nodes.data(), root_node, ray, hit);
+}
+
+}
@@ -0,0 +1,353 @@
+#include <linear_bvh.hpp>
+#include <bvh_tree.hpp>
+#include <traversal.hpp>
+#include <linear_bvh_traversal.hpp>
+
+#include <algorithm>
+#include <unordered_map>
+
+
+namespace bvh {
+
+// Axis along which the centroids of the two children are the furthest apart
+static uint8_t child_separation_axis(const BvhNode* node) {
+    vec3<float> d = node->right->bounding_box.centroid() - node->left->bounding_box.centroid();
+    float dx = std::abs(d.x), dy = std::abs(d.y), dz = std::abs(d.z);
+    if (dx >= dy && dx >= dz) {
+        return 0;
+    }
+    return dy >= dz ? 1 : 2;
+}
+
+// The orders below list internal nodes, the children of the k-th one are stored at 1 + 2k and 2 + 2k
+
+static void order_depth_first(const BvhNode* node, std::vector<const BvhNode*>& pairs) {
+    if (node->left == nullptr) {
+        return;
+    }
+    pairs.push_back(node);
+    order_depth_first(node->left, pairs);
+    order_depth_first(node->right, pairs);
+}
+
+static void order_breadth_first(const BvhNode* root, std::vector<const BvhNode*>& pairs) {
+    if (root->left != nullptr) {
+        pairs.push_back(root);
+    }
+    for (size_t i = 0; i < pairs.size(); i++) {
+        for (const BvhNode* child : {pairs[i]->left, pairs[i]->right}) {
+            if (child->left != nullptr) {
+                pairs.push_back(child);
+            }
+        }
+    }
+}
+
+// Number of levels of internal nodes in the subtree of node, 0 for a leaf
+static int internal_height(const BvhNode* node) {
+    if (node->left == nullptr) {
+        return 0;
+    }
+    return 1 + std::max(internal_height(node->left), internal_height(node->right));
+}
+
+// Appends the internal nodes exactly depth levels below node, left to right
+static void internal_nodes_at(const BvhNode* node, int depth, std::vector<const BvhNode*>& nodes) {
+    if (node->left == nullptr) {
+        return;
+    }
+    if (depth == 0) {
+        nodes.push_back(node);
+        return;
+    }
+    internal_nodes_at(node->left, depth - 1, nodes);
+    internal_nodes_at(node->right, depth - 1, nodes);
+}
+
+// Lays out the first levels of internal nodes below node: the top half of the levels recursively, then
+// recursively every subtree hanging below it. Unbalanced trees just have fewer nodes in some subtrees.
+static void order_van_emde_boas(const BvhNode* node, int levels, std::vector<const BvhNode*>& pairs) {
+    if (levels == 1) {
+        pairs.push_back(node);
+        return;
+    }
+    int top = levels / 2;
+    order_van_emde_boas(node, top, pairs);
+    std::vector<const BvhNode*> bottom;
+    internal_nodes_at(node, top, bottom);
+    for (const BvhNode* subtree : bottom) {
+        order_van_emde_boas(subtree, levels - top, pairs);
+    }
+}
+
+// Fills clusters of page_nodes nodes breadth first, the internal nodes that do not fit start new clusters.
+// The first cluster also holds the root, so that every cluster starts at a multiple of page_nodes.
+static void order_page_clustered(const BvhNode* root, size_t page_nodes, std::vector<const BvhNode*>& pairs) {
+    if (root->left == nullptr) {
+        return;
+    }
+    std::vector<const BvhNode*> page_roots = {root};
+    std::vector<const BvhNode*> page;
+    for (size_t p = 0; p < page_roots.size(); p++) {
+        page.assign(1, page_roots[p]);
+        size_t used = (p == 0) ? 1 : 0;
+        for (size_t i = 0; i < page.size(); i++) {
+            if (i > 0 && used + 2 > page_nodes) {
+                page_roots.push_back(page[i]);
+                continue;
+            }
+            pairs.push_back(page[i]);
+            used += 2;
+            for (const BvhNode* child : {page[i]->left, page[i]->right}) {
+                if (child->left != nullptr) {
+                    page.push_back(child);
+                }
+            }
+        }
+    }
+}
+
+// Whether the subtree has leaves a LinearBvhNode cannot hold: empty ones, which would read as internal nodes,
+// and ones with more than BVH_MAX_LEAF_SIZE triangles, which count cannot hold. Builders never make them,
+// hand-built and loaded trees can.
+static bool has_unflattenable_leaves(const BvhNode* node) {
+    if (node->left == nullptr) {
+        int count = static_cast<const BvhLeaf*>(node)->num_triangles;
+        return count <= 0 || count > BVH_MAX_LEAF_SIZE;
+    }
+    return has_unflattenable_leaves(node->left) || has_unflattenable_leaves(node->right);
+}
+
+// Leaf over indices[0, count[ split in halves until every part fits in a LinearBvhNode, all with the box of
+// the original leaf
+static BvhNode* split_leaf(const BvhNode* leaf, const int* indices, int count, const ArenaNodeAllocator& alloc) {
+    if (count <= BVH_MAX_LEAF_SIZE) {
+        return alloc.leaf(leaf->bounding_box.min, leaf->bounding_box.max, count, indices);
+    }
+    BvhNode* node = alloc.node(leaf->bounding_box.min, leaf->bounding_box.max);
+    node->left = split_leaf(leaf, indices, count / 2, alloc);
+    node->right = split_leaf(leaf, indices + count / 2, count - count / 2, alloc);
+    return node;
+}
+
+// Copy of the subtree without empty leaves and with oversized leaves split. An internal node with an empty
+// side is replaced by the other side, nullptr when the subtree has no triangle at all.
+static BvhNode* flattenable_copy(const BvhNode* node, const ArenaNodeAllocator& alloc) {
+    if (node->left == nullptr) {
+        const BvhLeaf* leaf = static_cast<const BvhLeaf*>(node);
+        return leaf->num_triangles > 0 ? split_leaf(leaf, leaf->indices, leaf->num_triangles, alloc) : nullptr;
+    }
+    BvhNode* left = flattenable_copy(node->left, alloc);
+    BvhNode* right = flattenable_copy(node->right, alloc);
+    if (left == nullptr || right == nullptr) {
+        return left != nullptr ? left : right;
+    }
+    BvhNode* copy = alloc.node(node->bounding_box.min, node->bounding_box.max);
+    copy->left = left;
+    copy->right = right;
+    return copy;
+}
+
+const BvhNode* flattenable_tree(const BvhNode* root, NodeArena& arena) {
+    return has_unflattenable_leaves(root) ? flattenable_copy(root, ArenaNodeAllocator{&arena}) : root;
+}
+
+LinearBvh LinearBvh::flatten(const BvhNode* root, NodeLayout layout, size_t page_size) {
+    LinearBvh bvh;
+    if (root == nullptr) {
+        return bvh;
+    }
+
+    NodeArena copy_arena;
+    root = flattenable_tree(root, copy_arena);
+    if (root == nullptr) {
+        return bvh;
+    }
+
+    std::vector<const BvhNode*> pairs;
+    switch (layout) {
+    case NodeLayout::DepthFirst:
+        order_depth_first(root, pairs);
+        break;
+    case NodeLayout::BreadthFirst:
+        order_breadth_first(root, pairs);
+        break;
+    case NodeLayout::VanEmdeBoas:
+        if (root->left != nullptr) {
+            order_van_emde_boas(root, internal_height(root), pairs);
+        }
+        break;
+    case NodeLayout::PageClustered:
+        order_page_clustered(root, std::max<size_t>(2, page_size / sizeof(LinearBvhNode)), pairs);
+        break;
+    }
+
+    // Root first, then the pairs of children
+    std::vector<const BvhNode*> order(1 + 2 * pairs.size());
+    std::unordered_map<const BvhNode*, uint32_t> left_index;
+    order[0] = root;
+    for (size_t k = 0; k < pairs.size(); k++) {
+        order[1 + 2 * k] = pairs[k]->left;
+        order[2 + 2 * k] = pairs[k]->right;
+        left_index[pairs[k]] = 1 + 2 * k;
+    }
+
+    bvh.nodes.resize(order.size());
+    for (size_t i = 0; i < order.size(); i++) {
+        const BvhNode* node = order[i];
+        LinearBvhNode& out = bvh.nodes[i];
+        out.min = node->bounding_box.min;
+        out.max = node->bounding_box.max;
+        out.pad = 0;
+
+        // Nodes without children are always leaves
+        if (node->left == nullptr) {
+            const BvhLeaf* leaf = static_cast<const BvhLeaf*>(node);
+            out.offset = bvh.primitive_indices.size();
+            out.count = leaf->num_triangles;
+            out.axis = 0;
+            bvh.primitive_indices.insert(bvh.primitive_indices.end(), leaf->indices, leaf->indices + leaf->num_triangles);
+        } else {
+            out.offset = left_index[node];
+            out.count = 0;
+            out.axis = child_separation_axis(node);
+        }
+    }
+    return bvh;
+}
+
+template <typename Allocator>
+static BvhNode* to_tree_helper(const LinearBvhView& bvh, uint32_t index, const Allocator& alloc) {
+    const LinearBvhNode& node = bvh.nodes[index];
+    if (node.is_leaf()) {
+        return alloc.leaf(node.min, node.max, node.count, &bvh.primitive_indices[node.offset]);
+    }
+
+    BvhNode* left = to_tree_helper(bvh, node.offset, alloc);
+    BvhNode* right = left ? to_tree_helper(bvh, node.offset + 1, alloc) : nullptr;
+    if (left == nullptr || right == nullptr) {
+        alloc.discard(left);
+        return nullptr;
+    }
+
+    BvhNode* tree_node = alloc.node(node.min, node.max);
+    tree_node->left = left;
+    tree_node->right = right;
+    return tree_node;
+}
+
+BvhNode* to_tree(const LinearBvhView& bvh) {
+    if (bvh.empty()) {
+        return nullptr;
+    }
+    return to_tree_helper(bvh, 0, HeapNodeAllocator());
+}
+
+BvhTree BvhTree::from_linear(const LinearBvhView& bvh) {
+    if (bvh.empty()) {
+        return BvhTree();
+    }
+    std::unique_ptr<NodeArena> arena = std::make_unique<NodeArena>();
+    BvhNode* root = to_tree_helper(bvh, 0, ArenaNodeAllocator{arena.get()});
+    return root ? BvhTree(std::move(arena), root) : BvhTree();
+}
+
+BvhNode* LinearBvh::to_tree() const {
+    return bvh::to_tree(view());
+}
+
+template <typename Accessor>
+static void refit_nodes(LinearBvh& bvh, const Accessor& tris) {
+    for (size_t i = bvh.nodes.size(); i-- > 0;) {
+        LinearBvhNode& node = bvh.nodes[i];
+        if (node.is_leaf()) {
+            BoundingBox box = BoundingBox::empty();
+            for (uint32_t j = node.offset; j < node.offset + node.count; j++) {
+                int tri = bvh.primitive_indices[j];
+                box.expand(tris.vertex(tri, 0));
+                box.expand(tris.vertex(tri, 1));
+                box.expand(tris.vertex(tri, 2));
+            }
+            node.min = box.min;
+            node.max = box.max;
+        } else {
+            const LinearBvhNode& left = bvh.nodes[node.offset];
+            const LinearBvhNode& right = bvh.nodes[node.offset + 1];
+            node.min = vec3<float>::min(left.min, right.min);
+            node.max = vec3<float>::max(left.max, right.max);
+        }
+    }
+}
+
+void LinearBvh::refit(const Triangle* tris) {
+    if (tris != nullptr) {
+        refit_nodes(*this, TriangleArrayAccessor{tris});
+    }
+}
+
+void LinearBvh::refit(const Mesh& mesh) {
+    refit_nodes(*this, MeshAccessor{&mesh});
+}
+
+template <typename Accessor>
+static Hit intersect_closest(const LinearBvhView& bvh, const Accessor& tris, const Ray& ray) {
+    Hit hit;
+    hit.t = ray.tmax;
+    if (bvh.empty()) {
+        return Hit();
+    }
+
+    traverse_linear<false>(bvh, 0, tris, ray, hit);
+    if (!hit.hit()) {
+        hit.t = std::numeric_limits<float>::max();
+    }
+    return hit;
+}
+
+template <typename Accessor>
+static bool intersect_any(const LinearBvhView& bvh, const Accessor& tris, const Ray& ray) {
+    Hit hit;
+    hit.t = ray.tmax;
+    if (bvh.empty()) {
+        return false;
+    }
+
+    return traverse_linear<true>(bvh, 0, tris, ray, hit);
+}
+
+Hit intersect(const LinearBvhView& bvh, const Triangle* tris, const Ray& ray) {
+    if (tris == nullptr) {
+        return Hit();
+    }
+    return intersect_closest(bvh, TriangleArrayAccessor{tris}, ray);
+}
+
+bool occluded(const LinearBvhView& bvh, const Triangle* tris, const Ray& ray) {
+    return tris != nullptr && intersect_any(bvh, TriangleArrayAccessor{tris}, ray);
+}
+
+Hit intersect(const LinearBvh& bvh, const Triangle* tris, const Ray& ray) {
+    return intersect(bvh.view(), tris, ray);
+}
+
+bool occluded(const LinearBvh& bvh, const Triangle* tris, const Ray& ray) {
+    return occluded(bvh.view(), tris, ray);
+}
+
+Hit intersect(const LinearBvhView& bvh, const Mesh& mesh, const Ray& ray) {
+    return intersect_closest(bvh, MeshAccessor{&mesh}, ray);
+}
+
+bool occluded(const LinearBvhView& bvh, const Mesh& mesh, const Ray& ray) {
+    return intersect_any(bvh, MeshAccessor{&mesh}, ray);
+}
+
+Hit intersect(const LinearBvh& bvh, const Mesh& mesh, const Ray& ray) {
+    return intersect(bvh.view(), mesh, ray);
+}
+
+bool occluded(const LinearBvh& bvh, const Mesh& mesh, const Ray& ray) {
+    return occluded(bvh.view(), mesh, ray);
+}
+
+}
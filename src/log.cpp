@@ -0,0 +1,129 @@
+#include <log.hpp>
+#include <thread_pool.hpp>
+
+#include <cstdio>
+#include <iostream>
+#include <mutex>
+
+namespace bvh {
+
+namespace log {
+
+namespace detail {
+    std::atomic<int> runtime_level{BVH_LOG_LEVEL_INFO};
+}
+
+static std::mutex output_mutex;
+static std::ostream* output = &std::cerr;
+
+static const char* level_name(Level level) {
+    switch (level) {
+        case Level::Trace: return "Trace";
+        case Level::Debug: return "Debug";
+        case Level::Info: return "Info";
+        case Level::Warn: return "Warning";
+        case Level::Error: return "Error";
+        default: return "";
+    }
+}
+
+void set_level(Level level) {
+    detail::runtime_level.store(static_cast<int>(level), std::memory_order_relaxed);
+}
+
+Level level() {
+    return static_cast<Level>(detail::runtime_level.load(std::memory_order_relaxed));
+}
+
+void set_output(std::ostream& stream) {
+    std::lock_guard<std::mutex> lock(output_mutex);
+    output = &stream;
+}
+
+void write(Level level, const std::string& message) {
+    std::lock_guard<std::mutex> lock(output_mutex);
+    *output << level_name(level) << ": " << message << std::endl;
+}
+
+}
+
+namespace trace {
+
+namespace detail {
+    std::atomic<bool> active{false};
+}
+
+static std::mutex file_mutex;
+static FILE* file = nullptr;
+
+bool open(const std::string& path) {
+    std::lock_guard<std::mutex> lock(file_mutex);
+    if (file != nullptr) {
+        fclose(file);
+    }
+    file = fopen(path.c_str(), "w");
+    detail::active.store(file != nullptr, std::memory_order_relaxed);
+    if (file == nullptr) {
+        BVH_LOG(ERROR, "Could not open build trace file " << path);
+        return false;
+    }
+    return true;
+}
+
+void close() {
+    std::lock_guard<std::mutex> lock(file_mutex);
+    detail::active.store(false, std::memory_order_relaxed);
+    if (file != nullptr) {
+        fclose(file);
+        file = nullptr;
+    }
+}
+
+// Events are small, they are formatted on the stack and written with one call under the lock. length is what
+// snprintf returned for a buffer of size bytes: the length the line would have had, so a line that did not fit
+// (e.g. with a very long builder or phase name) is cut short and is skipped rather than written as broken JSON.
+static void write_event(const char* line, int length, size_t size) {
+    if (length <= 0 || static_cast<size_t>(length) >= size) {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(file_mutex);
+    if (file != nullptr) {
+        fwrite(line, 1, length, file);
+    }
+}
+
+void split(const char* builder, int depth, int count, int left, int axis, float cost) {
+    char line[256];
+    int length = snprintf(line, sizeof(line),
+                          "{\"event\":\"split\",\"builder\":\"%s\",\"worker\":%d,\"depth\":%d,\"count\":%d,\"left\":%d,\"axis\":%d,\"cost\":%g}\n",
+                          builder, ThreadPool::current_worker(), depth, count, left, axis, cost);
+    write_event(line, length, sizeof(line));
+}
+
+void leaf(const char* builder, int depth, int count) {
+    char line[192];
+    int length = snprintf(line, sizeof(line),
+                          "{\"event\":\"leaf\",\"builder\":\"%s\",\"worker\":%d,\"depth\":%d,\"count\":%d}\n",
+                          builder, ThreadPool::current_worker(), depth, count);
+    write_event(line, length, sizeof(line));
+}
+
+void phase(const char* builder, const char* name, double ms) {
+    char line[192];
+    int length = snprintf(line, sizeof(line),
+                          "{\"event\":\"phase\",\"builder\":\"%s\",\"phase\":\"%s\",\"ms\":%.3f}\n",
+                          builder, name, ms);
+    write_event(line, length, sizeof(line));
+}
+
+void build(const char* builder, int num_tris, double ms) {
+    char line[192];
+    int length = snprintf(line, sizeof(line),
+                          "{\"event\":\"build\",\"builder\":\"%s\",\"triangles\":%d,\"ms\":%.3f}\n",
+                          builder, num_tris, ms);
+    write_event(line, length, sizeof(line));
+}
+
+}
+
+}
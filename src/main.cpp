@@ -4,6 +4,27 @@
 #include <test_save_bvh.hpp>
 #include <test_precompute_bvh.hpp>
 #include <test_build_bvh.hpp>
+#include <test_sah_bvh.hpp>
+#include <test_traversal.hpp>
+#include <test_linear_bvh.hpp>
+#include <test_parallel_bvh.hpp>
+#include <test_binary_bvh.hpp>
+#include <test_obj_loader.hpp>
+#include <test_mesh.hpp>
+#include <test_packet.hpp>
+#include <test_wide_bvh.hpp>
+#include <test_refit.hpp>
+#include <test_tlas.hpp>
+#include <test_arena.hpp>
+#include <test_lbvh.hpp>
+#include <test_log.hpp>
+#include <test_sbvh.hpp>
+#include <test_build_settings.hpp>
+#include <test_query.hpp>
+#include <test_quantized_bvh.hpp>
+#include <test_dynamic_bvh.hpp>
+#include <test_async_build.hpp>
+#include <test_concurrency.hpp>
 #include <iostream>
 #include <cstdio>
 #include <string>
@@ -13,11 +34,32 @@
 // Add new tests here
 std::unordered_map<std::string, void (*)()> tests = {
   {"precompute_bvh", bvh::tests::precompute_bvh},
+  {"precompute_bvh_sah", bvh::tests::precompute_bvh_sah},
+  {"precompute_bvh_parallel", bvh::tests::precompute_bvh_parallel},
   {"build_bvh", bvh::tests::build_bvh},
   {"load_bvh_leaf", bvh::tests::load_bvh_leaf},
   {"load_bvh_node", bvh::tests::load_bvh_node},
   {"load_bvh_with_comment", bvh::tests::load_bvh_with_comment},
-  {"save_bvh_test", bvh::tests::save_bvh_test}
+  {"save_bvh_test", bvh::tests::save_bvh_test},
+  {"traversal", bvh::tests::traversal},
+  {"linear_bvh", bvh::tests::linear_bvh},
+  {"binary_bvh", bvh::tests::binary_bvh},
+  {"obj_loader", bvh::tests::obj_loader},
+  {"mesh", bvh::tests::mesh},
+  {"packet", bvh::tests::packet},
+  {"wide_bvh", bvh::tests::wide_bvh},
+  {"refit", bvh::tests::refit},
+  {"tlas", bvh::tests::tlas},
+  {"arena", bvh::tests::arena},
+  {"precompute_bvh_lbvh", bvh::tests::precompute_bvh_lbvh},
+  {"logging", bvh::tests::logging},
+  {"precompute_bvh_sbvh", bvh::tests::precompute_bvh_sbvh},
+  {"build_settings", bvh::tests::build_settings},
+  {"queries", bvh::tests::queries},
+  {"quantized_bvh", bvh::tests::quantized_bvh},
+  {"dynamic_bvh", bvh::tests::dynamic_bvh},
+  {"async_build", bvh::tests::async_build},
+  {"concurrency", bvh::tests::concurrency}
 };
 
 bool run_one_test(std::string test_name, void (*test_funct)())
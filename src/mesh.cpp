@@ -0,0 +1,95 @@
+#include <mesh.hpp>
+
+#include <cstring>
+#include <initializer_list>
+#include <unordered_map>
+
+namespace bvh {
+
+uint32_t Mesh::add_vertex(const vec3<float>& position, const vec2<float>& uv, const vec3<float>& normal) {
+    px.push_back(position.x);
+    py.push_back(position.y);
+    pz.push_back(position.z);
+    u.push_back(uv.x);
+    v.push_back(uv.y);
+    nx.push_back(normal.x);
+    ny.push_back(normal.y);
+    nz.push_back(normal.z);
+    return static_cast<uint32_t>(px.size() - 1);
+}
+
+Triangle Mesh::triangle(int tri) const {
+    Triangle result;
+    for (int k = 0; k < 3; k++) {
+        uint32_t index = indices[3 * tri + k];
+        result.vertices[k] = position(index);
+        result.uv[k] = vec2<float>(u[index], v[index]);
+        result.normals[k] = vec3<float>(nx[index], ny[index], nz[index]);
+    }
+    result.smooth = smooth[tri] != 0;
+    return result;
+}
+
+size_t Mesh::memory_size() const {
+    return (px.capacity() + py.capacity() + pz.capacity() + nx.capacity() + ny.capacity() + nz.capacity() +
+            u.capacity() + v.capacity()) * sizeof(float) +
+           indices.capacity() * sizeof(uint32_t) + smooth.capacity() * sizeof(uint8_t);
+}
+
+void Mesh::shrink_to_fit() {
+    for (std::vector<float>* stream : {&px, &py, &pz, &nx, &ny, &nz, &u, &v}) {
+        stream->shrink_to_fit();
+    }
+    indices.shrink_to_fit();
+    smooth.shrink_to_fit();
+}
+
+// Bit pattern of a vertex, so that merging never changes a value (0.0f and -0.0f stay apart)
+struct VertexKey {
+    uint32_t bits[8];
+
+    bool operator==(const VertexKey& other) const {
+        return std::memcmp(bits, other.bits, sizeof(bits)) == 0;
+    }
+};
+
+struct VertexKeyHash {
+    size_t operator()(const VertexKey& key) const {
+        uint64_t hash = 14695981039346656037ULL;
+        for (uint32_t b : key.bits) {
+            hash = (hash ^ b) * 1099511628211ULL;
+        }
+        return hash;
+    }
+};
+
+Mesh Mesh::from_triangles(const Triangle* tris, int num_tris) {
+    Mesh mesh;
+    mesh.indices.reserve(3 * num_tris);
+    mesh.smooth.reserve(num_tris);
+
+    std::unordered_map<VertexKey, uint32_t, VertexKeyHash> vertex_map;
+    vertex_map.reserve(num_tris);
+    for (int i = 0; i < num_tris; i++) {
+        for (int k = 0; k < 3; k++) {
+            const Triangle& tri = tris[i];
+            float values[8] = {tri.vertices[k].x, tri.vertices[k].y, tri.vertices[k].z, tri.uv[k].x, tri.uv[k].y,
+                               tri.normals[k].x, tri.normals[k].y, tri.normals[k].z};
+            VertexKey key;
+            std::memcpy(key.bits, values, sizeof(values));
+
+            auto found = vertex_map.find(key);
+            if (found == vertex_map.end()) {
+                uint32_t index = mesh.add_vertex(tri.vertices[k], tri.uv[k], tri.normals[k]);
+                found = vertex_map.emplace(key, index).first;
+            }
+            mesh.indices.push_back(found->second);
+        }
+        mesh.smooth.push_back(tris[i].smooth ? 1 : 0);
+    }
+
+    mesh.shrink_to_fit();
+    return mesh;
+}
+
+}
@@ -0,0 +1,545 @@
+#include <obj_loader.hpp>
+#include <mesh.hpp>
+#include <thread_pool.hpp>
+#include <vec2.hpp>
+#include <vec3.hpp>
+#include <log.hpp>
+
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace bvh {
+
+// Files are split into at most 4 chunks per thread, and chunks are at least this large
+static const size_t OBJ_MIN_CHUNK_SIZE = 1 << 20;
+
+// Bits of ObjCorner::relative, set when the index is relative to the start of the chunk
+static const unsigned char OBJ_RELATIVE_V = 1;
+static const unsigned char OBJ_RELATIVE_VT = 2;
+static const unsigned char OBJ_RELATIVE_VN = 4;
+
+// One corner of a face, 0-based indices, -1 when the attribute is missing.
+// Negative OBJ indices depend on how many vertices the previous chunks hold, so they are
+// stored relative to the chunk start and resolved during the merge.
+struct ObjCorner {
+    int v, vt, vn;
+    unsigned char relative;
+};
+
+struct ObjChunk {
+    const char* begin;
+    const char* end;
+    std::vector<vec3<float>> positions;
+    std::vector<vec2<float>> uvs;
+    std::vector<vec3<float>> normals;
+    std::vector<ObjCorner> corners;   // 3 per triangle
+    std::vector<signed char> smooth;  // per triangle: 0 or 1, -1 until the chunk's first s statement
+    int smooth_state = -1;            // state at the end of the chunk, -1 if it has no s statement
+    size_t error_offset = 0;          // offset of the first malformed line + 1, 0 if none
+};
+
+static const double POW10[] = {
+    1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+    1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+static inline bool is_digit(char c) {
+    return c >= '0' && c <= '9';
+}
+
+static inline void skip_blanks(const char*& p, const char* end) {
+    while (p < end && (*p == ' ' || *p == '\t')) {
+        p++;
+    }
+}
+
+// Hand-written float parser for the common [-+]digits[.digits][e[-+]digits] form,
+// falls back to strtof for anything else (nan, inf, hexadecimal floats)
+static bool parse_float(const char*& p, const char* end, float& out) {
+    skip_blanks(p, end);
+    const char* start = p;
+
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+
+    uint64_t mantissa = 0;
+    int exponent = 0;
+    int num_digits = 0;
+    bool any_digit = false;
+    while (p < end && is_digit(*p)) {
+        if (num_digits < 19) {
+            mantissa = mantissa * 10 + (*p - '0');
+            num_digits += (mantissa != 0);
+        } else {
+            exponent++;
+        }
+        any_digit = true;
+        p++;
+    }
+    if (p < end && *p == '.') {
+        p++;
+        while (p < end && is_digit(*p)) {
+            if (num_digits < 19) {
+                mantissa = mantissa * 10 + (*p - '0');
+                num_digits += (mantissa != 0);
+                exponent--;
+            }
+            any_digit = true;
+            p++;
+        }
+    }
+
+    if (!any_digit) {
+        // Not a plain decimal number: copy the token so that strtof cannot read past the mapping
+        char buffer[64];
+        size_t length = 0;
+        p = start;
+        while (p < end && length < sizeof(buffer) - 1 && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+            buffer[length++] = *p++;
+        }
+        buffer[length] = '\0';
+        char* parsed_end;
+        out = std::strtof(buffer, &parsed_end);
+        return length > 0 && parsed_end == buffer + length;
+    }
+
+    if (p < end && (*p == 'e' || *p == 'E')) {
+        const char* exponent_start = p++;
+        bool negative_exponent = false;
+        if (p < end && (*p == '-' || *p == '+')) {
+            negative_exponent = (*p == '-');
+            p++;
+        }
+        if (p < end && is_digit(*p)) {
+            int e = 0;
+            while (p < end && is_digit(*p)) {
+                e = std::min(e * 10 + (*p - '0'), 100000);
+                p++;
+            }
+            exponent += negative_exponent ? -e : e;
+        } else {
+            p = exponent_start; // a lone 'e' is not part of the number
+        }
+    }
+
+    double value = static_cast<double>(mantissa);
+    if (exponent != 0) {
+        if (exponent > 0 && exponent <= 22) {
+            value *= POW10[exponent];
+        } else if (exponent < 0 && exponent >= -22) {
+            value /= POW10[-exponent];
+        } else {
+            value *= std::pow(10.0, exponent);
+        }
+    }
+    out = static_cast<float>(negative ? -value : value);
+    return true;
+}
+
+static bool parse_int(const char*& p, const char* end, int& out) {
+    bool negative = false;
+    if (p < end && (*p == '-' || *p == '+')) {
+        negative = (*p == '-');
+        p++;
+    }
+    if (p >= end || !is_digit(*p)) {
+        return false;
+    }
+    long long value = 0;
+    while (p < end && is_digit(*p)) {
+        value = std::min(value * 10 + (*p - '0'), 1LL << 40);
+        p++;
+    }
+    if (value > 0x7fffffff) {
+        return false;
+    }
+    out = static_cast<int>(negative ? -value : value);
+    return true;
+}
+
+// Turns a 1-based (or negative, relative) OBJ index into a 0-based index
+static inline bool resolve_index(int raw, int local_count, unsigned char relative_bit, int& index, unsigned char& relative) {
+    if (raw > 0) {
+        index = raw - 1;
+        return true;
+    }
+    if (raw < 0) {
+        index = local_count + raw;
+        relative |= relative_bit;
+        return true;
+    }
+    return false; // 0 is not a valid OBJ index
+}
+
+static bool parse_face(const char* p, const char* end, ObjChunk& chunk, std::vector<ObjCorner>& polygon, int smooth) {
+    polygon.clear();
+    while (true) {
+        skip_blanks(p, end);
+        if (p >= end || *p == '\r' || *p == '\n' || *p == '#') {
+            break;
+        }
+
+        ObjCorner corner = {-1, -1, -1, 0};
+        int raw;
+        if (!parse_int(p, end, raw) ||
+            !resolve_index(raw, chunk.positions.size(), OBJ_RELATIVE_V, corner.v, corner.relative)) {
+            return false;
+        }
+        if (p < end && *p == '/') {
+            p++;
+            if (p < end && *p != '/') { // v/vt or v/vt/vn
+                if (!parse_int(p, end, raw) ||
+                    !resolve_index(raw, chunk.uvs.size(), OBJ_RELATIVE_VT, corner.vt, corner.relative)) {
+                    return false;
+                }
+            }
+            if (p < end && *p == '/') { // v//vn or v/vt/vn
+                p++;
+                if (!parse_int(p, end, raw) ||
+                    !resolve_index(raw, chunk.normals.size(), OBJ_RELATIVE_VN, corner.vn, corner.relative)) {
+                    return false;
+                }
+            }
+        }
+        if (p < end && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') {
+            return false;
+        }
+        polygon.push_back(corner);
+    }
+
+    if (polygon.size() < 3) {
+        return false;
+    }
+
+    // Triangulate as a fan around the first corner
+    for (size_t i = 1; i + 1 < polygon.size(); i++) {
+        chunk.corners.push_back(polygon[0]);
+        chunk.corners.push_back(polygon[i]);
+        chunk.corners.push_back(polygon[i + 1]);
+        chunk.smooth.push_back(smooth);
+    }
+    return true;
+}
+
+static void parse_chunk(ObjChunk& chunk, const char* file_begin) {
+    std::vector<ObjCorner> polygon;
+    int smooth = -1;
+
+    const char* line = chunk.begin;
+    while (line < chunk.end) {
+        const char* line_end = static_cast<const char*>(std::memchr(line, '\n', chunk.end - line));
+        if (line_end == nullptr) {
+            line_end = chunk.end;
+        }
+
+        const char* p = line;
+        skip_blanks(p, line_end);
+        bool ok = true;
+        if (p + 1 < line_end && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+            vec3<float> position;
+            p++;
+            ok = parse_float(p, line_end, position.x) && parse_float(p, line_end, position.y) && parse_float(p, line_end, position.z);
+            chunk.positions.push_back(position);
+        } else if (p + 2 < line_end && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t')) {
+            vec2<float> uv;
+            p += 2;
+            ok = parse_float(p, line_end, uv.x);
+            const char* q = p;
+            skip_blanks(q, line_end);
+            if (ok && q < line_end && *q != '\r' && *q != '#') { // v is optional
+                ok = parse_float(p, line_end, uv.y);
+            }
+            chunk.uvs.push_back(uv);
+        } else if (p + 2 < line_end && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t')) {
+            vec3<float> normal;
+            p += 2;
+            ok = parse_float(p, line_end, normal.x) && parse_float(p, line_end, normal.y) && parse_float(p, line_end, normal.z);
+            chunk.normals.push_back(normal);
+        } else if (p + 1 < line_end && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+            ok = parse_face(p + 1, line_end, chunk, polygon, smooth);
+        } else if (p + 1 < line_end && p[0] == 's' && (p[1] == ' ' || p[1] == '\t')) {
+            p++;
+            skip_blanks(p, line_end);
+            bool off = (line_end - p >= 3 && std::strncmp(p, "off", 3) == 0) || (p < line_end && *p == '0' &&
+                       (p + 1 == line_end || p[1] == ' ' || p[1] == '\r'));
+            smooth = off ? 0 : 1;
+            chunk.smooth_state = smooth;
+        }
+        // TODO: Handle groups, materials, etc.
+
+        if (!ok && chunk.error_offset == 0) {
+            chunk.error_offset = (line - file_begin) + 1;
+        }
+        line = line_end + 1;
+    }
+}
+
+// Line number of a byte offset, only used to report errors
+static size_t line_number(const char* data, size_t offset) {
+    size_t line = 1;
+    for (size_t i = 0; i < offset; i++) {
+        line += (data[i] == '\n');
+    }
+    return line;
+}
+
+// Result of the parallel parse: merged vertex attributes, and the faces still held by their chunks
+struct ObjData {
+    std::vector<ObjChunk> chunks;
+    std::vector<size_t> base_v, base_vt, base_vn, base_tri;  // offsets of every chunk in the merged arrays
+    std::vector<int> start_smooth;                            // smoothing state every chunk starts with
+    std::vector<vec3<float>> positions;
+    std::vector<vec2<float>> uvs;
+    std::vector<vec3<float>> normals;
+    size_t num_faces = 0;
+};
+
+static bool load_obj_data(const char *obj_filename, ThreadPool& pool, ObjData& obj)
+{
+    // Map the file
+    int fd = open(obj_filename, O_RDONLY);
+    if (fd < 0) {
+        BVH_LOG(ERROR, "Could not open file " << obj_filename);
+        return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        BVH_LOG(ERROR, "Could not open file " << obj_filename);
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    if (size == 0) {
+        close(fd);
+        obj.base_v = obj.base_vt = obj.base_vn = obj.base_tri = std::vector<size_t>(1, 0);
+        return true;
+    }
+    void* mapping = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) {
+        BVH_LOG(ERROR, "Could not map file " << obj_filename);
+        return false;
+    }
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    const char* data = static_cast<const char*>(mapping);
+
+    // Split the file into chunks that start at the beginning of a line
+    std::vector<ObjChunk>& chunks = obj.chunks;
+    size_t num_chunks = std::max<size_t>(1, std::min<size_t>(pool.num_threads() * 4, size / OBJ_MIN_CHUNK_SIZE));
+    const char* chunk_begin = data;
+    for (size_t i = 1; i <= num_chunks && chunk_begin < data + size; i++) {
+        const char* chunk_end = data + size * i / num_chunks;
+        if (chunk_end < chunk_begin) {
+            chunk_end = chunk_begin;
+        }
+        const char* newline = static_cast<const char*>(std::memchr(chunk_end, '\n', data + size - chunk_end));
+        chunk_end = (i == num_chunks || newline == nullptr) ? data + size : newline + 1;
+        ObjChunk chunk;
+        chunk.begin = chunk_begin;
+        chunk.end = chunk_end;
+        chunks.push_back(std::move(chunk));
+        chunk_begin = chunk_end;
+    }
+
+    // Parse the chunks in parallel
+    TaskGroup group(pool);
+    for (ObjChunk& chunk : chunks) {
+        group.run([&chunk, data]() { parse_chunk(chunk, data); });
+    }
+    group.wait();
+
+    for (const ObjChunk& chunk : chunks) {
+        if (chunk.error_offset != 0) {
+            BVH_LOG(ERROR, "Malformed line " << line_number(data, chunk.error_offset - 1) << " in " << obj_filename);
+            munmap(mapping, size);
+            return false;
+        }
+    }
+    munmap(mapping, size);
+
+    // Offsets of every chunk in the merged arrays, and the smoothing state each chunk starts with
+    size_t num_parts = chunks.size();
+    obj.base_v.assign(num_parts + 1, 0);
+    obj.base_vt.assign(num_parts + 1, 0);
+    obj.base_vn.assign(num_parts + 1, 0);
+    obj.base_tri.assign(num_parts + 1, 0);
+    obj.start_smooth.assign(num_parts, 0);
+    int smooth = 0;
+    for (size_t c = 0; c < num_parts; c++) {
+        obj.base_v[c + 1] = obj.base_v[c] + chunks[c].positions.size();
+        obj.base_vt[c + 1] = obj.base_vt[c] + chunks[c].uvs.size();
+        obj.base_vn[c + 1] = obj.base_vn[c] + chunks[c].normals.size();
+        obj.base_tri[c + 1] = obj.base_tri[c] + chunks[c].smooth.size();
+        obj.start_smooth[c] = smooth;
+        if (chunks[c].smooth_state != -1) {
+            smooth = chunks[c].smooth_state;
+        }
+    }
+
+    obj.num_faces = obj.base_tri[num_parts];
+    if (obj.num_faces > 0x7fffffff || obj.base_v[num_parts] > 0xffffffffu) {
+        BVH_LOG(ERROR, "Too many triangles in " << obj_filename);
+        return false;
+    }
+
+    // Merge the vertex attributes
+    obj.positions.resize(obj.base_v[num_parts]);
+    obj.uvs.resize(obj.base_vt[num_parts]);
+    obj.normals.resize(obj.base_vn[num_parts]);
+    for (size_t c = 0; c < num_parts; c++) {
+        group.run([&obj, c]() {
+            const ObjChunk& chunk = obj.chunks[c];
+            std::copy(chunk.positions.begin(), chunk.positions.end(), obj.positions.begin() + obj.base_v[c]);
+            std::copy(chunk.uvs.begin(), chunk.uvs.end(), obj.uvs.begin() + obj.base_vt[c]);
+            std::copy(chunk.normals.begin(), chunk.normals.end(), obj.normals.begin() + obj.base_vn[c]);
+        });
+    }
+    group.wait();
+    return true;
+}
+
+// Turns a corner of chunk c into indices in the merged arrays, -1 for missing attributes.
+// Returns false if an index is out of range.
+static bool resolve_corner(const ObjData& obj, size_t c, const ObjCorner& corner, long long& v, long long& vt, long long& vn) {
+    v = corner.v + ((corner.relative & OBJ_RELATIVE_V) ? (long long)obj.base_v[c] : 0);
+    if (v < 0 || v >= (long long)obj.positions.size()) {
+        return false;
+    }
+
+    vt = -1;
+    if (corner.vt != -1 || (corner.relative & OBJ_RELATIVE_VT)) {
+        vt = corner.vt + ((corner.relative & OBJ_RELATIVE_VT) ? (long long)obj.base_vt[c] : 0);
+        if (vt < 0 || vt >= (long long)obj.uvs.size()) {
+            return false;
+        }
+    }
+
+    vn = -1;
+    if (corner.vn != -1 || (corner.relative & OBJ_RELATIVE_VN)) {
+        vn = corner.vn + ((corner.relative & OBJ_RELATIVE_VN) ? (long long)obj.base_vn[c] : 0);
+        if (vn < 0 || vn >= (long long)obj.normals.size()) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static bool triangle_smooth(const ObjData& obj, size_t c, size_t t) {
+    signed char smooth = obj.chunks[c].smooth[t];
+    return (smooth == -1) ? (obj.start_smooth[c] != 0) : (smooth != 0);
+}
+
+int parse_obj_file(const char *obj_filename, Triangle **triangles, int num_threads)
+{
+    *triangles = nullptr;
+
+    ThreadPool pool(num_threads);
+    ObjData obj;
+    if (!load_obj_data(obj_filename, pool, obj)) {
+        return -1;
+    }
+
+    // Build the triangles, resolving the chunk-relative indices
+    Triangle* result = new Triangle[obj.num_faces];
+    std::atomic<bool> out_of_range{false};
+    TaskGroup group(pool);
+    for (size_t c = 0; c < obj.chunks.size(); c++) {
+        group.run([&, c]() {
+            const ObjChunk& chunk = obj.chunks[c];
+            for (size_t t = 0; t < chunk.smooth.size(); t++) {
+                Triangle& tri = result[obj.base_tri[c] + t];
+                tri.smooth = triangle_smooth(obj, c, t);
+                for (int k = 0; k < 3; k++) {
+                    long long v, vt, vn;
+                    if (!resolve_corner(obj, c, chunk.corners[3 * t + k], v, vt, vn)) {
+                        out_of_range = true;
+                        return;
+                    }
+                    tri.vertices[k] = obj.positions[v];
+                    tri.uv[k] = (vt == -1) ? vec2<float>() : obj.uvs[vt];
+                    tri.normals[k] = (vn == -1) ? vec3<float>() : obj.normals[vn];
+                }
+            }
+        });
+    }
+    group.wait();
+
+    if (out_of_range) {
+        BVH_LOG(ERROR, "Face index out of range in " << obj_filename);
+        delete[] result;
+        return -1;
+    }
+
+    *triangles = result;
+    return static_cast<int>(obj.num_faces);
+}
+
+int parse_obj_file(const char *obj_filename, Mesh &mesh, int num_threads)
+{
+    mesh = Mesh();
+
+    ThreadPool pool(num_threads);
+    ObjData obj;
+    if (!load_obj_data(obj_filename, pool, obj)) {
+        return -1;
+    }
+
+    // One mesh vertex per distinct (v, vt, vn) combination. The combinations already seen for a
+    // position are chained from that position, OBJ files rarely have more than a few per position.
+    const uint32_t NONE = 0xffffffffu;
+    struct VertexEntry {
+        long long vt, vn;
+        uint32_t vertex;
+        uint32_t next;
+    };
+    std::vector<uint32_t> first_entry(obj.positions.size(), NONE);
+    std::vector<VertexEntry> entries;
+    entries.reserve(obj.positions.size());
+
+    mesh.indices.resize(3 * obj.num_faces);
+    mesh.smooth.resize(obj.num_faces);
+    for (size_t c = 0; c < obj.chunks.size(); c++) {
+        const ObjChunk& chunk = obj.chunks[c];
+        for (size_t t = 0; t < chunk.smooth.size(); t++) {
+            size_t tri = obj.base_tri[c] + t;
+            mesh.smooth[tri] = triangle_smooth(obj, c, t) ? 1 : 0;
+            for (int k = 0; k < 3; k++) {
+                long long v, vt, vn;
+                if (!resolve_corner(obj, c, chunk.corners[3 * t + k], v, vt, vn)) {
+                    BVH_LOG(ERROR, "Face index out of range in " << obj_filename);
+                    mesh = Mesh();
+                    return -1;
+                }
+
+                uint32_t entry = first_entry[v];
+                while (entry != NONE && (entries[entry].vt != vt || entries[entry].vn != vn)) {
+                    entry = entries[entry].next;
+                }
+                if (entry == NONE) {
+                    uint32_t vertex = mesh.add_vertex(obj.positions[v], (vt == -1) ? vec2<float>() : obj.uvs[vt],
+                                                      (vn == -1) ? vec3<float>() : obj.normals[vn]);
+                    entries.push_back({vt, vn, vertex, first_entry[v]});
+                    entry = entries.size() - 1;
+                    first_entry[v] = entry;
+                }
+                mesh.indices[3 * tri + k] = entries[entry].vertex;
+            }
+        }
+    }
+
+    mesh.shrink_to_fit();
+    return static_cast<int>(obj.num_faces);
+}
+
+}
@@ -2,136 +2,85 @@
 #include <object.hpp>
 #include <bvh_node.hpp>
 #include <bvh.hpp>
+#include <traversal.hpp>
+#include <linear_bvh.hpp>
+#include <bvh_binary.hpp>
+#include <obj_loader.hpp>
+#include <log.hpp>
 
 #include <cstdio>
+#include <cstdlib>
 #include <iostream>
-#include <queue>
+#include <utility>
+#include <vector>
 
 using namespace bvh;
 
-int parse_obj_file(char *obj_filename, Triangle **triangles)
+// Checks that the explicit child links of a text BVH form a single tree rooted at the first line: every
+// other line is the child of exactly one node and is reachable from the root
+static bool valid_tree_links(const std::vector<std::pair<int, int>> &children)
 {
-
-  // Open the file
-  FILE *file = fopen(obj_filename, "r");
-  if (!file)
+  int num_lines = static_cast<int>(children.size());
+  std::vector<char> has_parent(num_lines, 0);
+  for (const std::pair<int, int> &links : children)
   {
-    std::cerr << "Error: Could not open file " << obj_filename << std::endl;
-    return -1;
-  }
-
-  // 1st pass: count the number
-  int num_vertices = 0;
-  int num_texture_coords = 0;
-  int num_normals = 0;
-  int num_faces = 0;
-
-  char line[256];
-  while (fgets(line, 256, file))
-  {
-    if (line[0] == 'v')
+    for (int child : {links.first, links.second})
     {
-      if (line[1] == ' ')
-      {
-        num_vertices++;
-      }
-      else if (line[1] == 't')
+      if (child == -1)
       {
-        num_texture_coords++;
+        continue;
       }
-      else if (line[1] == 'n')
+      if (child <= 0 || child >= num_lines || has_parent[child])
       {
-        num_normals++;
+        return false;
       }
-    }
-    else if (line[0] == 'f')
-    {
-      num_faces++;
+      has_parent[child] = 1;
     }
   }
 
-  fseek(file, 0, SEEK_SET); // rewind
-
-  // 2nd pass: read the vertices and faces
-  vec3<float> *vertices = new vec3<float>[num_vertices];
-  vec2<float> *texture_coords = new vec2<float>[num_texture_coords];
-  vec3<float> *normals = new vec3<float>[num_normals];
-  *triangles = new Triangle[num_faces];
-
-  int vertex_index = 0;
-  int texture_coord_index = 0;
-  int normal_index = 0;
-  int face_index = 0;
-
-  int v0, vt0, vn0, v1, vt1, vn1, v2, vt2, vn2;
-  while (fgets(line, 256, file))
+  // Each line has at most one parent and the root has none, so a walk from the root visits every line at
+  // most once, and visits them all unless some lines form a cycle apart from it
+  int reached = 0;
+  std::vector<int> stack = {0};
+  while (!stack.empty())
   {
-    if (line[0] == 'v')
+    int line = stack.back();
+    stack.pop_back();
+    reached++;
+    for (int child : {children[line].first, children[line].second})
     {
-      if (line[1] == ' ')
-      {
-        sscanf(line, "v %f %f %f", &vertices[vertex_index].x, &vertices[vertex_index].y, &vertices[vertex_index].z);
-        vertex_index++;
-      }
-      else if (line[1] == 't')
+      if (child != -1)
       {
-        sscanf(line, "vt %f %f", &texture_coords[texture_coord_index].x, &texture_coords[texture_coord_index].y);
-        texture_coord_index++;
-      }
-      else if (line[1] == 'n')
-      {
-        sscanf(line, "vn %f %f %f", &normals[normal_index].x, &normals[normal_index].y, &normals[normal_index].z);
-        normal_index++;
+        stack.push_back(child);
       }
     }
-    else if (line[0] == 'f')
-    {
-      sscanf(line, "f %d/%d/%d %d/%d/%d %d/%d/%d", &v0, &vt0, &vn0, &v1, &vt1, &vn1, &v2, &vt2, &vn2);
-
-      (*triangles)[face_index].vertices[0] = vertices[v0 - 1];
-      (*triangles)[face_index].vertices[1] = vertices[v1 - 1];
-      (*triangles)[face_index].vertices[2] = vertices[v2 - 1];
-
-      (*triangles)[face_index].uv[0] = texture_coords[vt0 - 1];
-      (*triangles)[face_index].uv[1] = texture_coords[vt1 - 1];
-      (*triangles)[face_index].uv[2] = texture_coords[vt2 - 1];
-
-      (*triangles)[face_index].normals[0] = normals[vn0 - 1];
-      (*triangles)[face_index].normals[1] = normals[vn1 - 1];
-      (*triangles)[face_index].normals[2] = normals[vn2 - 1];
-
-      face_index++;
-    }
-    // TODO: Handle groups, smoothing, materials, etc.
   }
-
-  fclose(file);
-
-  // Cleanup
-  delete[] vertices;
-  delete[] texture_coords;
-  delete[] normals;
-
-  return num_faces;
+  return reached == num_lines;
 }
 
-BvhNode *parse_bvh_file(char *bvh_filename)
+// Reads a BVH in the text format. Internal nodes give the line numbers of their children, so the nodes can
+// come in any order (see NodeLayout). Older files without them list the nodes breadth first, internal nodes
+// before leaves, and the children of the i-th node (counting from 1) are the nodes 2i and 2i + 1. Leaves list
+// any number of triangles, so lines are read whole whatever their length. Every leaf must list at least one
+// triangle, and every index must be one of the num_triangles triangles of the object.
+static BvhTree parse_bvh_file(char *bvh_filename, int num_triangles)
 {
 
   // Open the file
   FILE *file = fopen(bvh_filename, "r");
   if (!file)
   {
-    std::cerr << "Error: Could not open file " << bvh_filename << std::endl;
-    return nullptr;
+    BVH_LOG(ERROR, "Could not open file " << bvh_filename);
+    return BvhTree();
   }
 
   // 1st pass: count the number of nodes
   int num_nodes = 0;
   int num_leaves = 0;
 
-  char line[256];
-  while (fgets(line, 256, file))
+  char *line = nullptr;
+  size_t capacity = 0;
+  while (getline(&line, &capacity, file) != -1)
   {
     if (line[0] == 'n')
     {
@@ -145,52 +94,129 @@ BvhNode *parse_bvh_file(char *bvh_filename)
 
   fseek(file, 0, SEEK_SET); // rewind
 
-  // 2nd pass: read the nodes and leaves
-  BvhNode *nodes = new BvhNode[num_nodes];
-  BvhLeaf *leaves = new BvhLeaf[num_leaves];
-
-  int nodes_index = 0;
-  int leaves_index = 0;
-
+  // 2nd pass: read the nodes and leaves, every one of them allocated in the arena of the tree
+  std::unique_ptr<NodeArena> arena = std::make_unique<NodeArena>();
+  std::vector<BvhNode *> nodes;
+  std::vector<BvhNode *> leaves;
+  nodes.reserve(num_nodes);
+  leaves.reserve(num_leaves);
+
+  ArenaNodeAllocator alloc{arena.get()};
+  std::vector<int> indices;
+  std::vector<BvhNode *> lines;                 // Nodes and leaves in file order
+  std::vector<std::pair<int, int>> children;    // Child lines of each line, -1 for leaves
+  int num_linked = 0;                           // Internal nodes that give their children
+  lines.reserve(num_nodes + num_leaves);
+  children.reserve(num_nodes + num_leaves);
   vec3<float> min, max;
-  while (fgets(line, 256, file))
+  bool valid = true;
+  while (valid && getline(&line, &capacity, file) != -1)
   {
     if (line[0] == 'n')
     {
-      sscanf(line, "n %f %f %f %f %f %f", &min.x, &min.y, &min.z, &max.x, &max.y, &max.z);
-      nodes[nodes_index] = BvhNode(min, max);
+      int left = -1, right = -1;
+      int fields = sscanf(line, "n %f %f %f %f %f %f %d %d", &min.x, &min.y, &min.z, &max.x, &max.y, &max.z, &left, &right);
+      if (fields > 6)
+      {
+        // Only leaves may have no children: an internal node that gives links must give two valid ones
+        int num_lines = num_nodes + num_leaves;
+        if (fields != 8 || left < 1 || left >= num_lines || right < 1 || right >= num_lines)
+        {
+          BVH_LOG(ERROR, bvh_filename << " has a node with invalid child links");
+          valid = false;
+          break;
+        }
+        num_linked++;
+      }
+      nodes.push_back(arena->create<BvhNode>(min, max));
+      lines.push_back(nodes.back());
+      children.push_back({left, right});
     }
     else if (line[0] == 'l')
     {
-      int num_triangles = 0;
-      int indices[BVH_LEAF_SIZE];
-
-      num_triangles = sscanf(
-                          line, "l %f %f %f %f %f %f %d %d %d %d %d %d %d %d",
-                          &min.x, &min.y, &min.z, &max.x, &max.y, &max.z,
-                          &indices[0], &indices[1], &indices[2], &indices[3], &indices[4], &indices[5], &indices[6], &indices[7]) -
-                      6;
+      int read = 0;
+      sscanf(line, "l %f %f %f %f %f %f%n", &min.x, &min.y, &min.z, &max.x, &max.y, &max.z, &read);
+
+      // Triangle indices until the end of the line
+      indices.clear();
+      char *cursor = line + read;
+      char *next = cursor;
+      for (long index = strtol(cursor, &next, 10); next != cursor; index = strtol(cursor, &next, 10))
+      {
+        // Compared as a long, so that values past the range of int (clamped to LONG_MIN/MAX by strtol) are
+        // rejected before being narrowed
+        if (index < 0 || index >= num_triangles)
+        {
+          BVH_LOG(ERROR, bvh_filename << " has triangle index " << index << " out of [0, " << num_triangles << "[");
+          valid = false;
+          break;
+        }
+        indices.push_back(static_cast<int>(index));
+        cursor = next;
+      }
+      if (!valid)
+      {
+        break;
+      }
+      if (indices.empty())
+      {
+        BVH_LOG(ERROR, bvh_filename << " has a leaf without triangles");
+        valid = false;
+        break;
+      }
 
-      leaves[leaves_index++] = BvhLeaf(min, max, num_triangles, indices);
+      leaves.push_back(alloc.leaf(min, max, static_cast<int>(indices.size()), indices.data()));
+      lines.push_back(leaves.back());
+      children.push_back({-1, -1});
     }
   }
 
+  free(line);
   fclose(file);
+  if (!valid)
+  {
+    return BvhTree();
+  }
 
   // Build the BVH
   BvhNode *root;
 
+  if (num_linked > 0)
+  {
+    if (num_linked != num_nodes || !valid_tree_links(children))
+    {
+      BVH_LOG(ERROR, bvh_filename << " has invalid child links");
+      return BvhTree();
+    }
+    for (size_t i = 0; i < lines.size(); i++)
+    {
+      if (children[i].first != -1)
+      {
+        lines[i]->left = lines[children[i].first];
+        lines[i]->right = lines[children[i].second];
+      }
+    }
+    return BvhTree(std::move(arena), lines[0]);
+  }
+
   if (num_nodes > 0)
   { // track the root node
-    root = nodes;
+    root = nodes[0];
   }
   else if (num_leaves > 0)
   {
-    root = leaves;
+    root = leaves[0];
   }
   else
   {
-    return nullptr;
+    return BvhTree();
+  }
+
+  // A full binary tree with n internal nodes has n + 1 leaves
+  if (num_nodes > 0 && num_leaves != num_nodes + 1)
+  {
+    BVH_LOG(ERROR, bvh_filename << " has " << num_nodes << " nodes but " << num_leaves << " leaves");
+    return BvhTree();
   }
 
   // Link the nodes
@@ -199,30 +225,64 @@ BvhNode *parse_bvh_file(char *bvh_filename)
     int i_left = 2 * i;
     int i_right = 2 * i + 1;
 
-    if (i_right <= num_nodes)
-    {
-      nodes[i - 1].left = &nodes[i_left - 1];
-      nodes[i - 1].right = &nodes[i_right - 1];
-    }
-    else
-    {
-      nodes[i - 1].left = &leaves[i_left - num_nodes - 1];
-      nodes[i - 1].right = &leaves[i_right - num_nodes - 1];
-    }
+    nodes[i - 1]->left = i_left <= num_nodes ? nodes[i_left - 1] : leaves[i_left - num_nodes - 1];
+    nodes[i - 1]->right = i_right <= num_nodes ? nodes[i_right - 1] : leaves[i_right - num_nodes - 1];
   }
 
-  // Cleanup
-  // Do not delete the nodes and leaves, as they live in the heap and are now owned by the root node
-
-  return root;
+  return BvhTree(std::move(arena), root);
 }
 
 Object::Object(vec3<float> position, vec3<float> rotation, vec3<float> scale, Triangle *triangles, int num_triangles, BvhNode *bvh)
-    : position(position), rotation(rotation), scale(scale), triangles(triangles), num_triangles(num_triangles), bvh(bvh) {}
+    : position(position), rotation(rotation), scale(scale), triangles(triangles), num_triangles(num_triangles), mesh(nullptr), bvh(bvh), bvh_build_cost(sah_cost(bvh)) {}
+
+Object::Object(vec3<float> position, vec3<float> rotation, vec3<float> scale, Mesh *mesh, BvhNode *bvh)
+    : position(position), rotation(rotation), scale(scale), triangles(nullptr), num_triangles(mesh->num_triangles()), mesh(mesh), bvh(bvh), bvh_build_cost(sah_cost(bvh)) {}
+
+Object::Object(vec3<float> position, vec3<float> rotation, vec3<float> scale, Triangle *triangles, int num_triangles, BvhTree &&tree)
+    : position(position), rotation(rotation), scale(scale), triangles(triangles), num_triangles(num_triangles), mesh(nullptr), bvh(tree.root()), bvh_tree(std::move(tree)), bvh_build_cost(sah_cost(bvh)) {}
+
+Object::Object(vec3<float> position, vec3<float> rotation, vec3<float> scale, Mesh *mesh, BvhTree &&tree)
+    : position(position), rotation(rotation), scale(scale), triangles(nullptr), num_triangles(mesh->num_triangles()), mesh(mesh), bvh(tree.root()), bvh_tree(std::move(tree)), bvh_build_cost(sah_cost(bvh)) {}
 
 Object::~Object()
 {
   delete[] triangles;
+  delete mesh;
+}
+
+Hit Object::intersect(const Ray &ray) const
+{
+  if (mesh != nullptr)
+  {
+    return bvh::intersect(bvh, *mesh, ray);
+  }
+  return bvh::intersect(bvh, triangles, ray);
+}
+
+bool Object::occluded(const Ray &ray) const
+{
+  if (mesh != nullptr)
+  {
+    return bvh::occluded(bvh, *mesh, ray);
+  }
+  return bvh::occluded(bvh, triangles, ray);
+}
+
+void Object::refit(bool parallel)
+{
+  if (mesh != nullptr)
+  {
+    parallel ? refit_bvh_parallel(bvh, *mesh) : refit_bvh(bvh, *mesh);
+  }
+  else
+  {
+    parallel ? refit_bvh_parallel(bvh, triangles) : refit_bvh(bvh, triangles);
+  }
+}
+
+bool Object::needs_rebuild(float max_degradation) const
+{
+  return refit_degradation(bvh, bvh_build_cost) > max_degradation;
 }
 
 void Object::build_bvh(char *obj_filename, char *bvh_filename)
@@ -252,74 +312,81 @@ void Object::build_bvh(char *obj_filename, char *bvh_filename)
  *
  * @param bvh_filename The name of the file to save the BVH structure to
  * @param bvh The root node of the BVH structure
+ * @param layout The order of the lines, internal nodes give the line numbers of their children
  */
-void Object::save_bvh(char *bvh_filename, BvhNode *bvh)
+void Object::save_bvh(char *bvh_filename, BvhNode *bvh, NodeLayout layout)
 {
   // Open the BVH file for writing
   FILE *file = fopen(bvh_filename, "w"); // Open for writing
   if (!file)
   {
-    std::cerr << "Error: Could not open file " << bvh_filename << " for writing." << std::endl;
+    BVH_LOG(ERROR, "Could not open file " << bvh_filename << " for writing.");
     return;
   }
 
-  // Breadth-first traversal to save BVH structure
-  std::queue<BvhNode *> node_tree_queue;
-  node_tree_queue.push(bvh); // Store the root node
-  // std::cout << "Processing root node " << bvh << " with children " << bvh->left << " and " << bvh->right << std::endl;
-  while (!node_tree_queue.empty())
+  // The flattened BVH has the nodes in the order of the layout, one line per node
+  LinearBvh linear = LinearBvh::flatten(bvh, layout);
+  for (size_t i = 0; i < linear.nodes.size(); i++)
   {
-    BvhNode *current_node = node_tree_queue.front(); // Get the current node
-    node_tree_queue.pop();                           // Remove the current node from the queue
-
-    // Put leaf information inside the BVH file
-    if (dynamic_cast<BvhLeaf *>(current_node)) // Check if the current node is a leaf
+    const LinearBvhNode &node = linear.nodes[i];
+    if (node.is_leaf())
     {
-      BvhLeaf *current_leaf = dynamic_cast<BvhLeaf *>(current_node); // Get the node as a leaf
-      // std::cout << "Processing leaf node " << current_leaf << " with " << current_leaf->num_triangles << " triangles." << std::endl;
-
       // Format in BVH file: l <min.x> <min.y> <min.z> <max.x> <max.y> <max.z> <triangle_1> [<triangle_2> <triangle_3> ...]
-      fprintf(file, "l %f %f %f %f %f %f %d ",
-              current_leaf->bounding_box.min.x, current_leaf->bounding_box.min.y, current_leaf->bounding_box.min.z,
-              current_leaf->bounding_box.max.x, current_leaf->bounding_box.max.y, current_leaf->bounding_box.max.z,
-              current_leaf->indices[0]);
-      for (int i = 1; i < current_leaf->num_triangles; i++)
+      fprintf(file, "l %f %f %f %f %f %f", node.min.x, node.min.y, node.min.z, node.max.x, node.max.y, node.max.z);
+      for (uint32_t j = node.offset; j < node.offset + node.count; j++)
       {
-        if (i < current_leaf->num_triangles - 1)
-        {
-          fprintf(file, "%d ", current_leaf->indices[i]);
-        }
-        else if (i == current_leaf->num_triangles - 1)
-        {
-          fprintf(file, "%d\n", current_leaf->indices[i]);
-        }
+        fprintf(file, " %d", linear.primitive_indices[j]);
       }
+      fprintf(file, "\n");
+    }
+    else
+    {
+      // Format in BVH file: n <min.x> <min.y> <min.z> <max.x> <max.y> <max.z> <left> <right>
+      fprintf(file, "n %f %f %f %f %f %f %u %u\n", node.min.x, node.min.y, node.min.z, node.max.x, node.max.y, node.max.z,
+              node.offset, node.offset + 1);
     }
+  }
 
-    // Put node information inside the BVH file
-    else // It's an internal node
+  fclose(file);
+}
+
+/**
+ * @brief Function to save the BVH structure to a binary file
+ *
+ * @param bvh_filename The name of the file to save the BVH structure to
+ * @param bvh The root node of the BVH structure
+ * @param num_triangles The number of triangles the BVH was built over
+ */
+void Object::save_bvh_binary(char *bvh_filename, BvhNode *bvh, int num_triangles)
+{
+  bvh::save_bvh_binary(bvh_filename, LinearBvh::flatten(bvh), num_triangles);
+}
+
+// Reads a BVH in the text or in the binary format, binary files are mapped and converted without parsing
+static BvhTree load_bvh_file(char *bvh_filename, int num_triangles)
+{
+  BvhTree bvh;
+  if (is_bvh_binary(bvh_filename))
+  {
+    MappedBvh *mapped = MappedBvh::open(bvh_filename);
+    if (mapped != nullptr)
     {
-      // std::cout << "Processing internal node " << current_node << " with children " << current_node->left << " and " << current_node->right << std::endl;
-      // Format in BVH file: n <min.x> <min.y> <min.z> <max.x> <max.y> <max.z>
-      fprintf(file, "n %f %f %f %f %f %f\n",
-              current_node->bounding_box.min.x, current_node->bounding_box.min.y, current_node->bounding_box.min.z,
-              current_node->bounding_box.max.x, current_node->bounding_box.max.y, current_node->bounding_box.max.z);
-
-      // Save the node's children
-      if (current_node->left)
+      if (mapped->num_triangles() != static_cast<uint32_t>(num_triangles))
       {
-        node_tree_queue.push(current_node->left);
+        BVH_LOG(ERROR, bvh_filename << " was built over " << mapped->num_triangles() << " triangles but the object has " << num_triangles);
       }
-      if (current_node->right)
+      else
       {
-        node_tree_queue.push(current_node->right);
+        bvh = BvhTree::from_linear(mapped->view());
       }
+      delete mapped;
     }
-
-    // std::cout << "Queue size: " << node_tree_queue.size() << std::endl;
   }
-
-  fclose(file);
+  else
+  {
+    bvh = parse_bvh_file(bvh_filename, num_triangles);
+  }
+  return bvh;
 }
 
 Object *Object::load(char *obj_filename, char *bvh_filename)
@@ -336,13 +403,37 @@ Object *Object::load(char *obj_filename, char *bvh_filename)
   }
 
   // Parse the bvh file
-  BvhNode *bvh = parse_bvh_file(bvh_filename);
+  BvhTree bvh = load_bvh_file(bvh_filename, num_triangles);
+
+  if (bvh.empty())
+  {
+    delete[] triangles;
+    return nullptr;
+  }
+
+  // Build and return object
+  return new Object(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0), vec3<float>(1, 1, 1), triangles, num_triangles, std::move(bvh));
+}
+
+Object *Object::load_indexed(char *obj_filename, char *bvh_filename)
+{
+  // Parse the obj file
+  Mesh *mesh = new Mesh();
+  if (parse_obj_file(obj_filename, *mesh) == -1)
+  {
+    delete mesh;
+    return nullptr;
+  }
+
+  // Parse the bvh file
+  BvhTree bvh = load_bvh_file(bvh_filename, mesh->num_triangles());
 
-  if (bvh == nullptr)
+  if (bvh.empty())
   {
+    delete mesh;
     return nullptr;
   }
 
   // Build and return object
-  return new Object(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0), vec3<float>(1, 1, 1), triangles, num_triangles, bvh);
+  return new Object(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0), vec3<float>(1, 1, 1), mesh, std::move(bvh));
 }
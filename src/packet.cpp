@@ -0,0 +1,462 @@
+#include <packet.hpp>
+#include <linear_bvh_traversal.hpp>
+#include <simd.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace bvh {
+
+#ifdef __AVX2__
+
+// The rays of a packet in SoA form, one lane per ray
+struct PacketRays {
+    __m256 ox, oy, oz;  // Origins
+    __m256 dx, dy, dz;  // Directions
+    __m256 ix, iy, iz;  // Inverse directions
+    __m256 tmin;
+};
+
+// The closest hits of a packet so far, t starts at ray.tmax
+struct PacketHits {
+    __m256 t, u, v;
+    __m256i triangle;
+};
+
+static void load_packet(const Ray* rays, int count, PacketRays& packet, PacketHits& hits) {
+    alignas(32) float values[11][BVH_PACKET_SIZE];
+    for (int i = 0; i < BVH_PACKET_SIZE; i++) {
+        // Unused lanes repeat the last ray, they are never active
+        const Ray& ray = rays[std::min(i, count - 1)];
+        values[0][i] = ray.origin.x;
+        values[1][i] = ray.origin.y;
+        values[2][i] = ray.origin.z;
+        values[3][i] = ray.direction.x;
+        values[4][i] = ray.direction.y;
+        values[5][i] = ray.direction.z;
+        values[6][i] = ray.inv_direction.x;
+        values[7][i] = ray.inv_direction.y;
+        values[8][i] = ray.inv_direction.z;
+        values[9][i] = ray.tmin;
+        values[10][i] = ray.tmax;
+    }
+    packet.ox = _mm256_load_ps(values[0]);
+    packet.oy = _mm256_load_ps(values[1]);
+    packet.oz = _mm256_load_ps(values[2]);
+    packet.dx = _mm256_load_ps(values[3]);
+    packet.dy = _mm256_load_ps(values[4]);
+    packet.dz = _mm256_load_ps(values[5]);
+    packet.ix = _mm256_load_ps(values[6]);
+    packet.iy = _mm256_load_ps(values[7]);
+    packet.iz = _mm256_load_ps(values[8]);
+    packet.tmin = _mm256_load_ps(values[9]);
+
+    hits.t = _mm256_load_ps(values[10]);
+    hits.u = _mm256_setzero_ps();
+    hits.v = _mm256_setzero_ps();
+    hits.triangle = _mm256_set1_epi32(-1);
+}
+
+// Slab test of a node against all the lanes, same arithmetic as intersect_box()
+static inline __m256 intersect_box(const LinearBvhNode& node, const PacketRays& p, __m256 tmax) {
+    __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.min.x), p.ox), p.ix);
+    __m256 tx2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.max.x), p.ox), p.ix);
+    __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.min.y), p.oy), p.iy);
+    __m256 ty2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.max.y), p.oy), p.iy);
+    __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.min.z), p.oz), p.iz);
+    __m256 tz2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_set1_ps(node.max.z), p.oz), p.iz);
+
+    __m256 tnear = lane_max(lane_max(lane_min(tx1, tx2), lane_min(ty1, ty2)), lane_max(lane_min(tz1, tz2), p.tmin));
+    __m256 tfar = lane_min(lane_min(lane_max(tx1, tx2), lane_max(ty1, ty2)), lane_min(lane_max(tz1, tz2), tmax));
+    return _mm256_cmp_ps(tnear, tfar, _CMP_LE_OQ);
+}
+
+// Moller-Trumbore of one triangle against all the lanes, same arithmetic as intersect_triangle()
+static inline __m256 intersect_triangle(const PacketRays& p, const vec3<float>& v0, const vec3<float>& v1,
+                                        const vec3<float>& v2, __m256 tmax, __m256& t, __m256& u, __m256& v) {
+    vec3<float> e1 = v1 - v0;
+    vec3<float> e2 = v2 - v0;
+    __m256 e1x = _mm256_set1_ps(e1.x), e1y = _mm256_set1_ps(e1.y), e1z = _mm256_set1_ps(e1.z);
+    __m256 e2x = _mm256_set1_ps(e2.x), e2y = _mm256_set1_ps(e2.y), e2z = _mm256_set1_ps(e2.z);
+
+    // p = cross(direction, e2)
+    __m256 px = _mm256_sub_ps(_mm256_mul_ps(p.dy, e2z), _mm256_mul_ps(p.dz, e2y));
+    __m256 py = _mm256_sub_ps(_mm256_mul_ps(p.dz, e2x), _mm256_mul_ps(p.dx, e2z));
+    __m256 pz = _mm256_sub_ps(_mm256_mul_ps(p.dx, e2y), _mm256_mul_ps(p.dy, e2x));
+    __m256 det = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e1x, px), _mm256_mul_ps(e1y, py)), _mm256_mul_ps(e1z, pz));
+    __m256 inv_det = _mm256_div_ps(_mm256_set1_ps(1.0f), det);
+
+    // s = origin - v0
+    __m256 sx = _mm256_sub_ps(p.ox, _mm256_set1_ps(v0.x));
+    __m256 sy = _mm256_sub_ps(p.oy, _mm256_set1_ps(v0.y));
+    __m256 sz = _mm256_sub_ps(p.oz, _mm256_set1_ps(v0.z));
+    u = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(sx, px), _mm256_mul_ps(sy, py)), _mm256_mul_ps(sz, pz)), inv_det);
+
+    // q = cross(s, e1)
+    __m256 qx = _mm256_sub_ps(_mm256_mul_ps(sy, e1z), _mm256_mul_ps(sz, e1y));
+    __m256 qy = _mm256_sub_ps(_mm256_mul_ps(sz, e1x), _mm256_mul_ps(sx, e1z));
+    __m256 qz = _mm256_sub_ps(_mm256_mul_ps(sx, e1y), _mm256_mul_ps(sy, e1x));
+    v = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(p.dx, qx), _mm256_mul_ps(p.dy, qy)), _mm256_mul_ps(p.dz, qz)), inv_det);
+    t = _mm256_mul_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(e2x, qx), _mm256_mul_ps(e2y, qy)), _mm256_mul_ps(e2z, qz)), inv_det);
+
+    // Negated comparisons (unordered is true) reject exactly what the scalar early returns reject
+    __m256 zero = _mm256_setzero_ps();
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 mask = _mm256_cmp_ps(det, zero, _CMP_NEQ_UQ);
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, zero, _CMP_NLT_UQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(u, one, _CMP_NGT_UQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(v, zero, _CMP_NLT_UQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(_mm256_add_ps(u, v), one, _CMP_NGT_UQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, p.tmin, _CMP_GT_OQ));
+    mask = _mm256_and_ps(mask, _mm256_cmp_ps(t, tmax, _CMP_LT_OQ));
+    return mask;
+}
+
+// Finishes a subtree one ray at a time for the lanes in lane_bits
+template <bool ANY_HIT, typename Accessor>
+static void traverse_lanes(const LinearBvhView& bvh, uint32_t node, const Accessor& tris, const Ray* rays,
+                           int lane_bits, PacketHits& hits) {
+    alignas(32) float t[BVH_PACKET_SIZE], u[BVH_PACKET_SIZE], v[BVH_PACKET_SIZE];
+    alignas(32) int triangle[BVH_PACKET_SIZE];
+    _mm256_store_ps(t, hits.t);
+    _mm256_store_ps(u, hits.u);
+    _mm256_store_ps(v, hits.v);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(triangle), hits.triangle);
+
+    for (int lane = 0; lane < BVH_PACKET_SIZE; lane++) {
+        if (lane_bits & (1 << lane)) {
+            Hit hit;
+            hit.triangle = triangle[lane];
+            hit.t = t[lane];
+            hit.u = u[lane];
+            hit.v = v[lane];
+            traverse_linear<ANY_HIT>(bvh, node, tris, rays[lane], hit);
+            triangle[lane] = hit.triangle;
+            t[lane] = hit.t;
+            u[lane] = hit.u;
+            v[lane] = hit.v;
+        }
+    }
+
+    hits.t = _mm256_load_ps(t);
+    hits.u = _mm256_load_ps(u);
+    hits.v = _mm256_load_ps(v);
+    hits.triangle = _mm256_load_si256(reinterpret_cast<const __m256i*>(triangle));
+}
+
+// Packet traversal loop. active holds the lanes still searching, with ANY_HIT a lane stops at its first hit.
+template <bool ANY_HIT, typename Accessor>
+static void traverse_packet(const LinearBvhView& bvh, uint32_t current, const Accessor& tris, const Ray* rays,
+                            const PacketRays& packet, __m256& active, PacketHits& hits) {
+    // The children are ordered for the direction of the first active ray, coherent rays mostly agree with it
+    const Ray& first = rays[__builtin_ctz(_mm256_movemask_ps(active))];
+    const bool dir_is_neg[3] = {first.inv_direction.x < 0.0f, first.inv_direction.y < 0.0f, first.inv_direction.z < 0.0f};
+
+    uint32_t stack[BVH_TRAVERSAL_STACK_SIZE];
+    int stack_size = 0;
+
+    while (true) {
+        const LinearBvhNode& node = bvh.nodes[current];
+        __m256 mask = _mm256_and_ps(active, intersect_box(node, packet, hits.t));
+        int mask_bits = _mm256_movemask_ps(mask);
+
+        if (mask_bits != 0) {
+            if (__builtin_popcount(mask_bits) <= BVH_PACKET_SCALAR_THRESHOLD) {
+                // Too few rays left to fill the lanes
+                traverse_lanes<ANY_HIT>(bvh, current, tris, rays, mask_bits, hits);
+                if (ANY_HIT) {
+                    __m256 found = _mm256_castsi256_ps(_mm256_cmpgt_epi32(hits.triangle, _mm256_set1_epi32(-1)));
+                    active = _mm256_andnot_ps(found, active);
+                    if (_mm256_movemask_ps(active) == 0) {
+                        return;
+                    }
+                }
+            } else if (node.is_leaf()) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                    int tri = bvh.primitive_indices[i];
+                    __m256 t, u, v;
+                    __m256 hit = _mm256_and_ps(mask, intersect_triangle(packet, tris.vertex(tri, 0), tris.vertex(tri, 1),
+                                                                         tris.vertex(tri, 2), hits.t, t, u, v));
+                    if (_mm256_movemask_ps(hit) == 0) {
+                        continue;
+                    }
+                    hits.t = _mm256_blendv_ps(hits.t, t, hit);
+                    hits.u = _mm256_blendv_ps(hits.u, u, hit);
+                    hits.v = _mm256_blendv_ps(hits.v, v, hit);
+                    hits.triangle = _mm256_blendv_epi8(hits.triangle, _mm256_set1_epi32(tri), _mm256_castps_si256(hit));
+                    if (ANY_HIT) {
+                        active = _mm256_andnot_ps(hit, active);
+                        mask = _mm256_andnot_ps(hit, mask);
+                        if (_mm256_movemask_ps(active) == 0) {
+                            return;
+                        }
+                        if (_mm256_movemask_ps(mask) == 0) {
+                            break;
+                        }
+                    }
+                }
+            } else {
+                uint32_t near_child = node.offset;
+                uint32_t far_child = node.offset + 1;
+                if (dir_is_neg[node.axis]) {
+                    std::swap(near_child, far_child);
+                }
+                if (stack_size == BVH_TRAVERSAL_STACK_SIZE) {
+                    // Tree deeper than the stack: finish the far subtree recursively
+                    traverse_packet<ANY_HIT>(bvh, far_child, tris, rays, packet, active, hits);
+                    if (ANY_HIT && _mm256_movemask_ps(active) == 0) {
+                        return;
+                    }
+                } else {
+                    stack[stack_size++] = far_child;
+                }
+                current = near_child;
+                continue;
+            }
+        }
+
+        if (stack_size == 0) {
+            return;
+        }
+        current = stack[--stack_size];
+    }
+}
+
+template <typename Accessor>
+static void packet_closest(const LinearBvhView& bvh, const Accessor& tris, const Ray* rays, int count, Hit* hits) {
+    PacketRays packet;
+    PacketHits packet_hits;
+    load_packet(rays, count, packet, packet_hits);
+
+    __m256 active = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+    traverse_packet<false>(bvh, 0, tris, rays, packet, active, packet_hits);
+
+    alignas(32) float t[BVH_PACKET_SIZE], u[BVH_PACKET_SIZE], v[BVH_PACKET_SIZE];
+    alignas(32) int triangle[BVH_PACKET_SIZE];
+    _mm256_store_ps(t, packet_hits.t);
+    _mm256_store_ps(u, packet_hits.u);
+    _mm256_store_ps(v, packet_hits.v);
+    _mm256_store_si256(reinterpret_cast<__m256i*>(triangle), packet_hits.triangle);
+    for (int i = 0; i < count; i++) {
+        hits[i].triangle = triangle[i];
+        hits[i].t = (triangle[i] == -1) ? std::numeric_limits<float>::max() : t[i];
+        hits[i].u = u[i];
+        hits[i].v = v[i];
+    }
+}
+
+template <typename Accessor>
+static void packet_any(const LinearBvhView& bvh, const Accessor& tris, const Ray* rays, int count, bool* results) {
+    PacketRays packet;
+    PacketHits packet_hits;
+    load_packet(rays, count, packet, packet_hits);
+
+    __m256 active = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(count), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7)));
+    traverse_packet<true>(bvh, 0, tris, rays, packet, active, packet_hits);
+
+    alignas(32) int triangle[BVH_PACKET_SIZE];
+    _mm256_store_si256(reinterpret_cast<__m256i*>(triangle), packet_hits.triangle);
+    for (int i = 0; i < count; i++) {
+        results[i] = triangle[i] != -1;
+    }
+}
+
+#else
+
+// Without AVX2 the packets are traced one ray at a time
+template <typename Accessor>
+static void packet_closest(const LinearBvhView& bvh, const Accessor& tris, const Ray* rays, int count, Hit* hits) {
+    for (int i = 0; i < count; i++) {
+        hits[i] = Hit();
+        hits[i].t = rays[i].tmax;
+        if (!traverse_linear<false>(bvh, 0, tris, rays[i], hits[i])) {
+            hits[i].t = std::numeric_limits<float>::max();
+        }
+    }
+}
+
+template <typename Accessor>
+static void packet_any(const LinearBvhView& bvh, const Accessor& tris, const Ray* rays, int count, bool* results) {
+    for (int i = 0; i < count; i++) {
+        Hit hit;
+        hit.t = rays[i].tmax;
+        results[i] = traverse_linear<true>(bvh, 0, tris, rays[i], hit);
+    }
+}
+
+#endif
+
+// Spreads the lower 10 bits of x so that there are two zero bits between each
+static uint64_t spread_bits(uint32_t x) {
+    uint64_t v = x & 0x3ff;
+    v = (v | (v << 16)) & 0x030000ff;
+    v = (v | (v << 8)) & 0x0300f00f;
+    v = (v | (v << 4)) & 0x030c30c3;
+    v = (v | (v << 2)) & 0x09249249;
+    return v;
+}
+
+static uint32_t quantize(float value, float min, float scale, uint32_t max) {
+    float q = (value - min) * scale;
+    if (!(q > 0.0f)) {
+        return 0;
+    }
+    return std::min(static_cast<uint32_t>(q), max);
+}
+
+// Order in which to trace a stream of rays: by direction octant, then by origin and by direction along Morton curves
+static std::vector<int> coherent_order(const Ray* rays, int num_rays) {
+    BoundingBox origins = BoundingBox::empty();
+    for (int i = 0; i < num_rays; i++) {
+        origins.expand(rays[i].origin);
+    }
+    vec3<float> extent = origins.max - origins.min;
+    vec3<float> scale(extent.x > 0.0f ? 1023.0f / extent.x : 0.0f,
+                      extent.y > 0.0f ? 1023.0f / extent.y : 0.0f,
+                      extent.z > 0.0f ? 1023.0f / extent.z : 0.0f);
+
+    std::vector<uint64_t> keys(num_rays);
+    for (int i = 0; i < num_rays; i++) {
+        const Ray& ray = rays[i];
+        uint64_t octant = (ray.direction.x < 0.0f ? 4 : 0) | (ray.direction.y < 0.0f ? 2 : 0) | (ray.direction.z < 0.0f ? 1 : 0);
+        uint64_t origin_code = (spread_bits(quantize(ray.origin.x, origins.min.x, scale.x, 1023)) << 2) |
+                               (spread_bits(quantize(ray.origin.y, origins.min.y, scale.y, 1023)) << 1) |
+                               spread_bits(quantize(ray.origin.z, origins.min.z, scale.z, 1023));
+
+        float length = std::sqrt(vec3<float>::dot(ray.direction, ray.direction));
+        float dir_scale = length > 0.0f ? 63.5f / length : 0.0f;
+        uint64_t direction_code = (spread_bits(quantize(ray.direction.x, -length, dir_scale, 127)) << 2) |
+                                  (spread_bits(quantize(ray.direction.y, -length, dir_scale, 127)) << 1) |
+                                  spread_bits(quantize(ray.direction.z, -length, dir_scale, 127));
+
+        keys[i] = (octant << 51) | (origin_code << 21) | direction_code;
+    }
+
+    std::vector<int> order(num_rays);
+    for (int i = 0; i < num_rays; i++) {
+        order[i] = i;
+    }
+    std::sort(order.begin(), order.end(), [&keys](int a, int b) {
+        return keys[a] < keys[b] || (keys[a] == keys[b] && a < b);
+    });
+    return order;
+}
+
+template <typename Accessor>
+static void stream_closest(const LinearBvhView& bvh, const Accessor& tris, const Ray* rays, int num_rays, Hit* hits) {
+    std::vector<int> order = coherent_order(rays, num_rays);
+    std::vector<Ray> packet;
+    packet.reserve(BVH_PACKET_SIZE);
+    Hit packet_hits[BVH_PACKET_SIZE];
+
+    for (int start = 0; start < num_rays; start += BVH_PACKET_SIZE) {
+        int count = std::min(BVH_PACKET_SIZE, num_rays - start);
+        packet.clear();
+        for (int i = 0; i < count; i++) {
+            packet.push_back(rays[order[start + i]]);
+        }
+        packet_closest(bvh, tris, packet.data(), count, packet_hits);
+        for (int i = 0; i < count; i++) {
+            hits[order[start + i]] = packet_hits[i];
+        }
+    }
+}
+
+template <typename Accessor>
+static void stream_any(const LinearBvhView& bvh, const Accessor& tris, const Ray* rays, int num_rays, bool* results) {
+    std::vector<int> order = coherent_order(rays, num_rays);
+    std::vector<Ray> packet;
+    packet.reserve(BVH_PACKET_SIZE);
+    bool packet_results[BVH_PACKET_SIZE];
+
+    for (int start = 0; start < num_rays; start += BVH_PACKET_SIZE) {
+        int count = std::min(BVH_PACKET_SIZE, num_rays - start);
+        packet.clear();
+        for (int i = 0; i < count; i++) {
+            packet.push_back(rays[order[start + i]]);
+        }
+        packet_any(bvh, tris, packet.data(), count, packet_results);
+        for (int i = 0; i < count; i++) {
+            results[order[start + i]] = packet_results[i];
+        }
+    }
+}
+
+// Result of a query on an empty BVH, same as intersect() and occluded()
+static void no_hits(int count, Hit* hits) {
+    for (int i = 0; i < count; i++) {
+        hits[i] = Hit();
+    }
+}
+
+void intersect_packet(const LinearBvhView& bvh, const Triangle* tris, const Ray* rays, int count, Hit* hits) {
+    count = std::min(count, BVH_PACKET_SIZE);
+    if (bvh.empty() || tris == nullptr) {
+        no_hits(count, hits);
+    } else if (count > 0) {
+        packet_closest(bvh, TriangleArrayAccessor{tris}, rays, count, hits);
+    }
+}
+
+void occluded_packet(const LinearBvhView& bvh, const Triangle* tris, const Ray* rays, int count, bool* results) {
+    count = std::min(count, BVH_PACKET_SIZE);
+    if (bvh.empty() || tris == nullptr) {
+        std::fill(results, results + std::max(count, 0), false);
+    } else if (count > 0) {
+        packet_any(bvh, TriangleArrayAccessor{tris}, rays, count, results);
+    }
+}
+
+void intersect_stream(const LinearBvhView& bvh, const Triangle* tris, const Ray* rays, int num_rays, Hit* hits) {
+    if (bvh.empty() || tris == nullptr) {
+        no_hits(num_rays, hits);
+    } else if (num_rays > 0) {
+        stream_closest(bvh, TriangleArrayAccessor{tris}, rays, num_rays, hits);
+    }
+}
+
+void occluded_stream(const LinearBvhView& bvh, const Triangle* tris, const Ray* rays, int num_rays, bool* results) {
+    if (bvh.empty() || tris == nullptr) {
+        std::fill(results, results + std::max(num_rays, 0), false);
+    } else if (num_rays > 0) {
+        stream_any(bvh, TriangleArrayAccessor{tris}, rays, num_rays, results);
+    }
+}
+
+void intersect_packet(const LinearBvhView& bvh, const Mesh& mesh, const Ray* rays, int count, Hit* hits) {
+    count = std::min(count, BVH_PACKET_SIZE);
+    if (bvh.empty()) {
+        no_hits(count, hits);
+    } else if (count > 0) {
+        packet_closest(bvh, MeshAccessor{&mesh}, rays, count, hits);
+    }
+}
+
+void occluded_packet(const LinearBvhView& bvh, const Mesh& mesh, const Ray* rays, int count, bool* results) {
+    count = std::min(count, BVH_PACKET_SIZE);
+    if (bvh.empty()) {
+        std::fill(results, results + std::max(count, 0), false);
+    } else if (count > 0) {
+        packet_any(bvh, MeshAccessor{&mesh}, rays, count, results);
+    }
+}
+
+void intersect_stream(const LinearBvhView& bvh, const Mesh& mesh, const Ray* rays, int num_rays, Hit* hits) {
+    if (bvh.empty()) {
+        no_hits(num_rays, hits);
+    } else if (num_rays > 0) {
+        stream_closest(bvh, MeshAccessor{&mesh}, rays, num_rays, hits);
+    }
+}
+
+void occluded_stream(const LinearBvhView& bvh, const Mesh& mesh, const Ray* rays, int num_rays, bool* results) {
+    if (bvh.empty()) {
+        std::fill(results, results + std::max(num_rays, 0), false);
+    } else if (num_rays > 0) {
+        stream_any(bvh, MeshAccessor{&mesh}, rays, num_rays, results);
+    }
+}
+
+}
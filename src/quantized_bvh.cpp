@@ -0,0 +1,192 @@
+#include <quantized_bvh.hpp>
+#include <traversal.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace bvh {
+
+// Largest grid coordinate whose position is at or below value
+static uint8_t quantize_down(float value, float origin, float step) {
+    if (!(step > 0.0f)) {
+        return 0;
+    }
+    float q = std::floor((value - origin) / step);
+    int coord = static_cast<int>(std::min(std::max(q, 0.0f), 255.0f));
+    while (coord > 0 && origin + coord * step > value) {
+        coord--;
+    }
+    return static_cast<uint8_t>(coord);
+}
+
+// Smallest grid coordinate whose position is at or above value
+static uint8_t quantize_up(float value, float origin, float step) {
+    if (!(step > 0.0f)) {
+        return 0;
+    }
+    float q = std::ceil((value - origin) / step);
+    int coord = static_cast<int>(std::min(std::max(q, 0.0f), 255.0f));
+    while (coord < 255 && origin + coord * step < value) {
+        coord++;
+    }
+    return static_cast<uint8_t>(coord);
+}
+
+static void quantize_box(QuantizedBvhNode& node, const BoundingBox& box, const QuantizationGrid& grid) {
+    for (int axis = 0; axis < 3; axis++) {
+        node.qmin[axis] = quantize_down(box.min[axis], grid.origin[axis], grid.step[axis]);
+        node.qmax[axis] = quantize_up(box.max[axis], grid.origin[axis], grid.step[axis]);
+    }
+}
+
+QuantizedBvh QuantizedBvh::compress(const LinearBvhView& bvh) {
+    QuantizedBvh quantized;
+    if (bvh.empty()) {
+        return quantized;
+    }
+    quantized.nodes.resize(bvh.num_nodes);
+    quantized.primitive_indices.assign(bvh.primitive_indices, bvh.primitive_indices + bvh.num_primitives);
+    quantized.bounds = BoundingBox(bvh.nodes[0].min, bvh.nodes[0].max);
+
+    // Parents come before their children, so the grid of a parent is known when its children are quantized.
+    // Children are quantized on the decoded box of their parent, the one traversal sees.
+    std::vector<QuantizationGrid> parent_grid(bvh.num_nodes);
+    parent_grid[0] = QuantizationGrid::of(quantized.bounds);
+    for (uint32_t i = 0; i < bvh.num_nodes; i++) {
+        const LinearBvhNode& node = bvh.nodes[i];
+        QuantizedBvhNode& out = quantized.nodes[i];
+        out.offset = node.offset;
+        out.count = node.count;
+        out.axis = node.axis;
+        out.pad[0] = out.pad[1] = out.pad[2] = 0;
+        quantize_box(out, BoundingBox(node.min, node.max), parent_grid[i]);
+
+        if (!node.is_leaf()) {
+            QuantizationGrid grid = QuantizationGrid::of(parent_grid[i].decode(out));
+            parent_grid[node.offset] = grid;
+            parent_grid[node.offset + 1] = grid;
+        }
+    }
+    return quantized;
+}
+
+QuantizedBvh QuantizedBvh::compress(const BvhNode* root) {
+    LinearBvh linear = LinearBvh::flatten(root);
+    return compress(linear.view());
+}
+
+struct QuantizedStackEntry {
+    uint32_t node;
+    QuantizationGrid grid;  // grid of the parent, decodes the box of node
+};
+
+// Same loop as traverse_linear(), with the boxes decoded on the way down. With ANY_HIT the loop returns at
+// the first hit found.
+template <bool ANY_HIT, typename Accessor>
+static bool traverse(const QuantizedBvh& bvh, QuantizedStackEntry entry, const Accessor& tris, const Ray& ray, Hit& hit) {
+    const QuantizedBvhNode* nodes = bvh.nodes.data();
+    const int* primitive_indices = bvh.primitive_indices.data();
+    const bool dir_is_neg[3] = {ray.inv_direction.x < 0.0f, ray.inv_direction.y < 0.0f, ray.inv_direction.z < 0.0f};
+
+    QuantizedStackEntry stack[BVH_TRAVERSAL_STACK_SIZE];
+    int stack_size = 0;
+    bool found = false;
+
+    while (true) {
+        const QuantizedBvhNode& node = nodes[entry.node];
+        BoundingBox box = entry.grid.decode(node);
+        float tnear;
+        if (intersect_box(box.min, box.max, ray, hit.t, tnear)) {
+            if (node.is_leaf()) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                    int tri = primitive_indices[i];
+                    float t, u, v;
+                    if (intersect_triangle(ray, tris.vertex(tri, 0), tris.vertex(tri, 1), tris.vertex(tri, 2), hit.t, t, u, v)) {
+                        hit.triangle = tri;
+                        hit.t = t;
+                        hit.u = u;
+                        hit.v = v;
+                        found = true;
+                        if (ANY_HIT) {
+                            return true;
+                        }
+                    }
+                }
+            } else {
+                // Visit the child on the side the ray comes from first
+                QuantizationGrid grid = QuantizationGrid::of(box);
+                QuantizedStackEntry near_child = {node.offset, grid};
+                QuantizedStackEntry far_child = {node.offset + 1, grid};
+                if (dir_is_neg[node.axis]) {
+                    std::swap(near_child, far_child);
+                }
+                if (stack_size == BVH_TRAVERSAL_STACK_SIZE) {
+                    // Tree deeper than the stack: finish the far subtree recursively
+                    if (traverse<ANY_HIT>(bvh, far_child, tris, ray, hit)) {
+                        found = true;
+                        if (ANY_HIT) {
+                            return true;
+                        }
+                    }
+                } else {
+                    stack[stack_size++] = far_child;
+                }
+                entry = near_child;
+                continue;
+            }
+        }
+
+        if (stack_size == 0) {
+            return found;
+        }
+        entry = stack[--stack_size];
+    }
+}
+
+template <typename Accessor>
+static Hit intersect_closest(const QuantizedBvh& bvh, const Accessor& tris, const Ray& ray) {
+    Hit hit;
+    hit.t = ray.tmax;
+    if (bvh.empty()) {
+        return Hit();
+    }
+
+    traverse<false>(bvh, QuantizedStackEntry{0, QuantizationGrid::of(bvh.bounds)}, tris, ray, hit);
+    if (!hit.hit()) {
+        hit.t = std::numeric_limits<float>::max();
+    }
+    return hit;
+}
+
+template <typename Accessor>
+static bool intersect_any(const QuantizedBvh& bvh, const Accessor& tris, const Ray& ray) {
+    Hit hit;
+    hit.t = ray.tmax;
+    if (bvh.empty()) {
+        return false;
+    }
+
+    return traverse<true>(bvh, QuantizedStackEntry{0, QuantizationGrid::of(bvh.bounds)}, tris, ray, hit);
+}
+
+Hit intersect(const QuantizedBvh& bvh, const Triangle* tris, const Ray& ray) {
+    if (tris == nullptr) {
+        return Hit();
+    }
+    return intersect_closest(bvh, TriangleArrayAccessor{tris}, ray);
+}
+
+bool occluded(const QuantizedBvh& bvh, const Triangle* tris, const Ray& ray) {
+    return tris != nullptr && intersect_any(bvh, TriangleArrayAccessor{tris}, ray);
+}
+
+Hit intersect(const QuantizedBvh& bvh, const Mesh& mesh, const Ray& ray) {
+    return intersect_closest(bvh, MeshAccessor{&mesh}, ray);
+}
+
+bool occluded(const QuantizedBvh& bvh, const Mesh& mesh, const Ray& ray) {
+    return intersect_any(bvh, MeshAccessor{&mesh}, ray);
+}
+
+}
@@ -0,0 +1,533 @@
+#include <query.hpp>
+#include <traversal.hpp>
+
+#include <algorithm>
+#include <cmath>
+
+namespace bvh {
+
+// Number of queries of a batch run as one task
+static const size_t QUERY_BATCH_GRAIN = 32;
+static const size_t CLOSEST_BATCH_GRAIN = 256;
+
+Frustum Frustum::perspective(const vec3<float>& eye, const vec3<float>& forward, const vec3<float>& up,
+                             float vertical_fov, float aspect, float near, float far) {
+    auto normalize = [](const vec3<float>& v) { return v / std::sqrt(vec3<float>::dot(v, v)); };
+    vec3<float> f = normalize(forward);
+    vec3<float> r = normalize(vec3<float>::cross(f, up));
+    vec3<float> u = vec3<float>::cross(r, f);
+
+    // Half extents of the image at distance 1. Each side plane contains the eye and one edge of the image,
+    // e.g. r + f * half_width is orthogonal to the left edge direction f - r * half_width.
+    float half_height = std::tan(vertical_fov * 0.5f);
+    float half_width = half_height * aspect;
+    auto side = [&](const vec3<float>& normal) {
+        vec3<float> n = normalize(normal);
+        return Plane{n, -vec3<float>::dot(n, eye)};
+    };
+
+    Frustum frustum;
+    frustum.planes[0] = side(r + f * half_width);
+    frustum.planes[1] = side(f * half_width - r);
+    frustum.planes[2] = side(u + f * half_height);
+    frustum.planes[3] = side(f * half_height - u);
+    frustum.planes[4] = Plane{f, -vec3<float>::dot(f, eye) - near};
+    frustum.planes[5] = Plane{f * -1.0f, vec3<float>::dot(f, eye) + far};
+    return frustum;
+}
+
+// Query volumes: overlaps() is the test of the triangles and nodes, contains() lets whole subtrees be
+// appended without testing them
+struct BoxVolume {
+    BoundingBox box;
+
+    bool overlaps(const vec3<float>& min, const vec3<float>& max) const {
+        return min.x <= box.max.x && max.x >= box.min.x && min.y <= box.max.y && max.y >= box.min.y &&
+               min.z <= box.max.z && max.z >= box.min.z;
+    }
+
+    bool contains(const vec3<float>& min, const vec3<float>& max) const {
+        return min.x >= box.min.x && max.x <= box.max.x && min.y >= box.min.y && max.y <= box.max.y &&
+               min.z >= box.min.z && max.z <= box.max.z;
+    }
+};
+
+struct SphereVolume {
+    Sphere sphere;
+
+    // Squared distance from the center to the closest point of the box
+    bool overlaps(const vec3<float>& min, const vec3<float>& max) const {
+        const vec3<float>& c = sphere.center;
+        vec3<float> d(std::max(std::max(min.x - c.x, c.x - max.x), 0.0f),
+                      std::max(std::max(min.y - c.y, c.y - max.y), 0.0f),
+                      std::max(std::max(min.z - c.z, c.z - max.z), 0.0f));
+        return vec3<float>::dot(d, d) <= sphere.radius * sphere.radius;
+    }
+
+    // Squared distance from the center to the farthest corner of the box
+    bool contains(const vec3<float>& min, const vec3<float>& max) const {
+        const vec3<float>& c = sphere.center;
+        vec3<float> d(std::max(c.x - min.x, max.x - c.x), std::max(c.y - min.y, max.y - c.y), std::max(c.z - min.z, max.z - c.z));
+        return vec3<float>::dot(d, d) <= sphere.radius * sphere.radius;
+    }
+};
+
+struct FrustumVolume {
+    Frustum frustum;
+
+    // A box is outside if its corner furthest along the normal of a plane is behind that plane
+    bool overlaps(const vec3<float>& min, const vec3<float>& max) const {
+        for (const Plane& plane : frustum.planes) {
+            vec3<float> p(plane.normal.x >= 0.0f ? max.x : min.x, plane.normal.y >= 0.0f ? max.y : min.y,
+                          plane.normal.z >= 0.0f ? max.z : min.z);
+            if (plane.distance(p) < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // and inside if its nearest corner is in front of every plane
+    bool contains(const vec3<float>& min, const vec3<float>& max) const {
+        for (const Plane& plane : frustum.planes) {
+            vec3<float> p(plane.normal.x >= 0.0f ? min.x : max.x, plane.normal.y >= 0.0f ? min.y : max.y,
+                          plane.normal.z >= 0.0f ? min.z : max.z);
+            if (plane.distance(p) < 0.0f) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// Result buffer of one query, counts every match but only writes the first capacity
+template <typename T>
+struct QueryOutput {
+    T* results;
+    int capacity;
+    int count;
+
+    void add(const T& result) {
+        if (count < capacity) {
+            results[count] = result;
+        }
+        count++;
+    }
+};
+
+template <typename Accessor>
+static BoundingBox triangle_box(const Accessor& tris, int tri) {
+    BoundingBox box = BoundingBox::empty();
+    box.expand(tris.vertex(tri, 0));
+    box.expand(tris.vertex(tri, 1));
+    box.expand(tris.vertex(tri, 2));
+    return box;
+}
+
+static void add_subtree(const BvhNode* node, QueryOutput<int>& out) {
+    if (node->left == nullptr) {
+        const BvhLeaf* leaf = static_cast<const BvhLeaf*>(node);
+        for (int i = 0; i < leaf->num_triangles; i++) {
+            out.add(leaf->indices[i]);
+        }
+        return;
+    }
+    add_subtree(node->left, out);
+    add_subtree(node->right, out);
+}
+
+// Same loop as traverse() in traversal.cpp: nodes are tested when popped, deeper trees than the stack
+// finish the overflowing subtree recursively
+template <typename Volume, typename Accessor>
+static void query_node(const BvhNode* node, const Accessor& tris, const Volume& volume, QueryOutput<int>& out) {
+    const BvhNode* stack[BVH_TRAVERSAL_STACK_SIZE];
+    int stack_size = 0;
+
+    while (true) {
+        const BoundingBox& box = node->bounding_box;
+        if (volume.overlaps(box.min, box.max)) {
+            if (volume.contains(box.min, box.max)) {
+                add_subtree(node, out);
+            } else if (node->left == nullptr) {
+                const BvhLeaf* leaf = static_cast<const BvhLeaf*>(node);
+                for (int i = 0; i < leaf->num_triangles; i++) {
+                    BoundingBox tri_box = triangle_box(tris, leaf->indices[i]);
+                    if (volume.overlaps(tri_box.min, tri_box.max)) {
+                        out.add(leaf->indices[i]);
+                    }
+                }
+            } else {
+                if (stack_size == BVH_TRAVERSAL_STACK_SIZE) {
+                    query_node(node->right, tris, volume, out);
+                } else {
+                    stack[stack_size++] = node->right;
+                }
+                node = node->left;
+                continue;
+            }
+        }
+
+        if (stack_size == 0) {
+            return;
+        }
+        node = stack[--stack_size];
+    }
+}
+
+template <typename Volume, typename Accessor>
+static int query(const BvhNode* root, const Accessor& tris, const Volume& volume, int* indices, int capacity) {
+    QueryOutput<int> out{indices, capacity, 0};
+    if (root != nullptr) {
+        query_node(root, tris, volume, out);
+    }
+    return out.count;
+}
+
+template <typename Volume, typename Shape, typename Accessor>
+static void query_batch(const BvhNode* root, const Accessor& tris, const Shape* shapes, int num_queries,
+                        int* indices, int capacity, int* counts, ThreadPool& pool) {
+    parallel_for(pool, std::max(num_queries, 0), QUERY_BATCH_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            counts[i] = query(root, tris, Volume{shapes[i]}, indices + i * capacity, capacity);
+        }
+    });
+}
+
+int query_box(const BvhNode* root, const Triangle* tris, const BoundingBox& box, int* indices, int capacity) {
+    return query(root, TriangleArrayAccessor{tris}, BoxVolume{box}, indices, capacity);
+}
+
+int query_sphere(const BvhNode* root, const Triangle* tris, const Sphere& sphere, int* indices, int capacity) {
+    return query(root, TriangleArrayAccessor{tris}, SphereVolume{sphere}, indices, capacity);
+}
+
+int query_frustum(const BvhNode* root, const Triangle* tris, const Frustum& frustum, int* indices, int capacity) {
+    return query(root, TriangleArrayAccessor{tris}, FrustumVolume{frustum}, indices, capacity);
+}
+
+int query_box(const BvhNode* root, const Mesh& mesh, const BoundingBox& box, int* indices, int capacity) {
+    return query(root, MeshAccessor{&mesh}, BoxVolume{box}, indices, capacity);
+}
+
+int query_sphere(const BvhNode* root, const Mesh& mesh, const Sphere& sphere, int* indices, int capacity) {
+    return query(root, MeshAccessor{&mesh}, SphereVolume{sphere}, indices, capacity);
+}
+
+int query_frustum(const BvhNode* root, const Mesh& mesh, const Frustum& frustum, int* indices, int capacity) {
+    return query(root, MeshAccessor{&mesh}, FrustumVolume{frustum}, indices, capacity);
+}
+
+void query_boxes(const BvhNode* root, const Triangle* tris, const BoundingBox* boxes, int num_queries,
+                 int* indices, int capacity, int* counts, ThreadPool& pool) {
+    query_batch<BoxVolume>(root, TriangleArrayAccessor{tris}, boxes, num_queries, indices, capacity, counts, pool);
+}
+
+void query_spheres(const BvhNode* root, const Triangle* tris, const Sphere* spheres, int num_queries,
+                   int* indices, int capacity, int* counts, ThreadPool& pool) {
+    query_batch<SphereVolume>(root, TriangleArrayAccessor{tris}, spheres, num_queries, indices, capacity, counts, pool);
+}
+
+void query_frustums(const BvhNode* root, const Triangle* tris, const Frustum* frustums, int num_queries,
+                    int* indices, int capacity, int* counts, ThreadPool& pool) {
+    query_batch<FrustumVolume>(root, TriangleArrayAccessor{tris}, frustums, num_queries, indices, capacity, counts, pool);
+}
+
+void query_boxes(const BvhNode* root, const Mesh& mesh, const BoundingBox* boxes, int num_queries,
+                 int* indices, int capacity, int* counts, ThreadPool& pool) {
+    query_batch<BoxVolume>(root, MeshAccessor{&mesh}, boxes, num_queries, indices, capacity, counts, pool);
+}
+
+void query_spheres(const BvhNode* root, const Mesh& mesh, const Sphere* spheres, int num_queries,
+                   int* indices, int capacity, int* counts, ThreadPool& pool) {
+    query_batch<SphereVolume>(root, MeshAccessor{&mesh}, spheres, num_queries, indices, capacity, counts, pool);
+}
+
+void query_frustums(const BvhNode* root, const Mesh& mesh, const Frustum* frustums, int num_queries,
+                    int* indices, int capacity, int* counts, ThreadPool& pool) {
+    query_batch<FrustumVolume>(root, MeshAccessor{&mesh}, frustums, num_queries, indices, capacity, counts, pool);
+}
+
+// Closest point of the triangle (a, b, c) to p, by the Voronoi regions of its vertices, edges and face
+// (Ericson, Real-Time Collision Detection, 5.1.5). u and v are the barycentric coordinates of the result.
+static vec3<float> closest_on_triangle(const vec3<float>& p, const vec3<float>& a, const vec3<float>& b, const vec3<float>& c,
+                                       float& u, float& v) {
+    vec3<float> ab = b - a;
+    vec3<float> ac = c - a;
+    vec3<float> ap = p - a;
+    float d1 = vec3<float>::dot(ab, ap);
+    float d2 = vec3<float>::dot(ac, ap);
+    if (d1 <= 0.0f && d2 <= 0.0f) {
+        u = 0.0f;
+        v = 0.0f;
+        return a;
+    }
+
+    vec3<float> bp = p - b;
+    float d3 = vec3<float>::dot(ab, bp);
+    float d4 = vec3<float>::dot(ac, bp);
+    if (d3 >= 0.0f && d4 <= d3) {
+        u = 1.0f;
+        v = 0.0f;
+        return b;
+    }
+
+    float vc = d1 * d4 - d3 * d2;
+    if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) {
+        u = d1 / (d1 - d3);
+        v = 0.0f;
+        return a + ab * u;
+    }
+
+    vec3<float> cp = p - c;
+    float d5 = vec3<float>::dot(ab, cp);
+    float d6 = vec3<float>::dot(ac, cp);
+    if (d6 >= 0.0f && d5 <= d6) {
+        u = 0.0f;
+        v = 1.0f;
+        return c;
+    }
+
+    float vb = d5 * d2 - d1 * d6;
+    if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) {
+        u = 0.0f;
+        v = d2 / (d2 - d6);
+        return a + ac * v;
+    }
+
+    float va = d3 * d6 - d5 * d4;
+    if (va <= 0.0f && (d4 - d3) >= 0.0f && (d5 - d6) >= 0.0f) {
+        v = (d4 - d3) / ((d4 - d3) + (d5 - d6));
+        u = 1.0f - v;
+        return b + (c - b) * v;
+    }
+
+    float denom = 1.0f / (va + vb + vc);
+    u = vb * denom;
+    v = vc * denom;
+    return a + ab * u + ac * v;
+}
+
+// Squared distance from p to the closest point of a box, 0 inside
+static float box_distance2(const BoundingBox& box, const vec3<float>& p) {
+    vec3<float> d(std::max(std::max(box.min.x - p.x, p.x - box.max.x), 0.0f),
+                  std::max(std::max(box.min.y - p.y, p.y - box.max.y), 0.0f),
+                  std::max(std::max(box.min.z - p.z, p.z - box.max.z), 0.0f));
+    return vec3<float>::dot(d, d);
+}
+
+struct ClosestEntry {
+    float distance2;  // Squared distance from the query point to the box of node
+    const BvhNode* node;
+
+    // Reversed so that the std heap functions keep the nearest node on top
+    bool operator<(const ClosestEntry& other) const { return distance2 > other.distance2; }
+};
+
+// Best first search from node. best_distance2 is the squared search radius, it shrinks with every closer
+// triangle. The heap of pending nodes lives on the stack; when it is full, the node that does not fit is
+// searched right away with a heap of its own, which stays correct but is no longer strictly best first.
+template <typename Accessor>
+static void closest_node(const BvhNode* node, float node_distance2, const Accessor& tris, const vec3<float>& p,
+                         ClosestPoint& result, float& best_distance2) {
+    ClosestEntry heap[BVH_TRAVERSAL_STACK_SIZE];
+    int heap_size = 0;
+    heap[heap_size++] = {node_distance2, node};
+
+    while (heap_size > 0) {
+        std::pop_heap(heap, heap + heap_size);
+        ClosestEntry entry = heap[--heap_size];
+        if (entry.distance2 > best_distance2) {
+            return;  // Every pending node is farther than the closest triangle
+        }
+
+        if (entry.node->left == nullptr) {
+            const BvhLeaf* leaf = static_cast<const BvhLeaf*>(entry.node);
+            for (int i = 0; i < leaf->num_triangles; i++) {
+                int tri = leaf->indices[i];
+                float u, v;
+                vec3<float> q = closest_on_triangle(p, tris.vertex(tri, 0), tris.vertex(tri, 1), tris.vertex(tri, 2), u, v);
+                vec3<float> d = q - p;
+                float distance2 = vec3<float>::dot(d, d);
+                if (distance2 < best_distance2 || (distance2 == best_distance2 && !result.found())) {
+                    best_distance2 = distance2;
+                    result.triangle = tri;
+                    result.point = q;
+                    result.u = u;
+                    result.v = v;
+                }
+            }
+            continue;
+        }
+
+        for (const BvhNode* child : {entry.node->left, entry.node->right}) {
+            float child_distance2 = box_distance2(child->bounding_box, p);
+            if (child_distance2 > best_distance2) {
+                continue;
+            }
+            if (heap_size == BVH_TRAVERSAL_STACK_SIZE) {
+                closest_node(child, child_distance2, tris, p, result, best_distance2);
+            } else {
+                heap[heap_size++] = {child_distance2, child};
+                std::push_heap(heap, heap + heap_size);
+            }
+        }
+    }
+}
+
+template <typename Accessor>
+static ClosestPoint closest(const BvhNode* root, const Accessor& tris, const vec3<float>& p, float max_distance) {
+    ClosestPoint result;
+    float best_distance2 = max_distance * max_distance;
+    if (root != nullptr && max_distance >= 0.0f) {
+        float root_distance2 = box_distance2(root->bounding_box, p);
+        if (root_distance2 <= best_distance2) {
+            closest_node(root, root_distance2, tris, p, result, best_distance2);
+        }
+    }
+    if (result.found()) {
+        result.distance = std::sqrt(best_distance2);
+    }
+    return result;
+}
+
+template <typename Accessor>
+static void closest_batch(const BvhNode* root, const Accessor& tris, const vec3<float>* points, int num_points,
+                          ClosestPoint* results, ThreadPool& pool, float max_distance) {
+    parallel_for(pool, std::max(num_points, 0), CLOSEST_BATCH_GRAIN, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            results[i] = closest(root, tris, points[i], max_distance);
+        }
+    });
+}
+
+ClosestPoint closest_point(const BvhNode* root, const Triangle* tris, const vec3<float>& p, float max_distance) {
+    return closest(root, TriangleArrayAccessor{tris}, p, max_distance);
+}
+
+ClosestPoint closest_point(const BvhNode* root, const Mesh& mesh, const vec3<float>& p, float max_distance) {
+    return closest(root, MeshAccessor{&mesh}, p, max_distance);
+}
+
+void closest_points(const BvhNode* root, const Triangle* tris, const vec3<float>* points, int num_points,
+                    ClosestPoint* results, ThreadPool& pool, float max_distance) {
+    closest_batch(root, TriangleArrayAccessor{tris}, points, num_points, results, pool, max_distance);
+}
+
+void closest_points(const BvhNode* root, const Mesh& mesh, const vec3<float>* points, int num_points,
+                    ClosestPoint* results, ThreadPool& pool, float max_distance) {
+    closest_batch(root, MeshAccessor{&mesh}, points, num_points, results, pool, max_distance);
+}
+
+struct NodePair {
+    const BvhNode* a;
+    const BvhNode* b;
+};
+
+static bool boxes_overlap(const BoundingBox& a, const BoundingBox& b) {
+    return BoxVolume{a}.overlaps(b.min, b.max);
+}
+
+// Triangle pairs of two leaves, or of one leaf with itself when self
+template <typename Accessor>
+static void leaf_pairs(const BvhLeaf* leaf_a, const Accessor& tris_a, const BvhLeaf* leaf_b, const Accessor& tris_b,
+                       bool self, QueryOutput<PrimitivePair>& out) {
+    bool same_leaf = self && leaf_a == leaf_b;
+    for (int i = 0; i < leaf_a->num_triangles; i++) {
+        int a = leaf_a->indices[i];
+        BoundingBox box_a = triangle_box(tris_a, a);
+        if (!boxes_overlap(box_a, leaf_b->bounding_box)) {
+            continue;
+        }
+        for (int j = same_leaf ? i + 1 : 0; j < leaf_b->num_triangles; j++) {
+            int b = leaf_b->indices[j];
+            if (self && a == b) {
+                continue;  // The same triangle referenced by two leaves of a spatial split BVH
+            }
+            if (boxes_overlap(box_a, triangle_box(tris_b, b))) {
+                out.add(self ? PrimitivePair{std::min(a, b), std::max(a, b)} : PrimitivePair{a, b});
+            }
+        }
+    }
+}
+
+// Descends both trees together. A pair of a node with itself (self queries only) expands to the pairs of
+// its children with themselves and with each other, so every pair of distinct subtrees is visited once.
+template <typename Accessor>
+static void pair_node(NodePair pair, const Accessor& tris_a, const Accessor& tris_b, bool self, QueryOutput<PrimitivePair>& out) {
+    NodePair stack[2 * BVH_TRAVERSAL_STACK_SIZE];
+    int stack_size = 0;
+
+    while (true) {
+        const BvhNode* a = pair.a;
+        const BvhNode* b = pair.b;
+        bool leaf_a = a->left == nullptr;
+        bool leaf_b = b->left == nullptr;
+        NodePair children[3];
+        int num_children = 0;
+
+        if (self && a == b) {
+            if (leaf_a) {
+                leaf_pairs(static_cast<const BvhLeaf*>(a), tris_a, static_cast<const BvhLeaf*>(b), tris_b, true, out);
+            } else {
+                children[num_children++] = {a->left, a->left};
+                children[num_children++] = {a->right, a->right};
+                if (boxes_overlap(a->left->bounding_box, a->right->bounding_box)) {
+                    children[num_children++] = {a->left, a->right};
+                }
+            }
+        } else if (leaf_a && leaf_b) {
+            leaf_pairs(static_cast<const BvhLeaf*>(a), tris_a, static_cast<const BvhLeaf*>(b), tris_b, self, out);
+        } else if (leaf_b || (!leaf_a && a->bounding_box.surface_area() >= b->bounding_box.surface_area())) {
+            // Descend the larger node
+            if (boxes_overlap(a->left->bounding_box, b->bounding_box)) {
+                children[num_children++] = {a->left, b};
+            }
+            if (boxes_overlap(a->right->bounding_box, b->bounding_box)) {
+                children[num_children++] = {a->right, b};
+            }
+        } else {
+            if (boxes_overlap(a->bounding_box, b->left->bounding_box)) {
+                children[num_children++] = {a, b->left};
+            }
+            if (boxes_overlap(a->bounding_box, b->right->bounding_box)) {
+                children[num_children++] = {a, b->right};
+            }
+        }
+
+        for (int i = 0; i < num_children; i++) {
+            if (stack_size == 2 * BVH_TRAVERSAL_STACK_SIZE) {
+                pair_node(children[i], tris_a, tris_b, self, out);
+            } else {
+                stack[stack_size++] = children[i];
+            }
+        }
+        if (stack_size == 0) {
+            return;
+        }
+        pair = stack[--stack_size];
+    }
+}
+
+template <typename Accessor>
+static int query_pairs(const BvhNode* root_a, const Accessor& tris_a, const BvhNode* root_b, const Accessor& tris_b,
+                       bool self, PrimitivePair* pairs, int capacity) {
+    QueryOutput<PrimitivePair> out{pairs, capacity, 0};
+    if (root_a != nullptr && root_b != nullptr && boxes_overlap(root_a->bounding_box, root_b->bounding_box)) {
+        pair_node(NodePair{root_a, root_b}, tris_a, tris_b, self, out);
+    }
+    return out.count;
+}
+
+int query_pairs(const BvhNode* root_a, const Triangle* tris_a, const BvhNode* root_b, const Triangle* tris_b,
+                PrimitivePair* pairs, int capacity) {
+    bool self = root_a == root_b && tris_a == tris_b;
+    return query_pairs(root_a, TriangleArrayAccessor{tris_a}, root_b, TriangleArrayAccessor{tris_b}, self, pairs, capacity);
+}
+
+int query_pairs(const BvhNode* root_a, const Mesh& mesh_a, const BvhNode* root_b, const Mesh& mesh_b,
+                PrimitivePair* pairs, int capacity) {
+    bool self = root_a == root_b && &mesh_a == &mesh_b;
+    return query_pairs(root_a, MeshAccessor{&mesh_a}, root_b, MeshAccessor{&mesh_b}, self, pairs, capacity);
+}
+
+}
@@ -0,0 +1,181 @@
+#include <thread_pool.hpp>
+
+#include <algorithm>
+
+namespace bvh {
+
+// Pool and queue index of the calling thread, so that nested submits stay on the worker's own deque
+static thread_local const ThreadPool* t_pool = nullptr;
+static thread_local int t_worker = 0;
+
+ThreadPool::ThreadPool(int num_threads) {
+    if (num_threads <= 0) {
+        num_threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    for (int i = 0; i < num_threads; i++) {
+        queues.push_back(std::make_unique<WorkQueue>());
+    }
+    for (int i = 1; i < num_threads; i++) {
+        workers.emplace_back(&ThreadPool::worker_loop, this, i);
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(sleep_mutex);
+        stopping = true;
+    }
+    sleep_cv.notify_all();
+    for (std::thread& worker : workers) {
+        worker.join();
+    }
+}
+
+int ThreadPool::current_worker() {
+    return t_worker;
+}
+
+int ThreadPool::worker_index() const {
+    return (t_pool == this) ? t_worker : -1;
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    int worker = (t_pool == this) ? t_worker : 0;
+    {
+        std::lock_guard<std::mutex> lock(queues[worker]->mutex);
+        queues[worker]->tasks.push_back(std::move(task));
+    }
+    num_queued++;
+
+    // Taking the lock orders the increment with a worker checking num_queued before sleeping
+    { std::lock_guard<std::mutex> lock(sleep_mutex); }
+    sleep_cv.notify_one();
+}
+
+bool ThreadPool::pop_task(int worker, std::function<void()>& task) {
+    // Own deque first, newest task (the smallest subtree, still hot in cache)
+    if (worker > 0) {
+        WorkQueue& own = *queues[worker];
+        std::lock_guard<std::mutex> lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.back());
+            own.tasks.pop_back();
+            return true;
+        }
+    }
+
+    // Then the shared queue and the other workers, oldest task (the largest subtree)
+    int num_queues = queues.size();
+    for (int i = 0; i < num_queues; i++) {
+        int victim = (worker + i) % num_queues;
+        if (victim == worker && worker > 0) {
+            continue;
+        }
+        WorkQueue& queue = *queues[victim];
+        std::lock_guard<std::mutex> lock(queue.mutex);
+        if (!queue.tasks.empty()) {
+            task = std::move(queue.tasks.front());
+            queue.tasks.pop_front();
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::run_one() {
+    if (num_queued == 0) {
+        return false;
+    }
+
+    int worker = (t_pool == this) ? t_worker : 0;
+    std::function<void()> task;
+    if (!pop_task(worker, task)) {
+        return false;
+    }
+    num_queued--;
+    task();
+    return true;
+}
+
+void ThreadPool::worker_loop(int worker) {
+    t_pool = this;
+    t_worker = worker;
+
+    while (true) {
+        std::function<void()> task;
+        if (pop_task(worker, task)) {
+            num_queued--;
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mutex);
+        sleep_cv.wait(lock, [this] { return num_queued > 0 || stopping; });
+        if (stopping) {
+            return;
+        }
+    }
+}
+
+TaskGroup::~TaskGroup() {
+    // Never leave tasks running that reference a destroyed group
+    while (pending > 0) {
+        if (!pool.run_one()) {
+            std::this_thread::yield();
+        }
+    }
+}
+
+void TaskGroup::run(std::function<void()> task) {
+    pending++;
+    pool.submit([this, task = std::move(task)]() {
+        try {
+            task();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(error_mutex);
+            if (!error) {
+                error = std::current_exception();
+            }
+        }
+        pending--;
+    });
+}
+
+void TaskGroup::wait() {
+    while (pending > 0) {
+        if (!pool.run_one()) {
+            std::this_thread::yield();
+        }
+    }
+
+    if (error) {
+        std::exception_ptr e = error;
+        error = nullptr;
+        std::rethrow_exception(e);
+    }
+}
+
+void parallel_for(ThreadPool& pool, size_t count, size_t grain_size, const std::function<void(size_t, size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+
+    grain_size = std::max<size_t>(grain_size, 1);
+    size_t num_chunks = std::min<size_t>(pool.num_threads() * 4, (count + grain_size - 1) / grain_size);
+    if (num_chunks <= 1) {
+        body(0, count);
+        return;
+    }
+
+    size_t chunk_size = (count + num_chunks - 1) / num_chunks;
+    TaskGroup group(pool);
+    for (size_t begin = chunk_size; begin < count; begin += chunk_size) {
+        size_t end = std::min(begin + chunk_size, count);
+        group.run([&body, begin, end]() { body(begin, end); });
+    }
+    body(0, std::min(chunk_size, count)); // the calling thread takes the first chunk
+    group.wait();
+}
+
+}
@@ -0,0 +1,189 @@
+#include <tlas.hpp>
+#include <bvh.hpp>
+#include <traversal.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace bvh {
+
+int Tlas::add_instance(const Object* object) {
+    return add_instance(object, Transform::from_object(object->position, object->rotation, object->scale));
+}
+
+int Tlas::add_instance(const Object* object, const Transform& to_world) {
+    instances.push_back(Instance{object, Transform(), Transform(), BoundingBox::empty()});
+    set_transform(instances.size() - 1, to_world);
+    return instances.size() - 1;
+}
+
+void Tlas::set_transform(int instance, const Transform& to_world) {
+    Instance& inst = instances[instance];
+    inst.to_world = to_world;
+    inst.to_object = to_world.inverse();
+    update_bounds(instance);
+}
+
+void Tlas::update_bounds(int instance) {
+    Instance& inst = instances[instance];
+    const BvhNode* root = inst.object->getBvh();
+    inst.bounds = (root != nullptr) ? inst.to_world.box(root->bounding_box) : BoundingBox::empty();
+}
+
+// Builds the subtree over indices[0, count[ into the node index, which its parent reserved. The children
+// pairs are appended in depth-first order, like LinearBvh::flatten with NodeLayout::DepthFirst.
+static void build_helper(const std::vector<Instance>& instances, int* indices, int count, LinearBvh& top, uint32_t index) {
+    BoundingBox box = BoundingBox::empty();
+    BoundingBox centroids = BoundingBox::empty();
+    for (int i = 0; i < count; i++) {
+        box.expand(instances[indices[i]].bounds);
+        centroids.expand(instances[indices[i]].bounds.centroid());
+    }
+
+    LinearBvhNode node;
+    node.min = box.min;
+    node.max = box.max;
+    node.pad = 0;
+    if (count <= BVH_TLAS_LEAF_SIZE) {
+        node.offset = top.primitive_indices.size();
+        node.count = count;
+        node.axis = 0;
+        top.primitive_indices.insert(top.primitive_indices.end(), indices, indices + count);
+        top.nodes[index] = node;
+        return;
+    }
+
+    int axis = chooseSplitAxis(centroids);
+    int mid = count / 2;
+    std::nth_element(indices, indices + mid, indices + count, [&](int a, int b) {
+        float ca = instances[a].bounds.centroid()[axis];
+        float cb = instances[b].bounds.centroid()[axis];
+        return ca < cb || (ca == cb && a < b);
+    });
+
+    node.count = 0;
+    node.axis = axis;
+    node.offset = top.nodes.size();
+    top.nodes[index] = node;
+    top.nodes.resize(top.nodes.size() + 2);
+    build_helper(instances, indices, mid, top, node.offset);
+    build_helper(instances, indices + mid, count - mid, top, node.offset + 1);
+}
+
+void Tlas::build() {
+    top = LinearBvh();
+
+    // Instances without geometry are left out of the tree
+    std::vector<int> indices;
+    for (size_t i = 0; i < instances.size(); i++) {
+        if (instances[i].object->getBvh() != nullptr) {
+            indices.push_back(i);
+        }
+    }
+    if (!indices.empty()) {
+        top.nodes.resize(1);
+        build_helper(instances, indices.data(), indices.size(), top, 0);
+    }
+}
+
+void Tlas::refit() {
+    // The objects may have been refitted since the boxes were computed
+    for (size_t i = 0; i < instances.size(); i++) {
+        update_bounds(i);
+    }
+    for (size_t i = top.nodes.size(); i-- > 0;) {
+        LinearBvhNode& node = top.nodes[i];
+        if (node.is_leaf()) {
+            BoundingBox box = BoundingBox::empty();
+            for (uint32_t j = node.offset; j < node.offset + node.count; j++) {
+                box.expand(instances[top.primitive_indices[j]].bounds);
+            }
+            node.min = box.min;
+            node.max = box.max;
+        } else {
+            const LinearBvhNode& left = top.nodes[node.offset];
+            const LinearBvhNode& right = top.nodes[node.offset + 1];
+            node.min = vec3<float>::min(left.min, right.min);
+            node.max = vec3<float>::max(left.max, right.max);
+        }
+    }
+}
+
+// Top-level traversal loop, the instances of a leaf are traced in object space.
+// With ANY_HIT the loop returns at the first hit found.
+template <bool ANY_HIT>
+static bool traverse(const Tlas& tlas, const Ray& ray, Hit& hit) {
+    const LinearBvhNode* nodes = tlas.top.nodes.data();
+    const bool dir_is_neg[3] = {ray.inv_direction.x < 0.0f, ray.inv_direction.y < 0.0f, ray.inv_direction.z < 0.0f};
+
+    uint32_t stack[BVH_TRAVERSAL_STACK_SIZE];
+    int stack_size = 0;
+    uint32_t current = 0;
+    bool found = false;
+
+    while (true) {
+        const LinearBvhNode& node = nodes[current];
+        float tnear;
+        if (intersect_box(node.min, node.max, ray, hit.t, tnear)) {
+            if (node.is_leaf()) {
+                for (uint32_t i = node.offset; i < node.offset + node.count; i++) {
+                    int index = tlas.top.primitive_indices[i];
+                    const Instance& instance = tlas.instances[index];
+
+                    // The direction is not normalized, so t is the same in both spaces
+                    Ray local(instance.to_object.point(ray.origin), instance.to_object.vector(ray.direction), ray.tmin, hit.t);
+                    if (ANY_HIT) {
+                        if (instance.object->occluded(local)) {
+                            return true;
+                        }
+                        continue;
+                    }
+                    Hit local_hit = instance.object->intersect(local);
+                    if (local_hit.hit() && local_hit.t < hit.t) {
+                        hit = local_hit;
+                        hit.instance = index;
+                        found = true;
+                    }
+                }
+            } else {
+                // Visit the child on the side the ray comes from first
+                uint32_t near_child = node.offset;
+                uint32_t far_child = node.offset + 1;
+                if (dir_is_neg[node.axis]) {
+                    std::swap(near_child, far_child);
+                }
+                // Median splits keep the depth below log2(number of instances), the stack cannot overflow
+                stack[stack_size++] = far_child;
+                current = near_child;
+                continue;
+            }
+        }
+
+        if (stack_size == 0) {
+            return found;
+        }
+        current = stack[--stack_size];
+    }
+}
+
+Hit Tlas::intersect(const Ray& ray) const {
+    Hit hit;
+    hit.t = ray.tmax;
+    if (top.empty()) {
+        return Hit();
+    }
+
+    traverse<false>(*this, ray, hit);
+    if (!hit.hit()) {
+        hit.t = std::numeric_limits<float>::max();
+    }
+    return hit;
+}
+
+bool Tlas::occluded(const Ray& ray) const {
+    Hit hit;
+    hit.t = ray.tmax;
+    return !top.empty() && traverse<true>(*this, ray, hit);
+}
+
+}
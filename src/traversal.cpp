@@ -0,0 +1,132 @@
+#include <traversal.hpp>
+
+namespace bvh {
+
+struct StackEntry {
+    const BvhNode* node;
+    float tnear;  // entry distance into the node, used to skip nodes behind the closest hit
+};
+
+// Shared traversal loop. With ANY_HIT the loop returns at the first hit found.
+// The root box must already have been tested by the caller.
+template <bool ANY_HIT, typename Accessor>
+static bool traverse(const BvhNode* node, const Accessor& tris, const Ray& ray, Hit& hit) {
+    StackEntry stack[BVH_TRAVERSAL_STACK_SIZE];
+    int stack_size = 0;
+    bool found = false;
+
+    while (true) {
+        // Nodes without children are always leaves, no need for a dynamic_cast
+        if (node->left == nullptr) {
+            const BvhLeaf* leaf = static_cast<const BvhLeaf*>(node);
+            for (int i = 0; i < leaf->num_triangles; i++) {
+                int tri = leaf->indices[i];
+                float t, u, v;
+                if (intersect_triangle(ray, tris.vertex(tri, 0), tris.vertex(tri, 1), tris.vertex(tri, 2), hit.t, t, u, v)) {
+                    hit.triangle = leaf->indices[i];
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    found = true;
+                    if (ANY_HIT) {
+                        return true;
+                    }
+                }
+            }
+        } else {
+            float tleft, tright;
+            bool hit_left = intersect_box(node->left->bounding_box, ray, hit.t, tleft);
+            bool hit_right = intersect_box(node->right->bounding_box, ray, hit.t, tright);
+
+            if (hit_left && hit_right) {
+                // Visit the nearer child first and keep the other one for later
+                const BvhNode* near_child = node->left;
+                const BvhNode* far_child = node->right;
+                float tfar = tright;
+                if (tright < tleft) {
+                    std::swap(near_child, far_child);
+                    tfar = tleft;
+                }
+                if (stack_size == BVH_TRAVERSAL_STACK_SIZE) {
+                    // Tree deeper than the stack: finish the far subtree recursively
+                    if (traverse<ANY_HIT>(far_child, tris, ray, hit)) {
+                        found = true;
+                        if (ANY_HIT) {
+                            return true;
+                        }
+                    }
+                } else {
+                    stack[stack_size++] = {far_child, tfar};
+                }
+                node = near_child;
+                continue;
+            } else if (hit_left) {
+                node = node->left;
+                continue;
+            } else if (hit_right) {
+                node = node->right;
+                continue;
+            }
+        }
+
+        // Pop the next node that can still contain a closer hit
+        do {
+            if (stack_size == 0) {
+                return found;
+            }
+            stack_size--;
+        } while (stack[stack_size].tnear > hit.t);
+        node = stack[stack_size].node;
+    }
+}
+
+template <typename Accessor>
+static Hit intersect_closest(const BvhNode* root, const Accessor& tris, const Ray& ray) {
+    Hit hit;
+    hit.t = ray.tmax;
+
+    float tnear;
+    if (root == nullptr || !intersect_box(root->bounding_box, ray, ray.tmax, tnear)) {
+        return Hit();
+    }
+
+    traverse<false>(root, tris, ray, hit);
+    if (!hit.hit()) {
+        hit.t = std::numeric_limits<float>::max();
+    }
+    return hit;
+}
+
+template <typename Accessor>
+static bool intersect_any(const BvhNode* root, const Accessor& tris, const Ray& ray) {
+    Hit hit;
+    hit.t = ray.tmax;
+
+    float tnear;
+    if (root == nullptr || !intersect_box(root->bounding_box, ray, ray.tmax, tnear)) {
+        return false;
+    }
+
+    return traverse<true>(root, tris, ray, hit);
+}
+
+Hit intersect(const BvhNode* root, const Triangle* tris, const Ray& ray) {
+    if (tris == nullptr) {
+        return Hit();
+    }
+    return intersect_closest(root, TriangleArrayAccessor{tris}, ray);
+}
+
+bool occluded(const BvhNode* root, const Triangle* tris, const Ray& ray) {
+    return tris != nullptr && intersect_any(root, TriangleArrayAccessor{tris}, ray);
+}
+
+Hit intersect(const BvhNode* root, const Mesh& mesh, const Ray& ray) {
+    return intersect_closest(root, MeshAccessor{&mesh}, ray);
+}
+
+bool occluded(const BvhNode* root, const Mesh& mesh, const Ray& ray) {
+    return intersect_any(root, MeshAccessor{&mesh}, ray);
+}
+
+}
@@ -0,0 +1,296 @@
+#include <wide_bvh.hpp>
+#include <linear_bvh.hpp>
+#include <arena.hpp>
+#include <traversal.hpp>
+#include <simd.hpp>
+
+#include <algorithm>
+#include <limits>
+
+namespace bvh {
+
+// Opens the internal child with the largest surface area until the node has width children
+static void select_children(const BvhNode* node, int width, std::vector<const BvhNode*>& children) {
+    children.clear();
+    children.push_back(node->left);
+    children.push_back(node->right);
+    while ((int)children.size() < width) {
+        int best = -1;
+        float best_area = -1.0f;
+        for (size_t i = 0; i < children.size(); i++) {
+            if (children[i]->left != nullptr && children[i]->bounding_box.surface_area() > best_area) {
+                best = i;
+                best_area = children[i]->bounding_box.surface_area();
+            }
+        }
+        if (best == -1) {
+            break; // only leaves left
+        }
+        const BvhNode* opened = children[best];
+        children[best] = opened->left;
+        children.push_back(opened->right);
+    }
+}
+
+template <int N>
+static void set_child_bounds(WideBvhNode<N>& node, int slot, const BoundingBox& box) {
+    node.min_x[slot] = box.min.x;
+    node.min_y[slot] = box.min.y;
+    node.min_z[slot] = box.min.z;
+    node.max_x[slot] = box.max.x;
+    node.max_y[slot] = box.max.y;
+    node.max_z[slot] = box.max.z;
+}
+
+template <int N>
+static uint32_t collapse_node(const std::vector<const BvhNode*>& children, WideBvh<N>& bvh) {
+    uint32_t index = bvh.nodes.size();
+    bvh.nodes.push_back(WideBvhNode<N>());
+    WideBvhNode<N> node = {};
+
+    // Leaves first, the internal children are collapsed after the node is complete
+    std::vector<const BvhNode*> internal;
+    std::vector<int> internal_slots;
+    for (const BvhNode* child : children) {
+        if (child->left == nullptr) {
+            const BvhLeaf* leaf = static_cast<const BvhLeaf*>(child);
+            int slot = node.num_children++;
+            set_child_bounds(node, slot, child->bounding_box);
+            node.child[slot] = bvh.primitive_indices.size();
+            node.count[slot] = leaf->num_triangles;
+            bvh.primitive_indices.insert(bvh.primitive_indices.end(), leaf->indices, leaf->indices + leaf->num_triangles);
+        } else {
+            int slot = node.num_children++;
+            set_child_bounds(node, slot, child->bounding_box);
+            node.count[slot] = 0;
+            internal.push_back(child);
+            internal_slots.push_back(slot);
+        }
+    }
+
+    std::vector<const BvhNode*> grandchildren;
+    for (size_t i = 0; i < internal.size(); i++) {
+        select_children(internal[i], N, grandchildren);
+        node.child[internal_slots[i]] = collapse_node(grandchildren, bvh);
+    }
+
+    bvh.nodes[index] = node; // push_back may have moved the array, index again
+    return index;
+}
+
+template <int N>
+WideBvh<N> WideBvh<N>::collapse(const BvhNode* root) {
+    WideBvh<N> bvh;
+    if (root == nullptr) {
+        return bvh;
+    }
+
+    // Leaves whose count does not fit in WideBvhNode::count are split, as LinearBvh::flatten() does
+    NodeArena copy_arena;
+    root = flattenable_tree(root, copy_arena);
+    if (root == nullptr) {
+        return bvh;
+    }
+
+    // A leaf root becomes a node with a single leaf child
+    std::vector<const BvhNode*> children;
+    if (root->left == nullptr) {
+        children.push_back(root);
+    } else {
+        select_children(root, N, children);
+    }
+    collapse_node(children, bvh);
+    return bvh;
+}
+
+// Slab test of a ray against every child of a node. Returns the mask of the children hit within
+// [ray.tmin, tmax] and sets their entry distances, same arithmetic as intersect_box().
+template <int N>
+static inline int intersect_children(const WideBvhNode<N>& node, const Ray& ray, float tmax, float* tnear) {
+    int mask = 0;
+    for (int i = 0; i < node.num_children; i++) {
+        vec3<float> min(node.min_x[i], node.min_y[i], node.min_z[i]);
+        vec3<float> max(node.max_x[i], node.max_y[i], node.max_z[i]);
+        if (intersect_box(min, max, ray, tmax, tnear[i])) {
+            mask |= 1 << i;
+        }
+    }
+    return mask;
+}
+
+#ifdef __AVX2__
+
+template <>
+inline int intersect_children<8>(const WideBvhNode<8>& node, const Ray& ray, float tmax, float* tnear) {
+    __m256 ox = _mm256_set1_ps(ray.origin.x), oy = _mm256_set1_ps(ray.origin.y), oz = _mm256_set1_ps(ray.origin.z);
+    __m256 ix = _mm256_set1_ps(ray.inv_direction.x), iy = _mm256_set1_ps(ray.inv_direction.y), iz = _mm256_set1_ps(ray.inv_direction.z);
+    __m256 tx1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_x), ox), ix);
+    __m256 tx2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_x), ox), ix);
+    __m256 ty1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_y), oy), iy);
+    __m256 ty2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_y), oy), iy);
+    __m256 tz1 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.min_z), oz), iz);
+    __m256 tz2 = _mm256_mul_ps(_mm256_sub_ps(_mm256_load_ps(node.max_z), oz), iz);
+
+    __m256 near = lane_max(lane_max(lane_min(tx1, tx2), lane_min(ty1, ty2)), lane_max(lane_min(tz1, tz2), _mm256_set1_ps(ray.tmin)));
+    __m256 far = lane_min(lane_min(lane_max(tx1, tx2), lane_max(ty1, ty2)), lane_min(lane_max(tz1, tz2), _mm256_set1_ps(tmax)));
+    _mm256_storeu_ps(tnear, near);
+    return _mm256_movemask_ps(_mm256_cmp_ps(near, far, _CMP_LE_OQ)) & ((1 << node.num_children) - 1);
+}
+
+template <>
+inline int intersect_children<4>(const WideBvhNode<4>& node, const Ray& ray, float tmax, float* tnear) {
+    __m128 ox = _mm_set1_ps(ray.origin.x), oy = _mm_set1_ps(ray.origin.y), oz = _mm_set1_ps(ray.origin.z);
+    __m128 ix = _mm_set1_ps(ray.inv_direction.x), iy = _mm_set1_ps(ray.inv_direction.y), iz = _mm_set1_ps(ray.inv_direction.z);
+    __m128 tx1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_x), ox), ix);
+    __m128 tx2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_x), ox), ix);
+    __m128 ty1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_y), oy), iy);
+    __m128 ty2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_y), oy), iy);
+    __m128 tz1 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.min_z), oz), iz);
+    __m128 tz2 = _mm_mul_ps(_mm_sub_ps(_mm_load_ps(node.max_z), oz), iz);
+
+    __m128 near = lane_max(lane_max(lane_min(tx1, tx2), lane_min(ty1, ty2)), lane_max(lane_min(tz1, tz2), _mm_set1_ps(ray.tmin)));
+    __m128 far = lane_min(lane_min(lane_max(tx1, tx2), lane_max(ty1, ty2)), lane_min(lane_max(tz1, tz2), _mm_set1_ps(tmax)));
+    _mm_storeu_ps(tnear, near);
+    return _mm_movemask_ps(_mm_cmp_ps(near, far, _CMP_LE_OQ)) & ((1 << node.num_children) - 1);
+}
+
+#endif
+
+struct WideStackEntry {
+    uint32_t child;
+    uint32_t count;  // 0 for an internal node
+    float tnear;     // entry distance into the child, used to skip children behind the closest hit
+};
+
+// Shared traversal loop starting from one child. With ANY_HIT the loop returns at the first hit found.
+template <bool ANY_HIT, int N, typename Accessor>
+static bool traverse(const WideBvh<N>& bvh, WideStackEntry entry, const Accessor& tris, const Ray& ray, Hit& hit) {
+    WideStackEntry stack[BVH_TRAVERSAL_STACK_SIZE];
+    int stack_size = 0;
+    bool found = false;
+
+    while (true) {
+        if (entry.count > 0) {
+            for (uint32_t i = entry.child; i < entry.child + entry.count; i++) {
+                int tri = bvh.primitive_indices[i];
+                float t, u, v;
+                if (intersect_triangle(ray, tris.vertex(tri, 0), tris.vertex(tri, 1), tris.vertex(tri, 2), hit.t, t, u, v)) {
+                    hit.triangle = tri;
+                    hit.t = t;
+                    hit.u = u;
+                    hit.v = v;
+                    found = true;
+                    if (ANY_HIT) {
+                        return true;
+                    }
+                }
+            }
+        } else {
+            const WideBvhNode<N>& node = bvh.nodes[entry.child];
+            float tnear[N];
+            int mask = intersect_children(node, ray, hit.t, tnear);
+
+            // Children hit, sorted by decreasing distance so that the nearest one is last
+            WideStackEntry hits[N];
+            int num_hits = 0;
+            for (; mask != 0; mask &= mask - 1) {
+                int slot = __builtin_ctz(mask);
+                WideStackEntry child = {node.child[slot], node.count[slot], tnear[slot]};
+                int j = num_hits++;
+                for (; j > 0 && hits[j - 1].tnear < child.tnear; j--) {
+                    hits[j] = hits[j - 1];
+                }
+                hits[j] = child;
+            }
+
+            if (num_hits > 0) {
+                for (int i = 0; i < num_hits - 1; i++) {
+                    if (stack_size == BVH_TRAVERSAL_STACK_SIZE) {
+                        // Tree deeper than the stack: finish the farther children recursively
+                        if (traverse<ANY_HIT>(bvh, hits[i], tris, ray, hit)) {
+                            found = true;
+                            if (ANY_HIT) {
+                                return true;
+                            }
+                        }
+                    } else {
+                        stack[stack_size++] = hits[i];
+                    }
+                }
+                entry = hits[num_hits - 1];
+                continue;
+            }
+        }
+
+        // Pop the next child that can still contain a closer hit
+        do {
+            if (stack_size == 0) {
+                return found;
+            }
+            stack_size--;
+        } while (stack[stack_size].tnear > hit.t);
+        entry = stack[stack_size];
+    }
+}
+
+template <int N, typename Accessor>
+static Hit intersect_closest(const WideBvh<N>& bvh, const Accessor& tris, const Ray& ray) {
+    Hit hit;
+    hit.t = ray.tmax;
+    if (bvh.empty()) {
+        return Hit();
+    }
+
+    traverse<false>(bvh, WideStackEntry{0, 0, ray.tmin}, tris, ray, hit);
+    if (!hit.hit()) {
+        hit.t = std::numeric_limits<float>::max();
+    }
+    return hit;
+}
+
+template <int N, typename Accessor>
+static bool intersect_any(const WideBvh<N>& bvh, const Accessor& tris, const Ray& ray) {
+    Hit hit;
+    hit.t = ray.tmax;
+    if (bvh.empty()) {
+        return false;
+    }
+
+    return traverse<true>(bvh, WideStackEntry{0, 0, ray.tmin}, tris, ray, hit);
+}
+
+template <int N>
+Hit intersect(const WideBvh<N>& bvh, const Triangle* tris, const Ray& ray) {
+    if (tris == nullptr) {
+        return Hit();
+    }
+    return intersect_closest(bvh, TriangleArrayAccessor{tris}, ray);
+}
+
+template <int N>
+bool occluded(const WideBvh<N>& bvh, const Triangle* tris, const Ray& ray) {
+    return tris != nullptr && intersect_any(bvh, TriangleArrayAccessor{tris}, ray);
+}
+
+template <int N>
+Hit intersect(const WideBvh<N>& bvh, const Mesh& mesh, const Ray& ray) {
+    return intersect_closest(bvh, MeshAccessor{&mesh}, ray);
+}
+
+template <int N>
+bool occluded(const WideBvh<N>& bvh, const Mesh& mesh, const Ray& ray) {
+    return intersect_any(bvh, MeshAccessor{&mesh}, ray);
+}
+
+template class WideBvh<4>;
+template class WideBvh<8>;
+template Hit intersect(const WideBvh<4>&, const Triangle*, const Ray&);
+template Hit intersect(const WideBvh<8>&, const Triangle*, const Ray&);
+template bool occluded(const WideBvh<4>&, const Triangle*, const Ray&);
+template bool occluded(const WideBvh<8>&, const Triangle*, const Ray&);
+template Hit intersect(const WideBvh<4>&, const Mesh&, const Ray&);
+template Hit intersect(const WideBvh<8>&, const Mesh&, const Ray&);
+template bool occluded(const WideBvh<4>&, const Mesh&, const Ray&);
+template bool occluded(const WideBvh<8>&, const Mesh&, const Ray&);
+
+}
@@ -2,6 +2,7 @@
 #include <random>
 #include <iostream>
 #include <triangle.hpp>
+#include <ray.hpp>
 
 namespace bvh{
     std::vector<Triangle> generateRandomTriangles(int numTriangles, float rangeMin, float rangeMax) {
@@ -16,16 +17,37 @@ namespace bvh{
             tri.vertices[j] = vec3<float>(dis(gen), dis(gen), dis(gen)); // Random vertex within the range
         }
         triangles.push_back(tri); // Add triangle to the list
-        printf("Triangle %d: (%f, %f, %f), (%f, %f, %f), (%f, %f, %f)\n",
-            i, tri.vertices[0].x, tri.vertices[0].y, tri.vertices[0].z,
-            tri.vertices[1].x, tri.vertices[1].y, tri.vertices[1].z,
-            tri.vertices[2].x, tri.vertices[2].y, tri.vertices[2].z);
-        printf("Centroid: (%f, %f, %f)\n",
-            (tri.vertices[0].x + tri.vertices[1].x + tri.vertices[2].x) / 3.0f,
-            (tri.vertices[0].y + tri.vertices[1].y + tri.vertices[2].y) / 3.0f,
-            (tri.vertices[0].z + tri.vertices[1].z + tri.vertices[2].z) / 3.0f);
     }
         
     return triangles; // Return the list of triangles
     }
+
+    std::vector<Triangle> generateRandomTriangles(int numTriangles, float rangeMin, float rangeMax, unsigned int seed, float triangleSize,
+                                                  const vec3<float>& center) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> pos_dis(rangeMin, rangeMax);
+    std::uniform_real_distribution<float> offset_dis(-triangleSize, triangleSize);
+
+    std::vector<Triangle> triangles(numTriangles);
+    for (Triangle& tri : triangles) {
+        tri = {};
+        vec3<float> p = center + vec3<float>(pos_dis(gen), pos_dis(gen), pos_dis(gen));
+        for (int j = 0; j < 3; j++) {
+            tri.vertices[j] = vec3<float>(p.x + offset_dis(gen), p.y + offset_dis(gen), p.z + offset_dis(gen));
+        }
+    }
+    return triangles;
+    }
+
+    std::vector<Ray> generateRandomRays(int numRays, float rangeMin, float rangeMax, float targetScale, unsigned int seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> dis(rangeMin, rangeMax);
+
+    std::vector<Ray> rays;
+    for (int i = 0; i < numRays; i++) {
+        vec3<float> origin(dis(gen), dis(gen), dis(gen));
+        rays.push_back(Ray(origin, vec3<float>(dis(gen), dis(gen), dis(gen)) * targetScale - origin));
+    }
+    return rays;
+    }
 }  
\ No newline at end of file
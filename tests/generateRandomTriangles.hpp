@@ -1,6 +1,18 @@
+#pragma once
+
 #include <vector>
 #include <triangle.hpp>
+#include <ray.hpp>
 
 namespace bvh{
     std::vector<Triangle> generateRandomTriangles(int numTriangles, float rangeMin, float rangeMax);
+
+    // Same triangles for the same seed: each one has its vertices within triangleSize of a point of the range,
+    // moved by center
+    std::vector<Triangle> generateRandomTriangles(int numTriangles, float rangeMin, float rangeMax, unsigned int seed, float triangleSize = 0.5f,
+                                                  const vec3<float>& center = vec3<float>(0.0f, 0.0f, 0.0f));
+
+    // Same rays for the same seed: each one starts at a point of the range and goes through a point of the range
+    // scaled by targetScale, toward its center when targetScale < 1
+    std::vector<Ray> generateRandomRays(int numRays, float rangeMin, float rangeMax, float targetScale, unsigned int seed);
 }
\ No newline at end of file
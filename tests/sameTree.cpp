@@ -0,0 +1,28 @@
+#include <sameTree.hpp>
+
+namespace bvh::tests {
+
+bool same_tree(const BvhNode* a, const BvhNode* b, bool compare_boxes) {
+    if (a == nullptr || b == nullptr) {
+        return a == b;
+    }
+    if (compare_boxes && !(a->bounding_box == b->bounding_box)) {
+        return false;
+    }
+    const BvhLeaf* leaf_a = dynamic_cast<const BvhLeaf*>(a);
+    const BvhLeaf* leaf_b = dynamic_cast<const BvhLeaf*>(b);
+    if (leaf_a != nullptr || leaf_b != nullptr) {
+        if (leaf_a == nullptr || leaf_b == nullptr || leaf_a->num_triangles != leaf_b->num_triangles) {
+            return false;
+        }
+        for (int i = 0; i < leaf_a->num_triangles; i++) {
+            if (leaf_a->indices[i] != leaf_b->indices[i]) {
+                return false;
+            }
+        }
+        return true;
+    }
+    return same_tree(a->left, b->left, compare_boxes) && same_tree(a->right, b->right, compare_boxes);
+}
+
+}
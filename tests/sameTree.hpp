@@ -0,0 +1,10 @@
+#pragma once
+
+#include <bvh_node.hpp>
+
+namespace bvh::tests {
+
+    // Same shape and leaf contents, and same boxes if compare_boxes (the text format rounds them)
+    bool same_tree(const BvhNode* a, const BvhNode* b, bool compare_boxes = true);
+
+}
@@ -0,0 +1,173 @@
+#include <test_arena.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <sameTree.hpp>
+#include <arena.hpp>
+#include <bvh.hpp>
+#include <bvh_tree.hpp>
+#include <linear_bvh.hpp>
+#include <object.hpp>
+#include <thread_pool.hpp>
+#include <vector>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <thread>
+#include <utility>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: bytes taken by the nodes of a tree
+static size_t tree_bytes(const BvhNode* node) {
+    if (node->left == nullptr) {
+        return sizeof(BvhLeaf) + static_cast<const BvhLeaf*>(node)->num_triangles * sizeof(int);
+    }
+    return sizeof(BvhNode) + tree_bytes(node->left) + tree_bytes(node->right);
+}
+
+void arena() {
+    std::cout << "Starting arena tests..." << std::endl;
+
+    // Test Case 1: bump allocation, alignment and oversized requests
+    NodeArena arena(1024);
+    char* c = arena.create<char>('a');
+    double* d = arena.create<double>(2.0);
+    assert(*c == 'a' && *d == 2.0, "Arena objects should be constructed");
+    assert(reinterpret_cast<uintptr_t>(d) % alignof(double) == 0, "Arena allocations should be aligned");
+    void* aligned = arena.allocate(64, 64);
+    assert(reinterpret_cast<uintptr_t>(aligned) % 64 == 0, "Arena allocations should honour large alignments");
+    assert(arena.num_blocks() == 1, "Small allocations should share one block");
+    arena.allocate(4096, 8);
+    assert(arena.num_blocks() == 2, "An oversized allocation should get its own block");
+    assert(arena.bytes_used() == 1 + sizeof(double) + 64 + 4096, "Wrong number of bytes used");
+    std::cout << "Test Case 1 passed: bump allocation" << std::endl;
+
+    // Test Case 2: every pool thread allocates from its own sub-arena
+    ThreadPool pool(4);
+    NodeArena shared;
+    shared.reserve_threads(pool);
+    ArenaNodeAllocator alloc{&shared};
+    std::vector<NodeArena*> used_arenas(1000);
+    parallel_for(pool, used_arenas.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            ArenaNodeAllocator local = alloc.local(pool);
+            local.node(vec3<float>(0, 0, 0), vec3<float>(1, 1, 1));
+            used_arenas[i] = local.arena;
+        }
+    });
+    for (NodeArena* used : used_arenas) {
+        bool known = used == &shared;
+        for (int w = 1; w < pool.num_threads(); w++) {
+            known = known || used == &shared.thread_arena(w);
+        }
+        assert(known, "Nodes should come from the arena or one of its sub-arenas");
+    }
+    assert(shared.bytes_used() == used_arenas.size() * sizeof(BvhNode), "Sub-arenas should be counted with their parent");
+    std::cout << "Test Case 2 passed: per-thread sub-arenas" << std::endl;
+
+    // Test Case 3: arena trees are the same as heap trees
+    std::vector<Triangle> tris = generateRandomTriangles(50000, 0.0f, 100.0f, 12);
+    BvhNode* heap_sah = precompute_bvh_sah(tris.data(), 0, tris.size());
+    BvhTree arena_sah = BvhTree::sah(tris.data(), 0, tris.size());
+    assert(same_tree(heap_sah, arena_sah.root()), "BvhTree::sah() should match precompute_bvh_sah()");
+    assert(arena_sah.memory_size() == tree_bytes(arena_sah.root()), "The arena should only hold the nodes");
+
+    BvhNode* heap_parallel = precompute_bvh_parallel(tris.data(), 0, tris.size(), pool);
+    BvhTree arena_parallel = BvhTree::parallel(tris.data(), 0, tris.size(), pool);
+    assert(same_tree(heap_parallel, arena_parallel.root()), "BvhTree::parallel() should match precompute_bvh_parallel()");
+    assert(arena_parallel.memory_size() == tree_bytes(arena_parallel.root()), "Sub-arena nodes should belong to the tree");
+
+    Mesh mesh = Mesh::from_triangles(tris.data(), 2000);
+    BvhNode* heap_mesh = precompute_bvh_sah(mesh);
+    BvhTree arena_mesh = BvhTree::sah(mesh);
+    assert(same_tree(heap_mesh, arena_mesh.root()), "BvhTree::sah() over a mesh should match precompute_bvh_sah()");
+
+    BvhNode* heap_median = precompute_bvh(tris.data(), 0, 100);
+    BvhTree arena_median = BvhTree::median(tris.data(), 0, 100);
+    assert(same_tree(heap_median, arena_median.root()), "BvhTree::median() should match precompute_bvh()");
+
+    LinearBvh linear = LinearBvh::flatten(heap_sah);
+    BvhTree arena_linear = BvhTree::from_linear(linear.view());
+    assert(same_tree(heap_sah, arena_linear.root()), "BvhTree::from_linear() should rebuild the flattened tree");
+    assert(BvhTree::sah(tris.data(), 0, 0).empty() && BvhTree::from_linear(LinearBvhView()).empty(), "Empty input should give an empty tree");
+    std::cout << "Test Case 3 passed: arena trees match heap trees" << std::endl;
+
+    // Test Case 4: the handle moves its nodes
+    BvhNode* root = arena_sah.root();
+    BvhTree moved = std::move(arena_sah);
+    assert(moved.root() == root && arena_sah.empty() && arena_sah.memory_size() == 0, "Moving a tree should move its nodes");
+    arena_sah = std::move(moved);
+    assert(arena_sah.root() == root && moved.empty(), "Move assignment should move the nodes back");
+    std::cout << "Test Case 4 passed: move-only handle" << std::endl;
+
+    // Test Case 5: objects own the trees they load or are given, text BVH files included
+    Object* loaded = Object::load((char*)"../tests/data/final/grid.obj", (char*)"../tests/data/node.bvh");
+    assert(loaded != nullptr && loaded->bvh == loaded->bvh_tree.root(), "Object::load() should own its tree");
+    assert(loaded->bvh->left != nullptr && loaded->bvh->right != nullptr, "Loaded text tree should be linked");
+    delete loaded;
+
+    Triangle* object_tris = new Triangle[100];
+    std::copy(tris.begin(), tris.begin() + 100, object_tris);
+    Object given(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0), vec3<float>(1, 1, 1), object_tris, 100, BvhTree::sah(object_tris, 0, 100));
+    assert(given.bvh != nullptr && given.bvh == given.bvh_tree.root(), "Object should take the tree");
+    assert(given.bvh_build_cost == sah_cost(given.bvh), "Build cost of a given tree");
+
+    // Only the joining nodes belong to the tree of the objects, the object trees are shared
+    Triangle* pair_tris[2] = {new Triangle[100], new Triangle[100]};
+    std::copy(tris.begin(), tris.begin() + 100, pair_tris[0]);
+    std::copy(tris.begin() + 100, tris.begin() + 200, pair_tris[1]);
+    Object pair[] = {
+        Object(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0), vec3<float>(1, 1, 1), pair_tris[0], 100, BvhTree::sah(pair_tris[0], 0, 100)),
+        Object(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0), vec3<float>(1, 1, 1), pair_tris[1], 100, BvhTree::sah(pair_tris[1], 0, 100))
+    };
+    BvhTree joined = BvhTree::from_objects(pair, 2, 0);
+    assert(joined.root() != nullptr && joined.memory_size() == sizeof(BvhNode), "from_objects() should only allocate the joining node");
+    assert((joined.root()->left == pair[0].bvh) != (joined.root()->left == pair[1].bvh), "from_objects() should reuse the object trees");
+    std::cout << "Test Case 5 passed: object ownership" << std::endl;
+
+    // Test Case 6: parallel builds started from the tasks of another pool, and from two threads sharing a pool
+    std::vector<Triangle> small = generateRandomTriangles(20000, 0.0f, 100.0f, 13);
+    BvhNode* reference = precompute_bvh_parallel(small.data(), 0, small.size(), 1);
+    ThreadPool inner(2);
+    std::vector<char> nested_same(8, 0);
+    parallel_for(pool, nested_same.size(), 1, [&](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; i++) {
+            // Workers of pool have larger indices than inner has sub-arenas
+            BvhTree nested = (i % 2 == 0) ? BvhTree::parallel(small.data(), 0, small.size(), inner)
+                                          : BvhTree::lbvh(small.data(), 0, small.size(), inner);
+            nested_same[i] = (i % 2 == 0) ? same_tree(reference, nested.root()) : (nested.root() != nullptr && nested.memory_size() > 0);
+        }
+    });
+    for (char same : nested_same) {
+        assert(same, "Builds nested in the tasks of another pool should give the same trees");
+    }
+
+    ThreadPool one_pool(3);
+    BvhTree concurrent[2];
+    std::thread builders[2];
+    for (int b = 0; b < 2; b++) {
+        builders[b] = std::thread([&, b]() {
+            for (int round = 0; round < 4; round++) {
+                concurrent[b] = BvhTree::parallel(small.data(), 0, small.size(), one_pool);
+            }
+        });
+    }
+    for (std::thread& builder : builders) {
+        builder.join();
+    }
+    for (const BvhTree& tree : concurrent) {
+        assert(same_tree(reference, tree.root()) && tree.memory_size() == tree_bytes(tree.root()),
+               "Concurrent builds on one pool should give the same trees, with every node in their own arena");
+    }
+    std::cout << "Test Case 6 passed: nested pools and concurrent builds on one pool" << std::endl;
+
+    delete reference;
+    delete heap_sah;
+    delete heap_parallel;
+    delete heap_mesh;
+    delete heap_median;
+
+    std::cout << "All arena tests completed successfully." << std::endl;
+}
+
+}
@@ -0,0 +1,174 @@
+#include <test_async_build.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <async_build.hpp>
+#include <bvh_tree.hpp>
+#include <traversal.hpp>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: a copy of the triangles in a new[] array, the form AsyncBuild takes
+static Triangle* copy_triangles(const std::vector<Triangle>& tris) {
+    Triangle* copy = new Triangle[tris.size()];
+    std::copy(tris.begin(), tris.end(), copy);
+    return copy;
+}
+
+// Helper function, only used in this file: same hits as a tree built synchronously over the same triangles
+static void check_same_hits(const Object& object, const std::vector<Triangle>& tris, const std::vector<Ray>& rays, const std::string& what) {
+    std::vector<Triangle> copy = tris;
+    BvhTree tree = BvhTree::sah(copy.data(), 0, copy.size());
+    int num_hits = 0;
+    for (size_t i = 0; i < rays.size(); i++) {
+        Hit expected = intersect(tree.root(), copy.data(), rays[i]);
+        Hit hit = object.intersect(rays[i]);
+        assert(hit.triangle == expected.triangle && hit.t == expected.t, what + ": hit differs for ray " + std::to_string(i));
+        num_hits += hit.hit();
+    }
+    assert(num_hits > 0, what + ": no ray hit");
+}
+
+void async_build() {
+    std::cout << "Starting async_build tests..." << std::endl;
+    std::vector<Ray> rays = generateRandomRays(300, -12.0f, 12.0f, 0.3f, 1);
+
+    // Test Case 1: a background build gives the tree of the synchronous build, with progress up to 1
+    ThreadPool pool(2);
+    std::vector<Triangle> tris = generateRandomTriangles(20000, -10.0f, 10.0f, 3);
+    AsyncBuild build = AsyncBuild::start(pool, copy_triangles(tris), tris.size());
+    float last = 0.0f;
+    int num_polls = 0;
+    while (!build.ready()) {
+        float progress = build.progress();
+        assert(progress >= last && progress <= 1.0f, "Progress should grow within [0, 1]");
+        last = progress;
+        num_polls++;
+        std::this_thread::yield();
+    }
+    std::shared_ptr<Object> object = build.get();
+    assert(object != nullptr && object->num_triangles == static_cast<int>(tris.size()), "Built object should hold the triangles");
+    assert(build.progress() == 1.0f, "Progress should be 1 once built");
+    check_same_hits(*object, tris, rays, "Background build");
+    std::cout << "Test Case 1 passed: background build, progress polled " << num_polls << " times" << std::endl;
+
+    // Test Case 2: a build cancelled before it starts. The pool has no worker, the build only runs in get().
+    ThreadPool no_workers(1);
+    SharedObject slot;
+    AsyncBuild cancelled = AsyncBuild::start(no_workers, copy_triangles(tris), tris.size(), &slot);
+    assert(!cancelled.ready(), "A pool without workers should not run the build by itself");
+    cancelled.cancel();
+    bool thrown = false;
+    try {
+        cancelled.get();
+    } catch (const BuildCancelled&) {
+        thrown = true;
+    }
+    assert(thrown && slot.acquire() == nullptr, "Cancelled build should throw and publish nothing");
+    assert(slot.publish_refit(copy_triangles(tris)) == nullptr && slot.acquire() == nullptr,
+           "Refitting an empty slot should publish nothing");
+    std::cout << "Test Case 2 passed: cancelled before starting" << std::endl;
+
+    // Test Case 3: cancellation in the middle of a build, through the leaves
+    std::vector<Triangle> many = generateRandomTriangles(100000, -10.0f, 10.0f, 4);
+    AsyncBuild stopped = AsyncBuild::start(pool, copy_triangles(many), many.size(), &slot);
+    while (stopped.progress() == 0.0f && !stopped.ready()) {
+        std::this_thread::yield();
+    }
+    stopped.cancel();
+    try {
+        stopped.get();
+        std::cout << "Build finished before the cancellation" << std::endl;
+        assert(slot.acquire() != nullptr, "Finished build should be published");
+    } catch (const BuildCancelled&) {
+        assert(stopped.progress() < 1.0f && slot.acquire() == nullptr, "Cancelled build should stop early and publish nothing");
+    }
+    for (int builder = 0; builder < 3; builder++) {
+        BuildMonitor monitor(tris.size());
+        BuildSettings settings;
+        settings.monitor = &monitor;
+        std::vector<Triangle> copy = tris;
+        BvhTree tree = (builder == 0) ? BvhTree::median(copy.data(), 0, copy.size(), settings)
+                     : (builder == 1) ? BvhTree::parallel(copy.data(), 0, copy.size(), pool, settings)
+                                      : BvhTree::lbvh(copy.data(), 0, copy.size(), pool, LbvhOptions(), settings);
+        assert(!tree.empty() && monitor.progress() == 1.0f, "Every triangle should be reported once, builder " + std::to_string(builder));
+        monitor.cancel();
+        thrown = false;
+        try {
+            tree = (builder == 0) ? BvhTree::median(copy.data(), 0, copy.size(), settings)
+                 : (builder == 1) ? BvhTree::parallel(copy.data(), 0, copy.size(), pool, settings)
+                                  : BvhTree::lbvh(copy.data(), 0, copy.size(), pool, LbvhOptions(), settings);
+        } catch (const BuildCancelled&) {
+            thrown = true;
+        }
+        assert(thrown, "Cancelled monitor should stop builder " + std::to_string(builder));
+    }
+    std::cout << "Test Case 3 passed: cancellation during builds" << std::endl;
+
+    // Test Case 4: readers keep tracing while a new version is built and swapped in
+    std::vector<Triangle> tris_b = generateRandomTriangles(10000, -10.0f, 10.0f, 5);
+    std::shared_ptr<const Object> version_a = object;
+    std::weak_ptr<const Object> old_version = version_a;
+    slot.publish(version_a);
+    object.reset();
+    version_a.reset();
+
+    std::atomic<bool> stop{false};
+    std::atomic<int> num_traces{0};
+    std::atomic<int> num_errors{0};
+    std::vector<std::thread> readers;
+    for (int r = 0; r < 3; r++) {
+        readers.emplace_back([&, r]() {
+            while (!stop.load()) {
+                // One snapshot per batch of rays: a version never changes under its readers
+                std::shared_ptr<const Object> snapshot = slot.acquire();
+                for (size_t i = r; i < rays.size(); i += 3) {
+                    Hit hit = snapshot->intersect(rays[i]);
+                    if (hit.hit() && hit.triangle >= snapshot->num_triangles) {
+                        num_errors++;
+                    }
+                }
+                num_traces++;
+            }
+        });
+    }
+    AsyncBuild rebuild = AsyncBuild::start(pool, copy_triangles(tris_b), tris_b.size(), &slot);
+    std::shared_ptr<Object> version_b = rebuild.get();
+    int traces_at_swap = num_traces.load();
+    while (num_traces.load() < traces_at_swap + 6) {
+        std::this_thread::yield();
+    }
+    stop = true;
+    for (std::thread& reader : readers) {
+        reader.join();
+    }
+    assert(num_errors == 0, "Readers should always trace a complete version");
+    assert(slot.acquire() == version_b, "The slot should hold the new version");
+    assert(old_version.expired(), "The old version should be freed once its readers are done");
+    check_same_hits(*slot.acquire(), tris_b, rays, "Published build");
+    for (const Ray& ray : rays) {
+        Hit hit = slot.intersect(ray);
+        assert(hit.triangle == version_b->intersect(ray).triangle && slot.occluded(ray) == hit.hit(), "Slot should trace the current version");
+    }
+    std::cout << "Test Case 4 passed: swap under " << readers.size() << " readers, " << num_traces.load() << " traces" << std::endl;
+
+    // Test Case 5: loading in the background
+    AsyncBuild loaded = AsyncBuild::load(pool, "../tests/data/final/triangle.obj");
+    assert(loaded.get()->num_triangles == 1, "triangle.obj should have 1 triangle");
+    AsyncBuild missing = AsyncBuild::load(pool, "./no_such_file.obj", &slot);
+    thrown = false;
+    try {
+        missing.get();
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown && slot.acquire() == version_b, "A missing file should throw and leave the slot alone");
+    std::cout << "Test Case 5 passed: background loads" << std::endl;
+}
+
+}
@@ -0,0 +1,7 @@
+#pragma once
+
+namespace bvh::tests {
+
+    void async_build();
+
+}
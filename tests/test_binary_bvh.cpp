@@ -0,0 +1,107 @@
+#include <test_binary_bvh.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <bvh.hpp>
+#include <bvh_binary.hpp>
+#include <linear_bvh.hpp>
+#include <object.hpp>
+#include <vector>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: flips one byte of a file
+static void corrupt_file(const char* filename, long offset) {
+    FILE* file = fopen(filename, "r+b");
+    assert(file != nullptr, "Could not open file " + std::string(filename));
+    fseek(file, offset, SEEK_SET);
+    int byte = fgetc(file);
+    fseek(file, offset, SEEK_SET);
+    fputc(byte ^ 0xff, file);
+    fclose(file);
+}
+
+void binary_bvh() {
+    std::cout << "Starting binary_bvh tests..." << std::endl;
+
+    // Coordinates that %f cannot represent exactly
+    std::vector<Triangle> tris = generateRandomTriangles(2000, 0.0f, 1.0f, 21, 0.01f);
+    BvhNode* root = precompute_bvh_sah(tris.data(), 0, tris.size());
+    LinearBvh linear = LinearBvh::flatten(root);
+
+    // Test Case 1: the mapped file holds exactly the saved arrays
+    const char* filename = "./test_binary_bvh.bvh";
+    assert(save_bvh_binary(filename, linear, tris.size()), "save_bvh_binary() failed");
+    assert(is_bvh_binary(filename), "Saved file should be detected as binary");
+    MappedBvh* mapped = MappedBvh::open(filename);
+    assert(mapped != nullptr, "MappedBvh::open() failed on a valid file");
+    LinearBvhView view = mapped->view();
+    assert(view.num_nodes == linear.nodes.size() && view.num_primitives == linear.primitive_indices.size(), "Mapped sizes mismatch");
+    assert(std::memcmp(view.nodes, linear.nodes.data(), linear.nodes.size() * sizeof(LinearBvhNode)) == 0, "Mapped nodes mismatch");
+    assert(std::memcmp(view.primitive_indices, linear.primitive_indices.data(), linear.primitive_indices.size() * sizeof(int)) == 0,
+           "Mapped primitive indices mismatch");
+    assert(mapped->num_triangles() == tris.size(), "The header should store the number of triangles");
+    std::cout << "Test Case 1 passed: " << mapped->header().file_size << " bytes mapped" << std::endl;
+
+    // Test Case 2: boxes are exact, so the mapped BVH gives the same hits as the original tree
+    std::mt19937 gen(8);
+    std::uniform_real_distribution<float> dis(-0.5f, 1.5f);
+    for (int i = 0; i < 1000; i++) {
+        Ray ray(vec3<float>(dis(gen), dis(gen), dis(gen)), vec3<float>(dis(gen) - 0.5f, dis(gen) - 0.5f, dis(gen) - 0.5f));
+        Hit expected = intersect(linear, tris.data(), ray);
+        Hit actual = intersect(view, tris.data(), ray);
+        assert(expected.triangle == actual.triangle && expected.t == actual.t, "Mapped BVH traversal mismatch");
+    }
+    BvhNode* loaded_root = to_tree(view);
+    assert(loaded_root != nullptr && loaded_root->bounding_box == root->bounding_box, "Reloaded root box should be exact");
+    std::cout << "Test Case 2 passed: mapped traversal and exact boxes" << std::endl;
+    delete mapped;
+    delete loaded_root;
+
+    // Test Case 3: Object::load reads binary files
+    Triangle* leaf_tris = new Triangle[1];
+    leaf_tris[0] = {};
+    leaf_tris[0].vertices[1] = vec3<float>(2.0f, 0.0f, 0.0f);
+    leaf_tris[0].vertices[2] = vec3<float>(1.0f, 2.0f, 0.0f);
+    BvhNode* leaf = precompute_bvh_sah(leaf_tris, 0, 1);
+    Object::save_bvh_binary(const_cast<char*>("./test_binary_bvh_leaf.bvh"), leaf, 1);
+    Object* obj = Object::load(const_cast<char*>("../tests/data/final/triangle.obj"), const_cast<char*>("./test_binary_bvh_leaf.bvh"));
+    assert(obj != nullptr && obj->bvh != nullptr, "Object::load() failed on a binary BVH file");
+    assert(obj->bvh->bounding_box == leaf->bounding_box, "Object::load() returned the wrong BVH");
+    assert(obj->intersect(Ray(vec3<float>(1.0f, 0.5f, 1.0f), vec3<float>(0.0f, 0.0f, -1.0f))).hit(), "Loaded object should be hit");
+    std::cout << "Test Case 3 passed: Object::load() with a binary BVH" << std::endl;
+    delete obj;
+    delete leaf;
+    delete[] leaf_tris;
+
+    // Test Case 4: corrupted and truncated files are rejected
+    corrupt_file(filename, sizeof(BvhBinaryHeader) + 100);
+    assert(MappedBvh::open(filename) == nullptr, "A corrupted payload should fail the checksum");
+    assert(save_bvh_binary(filename, linear, tris.size()), "save_bvh_binary() failed");
+    corrupt_file(filename, 4);
+    assert(MappedBvh::open(filename) == nullptr, "A wrong version should be rejected");
+    assert(save_bvh_binary(filename, linear, tris.size()), "save_bvh_binary() failed");
+    corrupt_file(filename, offsetof(BvhBinaryHeader, num_triangles));
+    assert(MappedBvh::open(filename) == nullptr, "Primitive indices past the triangles of the header should be rejected");
+    assert(save_bvh_binary(filename, linear, tris.size() - 1), "save_bvh_binary() failed");
+    assert(MappedBvh::open(filename) == nullptr, "Primitive indices past the triangle count should be rejected");
+    assert(save_bvh_binary(filename, linear, 0), "save_bvh_binary() failed");
+    assert(MappedBvh::open(filename, false) == nullptr, "A file with primitives and no triangle count should be rejected");
+    assert(save_bvh_binary(filename, linear, tris.size()), "save_bvh_binary() failed");
+    assert(Object::load(const_cast<char*>("../tests/data/final/triangle.obj"), const_cast<char*>(filename)) == nullptr,
+           "A file referring to more triangles than the object should be rejected");
+    assert(MappedBvh::open("./does_not_exist.bvh") == nullptr, "A missing file should be rejected");
+    assert(!is_bvh_binary("../tests/data/node.bvh"), "Text files should not be detected as binary");
+    std::cout << "Test Case 4 passed: invalid files are rejected" << std::endl;
+
+    std::remove(filename);
+    delete root;
+
+    std::cout << "All binary_bvh tests completed successfully." << std::endl;
+}
+
+}
@@ -0,0 +1,260 @@
+#include <test_build_settings.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <sameTree.hpp>
+#include <bvh.hpp>
+#include <bvh_tree.hpp>
+#include <linear_bvh.hpp>
+#include <traversal.hpp>
+#include <object.hpp>
+#include <thread_pool.hpp>
+#include <vector>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <random>
+
+namespace bvh::tests {
+
+// Shape of a tree, filled by measure_tree()
+struct TreeShape {
+    bool valid = true;
+    int num_leaves = 0;
+    int largest_leaf = 0;
+    int smallest_internal = -1;  // Fewest triangles under an internal node, -1 without internal nodes
+    int depth = 0;
+    std::vector<int> references;  // Number of leaves referencing each triangle
+};
+
+// Helper function, only used in this file: returns the number of triangles under node
+static int measure_node(const BvhNode* node, int depth, TreeShape& shape) {
+    if (node == nullptr) {
+        shape.valid = false;
+        return 0;
+    }
+    shape.depth = std::max(shape.depth, depth);
+    const BvhLeaf* leaf = dynamic_cast<const BvhLeaf*>(node);
+    if (leaf != nullptr) {
+        shape.num_leaves++;
+        shape.largest_leaf = std::max(shape.largest_leaf, leaf->num_triangles);
+        for (int i = 0; i < leaf->num_triangles; i++) {
+            int index = leaf->indices[i];
+            if (index < 0 || index >= static_cast<int>(shape.references.size())) {
+                shape.valid = false;
+                continue;
+            }
+            shape.references[index]++;
+        }
+        return leaf->num_triangles;
+    }
+    if (node->left == nullptr || node->right == nullptr) {
+        shape.valid = false;
+        return 0;
+    }
+    int count = measure_node(node->left, depth + 1, shape) + measure_node(node->right, depth + 1, shape);
+    if (shape.smallest_internal == -1 || count < shape.smallest_internal) {
+        shape.smallest_internal = count;
+    }
+    return count;
+}
+
+// Helper function, only used in this file
+static TreeShape measure_tree(const BvhNode* root, int num_triangles) {
+    TreeShape shape;
+    shape.references.assign(num_triangles, 0);
+    measure_node(root, 0, shape);
+    return shape;
+}
+
+// Helper function, only used in this file: every triangle in exactly one leaf (at least one with duplicates)
+static bool references_all(const TreeShape& shape, bool allow_duplicates) {
+    for (int count : shape.references) {
+        if (count == 0 || (count > 1 && !allow_duplicates)) {
+            return false;
+        }
+    }
+    return shape.valid;
+}
+
+// Helper function, only used in this file: reference result by testing every triangle
+static float brute_force_t(const std::vector<Triangle>& tris, const Ray& ray) {
+    float closest = ray.tmax;
+    for (const Triangle& tri : tris) {
+        float t, u, v;
+        if (intersect_triangle(ray, tri.vertices[0], tri.vertices[1], tri.vertices[2], closest, t, u, v)) {
+            closest = t;
+        }
+    }
+    return closest;
+}
+
+void build_settings() {
+    std::cout << "Starting build_settings tests..." << std::endl;
+
+    std::vector<Triangle> tris = generateRandomTriangles(2000, 0.0f, 100.0f, 11, 1.0f);
+    int num_tris = tris.size();
+    ThreadPool pool(4);
+    LbvhOptions plain;
+    plain.agglomerate = false;
+
+    // Test Case 1: every builder respects the maximum leaf size
+    for (int max_leaf_size : {1, 2, 16}) {
+        BuildSettings settings;
+        settings.max_leaf_size = max_leaf_size;
+        BvhNode* roots[] = {
+            precompute_bvh(tris.data(), 0, num_tris, settings),
+            precompute_bvh_sah(tris.data(), 0, num_tris, 16, settings),
+            precompute_bvh_parallel(tris.data(), 0, num_tris, pool, settings),
+            precompute_bvh_lbvh(tris.data(), 0, num_tris, pool, LbvhOptions(), settings),
+            precompute_bvh_lbvh(tris.data(), 0, num_tris, pool, plain, settings),
+            precompute_bvh_sbvh(tris.data(), 0, num_tris, SbvhOptions(), settings),
+        };
+        const char* names[] = {"median", "sah", "parallel", "lbvh", "lbvh without clustering", "sbvh"};
+        for (int b = 0; b < 6; b++) {
+            TreeShape shape = measure_tree(roots[b], num_tris);
+            std::cout << names[b] << " with max_leaf_size " << max_leaf_size << ": " << shape.num_leaves << " leaves, largest "
+                      << shape.largest_leaf << ", depth " << shape.depth << std::endl;
+            assert(references_all(shape, b == 5), "Every triangle should be in the tree");
+            assert(shape.largest_leaf <= max_leaf_size, "A builder exceeded max_leaf_size");
+        }
+        assert(same_tree(roots[0], roots[2]), "The parallel build should match the serial one with the same settings");
+        for (BvhNode* root : roots) {
+            delete root;
+        }
+    }
+    BuildSettings big_leaves;
+    big_leaves.max_leaf_size = 64;
+    BvhNode* big_root = precompute_bvh(tris.data(), 0, num_tris, big_leaves);
+    TreeShape big_shape = measure_tree(big_root, num_tris);
+    assert(big_shape.largest_leaf > BVH_LEAF_SIZE && big_shape.largest_leaf <= 64, "Leaves should grow past BVH_LEAF_SIZE");
+    std::cout << "Test Case 1 passed: maximum leaf size" << std::endl;
+
+    // Test Case 2: nodes of min_leaf_size triangles or fewer are never split
+    BuildSettings min_leaves;
+    min_leaves.min_leaf_size = 6;
+    min_leaves.max_leaf_size = 16;
+    BvhNode* min_sah = precompute_bvh_sah(tris.data(), 0, num_tris, 16, min_leaves);
+    BvhNode* min_sbvh = precompute_bvh_sbvh(tris.data(), 0, num_tris, SbvhOptions(), min_leaves);
+    BvhNode* min_lbvh = precompute_bvh_lbvh(tris.data(), 0, num_tris, pool, LbvhOptions(), min_leaves);
+    TreeShape min_sah_shape = measure_tree(min_sah, num_tris);
+    TreeShape min_sbvh_shape = measure_tree(min_sbvh, num_tris);
+    TreeShape min_lbvh_shape = measure_tree(min_lbvh, num_tris);
+    assert(references_all(min_sah_shape, false) && min_sah_shape.smallest_internal > 6, "SAH split a node under min_leaf_size");
+    assert(references_all(min_sbvh_shape, true) && min_sbvh_shape.smallest_internal > 6, "SBVH split a node under min_leaf_size");
+    assert(references_all(min_lbvh_shape, false) && min_lbvh_shape.smallest_internal > 6, "LBVH clustered a node under min_leaf_size");
+    std::cout << "Test Case 2 passed: minimum leaf size" << std::endl;
+
+    // Test Case 3: nodes at max_depth become leaves, however many triangles they have
+    BuildSettings shallow;
+    shallow.max_depth = 3;
+    BvhNode* shallow_roots[] = {
+        precompute_bvh(tris.data(), 0, num_tris, shallow),
+        precompute_bvh_sah(tris.data(), 0, num_tris, 16, shallow),
+        precompute_bvh_parallel(tris.data(), 0, num_tris, pool, shallow),
+        precompute_bvh_lbvh(tris.data(), 0, num_tris, pool, LbvhOptions(), shallow),
+        precompute_bvh_sbvh(tris.data(), 0, num_tris, SbvhOptions(), shallow),
+    };
+    for (int b = 0; b < 5; b++) {
+        TreeShape shape = measure_tree(shallow_roots[b], num_tris);
+        assert(references_all(shape, b == 4), "Every triangle should be in the shallow tree");
+        assert(shape.depth <= 3 && shape.num_leaves <= 8, "A builder went deeper than max_depth");
+    }
+    BuildSettings deep_clusters;
+    deep_clusters.max_depth = 10;
+    BvhNode* deep_lbvh = precompute_bvh_lbvh(tris.data(), 0, num_tris, pool, LbvhOptions(), deep_clusters);
+    assert(measure_tree(deep_lbvh, num_tris).depth <= 10, "LBVH clusters went deeper than max_depth");
+
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<float> pos_dis(-10.0f, 110.0f);
+    for (int i = 0; i < 200; i++) {
+        vec3<float> origin(pos_dis(gen), pos_dis(gen), pos_dis(gen));
+        vec3<float> target(pos_dis(gen), pos_dis(gen), pos_dis(gen));
+        Ray ray(origin, target - origin);
+        float expected = brute_force_t(tris, ray);
+        Hit hit = intersect(shallow_roots[1], tris.data(), ray);
+        assert(hit.hit() == (expected < ray.tmax), "Traversal of large leaves disagrees with brute force");
+        if (hit.hit()) {
+            assert(hit.t == expected, "Traversal of large leaves did not return the closest hit");
+        }
+    }
+    std::cout << "Test Case 3 passed: maximum depth" << std::endl;
+
+    // Test Case 4: the cost constants drive the SAH leaf sizes, only their ratio matters
+    BuildSettings cheap_traversal;
+    cheap_traversal.traversal_cost = 0.1f;
+    cheap_traversal.max_leaf_size = 32;
+    BuildSettings costly_traversal = cheap_traversal;
+    costly_traversal.traversal_cost = 10.0f;
+    BvhNode* cheap_root = precompute_bvh_sah(tris.data(), 0, num_tris, 16, cheap_traversal);
+    BvhNode* costly_root = precompute_bvh_sah(tris.data(), 0, num_tris, 16, costly_traversal);
+    int cheap_leaves = measure_tree(cheap_root, num_tris).num_leaves;
+    int costly_leaves = measure_tree(costly_root, num_tris).num_leaves;
+    std::cout << "SAH leaves: " << cheap_leaves << " with traversal cost 0.1, " << costly_leaves << " with 10" << std::endl;
+    assert(costly_leaves < cheap_leaves, "A higher traversal cost should give fewer, larger leaves");
+
+    BuildSettings doubled;
+    doubled.traversal_cost = 2.0f;
+    doubled.intersection_cost = 2.0f;
+    BvhNode* default_root = precompute_bvh_sah(tris.data(), 0, num_tris);
+    BvhNode* doubled_root = precompute_bvh_sah(tris.data(), 0, num_tris, 16, doubled);
+    assert(same_tree(default_root, doubled_root), "Scaling both costs should not change the tree");
+    std::cout << "Test Case 4 passed: cost constants" << std::endl;
+
+    // Test Case 5: leaves larger than BVH_LEAF_SIZE survive the text format, flattening and the arena
+    BuildSettings large;
+    large.max_leaf_size = 32;
+    BvhNode* large_root = precompute_bvh(tris.data(), 0, 128, large);  // Complete tree, 4 leaves of 32 triangles
+    const char* filename = "./test_build_settings.bvh";
+    Object::save_bvh(const_cast<char*>(filename), large_root);
+    Object* loaded = Object::load(const_cast<char*>("../tests/data/final/grid.obj"), const_cast<char*>(filename));
+    assert(loaded != nullptr && same_tree(large_root, loaded->bvh, false), "Large leaves should be saved and loaded as text");
+    delete loaded;
+    std::remove(filename);
+
+    LinearBvh linear = LinearBvh::flatten(big_root);
+    BvhNode* unflattened = linear.to_tree();
+    BvhTree arena_unflattened = BvhTree::from_linear(linear.view());
+    assert(same_tree(big_root, unflattened) && same_tree(big_root, arena_unflattened.root()), "Large leaves should survive flattening");
+
+    BvhTree arena_sah = BvhTree::sah(tris.data(), 0, num_tris, 16, costly_traversal);
+    BvhTree arena_median = BvhTree::median(tris.data(), 0, num_tris, big_leaves);
+    assert(same_tree(costly_root, arena_sah.root()) && same_tree(big_root, arena_median.root()), "Arena builds should use the settings");
+    std::cout << "Test Case 5 passed: variable leaves in every representation" << std::endl;
+
+    // Test Case 6: out of range settings are clamped
+    BuildSettings wild;
+    wild.max_leaf_size = 0;
+    wild.min_leaf_size = 5;
+    wild.traversal_cost = -1.0f;
+    wild.intersection_cost = 0.0f;
+    wild.max_depth = -4;
+    BuildSettings clamped = wild.clamped();
+    assert(clamped.max_leaf_size == 1 && clamped.min_leaf_size == 1, "Leaf sizes should be clamped to at least 1");
+    assert(clamped.traversal_cost == 0.0f && clamped.intersection_cost == 1.0f && clamped.max_depth == 1, "Costs and depth should be clamped");
+    wild.max_leaf_size = 1 << 20;
+    assert(wild.clamped().max_leaf_size == BVH_MAX_LEAF_SIZE, "max_leaf_size should fit a flattened leaf");
+    BvhNode* wild_root = precompute_bvh_sah(tris.data(), 0, num_tris, 16, wild);
+    TreeShape wild_shape = measure_tree(wild_root, num_tris);
+    assert(references_all(wild_shape, false) && wild_shape.depth <= 1, "Clamped settings should still build a valid tree");
+    std::cout << "Test Case 6 passed: clamping" << std::endl;
+
+    delete big_root;
+    delete min_sah;
+    delete min_sbvh;
+    delete min_lbvh;
+    for (BvhNode* root : shallow_roots) {
+        delete root;
+    }
+    delete deep_lbvh;
+    delete cheap_root;
+    delete costly_root;
+    delete default_root;
+    delete doubled_root;
+    delete large_root;
+    delete unflattened;
+    delete wild_root;
+
+    std::cout << "All build_settings tests completed successfully." << std::endl;
+}
+
+}
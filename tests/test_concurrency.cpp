@@ -0,0 +1,142 @@
+#include <test_concurrency.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <async_build.hpp>
+#include <bvh_tree.hpp>
+#include <query.hpp>
+#include <traversal.hpp>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <iostream>
+#include <string>
+#include <thread>
+
+// Number of query threads of the stress tests
+#define CONCURRENCY_TEST_THREADS 4
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: a copy of the triangles in a new[] array, moved along x
+static Triangle* shifted_copy(const std::vector<Triangle>& tris, float dx) {
+    Triangle* copy = new Triangle[tris.size()];
+    for (size_t i = 0; i < tris.size(); i++) {
+        copy[i] = tris[i];
+        for (int j = 0; j < 3; j++) {
+            copy[i].vertices[j].x += dx;
+        }
+    }
+    return copy;
+}
+
+// Helper function, only used in this file: whether a hit found in an object is a real hit of its triangles,
+// which fails when a query sees boxes and triangles of different versions
+static bool consistent_hit(const Object& object, const Ray& ray, const Hit& hit) {
+    if (!hit.hit()) {
+        return !object.occluded(ray);
+    }
+    if (hit.triangle < 0 || hit.triangle >= object.num_triangles || !object.occluded(ray)) {
+        return false;
+    }
+    const Triangle& tri = object.triangles[hit.triangle];
+    float t, u, v;
+    return intersect_triangle(ray, tri.vertices[0], tri.vertices[1], tri.vertices[2], hit.t * 1.001f + 1e-4f, t, u, v) &&
+           std::abs(t - hit.t) <= 1e-4f * hit.t;
+}
+
+void concurrency() {
+    std::cout << "Starting concurrency tests..." << std::endl;
+    std::vector<Triangle> base = generateRandomTriangles(5000, -10.0f, 10.0f, 2);
+    std::vector<Ray> rays = generateRandomRays(200, -12.0f, 12.0f, 0.3f, 1);
+
+    // Test Case 1: many threads querying the same object, the results are those of a single thread
+    Triangle* tris = shifted_copy(base, 0.0f);
+    Object object(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0), vec3<float>(1, 1, 1), tris, base.size(), BvhTree::sah(tris, 0, base.size()));
+    std::vector<Hit> expected_hits;
+    std::vector<ClosestPoint> expected_points;
+    std::vector<int> expected_counts;
+    for (const Ray& ray : rays) {
+        expected_hits.push_back(object.intersect(ray));
+        expected_points.push_back(closest_point(object.getBvh(), tris, ray.origin));
+        int scratch[1];
+        expected_counts.push_back(query_sphere(object.getBvh(), tris, Sphere{ray.origin, 2.0f}, scratch, 0));
+    }
+
+    std::atomic<int> num_errors{0};
+    std::vector<std::thread> threads;
+    for (int t = 0; t < CONCURRENCY_TEST_THREADS; t++) {
+        threads.emplace_back([&, t]() {
+            std::vector<int> indices(base.size());
+            for (int round = 0; round < 2; round++) {
+                // Every thread goes through all the rays, starting at a different one
+                for (size_t k = 0; k < rays.size(); k++) {
+                    size_t i = (k + t * rays.size() / CONCURRENCY_TEST_THREADS) % rays.size();
+                    Hit hit = object.intersect(rays[i]);
+                    ClosestPoint point = closest_point(object.getBvh(), tris, rays[i].origin);
+                    int count = query_sphere(object.getBvh(), tris, Sphere{rays[i].origin, 2.0f}, indices.data(), indices.size());
+                    if (hit.triangle != expected_hits[i].triangle || hit.t != expected_hits[i].t ||
+                        object.occluded(rays[i]) != expected_hits[i].hit() || point.triangle != expected_points[i].triangle ||
+                        point.distance != expected_points[i].distance || count != expected_counts[i]) {
+                        num_errors++;
+                    }
+                }
+            }
+        });
+    }
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    assert(num_errors == 0, "Concurrent queries should give the single thread results, " + std::to_string(num_errors.load()) + " differ");
+    std::cout << "Test Case 1 passed: " << CONCURRENCY_TEST_THREADS << " threads querying one object" << std::endl;
+
+    // Test Case 2: query threads on a shared object while it is refitted and rebuilt under them
+    ThreadPool pool(2);
+    Triangle* first = shifted_copy(base, 0.0f);
+    BvhTree first_tree = BvhTree::sah(first, 0, base.size());
+    SharedObject slot(std::make_shared<const Object>(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0), vec3<float>(1, 1, 1), first, base.size(), std::move(first_tree)));
+    std::vector<std::weak_ptr<const Object>> replaced;
+    std::atomic<bool> stop{false};
+    std::atomic<int> num_snapshots{0};
+    threads.clear();
+    for (int t = 0; t < CONCURRENCY_TEST_THREADS; t++) {
+        threads.emplace_back([&, t]() {
+            while (!stop.load()) {
+                std::shared_ptr<const Object> snapshot = slot.acquire();
+                for (size_t i = t; i < rays.size(); i += CONCURRENCY_TEST_THREADS) {
+                    if (!consistent_hit(*snapshot, rays[i], snapshot->intersect(rays[i]))) {
+                        num_errors++;
+                    }
+                }
+                num_snapshots++;
+            }
+        });
+    }
+    const int num_versions = 12;
+    for (int version = 1; version <= num_versions; version++) {
+        Triangle* moved = shifted_copy(base, 0.05f * version);
+        if (version % 3 == 0) {
+            replaced.push_back(slot.acquire());
+            AsyncBuild::start(pool, moved, base.size(), &slot).get();
+        } else {
+            replaced.push_back(slot.publish_refit(moved));
+        }
+        assert(std::abs(slot.acquire()->triangles[0].vertices[0].x - (base[0].vertices[0].x + 0.05f * version)) < 1e-4f, "Slot should hold the new version");
+    }
+    int snapshots_at_end = num_snapshots.load();
+    while (num_snapshots.load() < snapshots_at_end + CONCURRENCY_TEST_THREADS) {
+        std::this_thread::yield();
+    }
+    stop = true;
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+    assert(num_errors == 0, "Readers should only see complete versions, " + std::to_string(num_errors.load()) + " inconsistent hits");
+    for (const std::weak_ptr<const Object>& version : replaced) {
+        assert(version.expired(), "Replaced versions should be freed once their readers are done");
+    }
+    std::cout << "Test Case 2 passed: " << num_versions << " versions swapped under " << CONCURRENCY_TEST_THREADS << " threads, "
+              << num_snapshots.load() << " snapshots" << std::endl;
+}
+
+}
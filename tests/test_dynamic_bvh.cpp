@@ -0,0 +1,157 @@
+#include <test_dynamic_bvh.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <bvh.hpp>
+#include <dynamic_bvh.hpp>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: a small object with its own SAH BVH, around center
+static Object* make_object(int num_tris, unsigned int seed, const vec3<float>& center) {
+    std::vector<Triangle> generated = generateRandomTriangles(num_tris, -1.0f, 1.0f, seed, 0.3f, center);
+    Triangle* tris = new Triangle[num_tris];
+    std::copy(generated.begin(), generated.end(), tris);
+    BvhNode* bvh = precompute_bvh_sah(tris, 0, num_tris);
+    return new Object(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0), vec3<float>(1, 1, 1), tris, num_tris, bvh);
+}
+
+// Helper function, only used in this file
+static void delete_object(Object* object) {
+    delete object->bvh;
+    delete object;
+}
+
+// Helper function, only used in this file: compares the tree against every object in it, one ray at a time
+static void check_hits(const DynamicBvh& tree, const std::vector<int>& proxies, int num_rays, unsigned int seed, const std::string& what) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> dis(-60.0f, 60.0f);
+    int num_hits = 0;
+    for (int i = 0; i < num_rays; i++) {
+        vec3<float> origin(dis(gen), dis(gen), dis(gen));
+        Ray ray(origin, vec3<float>(dis(gen), dis(gen), dis(gen)) * 0.4f - origin);
+        Hit expected;
+        for (int proxy : proxies) {
+            Hit object_hit = tree.object(proxy)->intersect(ray);
+            if (object_hit.hit() && object_hit.t < expected.t) {
+                expected = object_hit;
+                expected.instance = proxy;
+            }
+        }
+        Hit hit = tree.intersect(ray);
+        assert(hit.hit() == expected.hit(), what + ": hit/miss differs for ray " + std::to_string(i));
+        assert(tree.occluded(ray) == expected.hit(), what + ": occlusion differs for ray " + std::to_string(i));
+        if (hit.hit()) {
+            assert(hit.t == expected.t, what + ": wrong distance for ray " + std::to_string(i));
+            assert((hit.instance == expected.instance && hit.triangle == expected.triangle) || hit.t == expected.t,
+                   what + ": wrong object for ray " + std::to_string(i));
+            num_hits++;
+        }
+    }
+    assert(num_hits > num_rays / 20, what + ": too few rays hit");
+}
+
+void dynamic_bvh() {
+    std::cout << "Starting dynamic_bvh tests..." << std::endl;
+
+    // Test Case 1: objects inserted one at a time in random places
+    std::mt19937 gen(1);
+    std::uniform_real_distribution<float> dis(-25.0f, 25.0f);
+    const int num_objects = 400;
+    std::vector<Object*> objects;
+    for (int i = 0; i < num_objects; i++) {
+        objects.push_back(make_object(20, 100 + i, vec3<float>(dis(gen), dis(gen), dis(gen))));
+    }
+
+    DynamicBvh tree;
+    std::vector<int> proxies;
+    for (Object* object : objects) {
+        proxies.push_back(tree.insert(object));
+        assert(tree.validate(), "Tree is invalid after insertion " + std::to_string(proxies.size()));
+    }
+    assert(tree.size() == num_objects, "Wrong number of objects");
+    int log2_n = static_cast<int>(std::ceil(std::log2(static_cast<float>(num_objects))));
+    assert(tree.height() <= 3 * log2_n, "Tree is too deep for random insertions");
+    check_hits(tree, proxies, 1000, 2, "Inserted objects");
+    std::cout << "Test Case 1 passed: " << num_objects << " insertions, height " << tree.height() << ", SAH cost " << tree.sah_cost() << std::endl;
+
+    // Test Case 2: insertions sorted along an axis, which build a list without rotations
+    std::vector<Object*> row;
+    DynamicBvh sorted;
+    std::vector<int> row_proxies;
+    for (int i = 0; i < 256; i++) {
+        row.push_back(make_object(4, 1000 + i, vec3<float>(3.0f * i - 384.0f, 0.0f, 0.0f)));
+        row_proxies.push_back(sorted.insert(row.back()));
+    }
+    assert(sorted.validate() && sorted.height() <= 3 * 8, "Sorted insertions should stay logarithmic");
+    std::cout << "Test Case 2 passed: sorted insertions, height " << sorted.height() << std::endl;
+
+    // Test Case 3: objects moving, removed and added back, with the nodes of the first insertions reused
+    tree.reserve(num_objects);
+    const DynamicBvhNode* storage = tree.node_array().data();
+    size_t capacity = tree.node_array().capacity();
+    std::uniform_real_distribution<float> step_dis(-4.0f, 4.0f);
+    for (int round = 0; round < 5; round++) {
+        for (int i = round; i < num_objects; i += 3) {
+            Object* object = objects[i];
+            vec3<float> step(step_dis(gen), step_dis(gen), step_dis(gen));
+            for (int j = 0; j < object->num_triangles; j++) {
+                for (int k = 0; k < 3; k++) {
+                    object->triangles[j].vertices[k] = object->triangles[j].vertices[k] + step;
+                }
+            }
+            object->refit();
+            tree.update(proxies[i]);
+        }
+        assert(tree.validate(), "Tree is invalid after updates");
+
+        for (int i = round; i < num_objects; i += 4) {
+            tree.remove(proxies[i]);
+        }
+        assert(tree.validate() && tree.size() < num_objects, "Tree is invalid after removals");
+        for (int i = round; i < num_objects; i += 4) {
+            proxies[i] = tree.insert(objects[i]);
+        }
+        assert(tree.validate() && tree.size() == num_objects, "Tree is invalid after reinsertions");
+    }
+    assert(tree.node_array().data() == storage && tree.node_array().capacity() == capacity, "Updates should not allocate nodes");
+    assert(tree.height() <= 3 * log2_n, "Tree is too deep after updates");
+    check_hits(tree, proxies, 1000, 3, "Updated objects");
+    std::cout << "Test Case 3 passed: updates, removals and reinsertions, height " << tree.height() << ", SAH cost " << tree.sah_cost() << std::endl;
+
+    // Test Case 4: explicit boxes, objects without a BVH and emptying the tree
+    BoundingBox fat = tree.bounds(proxies[0]);
+    fat.expand(fat.max + vec3<float>(1.0f, 1.0f, 1.0f));
+    tree.update(proxies[0], fat);
+    assert(tree.bounds(proxies[0]) == fat && tree.validate(), "Explicit box should replace the root box");
+    Object no_bvh(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0), vec3<float>(1, 1, 1), nullptr, 0, nullptr);
+    assert(tree.insert(&no_bvh) == -1 && tree.size() == num_objects, "Objects without a BVH should be left out");
+    for (int proxy : proxies) {
+        tree.remove(proxy);
+    }
+    Ray ray(vec3<float>(0, 0, -100), vec3<float>(0, 0, 1));
+    assert(tree.empty() && tree.size() == 0 && tree.height() == 0 && tree.validate(), "Tree should be empty");
+    assert(!tree.intersect(ray).hit() && !tree.occluded(ray), "Empty tree should give no hits");
+    int single = tree.insert(objects[0]);
+    assert(tree.root() == single && tree.validate(), "A single object should be the root");
+    const Triangle& target = objects[0]->triangles[0];
+    Ray at_object(vec3<float>(0, 0, -100), (target.vertices[0] + target.vertices[1] + target.vertices[2]) * (1.0f / 3.0f) - vec3<float>(0, 0, -100));
+    Hit expected = objects[0]->intersect(at_object);
+    Hit hit = tree.intersect(at_object);
+    assert(expected.hit() && hit.instance == single && hit.triangle == expected.triangle && hit.t == expected.t, "Single object should be hit");
+    std::cout << "Test Case 4 passed: explicit boxes and empty trees" << std::endl;
+
+    for (Object* object : objects) {
+        delete_object(object);
+    }
+    for (Object* object : row) {
+        delete_object(object);
+    }
+}
+
+}
@@ -0,0 +1,115 @@
+#include <test_lbvh.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <sameTree.hpp>
+#include <bvh.hpp>
+#include <bvh_tree.hpp>
+#include <traversal.hpp>
+#include <thread_pool.hpp>
+#include <vector>
+#include <iostream>
+#include <random>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: every triangle in exactly one leaf, boxes tight around their content
+static bool check_tree(const BvhNode* node, const std::vector<Triangle>& tris, std::vector<int>& seen) {
+    const BvhLeaf* leaf = dynamic_cast<const BvhLeaf*>(node);
+    BoundingBox box = BoundingBox::empty();
+    if (leaf != nullptr) {
+        if (leaf->num_triangles < 1 || leaf->num_triangles > BVH_LEAF_SIZE) {
+            return false;
+        }
+        for (int i = 0; i < leaf->num_triangles; i++) {
+            seen[leaf->indices[i]]++;
+            for (int k = 0; k < 3; k++) {
+                box.expand(tris[leaf->indices[i]].vertices[k]);
+            }
+        }
+        return box == node->bounding_box;
+    }
+
+    if (node->left == nullptr || node->right == nullptr ||
+        !check_tree(node->left, tris, seen) || !check_tree(node->right, tris, seen)) {
+        return false;
+    }
+    box.expand(node->left->bounding_box);
+    box.expand(node->right->bounding_box);
+    return box == node->bounding_box;
+}
+
+void precompute_bvh_lbvh() {
+    std::cout << "Starting precompute_bvh_lbvh tests..." << std::endl;
+    std::vector<Triangle> tris = generateRandomTriangles(30000, 0.0f, 100.0f, 21);
+    ThreadPool pool(4);
+
+    // Test Case 1: valid trees for both code lengths, with and without clustering
+    BvhNode* roots[4];
+    for (int i = 0; i < 4; i++) {
+        LbvhOptions options;
+        options.morton_bits = (i & 1) ? 63 : 30;
+        options.agglomerate = (i & 2) != 0;
+        roots[i] = precompute_bvh_lbvh(tris.data(), 0, tris.size(), pool, options);
+        std::vector<int> seen(tris.size(), 0);
+        assert(roots[i] != nullptr && check_tree(roots[i], tris, seen), "LBVH has an invalid structure or loose boxes");
+        for (int count : seen) {
+            assert(count == 1, "Every triangle should be in exactly one LBVH leaf");
+        }
+    }
+    std::cout << "Test Case 1 passed: 30 and 63-bit codes, with and without clustering" << std::endl;
+
+    // Test Case 2: the tree does not depend on the number of threads
+    BvhNode* serial = precompute_bvh_lbvh(tris.data(), 0, tris.size(), 1);
+    assert(same_tree(serial, roots[2]), "LBVH should be the same on 1 and 4 threads");
+    BvhTree arena_tree = BvhTree::lbvh(tris.data(), 0, tris.size(), pool);
+    assert(same_tree(serial, arena_tree.root()), "BvhTree::lbvh() should match precompute_bvh_lbvh()");
+    Mesh mesh = Mesh::from_triangles(tris.data(), tris.size());
+    BvhNode* mesh_root = precompute_bvh_lbvh(mesh, pool);
+    std::vector<int> mesh_seen(tris.size(), 0);
+    assert(mesh_root != nullptr && check_tree(mesh_root, tris, mesh_seen), "LBVH over a mesh has an invalid structure");
+    std::cout << "Test Case 2 passed: deterministic across threads, arena and mesh builds" << std::endl;
+
+    // Test Case 3: clustering recovers quality, traversal matches the SAH tree
+    BvhNode* sah_root = precompute_bvh_sah(tris.data(), 0, tris.size());
+    float plain_cost = sah_cost(roots[0]);
+    float clustered_cost = sah_cost(roots[2]);
+    std::cout << "SAH cost: plain LBVH " << plain_cost << ", clustered LBVH " << clustered_cost << ", SAH " << sah_cost(sah_root) << std::endl;
+    assert(clustered_cost < plain_cost, "Agglomerative clustering should lower the SAH cost");
+
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<float> dis(0.0f, 100.0f);
+    for (int i = 0; i < 1000; i++) {
+        Ray ray(vec3<float>(dis(gen), dis(gen), -1.0f), vec3<float>(dis(gen) - 50.0f, dis(gen) - 50.0f, 100.0f));
+        Hit expected = intersect(sah_root, tris.data(), ray);
+        for (int k = 0; k < 4; k++) {
+            Hit actual = intersect(roots[k], tris.data(), ray);
+            assert(expected.triangle == actual.triangle && expected.t == actual.t, "LBVH traversal mismatch");
+        }
+        assert(occluded(roots[2], tris.data(), ray) == expected.hit(), "LBVH occlusion mismatch");
+    }
+    std::cout << "Test Case 3 passed: clustering quality and traversal" << std::endl;
+
+    // Test Case 4: degenerate input
+    std::vector<Triangle> same(100, tris[0]);
+    BvhNode* same_root = precompute_bvh_lbvh(same.data(), 0, same.size(), pool);
+    std::vector<int> same_seen(same.size(), 0);
+    assert(same_root != nullptr && check_tree(same_root, same, same_seen), "Identical triangles should still be split");
+    BvhNode* single = precompute_bvh_lbvh(tris.data(), 5, 6, pool);
+    BvhLeaf* single_leaf = dynamic_cast<BvhLeaf*>(single);
+    assert(single_leaf != nullptr && single_leaf->num_triangles == 1 && single_leaf->indices[0] == 5, "One triangle should give one leaf");
+    assert(precompute_bvh_lbvh(tris.data(), 0, 0, pool) == nullptr, "Empty range should give nullptr");
+    std::cout << "Test Case 4 passed: degenerate input" << std::endl;
+
+    for (BvhNode* root : roots) {
+        delete root;
+    }
+    delete serial;
+    delete mesh_root;
+    delete sah_root;
+    delete same_root;
+    delete single;
+
+    std::cout << "All precompute_bvh_lbvh tests completed successfully." << std::endl;
+}
+
+}
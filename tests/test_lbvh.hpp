@@ -0,0 +1,7 @@
+#pragma once
+
+namespace bvh::tests {
+
+    void precompute_bvh_lbvh();
+
+}
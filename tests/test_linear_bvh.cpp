@@ -0,0 +1,196 @@
+#include <test_linear_bvh.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <sameTree.hpp>
+#include <bvh.hpp>
+#include <linear_bvh.hpp>
+#include <traversal.hpp>
+#include <vector>
+#include <iostream>
+#include <random>
+#include <string>
+#include <algorithm>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: adds up the page changes along the paths from node to every
+// leaf below it, the pages a traversal reaching that leaf loads
+static void page_changes(const LinearBvh& bvh, uint32_t index, size_t page_nodes, int changes, long& total, long& leaves) {
+    const LinearBvhNode& node = bvh.nodes[index];
+    if (node.is_leaf()) {
+        total += changes;
+        leaves++;
+        return;
+    }
+    for (uint32_t child = node.offset; child <= node.offset + 1; child++) {
+        page_changes(bvh, child, page_nodes, changes + (child / page_nodes != index / page_nodes), total, leaves);
+    }
+}
+
+// Helper function, only used in this file: depth of every node of a flattened BVH
+static void node_depths(const LinearBvh& bvh, uint32_t index, int depth, std::vector<int>& depths) {
+    depths[index] = depth;
+    if (!bvh.nodes[index].is_leaf()) {
+        node_depths(bvh, bvh.nodes[index].offset, depth + 1, depths);
+        node_depths(bvh, bvh.nodes[index].offset + 1, depth + 1, depths);
+    }
+}
+
+void linear_bvh() {
+    std::cout << "Starting linear_bvh tests..." << std::endl;
+
+    std::vector<Triangle> tris = generateRandomTriangles(700, 0.0f, 10.0f, 3);
+    BvhNode* root = precompute_bvh_sah(tris.data(), 0, tris.size());
+
+    // Test Case 1: layout
+    LinearBvh linear = LinearBvh::flatten(root);
+    assert(sizeof(LinearBvhNode) == 32, "LinearBvhNode should be 32 bytes");
+    assert(linear.primitive_indices.size() == tris.size(), "Every triangle should appear once in the primitive indices");
+    int num_leaves = 0;
+    for (size_t i = 0; i < linear.nodes.size(); i++) {
+        const LinearBvhNode& node = linear.nodes[i];
+        if (node.is_leaf()) {
+            num_leaves++;
+            assert(node.offset + node.count <= linear.primitive_indices.size(), "Leaf range out of bounds");
+        } else {
+            assert(node.offset > i && node.offset + 1 < linear.nodes.size(), "Children should come after their parent");
+        }
+    }
+    assert((int)linear.nodes.size() == 2 * num_leaves - 1, "A binary tree with n leaves has 2n - 1 nodes");
+    std::cout << "Test Case 1 passed: " << linear.nodes.size() << " nodes, "
+              << linear.nodes.size() * sizeof(LinearBvhNode) << " bytes" << std::endl;
+
+    // Test Case 2: round trip back to a BvhNode tree
+    BvhNode* round_trip = linear.to_tree();
+    assert(same_tree(root, round_trip), "to_tree() should give back the flattened tree");
+    std::cout << "Test Case 2 passed: round trip to BvhNode" << std::endl;
+
+    // Test Case 3: traversal matches the BvhNode traversal
+    std::mt19937 gen(5);
+    std::uniform_real_distribution<float> dis(-5.0f, 15.0f);
+    int num_hits = 0;
+    for (int i = 0; i < 2000; i++) {
+        vec3<float> origin(dis(gen), dis(gen), dis(gen));
+        vec3<float> target(dis(gen), dis(gen), dis(gen));
+        Ray ray(origin, target - origin);
+        Hit expected = intersect(root, tris.data(), ray);
+        Hit actual = intersect(linear, tris.data(), ray);
+        assert(expected.triangle == actual.triangle && expected.t == actual.t, "Linear traversal disagrees with the tree traversal");
+        assert(occluded(linear, tris.data(), ray) == expected.hit(), "Linear occlusion disagrees with the tree traversal");
+        num_hits += expected.hit();
+    }
+    assert(num_hits > 0, "No ray hit the scene, the test is meaningless");
+    std::cout << "Test Case 3 passed: linear traversal matches the tree traversal (" << num_hits << " hits)" << std::endl;
+
+    // Test Case 4: empty and single leaf
+    assert(LinearBvh::flatten(nullptr).empty(), "Flattening an empty tree should give an empty BVH");
+    assert(!intersect(LinearBvh(), tris.data(), Ray(vec3<float>(0, 0, 0), vec3<float>(1, 1, 1))).hit(), "Empty BVH should not be hit");
+    BvhNode* leaf = precompute_bvh_sah(tris.data(), 0, 1);
+    LinearBvh linear_leaf = LinearBvh::flatten(leaf);
+    assert(linear_leaf.nodes.size() == 1 && linear_leaf.nodes[0].is_leaf(), "Single leaf should flatten to one leaf node");
+    std::cout << "Test Case 4 passed: edge cases" << std::endl;
+
+    // Test Case 5: node layouts, on a larger and unbalanced SAH tree. Every layout holds the same tree and
+    // gives the same hits, van Emde Boas and page clusters cross fewer pages from the root to a leaf.
+    std::vector<Triangle> big_tris = generateRandomTriangles(20000, 0.0f, 10.0f, 8);
+    BvhNode* big_root = precompute_bvh_sah(big_tris.data(), 0, big_tris.size());
+    const size_t page_nodes = BVH_LAYOUT_PAGE_SIZE / sizeof(LinearBvhNode);
+    NodeLayout layouts[] = {NodeLayout::DepthFirst, NodeLayout::BreadthFirst, NodeLayout::VanEmdeBoas, NodeLayout::PageClustered};
+    const char* names[] = {"depth first", "breadth first", "van Emde Boas", "page clustered"};
+    float locality[4];  // page changes per root to leaf path
+    LinearBvh reference = LinearBvh::flatten(big_root);
+    for (int l = 0; l < 4; l++) {
+        LinearBvh laid_out = LinearBvh::flatten(big_root, layouts[l]);
+        std::string name = names[l];
+        assert(laid_out.nodes.size() == reference.nodes.size(), name + ": node count differs");
+        for (size_t i = 0; i < laid_out.nodes.size(); i++) {
+            const LinearBvhNode& node = laid_out.nodes[i];
+            assert(node.is_leaf() || (node.offset > i && node.offset + 1 < laid_out.nodes.size()),
+                   name + ": children should come after their parent");
+        }
+        BvhNode* back = laid_out.to_tree();
+        assert(same_tree(big_root, back), name + ": to_tree() should give back the flattened tree");
+        delete back;
+
+        std::uniform_real_distribution<float> big_dis(-5.0f, 15.0f);
+        for (int i = 0; i < 300; i++) {
+            vec3<float> origin(big_dis(gen), big_dis(gen), big_dis(gen));
+            Ray ray(origin, vec3<float>(big_dis(gen), big_dis(gen), big_dis(gen)) - origin);
+            Hit expected = intersect(reference, big_tris.data(), ray);
+            Hit actual = intersect(laid_out, big_tris.data(), ray);
+            assert(expected.triangle == actual.triangle && expected.t == actual.t, name + ": traversal differs from depth first");
+        }
+        long total = 0, leaves = 0;
+        page_changes(laid_out, 0, page_nodes, 0, total, leaves);
+        locality[l] = static_cast<float>(total) / leaves;
+        std::cout << "    " << name << ": " << locality[l] << " page changes from the root to a leaf" << std::endl;
+
+        if (layouts[l] == NodeLayout::BreadthFirst) {
+            std::vector<int> depths(laid_out.nodes.size());
+            node_depths(laid_out, 0, 0, depths);
+            for (size_t i = 1; i < depths.size(); i++) {
+                assert(depths[i] >= depths[i - 1], "Breadth first nodes should be sorted by depth");
+            }
+        }
+    }
+    float linear_best = std::min(locality[0], locality[1]);
+    assert(locality[2] < linear_best && locality[3] < linear_best,
+           "Van Emde Boas and page clusters should cross fewer pages than depth and breadth first");
+    std::cout << "Test Case 5 passed: node layouts" << std::endl;
+    delete big_root;
+
+    // Test Case 6: empty and oversized leaves, which builders never make but hand-built and loaded trees can.
+    // An empty leaf would read as an internal node and a count above BVH_MAX_LEAF_SIZE would be truncated,
+    // flatten() leaves out the first and splits the second.
+    int first = 0;
+    BvhNode* sparse = new BvhNode(tris[0].vertices[0] - vec3<float>(20, 20, 20), tris[0].vertices[0] + vec3<float>(20, 20, 20));
+    sparse->left = new BvhLeaf(sparse->bounding_box.min, sparse->bounding_box.max, 0, nullptr);
+    sparse->right = new BvhLeaf(sparse->bounding_box.min, sparse->bounding_box.max, 1, &first);
+    LinearBvh linear_sparse = LinearBvh::flatten(sparse);
+    assert(linear_sparse.nodes.size() == 1 && linear_sparse.nodes[0].is_leaf() && linear_sparse.nodes[0].count == 1,
+           "The empty leaf should be left out and its parent replaced by the other leaf");
+    vec3<float> centroid = (tris[0].vertices[0] + tris[0].vertices[1] + tris[0].vertices[2]) / 3.0f;
+    Ray to_first(centroid - vec3<float>(0, 0, 30), vec3<float>(0, 0, 1));
+    assert(intersect(linear_sparse, tris.data(), to_first).triangle == intersect(sparse, tris.data(), to_first).triangle,
+           "Traversal without the empty leaf should find the same hit");
+    BvhNode* sparse_trip = linear_sparse.to_tree();
+    assert(same_tree(sparse_trip, sparse->right), "to_tree() should give back the remaining leaf");
+    delete sparse_trip;
+    delete sparse->right;
+    sparse->right = new BvhLeaf(sparse->bounding_box.min, sparse->bounding_box.max, 0, nullptr);
+    assert(LinearBvh::flatten(sparse).empty(), "A tree of empty leaves should flatten to an empty BVH");
+    delete sparse;
+
+    int num_big = BVH_MAX_LEAF_SIZE + 1000;
+    std::vector<Triangle> many_tris = generateRandomTriangles(num_big, 0.0f, 10.0f, 11);
+    std::vector<int> all_indices(num_big);
+    for (int i = 0; i < num_big; i++) {
+        all_indices[i] = i;
+    }
+    BvhNode* oversized = precompute_bvh_sah(many_tris.data(), 0, num_big);
+    BvhLeaf* one_leaf = new BvhLeaf(oversized->bounding_box.min, oversized->bounding_box.max, num_big, all_indices.data());
+    delete oversized;
+    LinearBvh linear_oversized = LinearBvh::flatten(one_leaf);
+    assert(linear_oversized.primitive_indices.size() == (size_t)num_big, "Splitting should keep every triangle");
+    for (const LinearBvhNode& node : linear_oversized.nodes) {
+        assert(!node.is_leaf() || node.count <= BVH_MAX_LEAF_SIZE, "No leaf should hold more than BVH_MAX_LEAF_SIZE triangles");
+    }
+    for (int i = 0; i < 50; i++) {
+        vec3<float> origin(dis(gen), dis(gen), dis(gen));
+        vec3<float> target(dis(gen), dis(gen), dis(gen));
+        Ray ray(origin, target - origin);
+        Hit expected = intersect(one_leaf, many_tris.data(), ray);
+        Hit actual = intersect(linear_oversized, many_tris.data(), ray);
+        assert(expected.triangle == actual.triangle && expected.t == actual.t, "Split leaf traversal disagrees with the tree traversal");
+    }
+    delete one_leaf;
+    std::cout << "Test Case 6 passed: empty and oversized leaves" << std::endl;
+
+    delete root;
+    delete round_trip;
+    delete leaf;
+
+    std::cout << "All linear_bvh tests completed successfully." << std::endl;
+}
+
+}
@@ -3,7 +3,7 @@
 #include <object.hpp>
 
 void bvh::tests::load_bvh_leaf() {
-  Object *obj = Object::load("../tests/data/final/triangle.obj", "../tests/data/final/leaf.bvh");
+  Object *obj = Object::load("../tests/data/final/grid.obj", "../tests/data/final/leaf.bvh");
 
   if (obj == nullptr) {
     assert(false, "Object::load() returned nullptr");
@@ -28,7 +28,7 @@ void bvh::tests::load_bvh_leaf() {
 }
 
 void bvh::tests::load_bvh_node() {
-  Object *obj = Object::load("../tests/data/final/triangle.obj", "../tests/data/node.bvh");
+  Object *obj = Object::load("../tests/data/final/grid.obj", "../tests/data/node.bvh");
 
   if (obj == nullptr) {
     assert(false, "Object::load() returned nullptr");
@@ -81,7 +81,7 @@ void bvh::tests::load_bvh_node() {
 }
 
 void bvh::tests::load_bvh_with_comment() {
-  Object *obj = Object::load("../tests/data/final/triangle.obj", "../tests/data/final/leaf_with_comment.bvh");
+  Object *obj = Object::load("../tests/data/final/grid.obj", "../tests/data/final/leaf_with_comment.bvh");
 
   if (obj == nullptr) {
     assert(false, "Object::load() returned nullptr");
@@ -0,0 +1,113 @@
+#include <test_log.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <log.hpp>
+#include <bvh.hpp>
+#include <bvh_tree.hpp>
+#include <thread_pool.hpp>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: counts the lines of a file containing every given piece
+static int count_lines(const char* filename, const std::vector<std::string>& pieces) {
+    std::ifstream file(filename);
+    std::string line;
+    int count = 0;
+    while (std::getline(file, line)) {
+        bool match = true;
+        for (const std::string& piece : pieces) {
+            match = match && line.find(piece) != std::string::npos;
+        }
+        count += match;
+    }
+    return count;
+}
+
+void logging() {
+    std::cout << "Starting log tests..." << std::endl;
+    log::Level saved_level = log::level();
+
+    // Test Case 1: messages below the runtime level are dropped
+    std::ostringstream captured;
+    log::set_output(captured);
+    log::set_level(log::Level::Warn);
+    BVH_LOG(INFO, "hidden " << 1);
+    BVH_LOG(WARN, "shown " << 2);
+    BVH_LOG(ERROR, "shown " << 3);
+    assert(captured.str() == "Warning: shown 2\nError: shown 3\n", "Only messages at or above the runtime level should be written");
+    std::cout << "Test Case 1 passed: runtime level" << std::endl;
+
+    // Test Case 2: messages below the compile level are not even evaluated
+    log::set_level(log::Level::Trace);
+    int evaluated = 0;
+    BVH_LOG(TRACE, "side effect " << ++evaluated);
+    BVH_LOG(ERROR, "side effect " << ++evaluated);
+#if BVH_LOG_COMPILE_LEVEL > BVH_LOG_LEVEL_TRACE
+    assert(evaluated == 1, "Compiled out messages should not evaluate their arguments");
+#else
+    assert(evaluated == 2, "Compiled in messages should evaluate their arguments");
+#endif
+    std::cout << "Test Case 2 passed: compile level" << std::endl;
+
+    // Test Case 3: builders write nothing to stdout
+    std::vector<Triangle> tris = generateRandomTriangles(2000, 0.0f, 100.0f, 5);
+    std::ostringstream stdout_capture;
+    std::streambuf* stdout_buffer = std::cout.rdbuf(stdout_capture.rdbuf());
+    captured.str("");
+    log::set_level(log::Level::Info);
+    BvhTree median = BvhTree::median(tris.data(), 0, tris.size());
+    std::cout.rdbuf(stdout_buffer);
+    assert(!median.empty(), "Median build failed");
+    assert(stdout_capture.str().empty() && captured.str().empty(), "The median build should not log at the default level");
+    std::cout << "Test Case 3 passed: quiet builds" << std::endl;
+
+    // Test Case 4: build trace events
+    const char* trace_file = "./test_log_trace.jsonl";
+    assert(trace::open(trace_file) && trace::enabled(), "Trace file should open");
+    BvhTree sah = BvhTree::sah(tris.data(), 0, tris.size());
+    ThreadPool pool(4);
+    BvhTree lbvh = BvhTree::lbvh(tris.data(), 0, tris.size(), pool);
+    trace::close();
+    assert(!trace::enabled(), "Tracing should stop when the file is closed");
+    BvhTree untraced = BvhTree::sah(tris.data(), 0, tris.size());
+
+    assert(count_lines(trace_file, {"\"event\":\"split\"", "\"builder\":\"sah\"", "\"depth\":0,", "\"count\":2000,"}) == 1,
+           "The root split of the SAH build should be traced once");
+    int sah_splits = count_lines(trace_file, {"\"event\":\"split\"", "\"builder\":\"sah\""});
+    int sah_leaves = count_lines(trace_file, {"\"event\":\"leaf\"", "\"builder\":\"sah\""});
+    assert(sah_leaves == sah_splits + 1, "Every SAH node should be traced");
+    assert(count_lines(trace_file, {"\"event\":\"build\"", "\"builder\":\"sah\"", "\"triangles\":2000,"}) == 1,
+           "Only the traced SAH build should be reported");
+    for (const char* phase : {"bounds", "codes", "sort", "hierarchy"}) {
+        assert(count_lines(trace_file, {"\"event\":\"phase\"", "\"builder\":\"lbvh\"", std::string("\"phase\":\"") + phase + "\""}) == 1,
+               std::string("Missing LBVH phase ") + phase);
+    }
+    assert(count_lines(trace_file, {"\"event\":\"build\"", "\"builder\":\"lbvh\""}) == 1, "The LBVH build should be reported");
+    assert(!trace::open("./does_not_exist/trace.jsonl") && !trace::enabled(), "An unwritable trace file should be rejected");
+
+    // Events too long for their line buffer are skipped instead of overrunning it
+    std::string long_name(1000, 'x');
+    assert(trace::open(trace_file), "Trace file should open");
+    trace::phase(long_name.c_str(), "bounds", 1.0);
+    trace::phase("sah", long_name.c_str(), 1.0);
+    trace::build(long_name.c_str(), 10, 1.0);
+    trace::build("sah", 10, 1.0);
+    trace::close();
+    assert(count_lines(trace_file, {"\"event\""}) == 1 && count_lines(trace_file, {"xxx"}) == 0,
+           "Only the event that fits its line should be written");
+    std::remove(trace_file);
+    std::cout << "Test Case 4 passed: build trace" << std::endl;
+
+    log::set_output(std::cerr);
+    log::set_level(saved_level);
+
+    std::cout << "All log tests completed successfully." << std::endl;
+}
+
+}
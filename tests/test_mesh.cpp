@@ -0,0 +1,133 @@
+#include <test_mesh.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <mesh.hpp>
+#include <obj_loader.hpp>
+#include <bvh.hpp>
+#include <traversal.hpp>
+#include <linear_bvh.hpp>
+#include <object.hpp>
+#include <vector>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file
+static void write_file(const char* filename, const std::string& content) {
+    FILE* file = fopen(filename, "wb");
+    assert(file != nullptr, "Could not open file " + std::string(filename));
+    fwrite(content.data(), 1, content.size(), file);
+    fclose(file);
+}
+
+static bool same_triangle(const Triangle& a, const Triangle& b) {
+    for (int k = 0; k < 3; k++) {
+        if (!(a.vertices[k] == b.vertices[k]) || !(a.normals[k] == b.normals[k]) ||
+            a.uv[k].x != b.uv[k].x || a.uv[k].y != b.uv[k].y) {
+            return false;
+        }
+    }
+    return a.smooth == b.smooth;
+}
+
+// A grid of size x size quads, every inner vertex is shared by 6 triangles
+static std::string grid_obj(int size) {
+    std::string content;
+    char line[128];
+    for (int y = 0; y <= size; y++) {
+        for (int x = 0; x <= size; x++) {
+            snprintf(line, sizeof(line), "v %d %d 0\n", x, y);
+            content += line;
+        }
+    }
+    content += "vn 0 0 1\n";
+    for (int y = 0; y < size; y++) {
+        for (int x = 0; x < size; x++) {
+            int i = y * (size + 1) + x + 1;
+            snprintf(line, sizeof(line), "f %d//1 %d//1 %d//1 %d//1\n", i, i + 1, i + size + 2, i + size + 1);
+            content += line;
+        }
+    }
+    return content;
+}
+
+void mesh() {
+    std::cout << "Starting mesh tests..." << std::endl;
+
+    // Test Case 1: shared vertices are stored once and the mesh matches the triangle array
+    const int size = 64;
+    write_file("./test_mesh_grid.obj", grid_obj(size));
+
+    Mesh grid;
+    int num_tris = parse_obj_file("./test_mesh_grid.obj", grid);
+    assert(num_tris == 2 * size * size, "Wrong number of triangles in the mesh");
+    assert(grid.num_triangles() == num_tris, "num_triangles() does not match the returned count");
+    assert(grid.num_vertices() == (size_t)(size + 1) * (size + 1), "Shared vertices should be stored once");
+
+    Triangle* tris = nullptr;
+    assert(parse_obj_file("./test_mesh_grid.obj", &tris) == num_tris, "Triangle and mesh loaders disagree");
+    for (int i = 0; i < num_tris; i++) {
+        assert(same_triangle(grid.triangle(i), tris[i]), "Mesh triangle " + std::to_string(i) + " differs from the triangle array");
+    }
+    assert(grid.memory_size() * 3 < num_tris * sizeof(Triangle), "The mesh should be a third of the triangle array or less");
+    std::cout << "Test Case 1 passed: " << grid.memory_size() << " bytes instead of " << num_tris * sizeof(Triangle) << std::endl;
+
+    // Test Case 2: from_triangles merges identical vertices and round trips
+    Mesh merged = Mesh::from_triangles(tris, num_tris);
+    assert(merged.num_vertices() == grid.num_vertices(), "from_triangles() should merge identical vertices");
+    for (int i = 0; i < num_tris; i++) {
+        assert(same_triangle(merged.triangle(i), tris[i]), "from_triangles() changed triangle " + std::to_string(i));
+    }
+    assert(Mesh::from_triangles(nullptr, 0).num_triangles() == 0, "Empty input should give an empty mesh");
+    std::cout << "Test Case 2 passed: from_triangles round trip" << std::endl;
+    delete[] tris;
+
+    // Test Case 3: builders and traversals over the mesh give the same results as over the triangle array
+    std::vector<Triangle> random_tris = generateRandomTriangles(3000, -10.0f, 10.0f, 3);
+    Mesh random_mesh = Mesh::from_triangles(random_tris.data(), random_tris.size());
+    BvhNode* tri_sah = precompute_bvh_sah(random_tris.data(), 0, random_tris.size());
+    BvhNode* mesh_sah = precompute_bvh_sah(random_mesh);
+    BvhNode* mesh_parallel = precompute_bvh_parallel(random_mesh, 4);
+    LinearBvh mesh_linear = LinearBvh::flatten(mesh_sah);
+    assert(sah_cost(tri_sah) == sah_cost(mesh_sah), "SAH trees over the mesh and the triangles differ");
+
+    std::mt19937 gen(7);
+    std::uniform_real_distribution<float> dis(-10.0f, 10.0f);
+    for (int i = 0; i < 500; i++) {
+        vec3<float> origin(dis(gen), dis(gen), -20.0f);
+        Ray ray(origin, vec3<float>(dis(gen), dis(gen), 20.0f) - origin);
+        Hit expected = intersect(tri_sah, random_tris.data(), ray);
+        Hit from_tree = intersect(mesh_sah, random_mesh, ray);
+        Hit from_parallel = intersect(mesh_parallel, random_mesh, ray);
+        Hit from_linear = intersect(mesh_linear, random_mesh, ray);
+        assert(from_tree.triangle == expected.triangle && from_tree.t == expected.t, "Mesh traversal differs");
+        assert(from_parallel.t == expected.t, "Parallel mesh build gives a different hit distance");
+        assert(from_linear.triangle == expected.triangle && from_linear.t == expected.t, "Linear mesh traversal differs");
+        assert(occluded(mesh_sah, random_mesh, ray) == expected.hit(), "Mesh occlusion differs");
+        assert(occluded(mesh_linear, random_mesh, ray) == expected.hit(), "Linear mesh occlusion differs");
+    }
+    assert(precompute_bvh_sah(Mesh()) == nullptr, "Empty mesh should give no tree");
+    delete tri_sah;
+    delete mesh_sah;
+    delete mesh_parallel;
+    std::cout << "Test Case 3 passed: builders and traversals over the mesh" << std::endl;
+
+    // Test Case 4: objects loaded as indexed meshes
+    Object::save_bvh_binary((char*)"./test_mesh_grid.bvh", precompute_bvh_sah(grid), grid.num_triangles());
+    Object* obj = Object::load_indexed((char*)"./test_mesh_grid.obj", (char*)"./test_mesh_grid.bvh");
+    assert(obj != nullptr && obj->mesh != nullptr, "load_indexed() failed");
+    assert(obj->num_triangles == num_tris, "Wrong number of triangles in the indexed object");
+    Hit hit = obj->intersect(Ray(vec3<float>(10.25f, 20.5f, 1.0f), vec3<float>(0.0f, 0.0f, -1.0f)));
+    assert(hit.hit() && hit.t == 1.0f, "Indexed object missed the grid");
+    assert(!obj->occluded(Ray(vec3<float>(-1.0f, 1.0f, 1.0f), vec3<float>(0.0f, 0.0f, -1.0f))), "Indexed object hit outside the grid");
+    delete obj;
+    std::cout << "Test Case 4 passed: Object::load_indexed()" << std::endl;
+
+    remove("./test_mesh_grid.obj");
+    remove("./test_mesh_grid.bvh");
+}
+
+}
@@ -0,0 +1,122 @@
+#include <test_obj_loader.hpp>
+#include <custom_assert.hpp>
+#include <obj_loader.hpp>
+#include <triangle.hpp>
+#include <vector>
+#include <cstdio>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file
+static void write_file(const char* filename, const std::string& content) {
+    FILE* file = fopen(filename, "wb");
+    assert(file != nullptr, "Could not open file " + std::string(filename));
+    fwrite(content.data(), 1, content.size(), file);
+    fclose(file);
+}
+
+static bool same_vec3(const vec3<float>& a, float x, float y, float z) {
+    return a.x == x && a.y == y && a.z == z;
+}
+
+void obj_loader() {
+    std::cout << "Starting obj_loader tests..." << std::endl;
+    Triangle* tris = nullptr;
+
+    // Test Case 1: the original v/vt/vn form
+    int num_tris = parse_obj_file("../tests/data/final/triangle.obj", &tris);
+    assert(num_tris == 1, "triangle.obj should have 1 triangle");
+    assert(same_vec3(tris[0].vertices[2], 1.0f, 2.0f, 0.0f), "Wrong vertex");
+    assert(tris[0].uv[2].x == 0.5f && tris[0].uv[2].y == 1.0f, "Wrong texture coordinate");
+    assert(same_vec3(tris[0].normals[1], 0.0f, 0.0f, 1.0f), "Wrong normal");
+    delete[] tris;
+    std::cout << "Test Case 1 passed: v/vt/vn faces" << std::endl;
+
+    // Test Case 2: every face form, negative indices, polygons, smoothing, comments and CRLF
+    write_file("./test_obj_loader_forms.obj",
+        "# comment\r\n"
+        "v 0 0 0\r\n"
+        "v 1.5 0 0\n"
+        "  v 0 2.5e1 0 # trailing comment\n"
+        "v -1 -2 -3.25 1.0\n"
+        "vt 0.25 0.75\n"
+        "vt 1\n"
+        "vn 0 0 1\n"
+        "o object\n"
+        "g group\n"
+        "f 1 2 3\n"
+        "s 1\n"
+        "f 1//1 2//1 3//1\n"
+        "f 1/1 2/2 3/1\n"
+        "s off\n"
+        "f -4/-2/-1 -3/-1/-1 -2/-2/-1\n"
+        "f 1 2 3 4\n"
+        "f\t1 3\t4");
+    num_tris = parse_obj_file("./test_obj_loader_forms.obj", &tris);
+    assert(num_tris == 7, "Expected 7 triangles (a quad gives 2)");
+    assert(same_vec3(tris[0].vertices[2], 0.0f, 25.0f, 0.0f), "Wrong vertex with exponent and leading blanks");
+    assert(same_vec3(tris[0].normals[0], 0.0f, 0.0f, 0.0f) && tris[0].uv[0].x == 0.0f, "Missing attributes should be 0");
+    assert(!tris[0].smooth && tris[1].smooth && tris[2].smooth && !tris[3].smooth, "Wrong smoothing groups");
+    assert(same_vec3(tris[1].normals[2], 0.0f, 0.0f, 1.0f), "Wrong normal in v//vn form");
+    assert(tris[2].uv[1].x == 1.0f && tris[2].uv[1].y == 0.0f, "Wrong texture coordinate in v/vt form");
+    assert(same_vec3(tris[3].vertices[0], 0.0f, 0.0f, 0.0f) && same_vec3(tris[3].vertices[2], 0.0f, 25.0f, 0.0f), "Wrong negative vertex index");
+    assert(tris[3].uv[0].x == 0.25f && tris[3].uv[1].x == 1.0f, "Wrong negative texture coordinate index");
+    assert(same_vec3(tris[4].vertices[2], 0.0f, 25.0f, 0.0f) && same_vec3(tris[5].vertices[1], 0.0f, 25.0f, 0.0f), "Wrong fan triangulation");
+    assert(same_vec3(tris[5].vertices[2], -1.0f, -2.0f, -3.25f), "Wrong fan triangulation");
+    assert(same_vec3(tris[6].vertices[2], -1.0f, -2.0f, -3.25f), "Wrong face with tabs and no final newline");
+    delete[] tris;
+    std::cout << "Test Case 2 passed: face forms, negative indices and polygons" << std::endl;
+
+    // Test Case 3: a file large enough to be split in several chunks, with relative indices across chunks
+    std::mt19937 gen(13);
+    std::uniform_int_distribution<int> dis(-100000, 100000);
+    std::string content;
+    std::vector<vec3<float>> expected;
+    int num_vertices = 0;
+    char line[128];
+    for (int i = 0; i < 60000; i++) {
+        for (int j = 0; j < 3; j++) {
+            vec3<float> v(dis(gen) / 64.0f, dis(gen) / 64.0f, dis(gen) / 64.0f);
+            snprintf(line, sizeof(line), "v %.6f %.6f %.6f\n", v.x, v.y, v.z);
+            content += line;
+            expected.push_back(v);
+            num_vertices++;
+        }
+        if (i % 2 == 0) {
+            content += "f -3 -2 -1\n";
+        } else {
+            snprintf(line, sizeof(line), "f %d %d %d\n", num_vertices - 2, num_vertices - 1, num_vertices);
+            content += line;
+        }
+    }
+    write_file("./test_obj_loader_large.obj", content);
+    num_tris = parse_obj_file("./test_obj_loader_large.obj", &tris, 4);
+    assert(num_tris == 60000, "Expected 60000 triangles");
+    for (int i = 0; i < num_tris; i++) {
+        for (int j = 0; j < 3; j++) {
+            assert(tris[i].vertices[j] == expected[3 * i + j], "Wrong vertex in the large file at triangle " + std::to_string(i));
+        }
+    }
+    delete[] tris;
+    std::cout << "Test Case 3 passed: " << content.size() << " bytes parsed in parallel" << std::endl;
+
+    // Test Case 4: invalid files
+    assert(parse_obj_file("./does_not_exist.obj", &tris) == -1, "A missing file should fail");
+    write_file("./test_obj_loader_bad.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2 4\n");
+    assert(parse_obj_file("./test_obj_loader_bad.obj", &tris) == -1, "An out of range index should fail");
+    write_file("./test_obj_loader_bad.obj", "v 0 0 0\nv 1 0 0\nv 0 1 0\nf 1 2\n");
+    assert(parse_obj_file("./test_obj_loader_bad.obj", &tris) == -1, "A face with two vertices should fail");
+    write_file("./test_obj_loader_bad.obj", "v 0 0 zero\n");
+    assert(parse_obj_file("./test_obj_loader_bad.obj", &tris) == -1, "A malformed float should fail");
+    write_file("./test_obj_loader_bad.obj", "");
+    assert(parse_obj_file("./test_obj_loader_bad.obj", &tris) == 0, "An empty file has no triangles");
+    delete[] tris;
+    std::cout << "Test Case 4 passed: invalid files" << std::endl;
+
+    std::cout << "All obj_loader tests completed successfully." << std::endl;
+}
+
+}
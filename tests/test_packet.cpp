@@ -0,0 +1,119 @@
+#include <test_packet.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <bvh.hpp>
+#include <linear_bvh.hpp>
+#include <packet.hpp>
+#include <vector>
+#include <algorithm>
+#include <memory>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: same result as the single ray traversal
+static void check_hit(const Hit& hit, const Hit& expected, const std::string& what) {
+    assert(hit.triangle == expected.triangle, what + ": wrong triangle");
+    assert(hit.t == expected.t && hit.u == expected.u && hit.v == expected.v, what + ": wrong hit distance or coordinates");
+}
+
+// Helper function, only used in this file: camera rays through a grid of pixels, all from the same point
+static std::vector<Ray> camera_rays(int width, int height) {
+    std::vector<Ray> rays;
+    vec3<float> eye(0.0f, 0.0f, -30.0f);
+    for (int y = 0; y < height; y++) {
+        for (int x = 0; x < width; x++) {
+            vec3<float> target(-12.0f + 24.0f * x / width, -12.0f + 24.0f * y / height, 0.0f);
+            rays.push_back(Ray(eye, target - eye));
+        }
+    }
+    return rays;
+}
+
+void packet() {
+    std::cout << "Starting packet tests..." << std::endl;
+
+    std::vector<Triangle> tris = generateRandomTriangles(2000, -10.0f, 10.0f, 4);
+    BvhNode* root = precompute_bvh_sah(tris.data(), 0, tris.size());
+    LinearBvh bvh = LinearBvh::flatten(root);
+    delete root;
+
+    // Test Case 1: coherent packets, full and partial, match the single ray traversal
+    std::vector<Ray> rays = camera_rays(64, 64);
+    int num_hits = 0;
+    for (size_t start = 0; start < rays.size(); start += BVH_PACKET_SIZE) {
+        int count = 1 + (start / BVH_PACKET_SIZE) % BVH_PACKET_SIZE; // every packet size from 1 to 8
+        Hit hits[BVH_PACKET_SIZE];
+        bool results[BVH_PACKET_SIZE];
+        intersect_packet(bvh.view(), tris.data(), &rays[start], count, hits);
+        occluded_packet(bvh.view(), tris.data(), &rays[start], count, results);
+        for (int i = 0; i < count; i++) {
+            Hit expected = intersect(bvh, tris.data(), rays[start + i]);
+            check_hit(hits[i], expected, "Packet ray " + std::to_string(start + i));
+            assert(results[i] == expected.hit(), "Packet occlusion differs for ray " + std::to_string(start + i));
+            num_hits += expected.hit();
+        }
+    }
+    assert(num_hits > 0, "The camera should see some triangles");
+    std::cout << "Test Case 1 passed: coherent packets, " << num_hits << " hits" << std::endl;
+
+    // Test Case 2: incoherent packets (random origins, directions and intervals) fall back to single rays
+    std::mt19937 gen(11);
+    std::uniform_real_distribution<float> dis(-15.0f, 15.0f);
+    std::vector<Ray> random_rays;
+    for (int i = 0; i < 4000; i++) {
+        vec3<float> origin(dis(gen), dis(gen), dis(gen));
+        vec3<float> direction(dis(gen), dis(gen), dis(gen));
+        float tmax = (i % 3 == 0) ? 0.5f : std::numeric_limits<float>::max();
+        random_rays.push_back(Ray(origin, direction, (i % 5 == 0) ? 0.2f : 0.0f, tmax));
+    }
+    // Axis aligned rays have infinite inverse directions
+    random_rays.push_back(Ray(vec3<float>(0.0f, 0.0f, -20.0f), vec3<float>(0.0f, 0.0f, 1.0f)));
+    random_rays.push_back(Ray(vec3<float>(-20.0f, 1.0f, 1.0f), vec3<float>(1.0f, 0.0f, 0.0f)));
+    for (size_t start = 0; start < random_rays.size(); start += BVH_PACKET_SIZE) {
+        int count = std::min<int>(BVH_PACKET_SIZE, random_rays.size() - start);
+        Hit hits[BVH_PACKET_SIZE];
+        bool results[BVH_PACKET_SIZE];
+        intersect_packet(bvh.view(), tris.data(), &random_rays[start], count, hits);
+        occluded_packet(bvh.view(), tris.data(), &random_rays[start], count, results);
+        for (int i = 0; i < count; i++) {
+            Hit expected = intersect(bvh, tris.data(), random_rays[start + i]);
+            check_hit(hits[i], expected, "Random ray " + std::to_string(start + i));
+            assert(results[i] == expected.hit(), "Random occlusion differs for ray " + std::to_string(start + i));
+        }
+    }
+    std::cout << "Test Case 2 passed: incoherent packets" << std::endl;
+
+    // Test Case 3: streams of any size come back in the order of the rays
+    std::vector<Ray> stream = rays;
+    stream.insert(stream.end(), random_rays.begin(), random_rays.begin() + 1001);
+    std::shuffle(stream.begin(), stream.end(), gen);
+    std::vector<Hit> stream_hits(stream.size());
+    std::unique_ptr<bool[]> stream_results(new bool[stream.size()]);
+    intersect_stream(bvh.view(), tris.data(), stream.data(), stream.size(), stream_hits.data());
+    occluded_stream(bvh.view(), tris.data(), stream.data(), stream.size(), stream_results.get());
+    for (size_t i = 0; i < stream.size(); i++) {
+        Hit expected = intersect(bvh, tris.data(), stream[i]);
+        check_hit(stream_hits[i], expected, "Stream ray " + std::to_string(i));
+        assert(stream_results[i] == expected.hit(), "Stream occlusion differs for ray " + std::to_string(i));
+    }
+    std::cout << "Test Case 3 passed: stream of " << stream.size() << " rays" << std::endl;
+
+    // Test Case 4: indexed meshes and empty BVHs
+    Mesh mesh = Mesh::from_triangles(tris.data(), tris.size());
+    std::vector<Hit> mesh_hits(rays.size());
+    intersect_stream(bvh.view(), mesh, rays.data(), rays.size(), mesh_hits.data());
+    for (size_t i = 0; i < rays.size(); i++) {
+        check_hit(mesh_hits[i], intersect(bvh, tris.data(), rays[i]), "Mesh stream ray " + std::to_string(i));
+    }
+    Hit empty_hits[2];
+    bool empty_results[2] = {true, true};
+    intersect_packet(LinearBvh().view(), tris.data(), rays.data(), 2, empty_hits);
+    occluded_stream(LinearBvh().view(), tris.data(), rays.data(), 2, empty_results);
+    assert(!empty_hits[0].hit() && !empty_hits[1].hit() && !empty_results[0] && !empty_results[1], "Empty BVH should give no hits");
+    std::cout << "Test Case 4 passed: meshes and empty BVHs" << std::endl;
+}
+
+}
@@ -0,0 +1,113 @@
+#include <test_parallel_bvh.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <sameTree.hpp>
+#include <bvh.hpp>
+#include <thread_pool.hpp>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: appends the leaf indices in tree order
+static void collect_leaf_order(const BvhNode* node, std::vector<int>& order) {
+    if (const BvhLeaf* leaf = dynamic_cast<const BvhLeaf*>(node)) {
+        order.insert(order.end(), leaf->indices, leaf->indices + leaf->num_triangles);
+        return;
+    }
+    collect_leaf_order(node->left, order);
+    collect_leaf_order(node->right, order);
+}
+
+void precompute_bvh_parallel() {
+    std::cout << "Starting precompute_bvh_parallel tests..." << std::endl;
+
+    // Test Case 1: thread pool basics
+    ThreadPool pool(4);
+    assert(pool.num_threads() == 4, "Pool should have the requested number of threads");
+    std::atomic<long long> sum{0};
+    parallel_for(pool, 100000, 1000, [&](size_t begin, size_t end) {
+        long long local = 0;
+        for (size_t i = begin; i < end; i++) {
+            local += i;
+        }
+        sum += local;
+    });
+    assert(sum == 100000LL * 99999LL / 2, "parallel_for should visit every index exactly once");
+    bool thrown = false;
+    try {
+        TaskGroup group(pool);
+        group.run([]() { throw std::runtime_error("task failure"); });
+        group.wait();
+    } catch (const std::runtime_error&) {
+        thrown = true;
+    }
+    assert(thrown, "TaskGroup::wait() should rethrow the exception of a task");
+    std::cout << "Test Case 1 passed: thread pool" << std::endl;
+
+    // Test Case 2: identical to the serial build, large enough to use parallel partitioning and bounds
+    std::vector<Triangle> tris = generateRandomTriangles(70000, 0.0f, 100.0f, 9);
+    BvhNode* serial_root = precompute_bvh(tris.data(), 0, tris.size());
+    BvhNode* parallel_root = bvh::precompute_bvh_parallel(tris.data(), 0, tris.size(), pool);
+    assert(same_tree(serial_root, parallel_root), "Parallel build should give the same tree as the serial build");
+    // Most triangles in a tiny cluster and a few far away, so the bin holding the median is partitioned again
+    std::vector<Triangle> clustered = generateRandomTriangles(100000, 0.0f, 100.0f, 10);
+    for (size_t i = 0; i < clustered.size(); i++) {
+        float scale = (i % 50 == 0) ? 1.0f : 1e-4f;
+        for (int j = 0; j < 3; j++) {
+            clustered[i].vertices[j] = clustered[i].vertices[j] * scale;
+        }
+    }
+    BvhNode* serial_clustered = precompute_bvh(clustered.data(), 0, clustered.size());
+    BvhNode* parallel_clustered = bvh::precompute_bvh_parallel(clustered.data(), 0, clustered.size(), pool);
+    assert(same_tree(serial_clustered, parallel_clustered), "Parallel build should give the same tree on clustered centroids");
+    delete serial_clustered;
+    delete parallel_clustered;
+    std::cout << "Test Case 2 passed: parallel tree identical to the serial tree" << std::endl;
+
+    // Test Case 3: sub-ranges, small inputs and the default thread count
+    int ranges[][2] = {{0, 1}, {3, 8}, {10, 11}, {100, 117}, {1000, 6000}};
+    for (auto& range : ranges) {
+        BvhNode* serial = precompute_bvh(tris.data(), range[0], range[1]);
+        BvhNode* parallel = bvh::precompute_bvh_parallel(tris.data(), range[0], range[1]);
+        assert(same_tree(serial, parallel), "Parallel build should give the same tree on sub-ranges");
+        delete serial;
+        delete parallel;
+    }
+    assert(bvh::precompute_bvh_parallel(tris.data(), 4, 4, pool) == nullptr, "Empty range should return null");
+    std::cout << "Test Case 3 passed: sub-ranges and edge cases" << std::endl;
+
+    // Test Case 4: in-place partitioning gives the leaves of a full sort along the longest axis. Half of the
+    // triangles are copies, so the order of equal centroids is checked as well.
+    for (int i = 0; i < 35000; i += 2) {
+        tris[i + 35000] = tris[i];
+    }
+    BvhNode* root = precompute_bvh(tris.data(), 0, tris.size());
+    int axis = chooseSplitAxis(root->bounding_box);
+    std::vector<float> keys(tris.size());
+    std::vector<int> sorted(tris.size());
+    for (size_t i = 0; i < tris.size(); i++) {
+        keys[i] = (tris[i].vertices[0][axis] + tris[i].vertices[1][axis] + tris[i].vertices[2][axis]) / 3.0f;
+        sorted[i] = i;
+    }
+    std::sort(sorted.begin(), sorted.end(), CentroidLess(keys.data(), 0));
+    std::vector<int> order;
+    collect_leaf_order(root, order);
+    assert(order == sorted, "Leaves should hold the triangles in the order of a full centroid sort");
+    BvhNode* parallel_copies = bvh::precompute_bvh_parallel(tris.data(), 0, tris.size(), pool);
+    assert(same_tree(root, parallel_copies), "Parallel build should give the same tree with equal centroids");
+    std::cout << "Test Case 4 passed: partitioned tree matches a full sort" << std::endl;
+
+    delete root;
+    delete parallel_copies;
+    delete serial_root;
+    delete parallel_root;
+
+    std::cout << "All precompute_bvh_parallel tests completed successfully." << std::endl;
+}
+
+}
@@ -0,0 +1,117 @@
+#include <test_quantized_bvh.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <bvh.hpp>
+#include <traversal.hpp>
+#include <linear_bvh.hpp>
+#include <quantized_bvh.hpp>
+#include <vector>
+#include <iostream>
+#include <limits>
+#include <random>
+#include <string>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: the distance of a miss depends on where the traversal stopped
+static bool same_hit(const Hit& a, const Hit& b) {
+    return a.triangle == b.triangle && (!a.hit() || (a.t == b.t && a.u == b.u && a.v == b.v));
+}
+
+// Helper function, only used in this file: decodes every box as traversal does and checks that it contains
+// the exact box of the linear node, and is at most two grid steps larger on each side
+static void check_boxes(const QuantizedBvh& quantized, const LinearBvh& linear, uint32_t index,
+                        const QuantizationGrid& grid, const std::string& name) {
+    const QuantizedBvhNode& node = quantized.nodes[index];
+    const LinearBvhNode& exact = linear.nodes[index];
+    BoundingBox box = grid.decode(node);
+    for (int axis = 0; axis < 3; axis++) {
+        assert(box.min[axis] <= exact.min[axis] && box.max[axis] >= exact.max[axis],
+               name + ": decoded box does not contain node " + std::to_string(index));
+        assert(exact.min[axis] - box.min[axis] <= 2.0f * grid.step[axis] &&
+               box.max[axis] - exact.max[axis] <= 2.0f * grid.step[axis],
+               name + ": decoded box is too loose at node " + std::to_string(index));
+    }
+    assert(node.count == exact.count && node.offset == exact.offset, name + ": node layout differs from the linear BVH");
+    if (!node.is_leaf()) {
+        QuantizationGrid child_grid = QuantizationGrid::of(box);
+        check_boxes(quantized, linear, node.offset, child_grid, name);
+        check_boxes(quantized, linear, node.offset + 1, child_grid, name);
+    }
+}
+
+void quantized_bvh() {
+    std::cout << "Starting quantized_bvh tests..." << std::endl;
+
+    // Test Case 1: conservative boxes at half the node size, also far from the origin where rounding is coarse
+    struct Scene {
+        std::string name;
+        vec3<float> center;
+        float size;
+    };
+    Scene scenes[] = {{"centered", vec3<float>(0.0f, 0.0f, 0.0f), 10.0f},
+                      {"offset", vec3<float>(1.0e5f, -3.0e4f, 7.0e3f), 20.0f}};
+    for (const Scene& scene : scenes) {
+        std::vector<Triangle> tris = generateRandomTriangles(6000, -scene.size, scene.size, 21, 0.02f * scene.size, scene.center);
+        BvhNode* root = precompute_bvh_sah(tris.data(), 0, tris.size());
+        LinearBvh linear = LinearBvh::flatten(root);
+        QuantizedBvh quantized = QuantizedBvh::compress(linear.view());
+        assert(quantized.nodes.size() == linear.nodes.size(), scene.name + ": one quantized node per linear node");
+        assert(quantized.primitive_indices == linear.primitive_indices, scene.name + ": primitive indices should be kept");
+        assert(quantized.bounds == root->bounding_box, scene.name + ": the root box should be exact");
+        check_boxes(quantized, linear, 0, QuantizationGrid::of(quantized.bounds), scene.name);
+        assert(quantized.memory_size() < linear.memory_size(), scene.name + ": quantized BVH should be smaller");
+
+        // Test Case 2: same hits as the exact tree
+        std::mt19937 gen(3);
+        std::uniform_real_distribution<float> dis(-1.5f * scene.size, 1.5f * scene.size);
+        int num_hits = 0;
+        for (int i = 0; i < 3000; i++) {
+            vec3<float> origin = scene.center + vec3<float>(dis(gen), dis(gen), dis(gen));
+            vec3<float> target = scene.center + vec3<float>(dis(gen), dis(gen), dis(gen));
+            Ray ray(origin, target - origin, 0.0f, (i % 4 == 0) ? 0.3f : std::numeric_limits<float>::max());
+            Hit expected = intersect(linear, tris.data(), ray);
+            assert(same_hit(intersect(quantized, tris.data(), ray), expected),
+                   scene.name + ": closest hit differs for ray " + std::to_string(i));
+            assert(occluded(quantized, tris.data(), ray) == expected.hit(),
+                   scene.name + ": occlusion differs for ray " + std::to_string(i));
+            num_hits += expected.hit();
+        }
+        assert(num_hits > 0, scene.name + ": some rays should hit");
+        std::cout << "Test Cases 1 and 2 passed (" << scene.name << "): " << quantized.memory_size() << " bytes instead of "
+                  << linear.memory_size() << ", " << num_hits << " hits" << std::endl;
+        delete root;
+    }
+
+    // Test Case 3: leaf roots, flat scenes, meshes and empty trees
+    std::vector<Triangle> tris = generateRandomTriangles(200, -5.0f, 5.0f, 4, 0.1f);
+    for (Triangle& tri : tris) {
+        for (int k = 0; k < 3; k++) {
+            tri.vertices[k].z = 1.0f; // zero extent along z
+        }
+    }
+    BvhNode* root = precompute_bvh_sah(tris.data(), 0, tris.size());
+    QuantizedBvh flat = QuantizedBvh::compress(root);
+    Ray down(vec3<float>(tris[7].vertices[0].x, tris[7].vertices[0].y, 5.0f) * (1.0f / 3.0f) +
+             vec3<float>(tris[7].vertices[1].x, tris[7].vertices[1].y, 5.0f) * (1.0f / 3.0f) +
+             vec3<float>(tris[7].vertices[2].x, tris[7].vertices[2].y, 5.0f) * (1.0f / 3.0f), vec3<float>(0.0f, 0.0f, -1.0f));
+    Hit flat_hit = intersect(flat, tris.data(), down);
+    assert(flat_hit.hit() && same_hit(flat_hit, intersect(root, tris.data(), down)), "Flat scene traversal differs");
+
+    int leaf_indices[3] = {0, 1, 2};
+    BvhNode* leaf_root = precompute_bvh(tris.data(), 0, 3);
+    QuantizedBvh small = QuantizedBvh::compress(leaf_root);
+    assert(small.nodes.size() == 1 && small.nodes[0].count == 3, "A leaf root should give a single leaf");
+    assert(small.primitive_indices == std::vector<int>(leaf_indices, leaf_indices + 3), "Leaf root indices differ");
+
+    Mesh mesh = Mesh::from_triangles(tris.data(), tris.size());
+    assert(same_hit(intersect(flat, mesh, down), flat_hit) && occluded(flat, mesh, down), "Mesh traversal differs");
+    assert(QuantizedBvh::compress(nullptr).empty() && !intersect(QuantizedBvh(), tris.data(), down).hit() &&
+           !occluded(QuantizedBvh(), tris.data(), down), "Empty quantized BVH should give no hits");
+    std::cout << "Test Case 3 passed: flat scenes, leaf roots, meshes and empty trees" << std::endl;
+
+    delete leaf_root;
+    delete root;
+}
+
+}
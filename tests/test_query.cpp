@@ -0,0 +1,285 @@
+#include <test_query.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <query.hpp>
+#include <bvh.hpp>
+#include <mesh.hpp>
+#include <thread_pool.hpp>
+#include <algorithm>
+#include <vector>
+#include <cmath>
+#include <iostream>
+#include <limits>
+#include <random>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file
+static BoundingBox triangle_box(const Triangle& tri) {
+    BoundingBox box = BoundingBox::empty();
+    for (int j = 0; j < 3; j++) {
+        box.expand(tri.vertices[j]);
+    }
+    return box;
+}
+
+// Helper function, only used in this file
+static bool boxes_overlap(const BoundingBox& a, const BoundingBox& b) {
+    return a.min.x <= b.max.x && a.max.x >= b.min.x && a.min.y <= b.max.y && a.max.y >= b.min.y &&
+           a.min.z <= b.max.z && a.max.z >= b.min.z;
+}
+
+// Helper function, only used in this file: same test as the frustum query, a box is kept unless it is
+// entirely behind one plane
+static bool box_in_frustum(const BoundingBox& box, const Frustum& frustum) {
+    for (const Plane& plane : frustum.planes) {
+        vec3<float> p(plane.normal.x >= 0.0f ? box.max.x : box.min.x, plane.normal.y >= 0.0f ? box.max.y : box.min.y,
+                      plane.normal.z >= 0.0f ? box.max.z : box.min.z);
+        if (plane.distance(p) < 0.0f) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// Helper function, only used in this file
+static bool box_in_sphere(const BoundingBox& box, const Sphere& sphere) {
+    float d2 = 0.0f;
+    for (int axis = 0; axis < 3; axis++) {
+        float c = sphere.center[axis];
+        float d = std::max(std::max(box.min[axis] - c, c - box.max[axis]), 0.0f);
+        d2 += d * d;
+    }
+    return d2 <= sphere.radius * sphere.radius;
+}
+
+// Helper function, only used in this file: results of a query, sorted
+static std::vector<int> sorted(const int* indices, int count) {
+    std::vector<int> result(indices, indices + count);
+    std::sort(result.begin(), result.end());
+    return result;
+}
+
+void queries() {
+    std::cout << "Starting query tests..." << std::endl;
+
+    std::vector<Triangle> tris = generateRandomTriangles(5000, 0.0f, 100.0f, 21, 1.5f);
+    int num_tris = tris.size();
+    BvhNode* root = precompute_bvh_sah(tris.data(), 0, num_tris);
+    std::vector<int> buffer(num_tris);
+    std::mt19937 gen(4);
+    std::uniform_real_distribution<float> pos_dis(-10.0f, 110.0f);
+    std::uniform_real_distribution<float> size_dis(0.0f, 20.0f);
+
+    // Test Case 1: box queries find the triangles whose boxes overlap, nothing more
+    std::vector<BoundingBox> boxes;
+    for (int q = 0; q < 200; q++) {
+        vec3<float> corner(pos_dis(gen), pos_dis(gen), pos_dis(gen));
+        BoundingBox box(corner, corner + vec3<float>(size_dis(gen), size_dis(gen), size_dis(gen)));
+        boxes.push_back(box);
+        std::vector<int> expected;
+        for (int i = 0; i < num_tris; i++) {
+            if (boxes_overlap(triangle_box(tris[i]), box)) {
+                expected.push_back(i);
+            }
+        }
+        int count = query_box(root, tris.data(), box, buffer.data(), num_tris);
+        assert(sorted(buffer.data(), count) == expected, "Box query differs from brute force");
+    }
+    BoundingBox everything(vec3<float>(-100, -100, -100), vec3<float>(200, 200, 200));
+    assert(query_box(root, tris.data(), everything, buffer.data(), num_tris) == num_tris, "A box around the scene should find every triangle");
+    std::cout << "Test Case 1 passed: box queries" << std::endl;
+
+    // Test Case 2: sphere queries
+    std::vector<Sphere> spheres;
+    for (int q = 0; q < 200; q++) {
+        Sphere sphere{vec3<float>(pos_dis(gen), pos_dis(gen), pos_dis(gen)), size_dis(gen)};
+        spheres.push_back(sphere);
+        std::vector<int> expected;
+        for (int i = 0; i < num_tris; i++) {
+            if (box_in_sphere(triangle_box(tris[i]), sphere)) {
+                expected.push_back(i);
+            }
+        }
+        int count = query_sphere(root, tris.data(), sphere, buffer.data(), num_tris);
+        assert(sorted(buffer.data(), count) == expected, "Sphere query differs from brute force");
+    }
+    std::cout << "Test Case 2 passed: sphere queries" << std::endl;
+
+    // Test Case 3: frustum queries, from cameras looking into the scene
+    Frustum camera = Frustum::perspective(vec3<float>(50, 50, -20), vec3<float>(0, 0, 1), vec3<float>(0, 1, 0), 0.8f, 1.5f, 1.0f, 200.0f);
+    assert(camera.planes[0].distance(vec3<float>(50, 50, 50)) > 0.0f, "The view axis should be inside the frustum");
+    bool inside = true;
+    for (const Plane& plane : camera.planes) {
+        inside = inside && plane.distance(vec3<float>(50, 50, 50)) > 0.0f;
+    }
+    assert(inside, "A point ahead of the camera should be inside every plane");
+    assert(camera.planes[4].distance(vec3<float>(50, 50, -30)) < 0.0f, "A point behind the camera should be outside the near plane");
+    assert(camera.planes[0].distance(vec3<float>(-100, 50, 0)) < 0.0f || camera.planes[1].distance(vec3<float>(-100, 50, 0)) < 0.0f,
+           "A point far to the side should be outside a side plane");
+
+    std::vector<Frustum> frustums;
+    std::uniform_real_distribution<float> dir_dis(-1.0f, 1.0f);
+    for (int q = 0; q < 100; q++) {
+        vec3<float> eye(pos_dis(gen), pos_dis(gen), pos_dis(gen));
+        vec3<float> forward(dir_dis(gen), dir_dis(gen), dir_dis(gen));
+        Frustum frustum = Frustum::perspective(eye, forward, vec3<float>(0.1f, 1, 0.2f), 0.7f, 1.3f, 0.5f, 60.0f);
+        frustums.push_back(frustum);
+        std::vector<int> expected;
+        for (int i = 0; i < num_tris; i++) {
+            if (box_in_frustum(triangle_box(tris[i]), frustum)) {
+                expected.push_back(i);
+            }
+        }
+        int count = query_frustum(root, tris.data(), frustum, buffer.data(), num_tris);
+        assert(sorted(buffer.data(), count) == expected, "Frustum query differs from brute force");
+    }
+    std::cout << "Test Case 3 passed: frustum queries" << std::endl;
+
+    // Test Case 4: small buffers are filled and the count still reports every match
+    int full = query_box(root, tris.data(), everything, buffer.data(), num_tris);
+    std::vector<int> first(buffer.begin(), buffer.begin() + 10);
+    std::vector<int> small(11, -7);
+    assert(query_box(root, tris.data(), everything, small.data(), 10) == full, "A small buffer should not change the count");
+    assert(std::equal(first.begin(), first.end(), small.begin()) && small[10] == -7, "A small buffer should get the first matches only");
+    assert(query_box(root, tris.data(), everything, nullptr, 0) == full, "Counting without a buffer");
+    assert(query_box(nullptr, tris.data(), everything, buffer.data(), num_tris) == 0, "Empty BVH should find nothing");
+    std::cout << "Test Case 4 passed: buffer capacity" << std::endl;
+
+    // Test Case 5: batches split across threads give the results of the single queries
+    ThreadPool pool(4);
+    int capacity = 256;
+    int num_queries = 200;
+    std::vector<int> batch(num_queries * capacity);
+    std::vector<int> counts(num_queries);
+    query_boxes(root, tris.data(), boxes.data(), num_queries, batch.data(), capacity, counts.data(), pool);
+    for (int q = 0; q < num_queries; q++) {
+        int count = query_box(root, tris.data(), boxes[q], buffer.data(), num_tris);
+        assert(counts[q] == count, "Batched box query count differs");
+        assert(std::equal(buffer.begin(), buffer.begin() + std::min(count, capacity), batch.begin() + q * capacity), "Batched box query differs");
+    }
+    query_spheres(root, tris.data(), spheres.data(), num_queries, batch.data(), capacity, counts.data(), pool);
+    for (int q = 0; q < num_queries; q++) {
+        int count = query_sphere(root, tris.data(), spheres[q], buffer.data(), num_tris);
+        assert(counts[q] == count && std::equal(buffer.begin(), buffer.begin() + std::min(count, capacity), batch.begin() + q * capacity),
+               "Batched sphere query differs");
+    }
+    query_frustums(root, tris.data(), frustums.data(), frustums.size(), batch.data(), capacity, counts.data(), pool);
+    for (size_t q = 0; q < frustums.size(); q++) {
+        int count = query_frustum(root, tris.data(), frustums[q], buffer.data(), num_tris);
+        assert(counts[q] == count && std::equal(buffer.begin(), buffer.begin() + std::min(count, capacity), batch.begin() + q * capacity),
+               "Batched frustum query differs");
+    }
+
+    Mesh mesh = Mesh::from_triangles(tris.data(), num_tris);
+    BvhNode* mesh_root = precompute_bvh_sah(mesh);
+    std::vector<int> mesh_counts(num_queries);
+    query_boxes(mesh_root, mesh, boxes.data(), num_queries, batch.data(), capacity, mesh_counts.data(), pool);
+    query_boxes(root, tris.data(), boxes.data(), num_queries, buffer.data(), 0, counts.data(), pool);
+    assert(mesh_counts == counts, "Queries over a mesh should find the same triangles");
+    std::cout << "Test Case 5 passed: batched queries" << std::endl;
+
+    // Test Case 6: pairs of overlapping triangles between two BVHs and within one
+    std::vector<Triangle> other = generateRandomTriangles(3000, 60.0f, 110.0f, 22, 1.5f);
+    int num_other = other.size();
+    BvhNode* other_root = precompute_bvh(other.data(), 0, num_other);
+    std::vector<std::pair<int, int>> expected_pairs;
+    for (int i = 0; i < num_tris; i++) {
+        BoundingBox box = triangle_box(tris[i]);
+        for (int j = 0; j < num_other; j++) {
+            if (boxes_overlap(box, triangle_box(other[j]))) {
+                expected_pairs.push_back({i, j});
+            }
+        }
+    }
+    std::vector<PrimitivePair> pairs(expected_pairs.size() + 10);
+    int num_pairs = query_pairs(root, tris.data(), other_root, other.data(), pairs.data(), pairs.size());
+    std::vector<std::pair<int, int>> found;
+    for (int p = 0; p < num_pairs; p++) {
+        found.push_back({pairs[p].a, pairs[p].b});
+    }
+    std::sort(found.begin(), found.end());
+    std::cout << "Overlapping pairs between the BVHs: " << num_pairs << std::endl;
+    assert(found == expected_pairs && num_pairs > 0, "Pair query differs from brute force");
+    assert(query_pairs(root, tris.data(), other_root, other.data(), pairs.data(), 1) == num_pairs, "A small pair buffer should not change the count");
+
+    std::vector<std::pair<int, int>> expected_self;
+    for (int i = 0; i < num_tris; i++) {
+        BoundingBox box = triangle_box(tris[i]);
+        for (int j = i + 1; j < num_tris; j++) {
+            if (boxes_overlap(box, triangle_box(tris[j]))) {
+                expected_self.push_back({i, j});
+            }
+        }
+    }
+    pairs.resize(expected_self.size() + 10);
+    num_pairs = query_pairs(root, tris.data(), root, tris.data(), pairs.data(), pairs.size());
+    found.clear();
+    for (int p = 0; p < num_pairs; p++) {
+        found.push_back({pairs[p].a, pairs[p].b});
+    }
+    std::sort(found.begin(), found.end());
+    std::cout << "Overlapping pairs within the BVH: " << num_pairs << std::endl;
+    assert(found == expected_self, "Self pair query should find each pair of distinct triangles once");
+    assert(query_pairs(mesh_root, mesh, mesh_root, mesh, pairs.data(), pairs.size()) == num_pairs, "Self pair query over a mesh");
+    assert(query_pairs(nullptr, tris.data(), root, tris.data(), pairs.data(), pairs.size()) == 0, "Empty BVH should have no pairs");
+    std::cout << "Test Case 6 passed: pair queries" << std::endl;
+
+    // Test Case 7: closest points, against the distance to every triangle
+    std::vector<vec3<float>> points;
+    for (int q = 0; q < 500; q++) {
+        points.push_back(vec3<float>(pos_dis(gen), pos_dis(gen), pos_dis(gen)));
+    }
+    points.push_back(tris[17].vertices[0]);
+    points.push_back((tris[42].vertices[0] + tris[42].vertices[1] + tris[42].vertices[2]) / 3.0f);
+    // Brute force: one leaf holding every triangle, and sample points of the triangles as upper bounds
+    std::vector<int> all_indices(num_tris);
+    for (int i = 0; i < num_tris; i++) {
+        all_indices[i] = i;
+    }
+    BvhLeaf all_leaf(everything.min, everything.max, num_tris, all_indices.data());
+    for (const vec3<float>& p : points) {
+        ClosestPoint result = closest_point(root, tris.data(), p);
+        ClosestPoint expected = closest_point(&all_leaf, tris.data(), p);
+        assert(result.found() && result.distance == expected.distance, "Closest point distance differs from brute force");
+        for (const Triangle& tri : tris) {
+            vec3<float> samples[4] = {tri.vertices[0], tri.vertices[1], tri.vertices[2], (tri.vertices[0] + tri.vertices[1] + tri.vertices[2]) / 3.0f};
+            for (const vec3<float>& sample : samples) {
+                vec3<float> d = sample - p;
+                assert(result.distance <= std::sqrt(vec3<float>::dot(d, d)) + 1e-4f, "A point of a triangle is closer than the closest point");
+            }
+        }
+        const Triangle& tri = tris[result.triangle];
+        vec3<float> rebuilt = tri.vertices[0] + (tri.vertices[1] - tri.vertices[0]) * result.u + (tri.vertices[2] - tri.vertices[0]) * result.v;
+        vec3<float> error = rebuilt - result.point;
+        vec3<float> offset = result.point - p;
+        assert(vec3<float>::dot(error, error) <= 1e-8f, "Barycentric coordinates should give back the closest point");
+        assert(result.u >= 0.0f && result.v >= 0.0f && result.u + result.v <= 1.0f + 1e-6f, "Closest point outside its triangle");
+        assert(std::fabs(std::sqrt(vec3<float>::dot(offset, offset)) - result.distance) <= 1e-4f, "Distance should be the one of the point");
+    }
+    assert(closest_point(root, tris.data(), tris[17].vertices[0]).distance == 0.0f, "A vertex should be at distance 0");
+
+    ClosestPoint far_away = closest_point(root, tris.data(), vec3<float>(500, 500, 500), 10.0f);
+    assert(!far_away.found() && far_away.triangle == -1, "Nothing should be found beyond max_distance");
+    assert(!closest_point(nullptr, tris.data(), points[0]).found(), "Empty BVH should find nothing");
+
+    std::vector<ClosestPoint> batch_points(points.size());
+    std::vector<ClosestPoint> mesh_points(points.size());
+    closest_points(root, tris.data(), points.data(), points.size(), batch_points.data(), pool, 5.0f);
+    closest_points(mesh_root, mesh, points.data(), points.size(), mesh_points.data(), pool, 5.0f);
+    for (size_t q = 0; q < points.size(); q++) {
+        ClosestPoint single = closest_point(root, tris.data(), points[q], 5.0f);
+        assert(batch_points[q].triangle == single.triangle && batch_points[q].distance == single.distance, "Batched closest point differs");
+        assert(mesh_points[q].distance == single.distance, "Closest point over a mesh differs");
+        assert(single.found() == (closest_point(root, tris.data(), points[q]).distance <= 5.0f), "max_distance should only drop farther triangles");
+    }
+    std::cout << "Test Case 7 passed: closest points" << std::endl;
+
+    delete root;
+    delete mesh_root;
+    delete other_root;
+
+    std::cout << "All query tests completed successfully." << std::endl;
+}
+
+}
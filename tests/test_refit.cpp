@@ -0,0 +1,135 @@
+#include <test_refit.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <bvh.hpp>
+#include <linear_bvh.hpp>
+#include <traversal.hpp>
+#include <object.hpp>
+#include <vector>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: a smooth deformation that keeps neighbours close
+static void deform(std::vector<Triangle>& tris, float time) {
+    for (Triangle& tri : tris) {
+        for (int k = 0; k < 3; k++) {
+            vec3<float>& p = tri.vertices[k];
+            p = vec3<float>(p.x + 0.5f * std::sin(time + 0.3f * p.y), p.y * (1.0f + 0.05f * time), p.z + 0.5f * std::cos(time + 0.2f * p.x));
+        }
+    }
+}
+
+// Helper function, only used in this file: every box is the tightest box of its content
+static BoundingBox check_tight(const BvhNode* node, const std::vector<Triangle>& tris) {
+    BoundingBox box = BoundingBox::empty();
+    if (node->left == nullptr) {
+        const BvhLeaf* leaf = static_cast<const BvhLeaf*>(node);
+        for (int i = 0; i < leaf->num_triangles; i++) {
+            for (int k = 0; k < 3; k++) {
+                box.expand(tris[leaf->indices[i]].vertices[k]);
+            }
+        }
+    } else {
+        box = check_tight(node->left, tris);
+        box.expand(check_tight(node->right, tris));
+    }
+    assert(node->bounding_box == box, "Refitted box is not the tightest box of its content");
+    return box;
+}
+
+// Helper function, only used in this file: same boxes at the same places of the tree
+static void check_same_boxes(const BvhNode* node, const LinearBvh& linear, uint32_t index, size_t& visited) {
+    const LinearBvhNode& flat = linear.nodes[index];
+    visited++;
+    assert(node->bounding_box.min == flat.min && node->bounding_box.max == flat.max, "Linear refit differs from the tree refit");
+    if (node->left != nullptr) {
+        check_same_boxes(node->left, linear, flat.offset, visited);
+        check_same_boxes(node->right, linear, flat.offset + 1, visited);
+    }
+}
+
+void refit() {
+    std::cout << "Starting refit tests..." << std::endl;
+
+    std::vector<Triangle> tris = generateRandomTriangles(20000, -10.0f, 10.0f, 9, 0.3f);
+    BvhNode* root = precompute_bvh_sah(tris.data(), 0, tris.size());
+    BvhNode* parallel_root = precompute_bvh_sah(tris.data(), 0, tris.size());
+    LinearBvh linear = LinearBvh::flatten(root);
+    float build_cost = sah_cost(root);
+    assert(refit_degradation(root, build_cost) == 1.0f, "A fresh tree should not be degraded");
+
+    // Test Case 1: serial, parallel and linear refits give the tightest boxes
+    deform(tris, 1.0f);
+    refit_bvh(root, tris.data());
+    refit_bvh_parallel(parallel_root, tris.data(), 4);
+    linear.refit(tris.data());
+    check_tight(root, tris);
+    check_tight(parallel_root, tris);
+    size_t visited = 0;
+    check_same_boxes(root, linear, 0, visited);
+    assert(visited == linear.nodes.size(), "Linear BVH has a different number of nodes");
+    std::cout << "Test Case 1 passed: serial, parallel and linear refits" << std::endl;
+
+    // Test Case 2: the refitted tree gives the same hits as a fresh tree
+    BvhNode* rebuilt = precompute_bvh_sah(tris.data(), 0, tris.size());
+    std::mt19937 gen(23);
+    std::uniform_real_distribution<float> dis(-15.0f, 15.0f);
+    int num_hits = 0;
+    for (int i = 0; i < 2000; i++) {
+        vec3<float> origin(dis(gen), dis(gen), dis(gen));
+        Ray ray(origin, vec3<float>(dis(gen), dis(gen), dis(gen)) - origin);
+        Hit expected = intersect(rebuilt, tris.data(), ray);
+        Hit hit = intersect(root, tris.data(), ray);
+        assert(hit.triangle == expected.triangle && (!hit.hit() || hit.t == expected.t), "Refitted tree hit differs for ray " + std::to_string(i));
+        assert(intersect(linear, tris.data(), ray).triangle == expected.triangle, "Refitted linear BVH hit differs for ray " + std::to_string(i));
+        num_hits += hit.hit();
+    }
+    assert(num_hits > 0, "Some rays should hit");
+    std::cout << "Test Case 2 passed: " << num_hits << " hits" << std::endl;
+
+    // Test Case 3: the degradation grows with the deformation and a rebuild resets it
+    float small = refit_degradation(root, build_cost);
+    assert(small < BVH_REFIT_REBUILD_RATIO && refit_degradation(rebuilt, sah_cost(rebuilt)) == 1.0f, "Wrong degradation");
+    std::vector<Triangle> scrambled = tris;
+    std::shuffle(scrambled.begin(), scrambled.end(), gen); // every leaf now holds triangles from all over the mesh
+    refit_bvh(root, scrambled.data());
+    float large = refit_degradation(root, build_cost);
+    assert(large > BVH_REFIT_REBUILD_RATIO && large > small, "A scrambled mesh should call for a rebuild");
+    std::cout << "Test Case 3 passed: degradation " << small << " after a smooth deformation, " << large << " after scrambling" << std::endl;
+
+    // Test Case 4: objects refit their own BVH, including indexed meshes
+    Triangle* obj_tris = new Triangle[tris.size()];
+    std::copy(tris.begin(), tris.end(), obj_tris);
+    Object obj(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0), vec3<float>(1, 1, 1), obj_tris, tris.size(), rebuilt);
+    std::vector<Triangle> moved = tris;
+    deform(moved, 0.5f);
+    std::copy(moved.begin(), moved.end(), obj_tris);
+    obj.refit(true);
+    check_tight(obj.bvh, moved);
+    assert(!obj.needs_rebuild(), "A smooth deformation should not call for a rebuild");
+
+    Mesh* mesh = new Mesh(Mesh::from_triangles(tris.data(), tris.size()));
+    Object mesh_obj(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0), vec3<float>(1, 1, 1), mesh, parallel_root);
+    for (size_t i = 0; i < mesh->num_vertices(); i++) {
+        mesh->px[i] += 1.0f;
+    }
+    mesh_obj.refit();
+    std::vector<Triangle> shifted = tris;
+    for (Triangle& tri : shifted) {
+        for (int k = 0; k < 3; k++) {
+            tri.vertices[k].x += 1.0f;
+        }
+    }
+    check_tight(mesh_obj.bvh, shifted);
+    std::cout << "Test Case 4 passed: Object::refit()" << std::endl;
+
+    delete root;
+    delete rebuilt;
+    delete parallel_root;
+}
+
+}
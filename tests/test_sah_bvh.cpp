@@ -0,0 +1,138 @@
+#include <test_sah_bvh.hpp>
+#include <custom_assert.hpp>
+#include <bvh.hpp>
+#include <vector>
+#include <triangle.hpp>
+#include <iostream>
+#include <random>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: a few dense clusters far apart from each other
+static std::vector<Triangle> generate_clustered_triangles(int num_clusters, int tris_per_cluster, unsigned int seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> center_dis(-100.0f, 100.0f);
+    std::uniform_real_distribution<float> offset_dis(-1.0f, 1.0f);
+
+    std::vector<Triangle> triangles;
+    for (int c = 0; c < num_clusters; c++) {
+        vec3<float> center(center_dis(gen), center_dis(gen), center_dis(gen));
+        for (int i = 0; i < tris_per_cluster; i++) {
+            Triangle tri = {};
+            vec3<float> p(center.x + offset_dis(gen), center.y + offset_dis(gen), center.z + offset_dis(gen));
+            for (int j = 0; j < 3; j++) {
+                tri.vertices[j] = vec3<float>(p.x + 0.1f * offset_dis(gen), p.y + 0.1f * offset_dis(gen), p.z + 0.1f * offset_dis(gen));
+            }
+            triangles.push_back(tri);
+        }
+    }
+
+    // Interleave the clusters so that the input order carries no spatial information
+    std::shuffle(triangles.begin(), triangles.end(), gen);
+    return triangles;
+}
+
+// Helper function, only used in this file: checks boxes and leaf sizes, and counts how often each triangle is referenced
+static bool check_sah_node(BvhNode* node, Triangle* tris, std::vector<int>& references) {
+    if (node == nullptr) {
+        std::cout << "Node is null" << std::endl;
+        return false;
+    }
+
+    BoundingBox computed = BoundingBox::empty();
+    BvhLeaf* leaf = dynamic_cast<BvhLeaf*>(node);
+    if (leaf != nullptr) {
+        if (leaf->num_triangles <= 0 || leaf->num_triangles > BVH_LEAF_SIZE) {
+            std::cout << "Leaf has " << leaf->num_triangles << " triangles" << std::endl;
+            return false;
+        }
+        for (int i = 0; i < leaf->num_triangles; i++) {
+            references[leaf->indices[i]]++;
+            for (int j = 0; j < 3; j++) {
+                computed.expand(tris[leaf->indices[i]].vertices[j]);
+            }
+        }
+    } else {
+        if (!node->left || !node->right) {
+            std::cout << "Only one child for BvhNode" << std::endl;
+            return false;
+        }
+        if (!check_sah_node(node->left, tris, references) || !check_sah_node(node->right, tris, references)) {
+            return false;
+        }
+        computed.expand(node->left->bounding_box);
+        computed.expand(node->right->bounding_box);
+    }
+
+    if (!(computed == node->bounding_box)) {
+        std::cout << "!! Bounding Box Mismatch !!" << std::endl;
+        std::cout << "Computed: " << computed.min << " " << computed.max << std::endl;
+        std::cout << "Stored: " << node->bounding_box.min << " " << node->bounding_box.max << std::endl;
+        return false;
+    }
+    return true;
+}
+
+static bool check_sah_bvh(BvhNode* root, Triangle* tris, int num_tris) {
+    std::vector<int> references(num_tris, 0);
+    if (!check_sah_node(root, tris, references)) {
+        return false;
+    }
+    for (int i = 0; i < num_tris; i++) {
+        if (references[i] != 1) {
+            std::cout << "Triangle " << i << " is referenced " << references[i] << " times" << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+void precompute_bvh_sah() {
+    std::cout << "Starting precompute_bvh_sah tests..." << std::endl;
+
+    // Test Case 1: structure and bounding boxes on clustered triangles
+    std::vector<Triangle> clustered = generate_clustered_triangles(8, 64, 42);
+    int num_tris = clustered.size();
+    BvhNode* sah_root = precompute_bvh_sah(clustered.data(), 0, num_tris);
+    assert(sah_root != nullptr, "SAH root node should not be null");
+    assert(check_sah_bvh(sah_root, clustered.data(), num_tris), "SAH BVH structure is invalid");
+    std::cout << "Test Case 1 passed: SAH BVH has proper structure" << std::endl;
+
+    // Test Case 2: the SAH tree is cheaper than the median split tree on the same mesh
+    BvhNode* median_root = precompute_bvh(clustered.data(), 0, num_tris);
+    float sah_tree_cost = sah_cost(sah_root);
+    float median_tree_cost = sah_cost(median_root);
+    std::cout << "SAH cost (binned SAH): " << sah_tree_cost << std::endl;
+    std::cout << "SAH cost (median split): " << median_tree_cost << std::endl;
+    assert(sah_tree_cost > 0.0f, "SAH cost should be positive");
+    assert(sah_tree_cost < median_tree_cost, "SAH builder should produce a cheaper tree than the median split");
+    std::cout << "Test Case 2 passed: SAH tree is cheaper than the median split tree" << std::endl;
+
+    // Test Case 3: sub-range, bin count clamping and a single triangle
+    BvhNode* sub_root = precompute_bvh_sah(clustered.data(), 100, 300, 1000);
+    std::vector<int> references(num_tris, 0);
+    assert(sub_root != nullptr && check_sah_node(sub_root, clustered.data(), references), "SAH BVH over a sub-range is invalid");
+    for (int i = 0; i < num_tris; i++) {
+        assert(references[i] == (i >= 100 && i < 300 ? 1 : 0), "SAH BVH over a sub-range references the wrong triangles");
+    }
+    BvhNode* leaf_root = precompute_bvh_sah(clustered.data(), 0, 1);
+    assert(dynamic_cast<BvhLeaf*>(leaf_root) != nullptr, "Should create a leaf node for a single triangle");
+    assert(precompute_bvh_sah(clustered.data(), 5, 5) == nullptr, "Empty range should return null");
+    std::cout << "Test Case 3 passed: sub-ranges and edge cases" << std::endl;
+
+    // Test Case 4: identical triangles cannot be separated by any plane but must still respect the leaf size
+    std::vector<Triangle> identical(3 * BVH_LEAF_SIZE, clustered[0]);
+    BvhNode* identical_root = precompute_bvh_sah(identical.data(), 0, identical.size());
+    assert(check_sah_bvh(identical_root, identical.data(), identical.size()), "SAH BVH over identical triangles is invalid");
+    std::cout << "Test Case 4 passed: coincident centroids" << std::endl;
+
+    delete sah_root;
+    delete median_root;
+    delete sub_root;
+    delete leaf_root;
+    delete identical_root;
+
+    std::cout << "All precompute_bvh_sah tests completed successfully." << std::endl;
+}
+
+}
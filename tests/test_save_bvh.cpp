@@ -8,7 +8,11 @@
 #include <bvh_node.hpp>
 #include <bvh.hpp>
 #include <custom_assert.hpp>
+#include <sameTree.hpp>
+#include <linear_bvh.hpp>
 #include <string.h>
+#include <random>
+#include <vector>
 
 void save_bvh_test_base_case()
 {
@@ -171,6 +175,75 @@ void compare_bvh_files(const char *filename1, const char *filename2)
     fclose(file2);
 }
 
+// Unbalanced trees survive the text format in every node layout, broken child links and leaves are rejected
+void save_bvh_test_layouts()
+{
+    std::mt19937 gen(12);
+    std::uniform_real_distribution<float> pos_dis(0.0f, 10.0f);
+    std::vector<bvh::Triangle> tris(500);
+    for (size_t i = 0; i < tris.size(); i++)
+    {
+        // Dense cluster next to sparse triangles, so that the SAH tree is unbalanced
+        float spread = (i % 5 == 0) ? 10.0f : 0.5f;
+        bvh::vec3<float> p(pos_dis(gen) * spread / 10.0f, pos_dis(gen) * spread / 10.0f, pos_dis(gen) * spread / 10.0f);
+        tris[i] = {};
+        tris[i].vertices[0] = p;
+        tris[i].vertices[1] = p + bvh::vec3<float>(0.05f, 0.0f, 0.0f);
+        tris[i].vertices[2] = p + bvh::vec3<float>(0.0f, 0.05f, 0.0f);
+    }
+    bvh::BvhNode *root = bvh::precompute_bvh_sah(tris.data(), 0, tris.size());
+
+    const char *bvh_filename = "./test_save_bvh_layout.bvh";
+    bvh::NodeLayout layouts[] = {bvh::NodeLayout::DepthFirst, bvh::NodeLayout::BreadthFirst,
+                                 bvh::NodeLayout::VanEmdeBoas, bvh::NodeLayout::PageClustered};
+    for (bvh::NodeLayout layout : layouts)
+    {
+        bvh::Object::save_bvh(const_cast<char *>(bvh_filename), root, layout);
+        bvh::Object *loaded = bvh::Object::load(const_cast<char *>("../tests/data/final/grid.obj"), const_cast<char *>(bvh_filename));
+        assert(loaded != nullptr && bvh::tests::same_tree(root, loaded->bvh, false), "Saved tree should load back in every layout");
+        delete loaded;
+    }
+
+    const char *broken[] = {
+        "n 0 0 0 1 1 1 1 1\nl 0 0 0 1 1 1 0\nl 0 0 0 1 1 1 1\n",        // same child twice
+        "n 0 0 0 1 1 1 1 3\nl 0 0 0 1 1 1 0\nl 0 0 0 1 1 1 1\n",        // child out of range
+        "n 0 0 0 1 1 1 0 1\nl 0 0 0 1 1 1 0\n",                           // root as its own child
+        "n 0 0 0 1 1 1 1 2\nl 0 0 0 1 1 1 0\nl 0 0 0 1 1 1 1\nn 0 0 0 1 1 1 4 5\nn 0 0 0 1 1 1 3 6\n"
+        "l 0 0 0 1 1 1 2\nl 0 0 0 1 1 1 3\n",                                                   // cycle of lines 3 and 4
+        "n 0 0 0 1 1 1 1 -1\nl 0 0 0 1 1 1 0\n",                          // missing right child
+        "n 0 0 0 1 1 1 -1 1\nl 0 0 0 1 1 1 0\n",                          // missing left child
+        "n 0 0 0 1 1 1 -1 -1\nl 0 0 0 1 1 1 0\n",                         // node without children
+    };
+    for (const char *contents : broken)
+    {
+        FILE *file = fopen(bvh_filename, "w");
+        fputs(contents, file);
+        fclose(file);
+        bvh::Object *loaded = bvh::Object::load(const_cast<char *>("../tests/data/final/grid.obj"), const_cast<char *>(bvh_filename));
+        assert(loaded == nullptr, std::string("Invalid child links should be rejected: ") + contents);
+    }
+
+    const char *bad_leaves[] = {
+        "l 0 0 0 1 1 1\n",                                              // no triangle
+        "n 0 0 0 1 1 1 1 2\nl 0 0 0 1 1 1 0\nl 0 0 0 1 1 1 \n",         // no triangle below a node
+        "l 0 0 0 1 1 1 0 -1\n",                                         // negative index
+        "l 0 0 0 1 1 1 512\n",                                          // one past the last triangle of grid.obj
+        "l 0 0 0 1 1 1 4294967296\n",                                   // past the range of int
+        "l 0 0 0 1 1 1 99999999999999999999999\n",                      // past the range of long
+    };
+    for (const char *contents : bad_leaves)
+    {
+        FILE *file = fopen(bvh_filename, "w");
+        fputs(contents, file);
+        fclose(file);
+        bvh::Object *loaded = bvh::Object::load(const_cast<char *>("../tests/data/final/grid.obj"), const_cast<char *>(bvh_filename));
+        assert(loaded == nullptr, std::string("Invalid leaves should be rejected: ") + contents);
+    }
+
+    std::remove(bvh_filename);
+    delete root;
+}
+
 void bvh::tests::save_bvh_test()
 {
     // save_bvh_test_base_case();
@@ -178,4 +251,6 @@ void bvh::tests::save_bvh_test()
 
     save_bvh_test_n_case();
     compare_bvh_files("./test_save_bvh_n_case.bvh", "../tests/data/final/test_save_bvh_n_case_results.bvh");
+
+    save_bvh_test_layouts();
 }
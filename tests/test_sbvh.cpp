@@ -0,0 +1,212 @@
+#include <test_sbvh.hpp>
+#include <custom_assert.hpp>
+#include <sameTree.hpp>
+#include <bvh.hpp>
+#include <bvh_tree.hpp>
+#include <linear_bvh.hpp>
+#include <traversal.hpp>
+#include <mesh.hpp>
+#include <vector>
+#include <cmath>
+#include <iostream>
+#include <random>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: a room of long floor and wall triangles crossing the whole scene,
+// long diagonal beams, and small clutter
+static std::vector<Triangle> generate_room_triangles(int num_beams, int num_clutter, unsigned int seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> pos_dis(0.0f, 100.0f);
+    std::uniform_real_distribution<float> offset_dis(-0.5f, 0.5f);
+
+    std::vector<Triangle> triangles;
+    auto add = [&triangles](vec3<float> a, vec3<float> b, vec3<float> c) {
+        Triangle tri = {};
+        tri.vertices[0] = a;
+        tri.vertices[1] = b;
+        tri.vertices[2] = c;
+        triangles.push_back(tri);
+    };
+
+    // Floors every 10 units and two walls, two triangles each
+    for (int level = 0; level <= 10; level++) {
+        float y = level * 10.0f;
+        add(vec3<float>(0, y, 0), vec3<float>(100, y, 0), vec3<float>(100, y, 100));
+        add(vec3<float>(0, y, 0), vec3<float>(100, y, 100), vec3<float>(0, y, 100));
+    }
+    add(vec3<float>(0, 0, 0), vec3<float>(0, 100, 0), vec3<float>(0, 100, 100));
+    add(vec3<float>(0, 0, 0), vec3<float>(0, 100, 100), vec3<float>(0, 0, 100));
+    add(vec3<float>(100, 0, 0), vec3<float>(100, 100, 0), vec3<float>(100, 100, 100));
+    add(vec3<float>(100, 0, 0), vec3<float>(100, 100, 100), vec3<float>(100, 0, 100));
+
+    for (int i = 0; i < num_beams; i++) {
+        vec3<float> a(pos_dis(gen), pos_dis(gen), pos_dis(gen));
+        vec3<float> b(pos_dis(gen), pos_dis(gen), pos_dis(gen));
+        add(a, b, b + vec3<float>(offset_dis(gen), offset_dis(gen), offset_dis(gen)));
+    }
+    for (int i = 0; i < num_clutter; i++) {
+        vec3<float> p(pos_dis(gen), pos_dis(gen), pos_dis(gen));
+        add(p, p + vec3<float>(offset_dis(gen), offset_dis(gen), offset_dis(gen)), p + vec3<float>(offset_dis(gen), offset_dis(gen), offset_dis(gen)));
+    }
+    return triangles;
+}
+
+// Helper function, only used in this file: box of a whole triangle
+static BoundingBox triangle_box(const Triangle& tri) {
+    BoundingBox box = BoundingBox::empty();
+    for (int j = 0; j < 3; j++) {
+        box.expand(tri.vertices[j]);
+    }
+    return box;
+}
+
+// Helper function, only used in this file: leaf sizes, boxes made of their children, leaf boxes inside the boxes of
+// their triangles (clipped parts), and the number of references to each triangle
+static bool check_sbvh_node(const BvhNode* node, const Triangle* tris, std::vector<int>& references) {
+    const BvhLeaf* leaf = dynamic_cast<const BvhLeaf*>(node);
+    if (leaf != nullptr) {
+        if (leaf->num_triangles < 1 || leaf->num_triangles > BVH_LEAF_SIZE) {
+            std::cout << "Leaf with " << leaf->num_triangles << " triangles" << std::endl;
+            return false;
+        }
+        BoundingBox content = BoundingBox::empty();
+        for (int i = 0; i < leaf->num_triangles; i++) {
+            references[leaf->indices[i]]++;
+            content.expand(triangle_box(tris[leaf->indices[i]]));
+        }
+        const BoundingBox& box = leaf->bounding_box;
+        bool inside = box.min.x >= content.min.x && box.min.y >= content.min.y && box.min.z >= content.min.z &&
+                      box.max.x <= content.max.x && box.max.y <= content.max.y && box.max.z <= content.max.z;
+        if (!inside) {
+            std::cout << "Leaf box " << box.min << " " << box.max << " exceeds its triangles" << std::endl;
+        }
+        return inside;
+    }
+
+    if (node->left == nullptr || node->right == nullptr) {
+        return false;
+    }
+    BoundingBox computed = node->left->bounding_box;
+    computed.expand(node->right->bounding_box);
+    if (!(computed == node->bounding_box)) {
+        std::cout << "Node box is not the union of its children" << std::endl;
+        return false;
+    }
+    return check_sbvh_node(node->left, tris, references) && check_sbvh_node(node->right, tris, references);
+}
+
+// Helper function, only used in this file: returns the number of references, -1 if the tree is invalid
+static int check_sbvh(const BvhNode* root, const std::vector<Triangle>& tris) {
+    std::vector<int> references(tris.size(), 0);
+    if (root == nullptr || !check_sbvh_node(root, tris.data(), references)) {
+        return -1;
+    }
+    int total = 0;
+    for (int count : references) {
+        if (count == 0) {
+            return -1;
+        }
+        total += count;
+    }
+    return total;
+}
+
+// Helper function, only used in this file: reference result by testing every triangle
+static float brute_force_t(const std::vector<Triangle>& tris, const Ray& ray) {
+    float closest = ray.tmax;
+    for (const Triangle& tri : tris) {
+        float t, u, v;
+        if (intersect_triangle(ray, tri.vertices[0], tri.vertices[1], tri.vertices[2], closest, t, u, v)) {
+            closest = t;
+        }
+    }
+    return closest;
+}
+
+void precompute_bvh_sbvh() {
+    std::cout << "Starting precompute_bvh_sbvh tests..." << std::endl;
+
+    // Test Case 1: structure, clipped leaves and the duplication budget
+    std::vector<Triangle> room = generate_room_triangles(300, 3000, 7);
+    int num_tris = room.size();
+    SbvhOptions options;
+    BvhNode* sbvh_root = precompute_bvh_sbvh(room.data(), 0, num_tris, options);
+    int references = check_sbvh(sbvh_root, room);
+    std::cout << "SBVH references: " << references << " for " << num_tris << " triangles" << std::endl;
+    assert(references >= num_tris, "SBVH structure is invalid");
+    assert(references > num_tris, "Spatial splits should duplicate some of the long triangles");
+    assert(references <= num_tris + static_cast<int>(options.duplication_budget * num_tris), "SBVH exceeded its duplication budget");
+    std::cout << "Test Case 1 passed: SBVH has proper structure" << std::endl;
+
+    // Test Case 2: spatial splits make the tree cheaper than the object split SAH tree
+    BvhNode* sah_root = precompute_bvh_sah(room.data(), 0, num_tris);
+    float sbvh_tree_cost = sah_cost(sbvh_root);
+    float sah_tree_cost = sah_cost(sah_root);
+    std::cout << "SAH cost (SBVH): " << sbvh_tree_cost << std::endl;
+    std::cout << "SAH cost (binned SAH): " << sah_tree_cost << std::endl;
+    assert(sbvh_tree_cost < sah_tree_cost, "SBVH should be cheaper than the binned SAH tree on overlapping triangles");
+
+    SbvhOptions no_splits;
+    no_splits.duplication_budget = 0.0f;
+    BvhNode* object_root = precompute_bvh_sbvh(room.data(), 0, num_tris, no_splits);
+    assert(check_sbvh(object_root, room) == num_tris, "Without a budget every triangle should be in exactly one leaf");
+    SbvhOptions small_budget;
+    small_budget.duplication_budget = 0.01f;
+    BvhNode* small_root = precompute_bvh_sbvh(room.data(), 0, num_tris, small_budget);
+    assert(check_sbvh(small_root, room) <= num_tris + static_cast<int>(0.01f * num_tris), "SBVH exceeded a small budget");
+    std::cout << "Test Case 2 passed: spatial splits lower the SAH cost within the budget" << std::endl;
+
+    // Test Case 3: duplicated references traverse like the triangles they stand for, as a tree and flattened
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<float> pos_dis(-10.0f, 110.0f);
+    LinearBvh linear = LinearBvh::flatten(sbvh_root);
+    assert(linear.primitive_indices.size() == static_cast<size_t>(references), "Flattening should keep every reference");
+    for (int i = 0; i < 500; i++) {
+        vec3<float> origin(pos_dis(gen), pos_dis(gen), pos_dis(gen));
+        vec3<float> target(pos_dis(gen), pos_dis(gen), pos_dis(gen));
+        Ray ray(origin, target - origin);
+        float expected = brute_force_t(room, ray);
+        Hit tree_hit = intersect(sbvh_root, room.data(), ray);
+        Hit linear_hit = intersect(linear, room.data(), ray);
+        assert(tree_hit.hit() == (expected < ray.tmax) && linear_hit.hit() == tree_hit.hit(), "SBVH traversal disagrees with brute force on whether the ray hits");
+        if (tree_hit.hit()) {
+            assert(std::fabs(tree_hit.t - expected) <= 1e-5f * expected && linear_hit.t == tree_hit.t, "SBVH traversal did not return the closest hit");
+        }
+        assert(occluded(sbvh_root, room.data(), ray) == tree_hit.hit(), "SBVH occlusion disagrees with the closest hit");
+    }
+    std::cout << "Test Case 3 passed: traversal over duplicated references" << std::endl;
+
+    // Test Case 4: arena and mesh variants, sub-ranges and edge cases
+    BvhTree arena_sbvh = BvhTree::sbvh(room.data(), 0, num_tris);
+    assert(same_tree(sbvh_root, arena_sbvh.root()), "BvhTree::sbvh() should match precompute_bvh_sbvh()");
+    Mesh mesh = Mesh::from_triangles(room.data(), num_tris);
+    BvhTree mesh_sbvh = BvhTree::sbvh(mesh);
+    assert(same_tree(sbvh_root, mesh_sbvh.root()), "SBVH over a mesh should match the triangle array build");
+
+    BvhNode* sub_root = precompute_bvh_sbvh(room.data(), 100, 400);
+    std::vector<int> sub_references(num_tris, 0);
+    assert(sub_root != nullptr && check_sbvh_node(sub_root, room.data(), sub_references), "SBVH over a sub-range is invalid");
+    for (int i = 0; i < num_tris; i++) {
+        assert((sub_references[i] > 0) == (i >= 100 && i < 400), "SBVH over a sub-range references the wrong triangles");
+    }
+    BvhNode* leaf_root = precompute_bvh_sbvh(room.data(), 0, 1);
+    assert(dynamic_cast<BvhLeaf*>(leaf_root) != nullptr, "Should create a leaf node for a single triangle");
+    assert(precompute_bvh_sbvh(room.data(), 5, 5) == nullptr, "Empty range should return null");
+    std::vector<Triangle> identical(3 * BVH_LEAF_SIZE, room[0]);
+    BvhNode* identical_root = precompute_bvh_sbvh(identical.data(), 0, identical.size());
+    assert(check_sbvh(identical_root, identical) > 0, "SBVH over identical triangles is invalid");
+    std::cout << "Test Case 4 passed: variants and edge cases" << std::endl;
+
+    delete sbvh_root;
+    delete sah_root;
+    delete object_root;
+    delete small_root;
+    delete sub_root;
+    delete leaf_root;
+    delete identical_root;
+
+    std::cout << "All precompute_bvh_sbvh tests completed successfully." << std::endl;
+}
+
+}
@@ -0,0 +1,151 @@
+#include <test_tlas.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <bvh.hpp>
+#include <tlas.hpp>
+#include <vector>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: an object with its own SAH BVH, centered on the origin
+static Object* make_object(int num_tris, unsigned int seed) {
+    std::vector<Triangle> generated = generateRandomTriangles(num_tris, -2.0f, 2.0f, seed, 0.3f);
+    Triangle* tris = new Triangle[num_tris];
+    std::copy(generated.begin(), generated.end(), tris);
+    BvhNode* bvh = precompute_bvh_sah(tris, 0, num_tris);
+    return new Object(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0), vec3<float>(1, 1, 1), tris, num_tris, bvh);
+}
+
+// Helper function, only used in this file: closest hit over every triangle of every instance, in world space
+static Hit brute_force(const Tlas& tlas, const Ray& ray) {
+    Hit best;
+    best.t = ray.tmax;
+    for (size_t i = 0; i < tlas.instances.size(); i++) {
+        const Instance& instance = tlas.instances[i];
+        for (int j = 0; j < instance.object->num_triangles; j++) {
+            const Triangle& tri = instance.object->triangles[j];
+            float t, u, v;
+            if (intersect_triangle(ray, instance.to_world.point(tri.vertices[0]), instance.to_world.point(tri.vertices[1]),
+                                   instance.to_world.point(tri.vertices[2]), best.t, t, u, v)) {
+                best.triangle = j;
+                best.instance = i;
+                best.t = t;
+            }
+        }
+    }
+    return best;
+}
+
+// Helper function, only used in this file: object space and world space tests round differently
+static void check_hits(const Tlas& tlas, int num_rays, unsigned int seed, const std::string& what) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> dis(-25.0f, 25.0f);
+    int num_hits = 0;
+    for (int i = 0; i < num_rays; i++) {
+        vec3<float> origin(dis(gen), dis(gen), dis(gen));
+        Ray ray(origin, vec3<float>(dis(gen), dis(gen), dis(gen)) * 0.2f - origin);
+        Hit expected = brute_force(tlas, ray);
+        Hit hit = tlas.intersect(ray);
+        assert(hit.hit() == expected.hit(), what + ": hit/miss differs for ray " + std::to_string(i));
+        assert(tlas.occluded(ray) == expected.hit(), what + ": occlusion differs for ray " + std::to_string(i));
+        if (hit.hit()) {
+            assert(std::abs(hit.t - expected.t) <= 1e-4f * expected.t, what + ": wrong distance for ray " + std::to_string(i));
+            bool same = hit.instance == expected.instance && hit.triangle == expected.triangle;
+            assert(same || std::abs(hit.t - expected.t) <= 1e-5f * expected.t, what + ": wrong triangle for ray " + std::to_string(i));
+            num_hits++;
+        }
+    }
+    assert(num_hits > num_rays / 20, what + ": too few rays hit");
+}
+
+void tlas() {
+    std::cout << "Starting tlas tests..." << std::endl;
+
+    // Test Case 1: transforms
+    Transform t = Transform::from_object(vec3<float>(1.0f, 2.0f, 3.0f), vec3<float>(0.3f, -1.2f, 2.0f), vec3<float>(2.0f, 0.5f, 1.5f));
+    vec3<float> p(0.7f, -0.2f, 1.1f);
+    vec3<float> back = t.inverse().point(t.point(p));
+    assert(std::abs(back.x - p.x) < 1e-5f && std::abs(back.y - p.y) < 1e-5f && std::abs(back.z - p.z) < 1e-5f, "inverse() does not undo the transform");
+    Transform quarter = Transform::from_object(vec3<float>(0, 0, 0), vec3<float>(0.0f, 0.0f, 1.5707963f), vec3<float>(1, 1, 1));
+    vec3<float> rotated = quarter.point(vec3<float>(1.0f, 0.0f, 0.0f));
+    assert(std::abs(rotated.x) < 1e-6f && std::abs(rotated.y - 1.0f) < 1e-6f, "A quarter turn around z should map x to y");
+    BoundingBox box = t.box(BoundingBox(vec3<float>(-1, -1, -1), vec3<float>(1, 1, 1)));
+    for (int corner = 0; corner < 8; corner++) {
+        vec3<float> c = t.point(vec3<float>((corner & 1) ? 1.0f : -1.0f, (corner & 2) ? 1.0f : -1.0f, (corner & 4) ? 1.0f : -1.0f));
+        assert(c.x >= box.min.x - 1e-5f && c.x <= box.max.x + 1e-5f && c.y >= box.min.y - 1e-5f && c.y <= box.max.y + 1e-5f &&
+               c.z >= box.min.z - 1e-5f && c.z <= box.max.z + 1e-5f, "Transformed box misses a corner");
+    }
+    std::cout << "Test Case 1 passed: transforms" << std::endl;
+
+    // Test Case 2: many instances sharing two objects, placed by the objects' own transforms and explicitly
+    Object* rock = make_object(300, 1);
+    Object* tree = make_object(500, 2);
+    rock->position = vec3<float>(-15.0f, 0.0f, 0.0f);
+    rock->rotation = vec3<float>(0.0f, 0.7f, 0.0f);
+    rock->scale = vec3<float>(2.0f, 2.0f, 2.0f);
+
+    Tlas scene;
+    assert(scene.add_instance(rock) == 0, "First instance should have index 0");
+    std::mt19937 gen(3);
+    std::uniform_real_distribution<float> dis(-20.0f, 20.0f);
+    std::uniform_real_distribution<float> angle_dis(-3.0f, 3.0f);
+    std::uniform_real_distribution<float> scale_dis(0.5f, 2.0f);
+    for (int i = 0; i < 60; i++) {
+        Transform to_world = Transform::from_object(vec3<float>(dis(gen), dis(gen), dis(gen)),
+                                                    vec3<float>(angle_dis(gen), angle_dis(gen), angle_dis(gen)),
+                                                    vec3<float>(scale_dis(gen), scale_dis(gen), scale_dis(gen)));
+        scene.add_instance((i % 3 == 0) ? rock : tree, to_world);
+    }
+    scene.build();
+    check_hits(scene, 1500, 5, "Built TLAS");
+    std::cout << "Test Case 2 passed: " << scene.instances.size() << " instances of 2 objects" << std::endl;
+
+    // Test Case 3: moving instances only updates the top level
+    BvhNode* rock_bvh = rock->bvh;
+    BoundingBox rock_box = rock_bvh->bounding_box;
+    for (size_t i = 0; i < scene.instances.size(); i += 2) {
+        Transform moved = scene.instances[i].to_world;
+        moved.m[0][3] += 1.5f;
+        moved.m[2][3] -= 2.0f;
+        scene.set_transform(i, moved);
+    }
+    scene.refit();
+    check_hits(scene, 800, 6, "Refitted TLAS");
+    scene.build();
+    check_hits(scene, 800, 7, "Rebuilt TLAS");
+    assert(rock->bvh == rock_bvh && rock_bvh->bounding_box == rock_box, "Bottom-level BVHs should not change");
+    std::cout << "Test Case 3 passed: moving instances" << std::endl;
+
+    // Test Case 4: an object deformed past its old box, then refitted, only needs a refit of the top level
+    BoundingBox old_box = tree->bvh->bounding_box;
+    for (int i = 0; i < tree->num_triangles; i++) {
+        for (int k = 0; k < 3; k++) {
+            tree->triangles[i].vertices[k] = tree->triangles[i].vertices[k] * 2.5f + vec3<float>(1.0f, 0.0f, 0.0f);
+        }
+    }
+    tree->refit();
+    assert(tree->bvh->bounding_box.max.x > old_box.max.x + 1.0f, "The deformed object should outgrow its old box");
+    scene.refit();
+    check_hits(scene, 800, 9, "TLAS refitted after deforming an object");
+    std::cout << "Test Case 4 passed: deformed objects" << std::endl;
+
+    // Test Case 5: empty scene
+    Tlas empty;
+    empty.build();
+    Ray ray(vec3<float>(0, 0, -10), vec3<float>(0, 0, 1));
+    assert(!empty.intersect(ray).hit() && !empty.occluded(ray), "Empty TLAS should give no hits");
+    assert(Hit().instance == -1 && !scene.intersect(Ray(vec3<float>(100, 100, 100), vec3<float>(1, 0, 0))).hit(), "Missing ray should give no instance");
+    std::cout << "Test Case 5 passed: empty scene" << std::endl;
+
+    delete rock->bvh;
+    delete tree->bvh;
+    delete rock;
+    delete tree;
+}
+
+}
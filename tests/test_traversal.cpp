@@ -0,0 +1,120 @@
+#include <test_traversal.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <bvh.hpp>
+#include <traversal.hpp>
+#include <object.hpp>
+#include <vector>
+#include <iostream>
+#include <random>
+#include <cmath>
+#include <limits>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: rays from outside the scene aimed at random points inside it
+static std::vector<Ray> generate_seeded_rays(int num_rays, unsigned int seed) {
+    std::mt19937 gen(seed);
+    std::uniform_real_distribution<float> pos_dis(-5.0f, 15.0f);
+    std::uniform_real_distribution<float> target_dis(0.0f, 10.0f);
+
+    std::vector<Ray> rays;
+    for (int i = 0; i < num_rays; i++) {
+        vec3<float> origin(pos_dis(gen), pos_dis(gen), -5.0f);
+        vec3<float> target(target_dis(gen), target_dis(gen), target_dis(gen));
+        rays.push_back(Ray(origin, target - origin));
+    }
+    // Axis aligned rays exercise the infinite inverse directions of the slab test
+    rays.push_back(Ray(vec3<float>(5.0f, 5.0f, -5.0f), vec3<float>(0.0f, 0.0f, 1.0f)));
+    rays.push_back(Ray(vec3<float>(-5.0f, 5.0f, 5.0f), vec3<float>(1.0f, 0.0f, 0.0f)));
+    return rays;
+}
+
+// Helper function, only used in this file: reference result by testing every triangle
+static Hit brute_force_intersect(const std::vector<Triangle>& tris, const Ray& ray) {
+    Hit hit;
+    hit.t = ray.tmax;
+    for (int i = 0; i < (int)tris.size(); i++) {
+        float t, u, v;
+        if (intersect_triangle(ray, tris[i].vertices[0], tris[i].vertices[1], tris[i].vertices[2], hit.t, t, u, v)) {
+            hit.triangle = i;
+            hit.t = t;
+            hit.u = u;
+            hit.v = v;
+        }
+    }
+    return hit;
+}
+
+static void check_against_brute_force(const BvhNode* root, const std::vector<Triangle>& tris, const std::vector<Ray>& rays) {
+    int num_hits = 0;
+    for (const Ray& ray : rays) {
+        Hit expected = brute_force_intersect(tris, ray);
+        Hit actual = intersect(root, tris.data(), ray);
+        assert(expected.hit() == actual.hit(), "intersect() disagrees with brute force on whether the ray hits");
+        assert(occluded(root, tris.data(), ray) == expected.hit(), "occluded() disagrees with brute force");
+        if (expected.hit()) {
+            assert(std::fabs(expected.t - actual.t) <= 1e-5f * expected.t, "intersect() did not return the closest hit");
+            num_hits++;
+        }
+
+        // A ray stopping just before the closest hit must not see it
+        if (expected.hit()) {
+            Ray shortened(ray.origin, ray.direction, ray.tmin, expected.t * 0.999f);
+            Hit before = intersect(root, tris.data(), shortened);
+            assert(!before.hit() || before.t < expected.t, "intersect() ignores tmax");
+        }
+    }
+    std::cout << num_hits << "/" << rays.size() << " rays hit the scene" << std::endl;
+    assert(num_hits > 0, "No ray hit the scene, the test is meaningless");
+}
+
+void traversal() {
+    std::cout << "Starting traversal tests..." << std::endl;
+
+    std::vector<Triangle> tris = generateRandomTriangles(500, 0.0f, 10.0f, 7);
+    std::vector<Ray> rays = generate_seeded_rays(1000, 11);
+
+    // Test Case 1: closest hit and occlusion on the median split tree
+    BvhNode* median_root = precompute_bvh(tris.data(), 0, tris.size());
+    check_against_brute_force(median_root, tris, rays);
+    std::cout << "Test Case 1 passed: traversal of the median split tree matches brute force" << std::endl;
+
+    // Test Case 2: closest hit and occlusion on the SAH tree
+    BvhNode* sah_root = precompute_bvh_sah(tris.data(), 0, tris.size());
+    check_against_brute_force(sah_root, tris, rays);
+    std::cout << "Test Case 2 passed: traversal of the SAH tree matches brute force" << std::endl;
+
+    // Test Case 3: a single-leaf tree, a miss and the Object API
+    Triangle* object_tris = new Triangle[1];
+    object_tris[0] = {};
+    object_tris[0].vertices[0] = vec3<float>(0.0f, 0.0f, 0.0f);
+    object_tris[0].vertices[1] = vec3<float>(2.0f, 0.0f, 0.0f);
+    object_tris[0].vertices[2] = vec3<float>(0.0f, 2.0f, 0.0f);
+    Object obj(vec3<float>(0, 0, 0), vec3<float>(0, 0, 0), vec3<float>(1, 1, 1), object_tris, 1, precompute_bvh_sah(object_tris, 0, 1));
+    Hit hit = obj.intersect(Ray(vec3<float>(0.5f, 0.5f, 1.0f), vec3<float>(0.0f, 0.0f, -1.0f)));
+    assert(hit.hit() && hit.triangle == 0, "Object::intersect() missed the triangle");
+    assert(std::fabs(hit.t - 1.0f) < 1e-6f, "Object::intersect() returned the wrong distance");
+    assert(std::fabs(hit.u - 0.25f) < 1e-6f && std::fabs(hit.v - 0.25f) < 1e-6f, "Object::intersect() returned the wrong barycentrics");
+    assert(!obj.occluded(Ray(vec3<float>(1.5f, 1.5f, 1.0f), vec3<float>(0.0f, 0.0f, -1.0f))), "Object::occluded() hit outside the triangle");
+    assert(!obj.intersect(Ray(vec3<float>(0.5f, 0.5f, 1.0f), vec3<float>(0.0f, 0.0f, 1.0f))).hit(), "Object::intersect() hit behind the ray");
+    assert(!intersect(nullptr, tris.data(), rays[0]).hit(), "intersect() on an empty tree should miss");
+
+    // Every kind of miss reports the same t, whatever the tmax of the ray
+    Ray short_ray(vec3<float>(1.5f, 1.5f, 1.0f), vec3<float>(0.0f, 0.0f, -1.0f), 0.0f, 5.0f);
+    const float miss_t = std::numeric_limits<float>::max();
+    assert(obj.intersect(short_ray).t == miss_t, "An ordinary miss should report the default t");
+    assert(intersect(obj.bvh, static_cast<const Triangle*>(nullptr), short_ray).t == miss_t, "A miss without triangles should report the default t");
+    assert(intersect(nullptr, object_tris, short_ray).t == miss_t, "A miss on an empty tree should report the default t");
+    Ray box_miss(vec3<float>(10.0f, 10.0f, 1.0f), vec3<float>(0.0f, 0.0f, -1.0f), 0.0f, 5.0f);
+    assert(obj.intersect(box_miss).t == miss_t, "A miss of the root box should report the default t");
+    std::cout << "Test Case 3 passed: Object API and edge cases" << std::endl;
+
+    delete median_root;
+    delete sah_root;
+    delete obj.bvh;
+
+    std::cout << "All traversal tests completed successfully." << std::endl;
+}
+
+}
@@ -0,0 +1,140 @@
+#include <test_wide_bvh.hpp>
+#include <custom_assert.hpp>
+#include <generateRandomTriangles.hpp>
+#include <bvh.hpp>
+#include <traversal.hpp>
+#include <wide_bvh.hpp>
+#include <vector>
+#include <algorithm>
+#include <iostream>
+#include <random>
+#include <string>
+
+namespace bvh::tests {
+
+// Helper function, only used in this file: the distance of a miss depends on where the traversal stopped
+static bool same_hit(const Hit& a, const Hit& b) {
+    return a.triangle == b.triangle && (!a.hit() || (a.t == b.t && a.u == b.u && a.v == b.v));
+}
+
+// Helper function, only used in this file: every triangle appears once and every child box contains its content
+template <int N>
+static void check_structure(const WideBvh<N>& bvh, const std::vector<Triangle>& tris, const std::string& name) {
+    std::vector<int> indices = bvh.primitive_indices;
+    std::sort(indices.begin(), indices.end());
+    assert(indices.size() == tris.size(), name + " should keep every triangle");
+    for (size_t i = 0; i < indices.size(); i++) {
+        assert(indices[i] == (int)i, name + " should keep every triangle once");
+    }
+
+    for (const WideBvhNode<N>& node : bvh.nodes) {
+        assert(node.num_children >= 1 && node.num_children <= N, name + " node has a wrong number of children");
+        for (int slot = 0; slot < node.num_children; slot++) {
+            if (node.count[slot] == 0) {
+                assert(node.child[slot] < bvh.nodes.size(), name + " child node out of range");
+                continue;
+            }
+            for (uint32_t i = node.child[slot]; i < node.child[slot] + node.count[slot]; i++) {
+                const Triangle& tri = tris[bvh.primitive_indices[i]];
+                for (int k = 0; k < 3; k++) {
+                    assert(tri.vertices[k].x >= node.min_x[slot] && tri.vertices[k].x <= node.max_x[slot] &&
+                           tri.vertices[k].y >= node.min_y[slot] && tri.vertices[k].y <= node.max_y[slot] &&
+                           tri.vertices[k].z >= node.min_z[slot] && tri.vertices[k].z <= node.max_z[slot],
+                           name + " leaf box does not contain its triangles");
+                }
+            }
+        }
+    }
+}
+
+void wide_bvh() {
+    std::cout << "Starting wide_bvh tests..." << std::endl;
+
+    std::vector<Triangle> tris = generateRandomTriangles(5000, -10.0f, 10.0f, 5);
+    BvhNode* root = precompute_bvh_sah(tris.data(), 0, tris.size());
+    Bvh4 bvh4 = Bvh4::collapse(root);
+    Bvh8 bvh8 = Bvh8::collapse(root);
+
+    // Test Case 1: the collapsed trees keep every triangle in fewer, fuller nodes
+    check_structure(bvh4, tris, "BVH4");
+    check_structure(bvh8, tris, "BVH8");
+    size_t num_children = 0;
+    for (const WideBvhNode<8>& node : bvh8.nodes) {
+        num_children += node.num_children;
+    }
+    assert(bvh8.nodes.size() < bvh4.nodes.size(), "BVH8 should have fewer nodes than BVH4");
+    assert(num_children > 4 * bvh8.nodes.size(), "BVH8 nodes should have more than 4 children on average");
+    std::cout << "Test Case 1 passed: " << bvh4.nodes.size() << " BVH4 nodes, " << bvh8.nodes.size() << " BVH8 nodes with "
+              << num_children / (float)bvh8.nodes.size() << " children on average" << std::endl;
+
+    // Test Case 2: traversals match the binary tree
+    std::mt19937 gen(17);
+    std::uniform_real_distribution<float> dis(-15.0f, 15.0f);
+    int num_hits = 0;
+    for (int i = 0; i < 3000; i++) {
+        vec3<float> origin(dis(gen), dis(gen), dis(gen));
+        Ray ray(origin, vec3<float>(dis(gen), dis(gen), dis(gen)) - origin, 0.0f, (i % 4 == 0) ? 0.3f : std::numeric_limits<float>::max());
+        Hit expected = intersect(root, tris.data(), ray);
+        Hit hit4 = intersect(bvh4, tris.data(), ray);
+        Hit hit8 = intersect(bvh8, tris.data(), ray);
+        assert(same_hit(hit4, expected), "BVH4 closest hit differs for ray " + std::to_string(i));
+        assert(same_hit(hit8, expected), "BVH8 closest hit differs for ray " + std::to_string(i));
+        assert(occluded(bvh4, tris.data(), ray) == expected.hit(), "BVH4 occlusion differs for ray " + std::to_string(i));
+        assert(occluded(bvh8, tris.data(), ray) == expected.hit(), "BVH8 occlusion differs for ray " + std::to_string(i));
+        num_hits += expected.hit();
+    }
+    assert(num_hits > 0, "Some rays should hit");
+    std::cout << "Test Case 2 passed: " << num_hits << " hits" << std::endl;
+
+    // Test Case 3: leaf roots, meshes and empty trees
+    BoundingBox box = BoundingBox::empty();
+    for (int i = 0; i < 3; i++) {
+        for (int k = 0; k < 3; k++) {
+            box.expand(tris[i].vertices[k]);
+        }
+    }
+    int leaf_indices[3] = {0, 1, 2};
+    BvhNode* small_root = new BvhLeaf(box.min, box.max, 3, leaf_indices);
+    Bvh8 small = Bvh8::collapse(small_root);
+    assert(small.nodes.size() == 1 && small.nodes[0].num_children == 1, "A leaf root should give one node with one child");
+    Ray ray(tris[1].vertices[0] * (1.0f / 3.0f) + tris[1].vertices[1] * (1.0f / 3.0f) + tris[1].vertices[2] * (1.0f / 3.0f) -
+            vec3<float>(0.0f, 0.0f, 20.0f), vec3<float>(0.0f, 0.0f, 1.0f));
+    assert(same_hit(intersect(small, tris.data(), ray), intersect(small_root, tris.data(), ray)), "Leaf root traversal differs");
+
+    Mesh mesh = Mesh::from_triangles(tris.data(), tris.size());
+    Ray mesh_ray(vec3<float>(-20.0f, 0.1f, 0.2f), vec3<float>(1.0f, 0.01f, 0.02f));
+    assert(same_hit(intersect(bvh8, mesh, mesh_ray), intersect(root, tris.data(), mesh_ray)), "BVH8 mesh traversal differs");
+    assert(Bvh8::collapse(nullptr).empty() && !intersect(Bvh8(), tris.data(), ray).hit(), "Empty BVH8 should give no hits");
+    std::cout << "Test Case 3 passed: leaf roots, meshes and empty trees" << std::endl;
+
+    // Test Case 4: a leaf too large for WideBvhNode::count, as a text .bvh file can hold, is split
+    int num_big = BVH_MAX_LEAF_SIZE + 1000;
+    std::vector<Triangle> many_tris = generateRandomTriangles(num_big, -10.0f, 10.0f, 6);
+    std::vector<int> all_indices(num_big);
+    BoundingBox big_box = BoundingBox::empty();
+    for (int i = 0; i < num_big; i++) {
+        all_indices[i] = i;
+        for (int k = 0; k < 3; k++) {
+            big_box.expand(many_tris[i].vertices[k]);
+        }
+    }
+    BvhNode* one_leaf = new BvhLeaf(big_box.min, big_box.max, num_big, all_indices.data());
+    Bvh4 big4 = Bvh4::collapse(one_leaf);
+    Bvh8 big8 = Bvh8::collapse(one_leaf);
+    check_structure(big4, many_tris, "Split BVH4");
+    check_structure(big8, many_tris, "Split BVH8");
+    for (int i = 0; i < 50; i++) {
+        vec3<float> origin(dis(gen), dis(gen), dis(gen));
+        Ray big_ray(origin, vec3<float>(dis(gen), dis(gen), dis(gen)) - origin);
+        Hit expected = intersect(one_leaf, many_tris.data(), big_ray);
+        assert(same_hit(intersect(big4, many_tris.data(), big_ray), expected), "Split leaf BVH4 traversal differs for ray " + std::to_string(i));
+        assert(same_hit(intersect(big8, many_tris.data(), big_ray), expected), "Split leaf BVH8 traversal differs for ray " + std::to_string(i));
+    }
+    delete one_leaf;
+    std::cout << "Test Case 4 passed: oversized leaves" << std::endl;
+
+    delete small_root;
+    delete root;
+}
+
+}